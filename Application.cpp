@@ -10,26 +10,47 @@
 #include "Materials/Emissive.h"
 
 #include "CollidableObjects/Sphere.h"
+#include "FrameBudgetController.h"
 #include "RayTracedImage.h"
+#include "RayTracing/EnvironmentMap.h"
 #include "RayTracing/RayEmitter.h"
 #include "RayTracing/RayTracer.h"
+#include "RayTracing/WavefrontIntegrator.h"
 #include "ScopedTimer.h"
 #include "TextureRenderer.h"
+#include "Utils/WorkerPool.h"
 #include "Window.h"
 #include "World.h"
 
 Application::Application() :
+	m_workerPool(std::make_unique<WorkerPool>()),
 	m_textureRenderer(std::make_unique<TextureRenderer>()),
 	m_rayEmitter(std::make_unique<RayEmitter>()),
 	m_rayTracer(std::make_unique<RayTracer>()),
 	m_rayTracedImage(std::make_unique<RayTracedImage>()),
 	m_window(std::make_unique<Window>()),
 	m_world(std::make_unique<World>()),
+	m_frameBudgetController(std::make_unique<FrameBudgetController>()),
 
 	m_lastMousePosition(-1),
 	m_mouseSensitivity(0.002f),
 
 	m_imageViewHovered(false),
+	m_dynamicResolution(true),
+	m_interactionResolutionScale(2),
+	m_framesSinceCameraMoved(std::numeric_limits<int>::max()),
+	m_workerNodes((int)WorkerPool::GetAvailableNodes()),
+	m_multiViewSequentialTime(0.0f),
+	m_multiViewBatchTime(0.0f),
+	m_multiViewPixels(0.0f),
+	m_integratorTimes{ 0.0f, 0.0f },
+	m_integratorMismatchedPixels(0),
+	m_shadingTimes{ 0.0f, 0.0f },
+	m_convergedFraction(0.0f),
+	m_pipelinedFrames(true),
+	m_presentLatency(0.0f),
+	m_environmentMapPath{},
+	m_environmentMapLoadTime(0.0f),
 	m_generationTime(0.0f),
 	m_lastFrameTime(0.0f),
 	m_needsResize(false),
@@ -39,6 +60,10 @@ Application::Application() :
 
 Application::~Application()
 {
+	// A pipelined frame still in flight reads the world, camera and ray tracer.
+	m_rayTracedImage->ResetFrameIndex();
+	m_rayTracedImage->EndFillPixels();
+
 	if (m_initialised)
 	{
 		ImGui_ImplDX11_Shutdown();
@@ -59,7 +84,10 @@ bool Application::Initialise()
 
 	m_rayTracer->Initialise();
 
-	if (!m_rayTracedImage->Initialise(m_window->m_renderWindowRect))
+	if (!m_workerPool->Initialise())
+		return false;
+
+	if (!m_rayTracedImage->Initialise(m_window->m_renderWindowRect, *m_workerPool))
 		return false;
 
 	IMGUI_CHECKVERSION();
@@ -179,9 +207,21 @@ bool Application::Run()
 
 	float deltaTime = glm::min<float>(m_lastFrameTime, 0.0333f);
 
-	if (!Update(deltaTime))
+	// Input is read before the frame being traced is collected, so a camera move cancels it at its next tile rather
+	// than waiting for the whole stale frame to finish.
+	if (!m_window->HandleEventLoop(deltaTime))
 		return false;
 
+	// Nothing below may change the camera, scene or image while a frame is being traced.
+	if (m_rayTracedImage->IsTraceInFlight())
+	{
+		if (IsCameraInputPending())
+			m_rayTracedImage->ResetFrameIndex(m_window->GetInputTime());
+		CompleteTrace();
+	}
+
+	Update(deltaTime);
+
 	ImGui_ImplDX11_NewFrame();
 	ImGui_ImplSDL2_NewFrame();
 	ImGui::NewFrame();
@@ -214,6 +254,142 @@ bool Application::Run()
 		ImGui::Begin("Settings", nullptr, settings_flags);
 
 			ImGui::Text("Last render: %.3fms", m_generationTime);
+			glm::vec2 renderDimensions = m_rayTracedImage->GetRenderDimensions();
+			ImGui::Text("Frame rate: %.1ffps at %dx%d (traced at %dx%d)", m_lastFrameTime > 0.0f ? 1000.0f / m_lastFrameTime : 0.0f,
+				(int)m_window->m_renderWindowRect.x, (int)m_window->m_renderWindowRect.y, (int)renderDimensions.x, (int)renderDimensions.y);
+			ImGui::Text("Restart latency: %.3fms (worst %.3fms)", m_rayTracedImage->GetLastRestartLatency(),
+				m_rayTracedImage->GetWorstRestartLatency());
+
+			// Pipelining overlaps the upload and present of one frame with tracing the next, at the cost of showing
+			// each frame one Run later.
+			ImGui::Checkbox("Pipelined frames", &m_pipelinedFrames);
+			ImGui::Text("Trace start to present: %.3fms", m_presentLatency);
+
+			RayTracer::PathSettings pathSettings = m_rayTracer->GetPathSettings();
+			bool pathSettingsChanged = false;
+			const char* shadingModels[] = { "Gathered", "Throughput" };
+			int shadingModel = (int)pathSettings.m_shadingModel;
+			if (ImGui::Combo("Shading model", &shadingModel, shadingModels, IM_ARRAYSIZE(shadingModels)))
+			{
+				pathSettings.m_shadingModel = (RayTracer::ShadingModel)shadingModel;
+				pathSettingsChanged = true;
+			}
+			pathSettingsChanged |= ImGui::SliderInt("Max bounces", &pathSettings.m_maxBounces, 1, 64);
+			pathSettingsChanged |= ImGui::Checkbox("Russian roulette", &pathSettings.m_russianRoulette);
+			if (pathSettings.m_russianRoulette)
+				pathSettingsChanged |= ImGui::SliderInt("Roulette min bounces", &pathSettings.m_rouletteMinBounces, 1, 16);
+			if (pathSettings.m_shadingModel == RayTracer::ShadingModel::Throughput)
+			{
+				pathSettingsChanged |= ImGui::Checkbox("Light sampling", &pathSettings.m_lightSampling);
+				const char* lightSelections[] = { "Uniform", "Light BVH" };
+				int lightSelection = (int)pathSettings.m_lightSelection;
+				if (pathSettings.m_lightSampling && ImGui::Combo("Light selection", &lightSelection, lightSelections, IM_ARRAYSIZE(lightSelections)))
+				{
+					pathSettings.m_lightSelection = (RayTracer::LightSelection)lightSelection;
+					pathSettingsChanged = true;
+				}
+				const char* environmentSamplings[] = { "Uniform", "Importance" };
+				int environmentSampling = (int)pathSettings.m_environmentSampling;
+				if (pathSettings.m_lightSampling && m_world->GetCurrentSnapshot().GetEnvironmentMap() &&
+					ImGui::Combo("Environment sampling", &environmentSampling, environmentSamplings, IM_ARRAYSIZE(environmentSamplings)))
+				{
+					pathSettings.m_environmentSampling = (RayTracer::EnvironmentSampling)environmentSampling;
+					pathSettingsChanged = true;
+				}
+
+				bool lightResampling = m_rayTracedImage->GetLightResampling();
+				if (pathSettings.m_lightSampling && ImGui::Checkbox("Light resampling", &lightResampling))
+				{
+					m_rayTracedImage->SetLightResampling(lightResampling);
+					m_rayTracedImage->ResetFrameIndex();
+				}
+
+				if (pathSettings.m_lightSampling && lightResampling)
+				{
+					LightResampler::Settings resamplerSettings = m_rayTracedImage->GetLightResamplerSettings();
+					int initialCandidates = (int)resamplerSettings.m_initialCandidates;
+					int spatialNeighbours = (int)resamplerSettings.m_spatialNeighbours;
+					bool resamplerChanged = ImGui::SliderInt("Candidates", &initialCandidates, 1, 32);
+					resamplerChanged |= ImGui::Checkbox("Temporal reuse", &resamplerSettings.m_temporalReuse);
+					resamplerChanged |= ImGui::SliderInt("Spatial neighbours", &spatialNeighbours, 0, 8);
+					if (resamplerChanged)
+					{
+						resamplerSettings.m_initialCandidates = (uint32_t)initialCandidates;
+						resamplerSettings.m_spatialNeighbours = (uint32_t)spatialNeighbours;
+						m_rayTracedImage->SetLightResamplerSettings(resamplerSettings);
+						m_rayTracedImage->ResetFrameIndex();
+					}
+				}
+
+				bool pathGuiding = m_rayTracedImage->GetPathGuiding();
+				if (ImGui::Checkbox("Path guiding", &pathGuiding))
+				{
+					m_rayTracedImage->SetPathGuiding(pathGuiding);
+					m_rayTracedImage->ResetFrameIndex();
+				}
+
+				if (pathGuiding)
+				{
+					PathGuide::Settings guideSettings = m_rayTracedImage->GetPathGuideSettings();
+					bool guideChanged = ImGui::Checkbox("Learn guide fraction", &guideSettings.m_learnGuideFraction);
+					guideChanged |= ImGui::SliderFloat("Guide fraction", &guideSettings.m_guideFraction, 0.0f, 1.0f);
+					if (guideChanged)
+					{
+						m_rayTracedImage->SetPathGuideSettings(guideSettings);
+						m_rayTracedImage->ResetFrameIndex();
+					}
+
+					const PathGuide& pathGuide = m_rayTracedImage->GetPathGuide();
+					ImGui::Text("Guide: %u cells, iteration %u", pathGuide.GetNumCells(), pathGuide.GetIteration());
+				}
+
+				bool radianceCaching = m_rayTracedImage->GetRadianceCaching();
+				if (ImGui::Checkbox("Radiance cache", &radianceCaching))
+				{
+					m_rayTracedImage->SetRadianceCaching(radianceCaching);
+					m_rayTracedImage->ResetFrameIndex();
+				}
+
+				if (radianceCaching)
+				{
+					RadianceCache::Settings cacheSettings = m_rayTracedImage->GetRadianceCacheSettings();
+					bool cacheChanged = ImGui::SliderFloat("Cache cell size", &cacheSettings.m_cellSize, 0.01f, 1.0f, "%.3f",
+						ImGuiSliderFlags_Logarithmic);
+					cacheChanged |= ImGui::SliderFloat("Cache update fraction", &cacheSettings.m_updateFraction, 0.01f, 1.0f);
+					if (cacheChanged)
+					{
+						m_rayTracedImage->SetRadianceCacheSettings(cacheSettings);
+						m_rayTracedImage->ResetFrameIndex();
+					}
+
+					ImGui::Text("Cache: %u cells", m_rayTracedImage->GetRadianceCache().GetNumCells());
+				}
+			}
+
+			if (pathSettingsChanged)
+			{
+				m_rayTracer->SetPathSettings(pathSettings);
+				m_rayTracedImage->ResetFrameIndex();
+			}
+
+			if (ImGui::Button("Roulette benchmark"))
+				RunRouletteBenchmark();
+
+			if (m_rouletteResults[0].m_samplesPerSecond > 0.0f)
+			{
+				ImGui::Text("10 bounces: %.0f samples/s, %.2f rays per path", m_rouletteResults[0].m_samplesPerSecond,
+					m_rouletteResults[0].m_averagePathLength);
+				ImGui::Text("Roulette: %.0f samples/s, %.2f rays per path", m_rouletteResults[1].m_samplesPerSecond,
+					m_rouletteResults[1].m_averagePathLength);
+			}
+
+			const char* samplers[] = { "Independent", "Stratified", "Sobol", "Blue noise" };
+			int sampler = (int)m_rayTracer->GetSamplerType();
+			if (ImGui::Combo("Sampler", &sampler, samplers, IM_ARRAYSIZE(samplers)))
+			{
+				m_rayTracer->SetSamplerType((SamplerType)sampler);
+				m_rayTracedImage->ResetFrameIndex();
+			}
 
 			bool accumulate = m_rayTracedImage->GetAccumulate();
 			if (ImGui::Checkbox("Accumulate", &accumulate))
@@ -225,6 +401,153 @@ bool Application::Run()
 			if (ImGui::Button("Restart Accumulation"))
 				m_rayTracedImage->ResetFrameIndex();
 
+			bool adaptiveSampling = m_rayTracedImage->GetAdaptiveSampling();
+			if (ImGui::Checkbox("Adaptive sampling", &adaptiveSampling))
+				m_rayTracedImage->SetAdaptiveSampling(adaptiveSampling);
+
+			if (adaptiveSampling)
+			{
+				float noiseThreshold = m_rayTracedImage->GetNoiseThreshold();
+				if (ImGui::SliderFloat("Noise threshold", &noiseThreshold, 0.002f, 0.2f, "%.3f", ImGuiSliderFlags_Logarithmic))
+					m_rayTracedImage->SetNoiseThreshold(noiseThreshold);
+
+				int minSamples = (int)m_rayTracedImage->GetAdaptiveMinSamples();
+				if (ImGui::SliderInt("Min samples", &minSamples, 2, 256))
+					m_rayTracedImage->SetAdaptiveMinSamples((uint32_t)minSamples);
+			}
+
+			bool showConvergence = m_rayTracedImage->GetShowConvergence();
+			if (ImGui::Checkbox("Show convergence", &showConvergence))
+				m_rayTracedImage->SetShowConvergence(showConvergence);
+
+			if (adaptiveSampling || showConvergence)
+				ImGui::Text("Converged: %.1f%% of pixels", m_convergedFraction * 100.0f);
+
+			if (ImGui::Button("Adaptive sampling benchmark"))
+				RunAdaptiveSamplingBenchmark();
+
+			for (int i = 0; i < 2 && m_adaptiveResults[0].m_passes > 0; i++)
+			{
+				const AdaptiveResult& result = m_adaptiveResults[i];
+				ImGui::Text("%s: %.1fms over %d passes%s", i == 0 ? "Uniform" : "Adaptive", result.m_traceTime, result.m_passes,
+					result.m_reachedTarget ? "" : " (target not reached)");
+			}
+
+			const char* tileOrders[] = { "Scanline", "Nearest cursor first", "Nearest centre first", "Most expensive first" };
+			int tileOrder = (int)m_rayTracedImage->GetTileOrder();
+			if (ImGui::Combo("Tile order", &tileOrder, tileOrders, IM_ARRAYSIZE(tileOrders)))
+				m_rayTracedImage->SetTileOrder((RayTracedImage::TileOrder)tileOrder);
+
+			const char* integrators[] = { "Megakernel", "Wavefront" };
+			int integrator = (int)m_rayTracedImage->GetIntegrator();
+			if (ImGui::Combo("Integrator", &integrator, integrators, IM_ARRAYSIZE(integrators)))
+				m_rayTracedImage->SetIntegrator((RayTracedImage::Integrator)integrator);
+
+			if (ImGui::Button("Integrator benchmark"))
+				RunIntegratorBenchmark();
+
+			if (m_integratorTimes[0] > 0.0f)
+			{
+				ImGui::Text("Megakernel: %.3fms, wavefront: %.3fms per pass, %.2fx", m_integratorTimes[0], m_integratorTimes[1],
+					m_integratorTimes[0] / m_integratorTimes[1]);
+				ImGui::Text("Pixels differing between integrators: %u", m_integratorMismatchedPixels);
+			}
+
+			if (m_rayTracedImage->GetIntegrator() == RayTracedImage::Integrator::Wavefront)
+			{
+				bool sortHits = m_rayTracedImage->GetSortHits();
+				if (ImGui::Checkbox("Sort hits by material", &sortHits))
+					m_rayTracedImage->SetSortHits(sortHits);
+			}
+
+			if (ImGui::Button("Shading benchmark"))
+				RunShadingBenchmark();
+
+			if (m_shadingTimes[0] > 0.0f)
+			{
+				ImGui::Text("Shading stage: %.3fms unsorted, %.3fms sorted per pass, %.2fx", m_shadingTimes[0], m_shadingTimes[1],
+					m_shadingTimes[0] / m_shadingTimes[1]);
+			}
+
+			ImGui::Text("Tail idle: %.3fms per worker (%.1f%% of trace), %u tiles split", m_rayTracedImage->GetTailIdleTime(),
+				m_rayTracedImage->GetTailIdleFraction() * 100.0f, m_rayTracedImage->GetNumSplitTiles());
+
+			ImGui::Checkbox("Dynamic resolution", &m_dynamicResolution);
+			if (m_dynamicResolution)
+				ImGui::SliderInt("Interaction scale", &m_interactionResolutionScale, 1, 8, "1/%d");
+
+			bool frameBudgetEnabled = m_frameBudgetController->IsEnabled();
+			if (ImGui::Checkbox("Frame time budget", &frameBudgetEnabled))
+				m_frameBudgetController->SetEnabled(frameBudgetEnabled);
+
+			if (frameBudgetEnabled)
+			{
+				float targetFrameTime = m_frameBudgetController->GetTargetFrameTime();
+				if (ImGui::Button("16ms"))
+					targetFrameTime = 16.0f;
+				ImGui::SameLine();
+				if (ImGui::Button("33ms"))
+					targetFrameTime = 33.0f;
+				ImGui::SameLine();
+				ImGui::DragFloat("Target", &targetFrameTime, 0.5f, 1.0f, 1000.0f, "%.1fms");
+				m_frameBudgetController->SetTargetFrameTime(targetFrameTime);
+
+				const std::vector<float>& frameTimes = m_frameBudgetController->GetFrameTimeHistory();
+				ImGui::PlotLines("Trace time", frameTimes.data(), (int)frameTimes.size(),
+					m_frameBudgetController->GetFrameTimeHistoryOffset(), nullptr, 0.0f, targetFrameTime * 2.0f);
+				ImGui::Text("Achieved: %.3fms (target %.1fms)", m_frameBudgetController->GetAchievedFrameTime(), targetFrameTime);
+			}
+
+			if (ImGui::SliderInt("Worker nodes", &m_workerNodes, 1, (int)WorkerPool::GetAvailableNodes()))
+				SetWorkerNodes(m_workerNodes);
+
+			bool replicateScene = m_rayTracedImage->GetReplicateScene();
+			if (ImGui::Checkbox("Replicate scene per node", &replicateScene))
+				m_rayTracedImage->SetReplicateScene(replicateScene);
+
+			for (uint32_t node = 0; node < m_nodeThroughput.size(); node++)
+			{
+				ImGui::Text("Node %u: %u workers, %.2f tiles/ms", m_workerPool->GetNode(node).m_numaNode,
+					m_workerPool->GetNode(node).m_numWorkers, m_nodeThroughput[node]);
+			}
+
+			if (ImGui::Button("Node scaling benchmark"))
+				RunNodeScalingBenchmark();
+
+			for (size_t i = 0; i < m_nodeScalingResults.size(); i++)
+			{
+				ImGui::Text("%zu node(s): %.3fms per pass, %.2fx", i + 1, m_nodeScalingResults[i],
+					m_nodeScalingResults[0] / m_nodeScalingResults[i]);
+			}
+
+			if (ImGui::Button("Multi-view benchmark"))
+				RunMultiViewBenchmark();
+
+			if (m_multiViewBatchTime > 0.0f)
+			{
+				ImGui::Text("Sequential views: %.3fms, %.0f pixels/ms", m_multiViewSequentialTime, m_multiViewPixels / m_multiViewSequentialTime);
+				ImGui::Text("Batched views: %.3fms, %.0f pixels/ms, %.2fx", m_multiViewBatchTime, m_multiViewPixels / m_multiViewBatchTime,
+					m_multiViewSequentialTime / m_multiViewBatchTime);
+			}
+
+			uint32_t tilesPerFrame = m_rayTracedImage->GetTilesPerFrame();
+			ImGui::Text("Samples per frame: %u, tiles per frame: %u/%u", m_rayTracedImage->GetSamplesPerFrame(),
+				tilesPerFrame == 0 ? m_rayTracedImage->GetNumTiles() : tilesPerFrame, m_rayTracedImage->GetNumTiles());
+
+#if RENDER_STATS
+			if (ImGui::TreeNode("Render stats"))
+			{
+				const RenderStats::Totals& renderStats = m_rayTracer->GetRenderStats().GetLastFrame();
+				for (int counter = 0; counter < RenderStats::NumCounters; counter++)
+				{
+					ImGui::Text("%s: %llu", RenderStats::GetCounterName((RenderStats::Counter)counter),
+						(unsigned long long)renderStats.Get((RenderStats::Counter)counter));
+				}
+				ImGui::Text("Bounces per path: %.2f", renderStats.GetBouncesPerPath());
+				ImGui::TreePop();
+			}
+#endif
+
 			glm::vec3 lightDirection = m_world->GetLightDirection();
 			if (ImGui::DragFloat3("Light direction", glm::value_ptr(lightDirection), 0.1f))
 			{
@@ -232,7 +555,25 @@ bool Application::Run()
 				m_rayTracedImage->ResetFrameIndex();
 			}
 
-			std::vector<CollidableObject*>& spheres = m_world->GetObjectsNonConst();
+			// A PFM or Radiance HDR latitude-longitude map lighting the scene in place of the sky gradient.
+			ImGui::InputText("Environment map", m_environmentMapPath, sizeof(m_environmentMapPath));
+			if (ImGui::Button("Load environment map"))
+				LoadEnvironmentMap();
+			ImGui::SameLine();
+			if (ImGui::Button("Sky gradient"))
+			{
+				m_world->SetEnvironmentMap(nullptr);
+				m_rayTracedImage->ResetFrameIndex();
+			}
+			if (const EnvironmentMap* environmentMap = m_world->GetCurrentSnapshot().GetEnvironmentMap())
+			{
+				ImGui::Text("Environment map: %ux%u, loaded in %.1fms", environmentMap->GetWidth(), environmentMap->GetHeight(),
+					m_environmentMapLoadTime);
+			}
+
+			// Edits publish a new version of the world. The renderer keeps reading the version it pinned for the current frame.
+			const WorldSnapshot& snapshot = m_world->GetCurrentSnapshot();
+			const WorldSnapshot::ObjectList& spheres = snapshot.GetCollidableObjects();
 			bool updated = false;
 			for (int i = 0; i < spheres.size(); i++)
 			{
@@ -240,56 +581,61 @@ bool Application::Run()
 
 				glm::vec3 spherePosition = spheres[i]->GetPosition();
 				if(ImGui::DragFloat3("Position", glm::value_ptr(spherePosition), 0.1f)) {
-					spheres[i]->SetPosition(spherePosition);
+					m_world->EditObject(i, [&spherePosition](CollidableObject& object) { object.SetPosition(spherePosition); });
 					updated = true;
 				}
 				float radius = spheres[i]->GetRadius();
 				if (ImGui::DragFloat("Radius", &radius, 0.1f))
 				{
-					spheres[i]->SetRadius(radius);
+					m_world->EditObject(i, [radius](CollidableObject& object) { object.SetRadius(radius); });
 					updated = true;
 				}
 
 				int materialIndex = spheres[i]->GetMaterialIndex();
 				if (ImGui::DragInt("Material", &materialIndex, 1.0f, 0, m_world->GetNumMaterials() - 1))
 				{
-					spheres[i]->SetMaterialIndex(materialIndex);
+					m_world->EditObject(i, [materialIndex](CollidableObject& object) { object.SetMaterialIndex(materialIndex); });
 					updated = true;
 				}
 
-				IMaterial* material = m_world->GetMaterialPtr(spheres[i]->GetMaterialIndex());
+				int sphereMaterialIndex = spheres[i]->GetMaterialIndex();
+				const IMaterial* material = snapshot.GetMaterialPtr(sphereMaterialIndex);
 				glm::vec3 albedo = material->GetAlbedo();
 				// Temporarily disabled tooltip and drag drop due to a bug in ImGui.
 				if (ImGui::ColorEdit3("Albedo", glm::value_ptr(albedo), ImGuiColorEditFlags_NoDragDrop | ImGuiColorEditFlags_NoTooltip | ImGuiColorEditFlags_NoPicker))
 				{
-					material->SetAlbedo(albedo);
-					m_world->UpdateMaterial(material, i);
+					m_world->EditMaterial(sphereMaterialIndex, [&albedo](IMaterial& editedMaterial) { editedMaterial.SetAlbedo(albedo); });
 					updated = true;
 				}
 
 				if (material->GetType() == MaterialType::Emissive)
 				{
-					Emissive* emissiveMaterial = dynamic_cast<Emissive*>(material);
+					const Emissive* emissiveMaterial = dynamic_cast<const Emissive*>(material);
 					assert(emissiveMaterial);
 
 					float emissionPower = emissiveMaterial->GetEmissionPower();
 					if (ImGui::DragFloat("Emission Power", &emissionPower, 0.05f, 0.0f, FLT_MAX))
 					{
-						emissiveMaterial->SetEmissionPower(emissionPower);
-						m_world->UpdateMaterial(emissiveMaterial, i);
+						m_world->EditMaterial(sphereMaterialIndex, [emissionPower](IMaterial& editedMaterial)
+							{
+								static_cast<Emissive&>(editedMaterial).SetEmissionPower(emissionPower);
+							});
 						updated = true;
 					}
 				}
 
 				if (m_rayTracer && material->GetType() == MaterialType::Diffuse)
 				{
-					Diffuse* diffuseMaterial = dynamic_cast<Diffuse*>(material);
+					const Diffuse* diffuseMaterial = dynamic_cast<const Diffuse*>(material);
 					assert(diffuseMaterial);
 
 					float roughness = diffuseMaterial->GetRoughness();
 					if (ImGui::DragFloat("Roughness", &roughness, 0.05f, 0.0f, 1.0f))
 					{
-						m_world->UpdateMaterial(material, i);
+						m_world->EditMaterial(sphereMaterialIndex, [roughness](IMaterial& editedMaterial)
+							{
+								static_cast<Diffuse&>(editedMaterial).SetRoughness(roughness);
+							});
 						updated = true;
 					}
 				}
@@ -322,6 +668,12 @@ bool Application::Run()
 				ImGui::Image((void*)m_textureRenderer->GetTextureView(),
 					ImVec2(m_textureRenderer->GetTextureDimensions().x,
 						m_textureRenderer->GetTextureDimensions().y));
+
+				// The mouse position is relative to the main window, ImGui positions are in desktop coordinates.
+				glm::vec2 imagePosition(ImGui::GetItemRectMin().x - viewport->Pos.x, ImGui::GetItemRectMin().y - viewport->Pos.y);
+				glm::vec2 cursorInImage = m_window->GetMousePosition() - imagePosition;
+				if (m_imageViewHovered)
+					m_rayTracedImage->SetFocusPoint(cursorInImage);
 			}
 
 		ImGui::End();
@@ -334,6 +686,9 @@ bool Application::Run()
 	if (!Render())
 		return false;
 
+	// The renderer has finished with any versions of the world replaced during this frame.
+	m_world->ReclaimSnapshots();
+
 	m_lastFrameTime = (float)timer.ElapsedTimeInMilliseconds();
 
 	return true;
@@ -357,21 +712,292 @@ bool Application::Resize()
 	return true;
 }
 
-bool Application::Update(float deltaTime)
+void Application::Update(float deltaTime)
 {
-	if (!m_window->HandleEventLoop(deltaTime))
-		return false;
-
+	bool cameraMoved = false;
 	if (m_imageViewHovered)
 	{
 		if(UpdateFromMouse())
-			m_rayTracedImage->ResetFrameIndex();
+			cameraMoved = true;
 
 		if(UpdateFromKeyPress(deltaTime))
-			m_rayTracedImage->ResetFrameIndex();
+			cameraMoved = true;
 	}
 
-	return true;
+	if (cameraMoved)
+		m_rayTracedImage->ResetFrameIndex(m_window->GetInputTime());
+
+	UpdateResolutionScale(cameraMoved);
+}
+
+// Accumulation restarts every frame while the camera moves, so trace fewer pixels to keep the view responsive and go
+// back to full resolution as soon as it stops.
+void Application::UpdateResolutionScale(bool cameraMoved)
+{
+	constexpr int stillFramesBeforeFullResolution = 2;
+
+	if (cameraMoved)
+		m_framesSinceCameraMoved = 0;
+	else if (m_framesSinceCameraMoved < stillFramesBeforeFullResolution)
+		m_framesSinceCameraMoved++;
+
+	uint32_t resolutionScale = 1;
+	if (m_dynamicResolution && m_framesSinceCameraMoved < stillFramesBeforeFullResolution)
+		resolutionScale = (uint32_t)m_interactionResolutionScale;
+
+	m_rayTracedImage->SetResolutionScale(resolutionScale);
+}
+
+void Application::SetWorkerNodes(int numNodes)
+{
+	// The image buffers are re-allocated so their pages are first touched by the new set of nodes.
+	m_workerPool->Initialise((uint32_t)numNodes);
+	m_rayTracedImage->Resize(m_window->m_renderWindowRect);
+	m_nodeThroughput.clear();
+	m_nodeItemsCompleted.clear();
+}
+
+// Times full passes over the image with the workers of 1 to N nodes, to show how tracing scales across sockets.
+// Blocks the UI until it finishes.
+void Application::RunNodeScalingBenchmark()
+{
+	constexpr int passesPerNodeCount = 8;
+
+	uint32_t samplesPerFrame = m_rayTracedImage->GetSamplesPerFrame();
+	uint32_t tilesPerFrame = m_rayTracedImage->GetTilesPerFrame();
+	m_rayTracedImage->SetSamplesPerFrame(1);
+	m_rayTracedImage->SetTilesPerFrame(0);
+
+	m_nodeScalingResults.clear();
+	uint32_t availableNodes = WorkerPool::GetAvailableNodes();
+	for (uint32_t numNodes = 1; numNodes <= availableNodes; numNodes++)
+	{
+		SetWorkerNodes((int)numNodes);
+
+		// Untimed pass to build any scene replicas and warm the caches.
+		m_rayTracedImage->FillPixels(*m_rayTracer.get(), *m_rayEmitter.get(), *m_world.get());
+
+		ScopedTimer timer;
+		for (int pass = 0; pass < passesPerNodeCount; pass++)
+			m_rayTracedImage->FillPixels(*m_rayTracer.get(), *m_rayEmitter.get(), *m_world.get());
+
+		m_nodeScalingResults.push_back((float)timer.ElapsedTimeInMilliseconds() / passesPerNodeCount);
+	}
+
+	SetWorkerNodes(m_workerNodes);
+	m_rayTracedImage->SetSamplesPerFrame(samplesPerFrame);
+	m_rayTracedImage->SetTilesPerFrame(tilesPerFrame);
+}
+
+void Application::RunMultiViewBenchmark()
+{
+	constexpr int passesPerMode = 8;
+	constexpr float eyeSeparation = 0.064f;
+
+	// The viewport, a quarter size thumbnail of it and a stereo pair of half width eyes either side of the camera.
+	glm::vec2 viewportSize = m_window->m_renderWindowRect;
+	glm::vec2 viewSizes[] = {
+		viewportSize,
+		glm::max(glm::floor(viewportSize * 0.25f), glm::vec2(1.0f)),
+		glm::max(glm::floor(viewportSize * glm::vec2(0.5f, 1.0f)), glm::vec2(1.0f)),
+		glm::max(glm::floor(viewportSize * glm::vec2(0.5f, 1.0f)), glm::vec2(1.0f)),
+	};
+
+	std::vector<std::unique_ptr<RayEmitter>> rayEmitters;
+	std::vector<std::unique_ptr<RayTracedImage>> images;
+	std::vector<RayTracedImage::View> views;
+	m_multiViewPixels = 0.0f;
+	for (glm::vec2 viewSize : viewSizes)
+	{
+		rayEmitters.push_back(std::make_unique<RayEmitter>(*m_rayEmitter));
+		rayEmitters.back()->Resize(viewSize);
+
+		images.push_back(std::make_unique<RayTracedImage>());
+		if (!images.back()->Initialise(viewSize, *m_workerPool))
+			return;
+
+		images.back()->SetSamplesPerFrame(1);
+		images.back()->SetReplicateScene(m_rayTracedImage->GetReplicateScene());
+		views.push_back({ images.back().get(), rayEmitters.back().get() });
+		m_multiViewPixels += viewSize.x * viewSize.y;
+	}
+	rayEmitters[2]->MoveLeft(eyeSeparation * 0.5f);
+	rayEmitters[3]->MoveRight(eyeSeparation * 0.5f);
+
+	// Untimed pass to build any scene replicas and warm the caches.
+	RayTracedImage::FillPixelsMultiView(views, *m_rayTracer.get(), *m_world.get());
+
+	ScopedTimer sequentialTimer;
+	for (int pass = 0; pass < passesPerMode; pass++)
+	{
+		for (const RayTracedImage::View& view : views)
+			view.m_image->FillPixels(*m_rayTracer.get(), *view.m_rayEmitter, *m_world.get());
+	}
+	m_multiViewSequentialTime = (float)sequentialTimer.ElapsedTimeInMilliseconds() / passesPerMode;
+
+	ScopedTimer batchTimer;
+	for (int pass = 0; pass < passesPerMode; pass++)
+		RayTracedImage::FillPixelsMultiView(views, *m_rayTracer.get(), *m_world.get());
+
+	m_multiViewBatchTime = (float)batchTimer.ElapsedTimeInMilliseconds() / passesPerMode;
+}
+
+void Application::RunIntegratorBenchmark()
+{
+	constexpr int passesPerIntegrator = 8;
+
+	RayTracedImage::Integrator integrator = m_rayTracedImage->GetIntegrator();
+	uint32_t samplesPerFrame = m_rayTracedImage->GetSamplesPerFrame();
+	uint32_t tilesPerFrame = m_rayTracedImage->GetTilesPerFrame();
+	m_rayTracedImage->SetSamplesPerFrame(1);
+	m_rayTracedImage->SetTilesPerFrame(0);
+
+	size_t numPixels = (size_t)m_window->m_renderWindowRect.x * (size_t)m_window->m_renderWindowRect.y;
+	std::vector<uint32_t> images[2];
+	for (int i = 0; i < 2; i++)
+	{
+		// Both start from a restart, so they trace the same samples and should give the same image.
+		m_rayTracedImage->SetIntegrator((RayTracedImage::Integrator)i);
+		m_rayTracedImage->ResetFrameIndex();
+
+		uint32_t* pixels = nullptr;
+		ScopedTimer timer;
+		for (int pass = 0; pass < passesPerIntegrator; pass++)
+			pixels = m_rayTracedImage->FillPixels(*m_rayTracer.get(), *m_rayEmitter.get(), *m_world.get());
+
+		m_integratorTimes[i] = (float)timer.ElapsedTimeInMilliseconds() / passesPerIntegrator;
+		if (pixels != nullptr)
+			images[i].assign(pixels, pixels + numPixels);
+	}
+
+	m_integratorMismatchedPixels = 0;
+	for (size_t i = 0; i < images[0].size() && i < images[1].size(); i++)
+		m_integratorMismatchedPixels += images[0][i] != images[1][i] ? 1 : 0;
+
+	m_rayTracedImage->SetIntegrator(integrator);
+	m_rayTracedImage->SetSamplesPerFrame(samplesPerFrame);
+	m_rayTracedImage->SetTilesPerFrame(tilesPerFrame);
+	m_rayTracedImage->ResetFrameIndex();
+}
+
+void Application::TraceWholeImage(WavefrontIntegrator& integrator, const WorldSnapshot& world, uint32_t sampleIndex)
+{
+	integrator.Clear();
+
+	uint32_t width = (uint32_t)m_window->m_renderWindowRect.x;
+	uint32_t height = (uint32_t)m_window->m_renderWindowRect.y;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+			integrator.AddPath(x, y, sampleIndex, Ray(m_rayEmitter->GetPosition(), m_rayEmitter->GetRayDirection(x, y)));
+	}
+
+	integrator.Trace(*m_rayTracer.get(), world);
+}
+
+void Application::RunShadingBenchmark()
+{
+	constexpr int passesPerMode = 2;
+
+	// Single threaded over the whole image, so the shading stage sees full size batches and the timing is not
+	// affected by how tiles are shared out. The default scene uses all five material types.
+	WavefrontIntegrator integrator;
+	World::SnapshotHandle snapshot = m_world->AcquireSnapshot();
+	for (int sorted = 0; sorted < 2; sorted++)
+	{
+		integrator.SetSortHits(sorted != 0);
+		integrator.ResetCounters();
+		for (int pass = 0; pass < passesPerMode; pass++)
+			TraceWholeImage(integrator, *snapshot, (uint32_t)pass);
+
+		m_shadingTimes[sorted] = (float)integrator.GetShadeTime() / passesPerMode;
+	}
+}
+
+void Application::LoadEnvironmentMap()
+{
+	// The workers are needed for loading, so the frame in flight is finished first.
+	m_rayTracedImage->ResetFrameIndex();
+	m_rayTracedImage->EndFillPixels();
+
+	ScopedTimer timer;
+	std::shared_ptr<EnvironmentMap> environmentMap = std::make_shared<EnvironmentMap>();
+	if (!environmentMap->Load(m_environmentMapPath, *m_workerPool))
+		return;
+	m_environmentMapLoadTime = (float)timer.ElapsedTimeInMilliseconds();
+
+	m_world->SetEnvironmentMap(environmentMap);
+}
+
+void Application::RunRouletteBenchmark()
+{
+	constexpr int passesPerMode = 2;
+
+	// The fixed ten bounces the renderer used to trace, against the current settings with roulette turned on.
+	RayTracer::PathSettings pathSettings = m_rayTracer->GetPathSettings();
+	RayTracer::PathSettings modes[2] = { pathSettings, pathSettings };
+	modes[0].m_maxBounces = 10;
+	modes[0].m_russianRoulette = false;
+	modes[1].m_russianRoulette = true;
+
+	// Single threaded, where every ray traced is counted.
+	WavefrontIntegrator integrator;
+	World::SnapshotHandle snapshot = m_world->AcquireSnapshot();
+	for (int mode = 0; mode < 2; mode++)
+	{
+		m_rayTracer->SetPathSettings(modes[mode]);
+		integrator.ResetCounters();
+
+		ScopedTimer timer;
+		for (int pass = 0; pass < passesPerMode; pass++)
+			TraceWholeImage(integrator, *snapshot, (uint32_t)pass);
+
+		float numPaths = (float)integrator.GetNumPaths() * passesPerMode;
+		m_rouletteResults[mode].m_samplesPerSecond = numPaths / (float)(timer.ElapsedTimeInMilliseconds() / 1000.0);
+		m_rouletteResults[mode].m_averagePathLength = (float)integrator.GetRaysTraced() / numPaths;
+	}
+
+	m_rayTracer->SetPathSettings(pathSettings);
+}
+
+void Application::RunAdaptiveSamplingBenchmark()
+{
+	// Time for 95% of the pixels to reach the noise threshold, which is measured the same way in both modes.
+	constexpr float targetConvergedFraction = 0.95f;
+	constexpr float maxTraceTime = 30000.0f;
+
+	bool accumulate = m_rayTracedImage->GetAccumulate();
+	bool adaptiveSampling = m_rayTracedImage->GetAdaptiveSampling();
+	uint32_t tilesPerFrame = m_rayTracedImage->GetTilesPerFrame();
+	m_rayTracedImage->SetAccumulate(true);
+	m_rayTracedImage->SetTilesPerFrame(0);
+
+	for (int i = 0; i < 2; i++)
+	{
+		AdaptiveResult& result = m_adaptiveResults[i];
+		result = AdaptiveResult();
+
+		m_rayTracedImage->SetAdaptiveSampling(i == 1);
+		m_rayTracedImage->ResetFrameIndex();
+		while (result.m_traceTime < maxTraceTime)
+		{
+			ScopedTimer timer;
+			m_rayTracedImage->FillPixels(*m_rayTracer.get(), *m_rayEmitter.get(), *m_world.get());
+			result.m_traceTime += (float)timer.ElapsedTimeInMilliseconds();
+			result.m_passes++;
+
+			if (m_rayTracedImage->ComputeConvergedFraction() >= targetConvergedFraction)
+			{
+				result.m_reachedTarget = true;
+				break;
+			}
+		}
+	}
+
+	m_rayTracedImage->SetAccumulate(accumulate);
+	m_rayTracedImage->SetAdaptiveSampling(adaptiveSampling);
+	m_rayTracedImage->SetTilesPerFrame(tilesPerFrame);
+	m_rayTracedImage->ResetFrameIndex();
 }
 
 // Returns true if an update occured
@@ -405,6 +1031,31 @@ bool Application::UpdateFromMouse()
 	return updated;
 }
 
+// Whether UpdateFromMouse or UpdateFromKeyPress will move the camera, without moving it.
+bool Application::IsCameraInputPending() const
+{
+	if (!m_imageViewHovered)
+		return false;
+
+	glm::vec2 currentMousePosition = m_window->GetMousePosition();
+	bool mouseTracked = m_lastMousePosition.x != -1 || m_lastMousePosition.y != -1;
+	if (mouseTracked && m_window->IsLeftMouseButtonDown() && currentMousePosition.x != m_lastMousePosition.x &&
+		currentMousePosition.y != m_lastMousePosition.y)
+	{
+		return true;
+	}
+
+	const SDL_Keycode movementKeys[] = { SDLK_DOWN, SDLK_s, SDLK_UP, SDLK_w, SDLK_LEFT, SDLK_a, SDLK_RIGHT, SDLK_d, SDLK_q,
+		SDLK_e };
+	for (SDL_Keycode key : movementKeys)
+	{
+		if (m_window->IsKeyDown(key))
+			return true;
+	}
+
+	return false;
+}
+
 // Returns true if an update occured
 bool Application::UpdateFromKeyPress(float deltaTime)
 {
@@ -451,18 +1102,62 @@ bool Application::Render()
 
 	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
 
-	ScopedTimer timer;
-	uint32_t* pixels = m_rayTracedImage->FillPixels(*m_rayTracer.get(), *m_rayEmitter.get(), *m_world.get());
-	if (!pixels)
+	// Pipelined, the frame traced during the previous Run is uploaded and presented while the workers trace the next
+	// one. Otherwise this frame is traced and waited for first.
+	Clock::time_point presentedTraceStart = m_traceStartTime;
+	m_traceStartTime = Clock::now();
+	if (!m_rayTracedImage->BeginFillPixels(*m_rayTracer.get(), *m_rayEmitter.get(), *m_world.get()))
 	{
 		std::cout << "failed to create pixel buffer";
 		return false;
 	}
 
-	m_generationTime = (float)timer.ElapsedTimeInMilliseconds();
+	if (!m_pipelinedFrames)
+	{
+		presentedTraceStart = m_traceStartTime;
+		CompleteTrace();
+	}
 
-	m_textureRenderer->Render(pixels);
+	m_textureRenderer->Render(m_rayTracedImage->GetPresentPixels());
 	m_textureRenderer->EndRender();
 
+	m_presentLatency = (float)std::chrono::duration<double, std::milli>(Clock::now() - presentedTraceStart).count();
+
 	return true;
 }
+
+// Collects the frame started by the last Render and sizes the next frame's work from how long it took.
+void Application::CompleteTrace()
+{
+	m_rayTracedImage->EndFillPixels();
+	m_generationTime = m_rayTracedImage->GetLastTraceTime();
+
+#if RENDER_STATS
+	m_rayTracer->GetRenderStats().EndFrame();
+#endif
+
+	// Per node throughput from the difference in items each worker has completed since the last render.
+	uint32_t numNodes = m_workerPool->GetNumNodes();
+	m_nodeThroughput.assign(numNodes, 0.0f);
+	m_nodeItemsCompleted.resize(numNodes, 0);
+	for (uint32_t node = 0; node < numNodes; node++)
+	{
+		const WorkerPool::NodeInfo& nodeInfo = m_workerPool->GetNode(node);
+		uint64_t itemsCompleted = 0;
+		for (uint32_t worker = nodeInfo.m_firstWorker; worker < nodeInfo.m_firstWorker + nodeInfo.m_numWorkers; worker++)
+			itemsCompleted += m_workerPool->GetItemsCompleted(worker);
+
+		if (m_generationTime > 0.0f)
+			m_nodeThroughput[node] = (float)(itemsCompleted - m_nodeItemsCompleted[node]) / m_generationTime;
+		m_nodeItemsCompleted[node] = itemsCompleted;
+	}
+
+	// Size the next frame's work from how long this one took.
+	m_frameBudgetController->AddFrameTiming(m_generationTime, m_rayTracedImage->GetTilesTraced(), m_rayTracedImage->GetSamplesPerFrame());
+	m_frameBudgetController->Update(m_rayTracedImage->GetNumTiles());
+	m_rayTracedImage->SetSamplesPerFrame(m_frameBudgetController->GetSamplesPerFrame());
+	m_rayTracedImage->SetTilesPerFrame(m_frameBudgetController->GetTilesPerFrame());
+
+	if (m_rayTracedImage->GetAdaptiveSampling() || m_rayTracedImage->GetShowConvergence())
+		m_convergedFraction = m_rayTracedImage->ComputeConvergedFraction();
+}
@@ -3,16 +3,23 @@
 #include <glm/glm.hpp>
 #include <memory>
 #include <functional>
+#include <vector>
+
+#include "ScopedTimer.h"
 
 class Renderer;
 class TextureRenderer;
 class ShaderManager;
 class Camera;
+class FrameBudgetController;
 class RayEmitter;
 class RayTracer;
 class RayTracedImage;
+class WavefrontIntegrator;
 class Window;
+class WorkerPool;
 class World;
+class WorldSnapshot;
 struct ID3D11DeviceContext;
 
 class Application
@@ -28,22 +35,40 @@ public:
 private:
 	void InitImGuiStyle();
 
-	bool Update(float deltaTime);
+	void Update(float deltaTime);
 	bool Render();
 	bool Resize();
 
+	bool IsCameraInputPending() const;
 	bool UpdateFromMouse();
 	bool UpdateFromKeyPress(float deltaTime);
+	void UpdateResolutionScale(bool cameraMoved);
+
+	void CompleteTrace();
+
+	void SetWorkerNodes(int numNodes);
+	void RunNodeScalingBenchmark();
+	void RunMultiViewBenchmark();
+	void RunIntegratorBenchmark();
+	void TraceWholeImage(WavefrontIntegrator& integrator, const WorldSnapshot& world, uint32_t sampleIndex);
+	void RunShadingBenchmark();
+	void RunRouletteBenchmark();
+	void RunAdaptiveSamplingBenchmark();
+	// Loads the environment map named in m_environmentMapPath into the world, keeping the current one if it fails.
+	void LoadEnvironmentMap();
 
 	bool m_initialised;
 	bool m_needsResize;
 
+	// Declared before the image so it outlives it.
+	std::unique_ptr<WorkerPool> m_workerPool;
 	std::unique_ptr<TextureRenderer> m_textureRenderer;
 	std::unique_ptr<RayTracedImage> m_rayTracedImage;
 	std::unique_ptr<RayEmitter> m_rayEmitter;
 	std::unique_ptr<RayTracer> m_rayTracer;
 	std::unique_ptr<Window> m_window;
 	std::unique_ptr<World> m_world;
+	std::unique_ptr<FrameBudgetController> m_frameBudgetController;
 
 	glm::vec2 m_lastMousePosition;
 	float m_mouseSensitivity;
@@ -52,5 +77,54 @@ private:
 	float m_generationTime;
 
 	bool m_imageViewHovered;
+
+	// Render at a lower resolution while the camera is moving.
+	bool m_dynamicResolution;
+	int m_interactionResolutionScale;
+	int m_framesSinceCameraMoved;
+
+	int m_workerNodes;
+	// Tiles per millisecond traced by each node's workers during the last render.
+	std::vector<float> m_nodeThroughput;
+	std::vector<uint64_t> m_nodeItemsCompleted;
+	// Milliseconds per full pass, index 0 for one node.
+	std::vector<float> m_nodeScalingResults;
+	// Milliseconds to trace one frame of every benchmark view, one after another and as a single batch.
+	float m_multiViewSequentialTime;
+	float m_multiViewBatchTime;
+	// Pixels in one frame of all the benchmark views together.
+	float m_multiViewPixels;
+	// Milliseconds per full pass with each RayTracedImage::Integrator, and the pixels that differed between them.
+	float m_integratorTimes[2];
+	uint32_t m_integratorMismatchedPixels;
+	// Milliseconds per pass spent in the wavefront shading stage with hits shaded in arrival order and sorted.
+	float m_shadingTimes[2];
+
+	struct RouletteResult
+	{
+		float m_samplesPerSecond = 0.0f;
+		float m_averagePathLength = 0.0f;
+	};
+	// Fixed ten bounces, then Russian roulette.
+	RouletteResult m_rouletteResults[2];
+
+	float m_convergedFraction;
+	struct AdaptiveResult
+	{
+		// Milliseconds spent tracing until the target was reached, or the time limit.
+		float m_traceTime = 0.0f;
+		int m_passes = 0;
+		bool m_reachedTarget = false;
+	};
+	// Uniform, then adaptive sampling.
+	AdaptiveResult m_adaptiveResults[2];
+
+	bool m_pipelinedFrames;
+	Clock::time_point m_traceStartTime;
+	// Time from starting a frame's trace to presenting it.
+	float m_presentLatency;
+
+	char m_environmentMapPath[260];
+	float m_environmentMapLoadTime;
 };
 
@@ -0,0 +1,267 @@
+#include "AsyncRenderer.h"
+
+#include <utility>
+
+#include "Utils/WorkerPool.h"
+#include "World.h"
+
+// Starts tracing the stream's next frame and suspends the producer until the trace job completes. The producer is
+// resumed on the worker that finished the job.
+class AsyncRenderer::FrameStream::TraceAwaiter
+{
+public:
+	TraceAwaiter(FrameStream& stream, const RayTracer& rayTracer, const World& world) :
+		m_stream(stream), m_rayTracer(rayTracer), m_world(world), m_failed(false) {}
+
+	bool await_ready() const { return false; }
+
+	bool await_suspend(std::coroutine_handle<> producer)
+	{
+		if (!m_stream.m_image.BeginFillPixels(m_rayTracer, m_stream.m_rayEmitter, m_world))
+		{
+			m_failed = true;
+			return false;
+		}
+
+		// Without a job the frame was traced on this thread and is already finished.
+		WorkerPool::JobHandle job = m_stream.m_image.GetTraceJob();
+		if (!job)
+			return false;
+
+		return m_stream.m_workerPool.AddContinuation(job, [producer]() { producer.resume(); });
+	}
+
+	// False when the frame could not be traced or the request was cancelled while tracing.
+	bool await_resume()
+	{
+		if (m_failed)
+			return false;
+
+		m_stream.m_image.EndFillPixels();
+		return !m_stream.IsCancelled();
+	}
+
+private:
+	FrameStream& m_stream;
+	const RayTracer& m_rayTracer;
+	const World& m_world;
+	bool m_failed;
+};
+
+// Queues a finished frame for the consumer, suspending the producer while the queue is full.
+class AsyncRenderer::FrameStream::PushAwaiter
+{
+public:
+	PushAwaiter(FrameStream& stream, ProgressiveFrame&& frame) :
+		m_stream(stream), m_frame(std::move(frame)) {}
+
+	bool await_ready() const { return false; }
+
+	bool await_suspend(std::coroutine_handle<> producer)
+	{
+		std::unique_lock<std::mutex> lock(m_stream.m_mutex);
+		if (m_stream.IsCancelled())
+		{
+			m_accepted = false;
+			return false;
+		}
+
+		if (m_stream.m_frames.size() < m_stream.m_request.m_maxQueuedFrames)
+		{
+			lock.unlock();
+			m_accepted = Push();
+			return false;
+		}
+
+		// Back-pressure: nothing more is traced until the consumer takes a frame or the request is cancelled.
+		m_stream.m_waitingProducer = producer;
+		return true;
+	}
+
+	// False when the request was cancelled and the frame dropped.
+	bool await_resume()
+	{
+		if (m_accepted.has_value())
+			return *m_accepted;
+
+		return Push();
+	}
+
+private:
+	bool Push()
+	{
+		std::coroutine_handle<> consumer;
+		{
+			std::lock_guard<std::mutex> lock(m_stream.m_mutex);
+			if (m_stream.IsCancelled())
+				return false;
+
+			m_stream.m_frames.push_back(std::move(m_frame));
+			m_stream.m_peakQueuedFrames = glm::max(m_stream.m_peakQueuedFrames, (uint32_t)m_stream.m_frames.size());
+			consumer = std::exchange(m_stream.m_waitingConsumer, nullptr);
+		}
+
+		if (consumer)
+			m_stream.ResumeOnPool(consumer);
+
+		return true;
+	}
+
+	FrameStream& m_stream;
+	ProgressiveFrame m_frame;
+	std::optional<bool> m_accepted;
+};
+
+AsyncRenderer::FrameStream::FrameStream(WorkerPool& workerPool, const RenderRequest& request) :
+	m_workerPool(workerPool),
+	m_request(request),
+	m_finished(false),
+	m_peakQueuedFrames(0)
+{
+	m_request.m_maxQueuedFrames = glm::max(m_request.m_maxQueuedFrames, 1u);
+}
+
+bool AsyncRenderer::FrameStream::NextAwaiter::await_suspend(std::coroutine_handle<> consumer)
+{
+	if (m_stream.TakeFrame(m_frame))
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_stream.m_mutex);
+
+	// A frame pushed since TakeFrame is picked up by await_resume.
+	if (m_stream.m_finished || m_stream.IsCancelled() || !m_stream.m_frames.empty())
+		return false;
+
+	m_stream.m_waitingConsumer = consumer;
+	return true;
+}
+
+std::optional<AsyncRenderer::ProgressiveFrame> AsyncRenderer::FrameStream::NextAwaiter::await_resume()
+{
+	if (!m_frame)
+		m_stream.TakeFrame(m_frame);
+
+	return std::move(m_frame);
+}
+
+bool AsyncRenderer::FrameStream::TakeFrame(std::optional<ProgressiveFrame>& frame)
+{
+	std::coroutine_handle<> producer;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (IsCancelled() || m_frames.empty())
+			return false;
+
+		frame = std::move(m_frames.front());
+		m_frames.pop_front();
+		producer = std::exchange(m_waitingProducer, nullptr);
+	}
+
+	// Taking a frame makes room in the queue, so a producer held back by it can carry on.
+	if (producer)
+		ResumeOnPool(producer);
+
+	return true;
+}
+
+void AsyncRenderer::FrameStream::Cancel()
+{
+	m_cancellationToken.Cancel();
+	m_image.ResetFrameIndex();
+
+	std::coroutine_handle<> producer;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_frames.clear();
+		producer = std::exchange(m_waitingProducer, nullptr);
+	}
+
+	// The producer sees the cancel when it resumes and finishes the stream, which wakes any waiting consumer.
+	if (producer)
+		ResumeOnPool(producer);
+}
+
+void AsyncRenderer::FrameStream::Finish()
+{
+	std::coroutine_handle<> consumer;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_finished = true;
+		consumer = std::exchange(m_waitingConsumer, nullptr);
+	}
+
+	if (consumer)
+		ResumeOnPool(consumer);
+}
+
+void AsyncRenderer::FrameStream::ResumeOnPool(std::coroutine_handle<> handle)
+{
+	m_workerPool.Dispatch(1, {}, [handle](uint32_t item, uint32_t workerIndex) { handle.resume(); });
+}
+
+AsyncRenderer::AsyncRenderer(WorkerPool& workerPool, const RayTracer& rayTracer, const World& world) :
+	m_workerPool(workerPool),
+	m_rayTracer(rayTracer),
+	m_world(world),
+	m_activeRequests(0)
+{
+}
+
+AsyncRenderer::~AsyncRenderer()
+{
+	std::unique_lock<std::mutex> lock(m_activeRequestsMutex);
+	m_activeRequestsCondition.wait(lock, [this]() { return m_activeRequests == 0; });
+}
+
+std::shared_ptr<AsyncRenderer::FrameStream> AsyncRenderer::Render(const RenderRequest& request)
+{
+	std::shared_ptr<FrameStream> stream = std::make_shared<FrameStream>(m_workerPool, request);
+
+	if (!stream->m_rayEmitter.Initialise(request.m_dimensions) || !stream->m_image.Initialise(request.m_dimensions, m_workerPool))
+	{
+		std::cout << "failed to initialise async render request" << std::endl;
+		stream->Finish();
+		return stream;
+	}
+
+	stream->m_image.SetSamplesPerFrame(request.m_samplesPerFrame);
+
+	{
+		std::lock_guard<std::mutex> lock(m_activeRequestsMutex);
+		m_activeRequests++;
+	}
+
+	// Runs on this thread until the first frame has been dispatched, then on the workers.
+	Produce(stream);
+
+	return stream;
+}
+
+DetachedTask AsyncRenderer::Produce(std::shared_ptr<FrameStream> stream)
+{
+	const RenderRequest& request = stream->m_request;
+	size_t imageSize = (size_t)request.m_dimensions.x * (size_t)request.m_dimensions.y;
+
+	for (uint32_t frameIndex = 1; frameIndex <= request.m_numFrames; frameIndex++)
+	{
+		if (!co_await FrameStream::TraceAwaiter(*stream, m_rayTracer, m_world))
+			break;
+
+		ProgressiveFrame frame;
+		const uint32_t* pixels = stream->m_image.GetPresentPixels();
+		frame.m_pixels.assign(pixels, pixels + imageSize);
+		frame.m_dimensions = request.m_dimensions;
+		frame.m_frameIndex = frameIndex;
+		frame.m_samplesPerPixel = frameIndex * stream->m_image.GetSamplesPerFrame();
+
+		if (!co_await FrameStream::PushAwaiter(*stream, std::move(frame)))
+			break;
+	}
+
+	stream->Finish();
+
+	// Notified under the lock so the renderer cannot be destroyed until this has returned.
+	std::lock_guard<std::mutex> lock(m_activeRequestsMutex);
+	m_activeRequests--;
+	m_activeRequestsCondition.notify_all();
+}
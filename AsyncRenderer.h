@@ -0,0 +1,134 @@
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "RayTracedImage.h"
+#include "RayTracing/RayEmitter.h"
+#include "Utils/CancellationToken.h"
+#include "Utils/DetachedTask.h"
+
+class RayTracer;
+class WorkerPool;
+class World;
+
+// Renders images for callers that want to await progressive results instead of blocking a thread on them, such as a
+// service handling many requests. Each request gets its own image and camera and is driven by a coroutine on the
+// worker pool. No thread is held while a frame is being traced or while the producer waits for a slow consumer.
+// Destroying the renderer waits for every request to finish, cancel them first to make that quick.
+class AsyncRenderer
+{
+public:
+
+	struct RenderRequest
+	{
+		glm::vec2 m_dimensions = glm::vec2(256.0f, 256.0f);
+		uint32_t m_samplesPerFrame = 1;
+		// Number of progressive frames to produce, each adding m_samplesPerFrame samples to every pixel.
+		uint32_t m_numFrames = 16;
+		// How many finished frames can wait for the consumer before tracing pauses.
+		uint32_t m_maxQueuedFrames = 2;
+	};
+
+	struct ProgressiveFrame
+	{
+		std::vector<uint32_t> m_pixels;
+		glm::vec2 m_dimensions = glm::vec2(0.0f, 0.0f);
+		// Starts at 1 for the first frame of a request.
+		uint32_t m_frameIndex = 0;
+		uint32_t m_samplesPerPixel = 0;
+	};
+
+	// The frames of one request, in the order they were traced. Shared between the producing coroutine and the
+	// consumer, one consumer per stream.
+	class FrameStream
+	{
+	public:
+
+		class NextAwaiter
+		{
+		public:
+			NextAwaiter(FrameStream& stream) : m_stream(stream) {}
+
+			bool await_ready() const { return false; }
+			bool await_suspend(std::coroutine_handle<> consumer);
+			std::optional<ProgressiveFrame> await_resume();
+
+		private:
+			FrameStream& m_stream;
+			std::optional<ProgressiveFrame> m_frame;
+		};
+
+		FrameStream(WorkerPool& workerPool, const RenderRequest& request);
+
+		// Awaits the next frame. Empty once every frame has been consumed or the request was cancelled. The awaiting
+		// coroutine may be resumed on a worker thread.
+		NextAwaiter Next()
+		{
+			return NextAwaiter(*this);
+		}
+
+		// Stops the request. The frame being traced is abandoned at the next tile boundary and queued frames are
+		// dropped. Callable from any thread.
+		void Cancel();
+
+		inline bool IsCancelled() const
+		{
+			return m_cancellationToken.IsCancelled();
+		}
+
+		// Largest number of frames that were ever queued waiting for the consumer.
+		inline uint32_t GetPeakQueuedFrames() const
+		{
+			return m_peakQueuedFrames;
+		}
+
+	private:
+
+		friend class AsyncRenderer;
+
+		class TraceAwaiter;
+		class PushAwaiter;
+
+		bool TakeFrame(std::optional<ProgressiveFrame>& frame);
+		void Finish();
+		void ResumeOnPool(std::coroutine_handle<> handle);
+
+		WorkerPool& m_workerPool;
+		RenderRequest m_request;
+		RayEmitter m_rayEmitter;
+		RayTracedImage m_image;
+		CancellationToken m_cancellationToken;
+
+		std::mutex m_mutex;
+		std::deque<ProgressiveFrame> m_frames;
+		bool m_finished;
+		uint32_t m_peakQueuedFrames;
+		std::coroutine_handle<> m_waitingConsumer;
+		std::coroutine_handle<> m_waitingProducer;
+	};
+
+	AsyncRenderer(WorkerPool& workerPool, const RayTracer& rayTracer, const World& world);
+	~AsyncRenderer();
+
+	// Starts producing frames and returns straight away. Must not be called from a worker thread.
+	std::shared_ptr<FrameStream> Render(const RenderRequest& request);
+
+private:
+
+	DetachedTask Produce(std::shared_ptr<FrameStream> stream);
+
+	WorkerPool& m_workerPool;
+	const RayTracer& m_rayTracer;
+	const World& m_world;
+
+	std::mutex m_activeRequestsMutex;
+	std::condition_variable m_activeRequestsCondition;
+	uint32_t m_activeRequests;
+};
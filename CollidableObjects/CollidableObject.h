@@ -2,7 +2,7 @@
 #include <glm/glm.hpp>
 
 class Ray;
-class World;
+class WorldSnapshot;
 
 class CollidableObject 
 {
@@ -37,7 +37,10 @@ public:
         m_materialIndex = materialIndex;
     };
 
-    virtual float Intersect(const Ray& ray, const World& world) const = 0;
+    // Objects are shared between World versions, so edits are made to a copy.
+    virtual CollidableObject* Clone() const = 0;
+
+    virtual float Intersect(const Ray& ray, const WorldSnapshot& world) const = 0;
 
 private:
     glm::vec3 m_position{ 0.0f, 0.0f, 0.0f };
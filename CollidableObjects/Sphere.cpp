@@ -1,10 +1,10 @@
 #include "Sphere.h"
 #include "../RayTracing/Ray.h"
-#include "../World.h"
+#include "../WorldSnapshot.h"
 
 // Returns T distance along the ray at the location of the first intersection with a sphere.
 // TODO try simplyfying ie: https://raytracing.github.io/books/RayTracingInOneWeekend.html Listing 14 and 16.
-float Sphere::Intersect(const Ray& ray, const World& world) const
+float Sphere::Intersect(const Ray& ray, const WorldSnapshot& world) const
 {
 	glm::vec3 origin = ray.GetOrigin() - GetPosition();
 
@@ -11,7 +11,12 @@ public:
 	{
 	}
 
-	float Intersect(const Ray& ray, const World& world) const override;
+	CollidableObject* Clone() const override
+	{
+		return new Sphere(*this);
+	}
+
+	float Intersect(const Ray& ray, const WorldSnapshot& world) const override;
 
 private:
 };
\ No newline at end of file
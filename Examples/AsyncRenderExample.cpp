@@ -0,0 +1,96 @@
+#include "AsyncRenderExample.h"
+
+#include <chrono>
+#include <iostream>
+#include <latch>
+#include <thread>
+
+#include "../AsyncRenderer.h"
+#include "../RayTracing/RayTracer.h"
+#include "../Utils/DetachedTask.h"
+#include "../Utils/WorkerPool.h"
+#include "../World.h"
+
+namespace
+{
+	struct ConsumerResult
+	{
+		uint32_t m_framesReceived = 0;
+		uint32_t m_lastSamplesPerPixel = 0;
+		bool m_inOrder = true;
+	};
+
+	// Takes frames until the stream ends, cancelling it after cancelAfter frames when that is non-zero. The delay
+	// stands in for a consumer doing slow work with each frame.
+	DetachedTask ConsumeFrames(std::shared_ptr<AsyncRenderer::FrameStream> stream, uint32_t cancelAfter,
+		std::chrono::milliseconds delay, ConsumerResult& result, std::latch& done)
+	{
+		while (std::optional<AsyncRenderer::ProgressiveFrame> frame = co_await stream->Next())
+		{
+			result.m_inOrder = result.m_inOrder && frame->m_frameIndex == result.m_framesReceived + 1;
+			result.m_framesReceived++;
+			result.m_lastSamplesPerPixel = frame->m_samplesPerPixel;
+
+			if (delay.count() > 0)
+				std::this_thread::sleep_for(delay);
+
+			if (result.m_framesReceived == cancelAfter)
+				stream->Cancel();
+		}
+
+		done.count_down();
+	}
+
+	bool Check(bool passed, const char* description)
+	{
+		std::cout << (passed ? "passed: " : "FAILED: ") << description << std::endl;
+		return passed;
+	}
+}
+
+int RunAsyncRenderExample()
+{
+	WorkerPool workerPool;
+	if (!workerPool.Initialise())
+		return 1;
+
+	RayTracer rayTracer;
+	rayTracer.Initialise();
+	World world;
+
+	bool passed = true;
+	{
+		AsyncRenderer asyncRenderer(workerPool, rayTracer, world);
+
+		AsyncRenderer::RenderRequest request;
+		request.m_dimensions = glm::vec2(128.0f, 96.0f);
+		request.m_samplesPerFrame = 2;
+		request.m_numFrames = 8;
+		request.m_maxQueuedFrames = 2;
+
+		AsyncRenderer::RenderRequest cancelledRequest = request;
+		cancelledRequest.m_numFrames = 1000;
+
+		std::latch done(3);
+		ConsumerResult fastResult;
+		ConsumerResult slowResult;
+		ConsumerResult cancelledResult;
+
+		ConsumeFrames(asyncRenderer.Render(request), 0, std::chrono::milliseconds(0), fastResult, done);
+
+		std::shared_ptr<AsyncRenderer::FrameStream> slowStream = asyncRenderer.Render(request);
+		ConsumeFrames(slowStream, 0, std::chrono::milliseconds(50), slowResult, done);
+
+		ConsumeFrames(asyncRenderer.Render(cancelledRequest), 3, std::chrono::milliseconds(0), cancelledResult, done);
+
+		done.wait();
+
+		passed &= Check(fastResult.m_framesReceived == request.m_numFrames && fastResult.m_inOrder, "every frame arrives in order");
+		passed &= Check(fastResult.m_lastSamplesPerPixel == request.m_numFrames * request.m_samplesPerFrame, "frames accumulate samples");
+		passed &= Check(slowResult.m_framesReceived == request.m_numFrames && slowResult.m_inOrder, "slow consumer receives every frame");
+		passed &= Check(slowStream->GetPeakQueuedFrames() <= request.m_maxQueuedFrames, "slow consumer bounds the queue");
+		passed &= Check(cancelledResult.m_framesReceived == 3, "cancelled request stops");
+	}
+
+	return passed ? 0 : 1;
+}
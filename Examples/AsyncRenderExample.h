@@ -0,0 +1,6 @@
+#pragma once
+
+// Renders a few requests through AsyncRenderer without opening a window and checks the streams behave: frames arrive
+// in order, a slow consumer never has more than the queue limit waiting, and a cancelled request stops early.
+// Returns 0 when every check passes.
+int RunAsyncRenderExample();
@@ -0,0 +1,81 @@
+#include "DeterminismCheck.h"
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "../RayTracedImage.h"
+#include "../RayTracing/RayEmitter.h"
+#include "../RayTracing/RayTracer.h"
+#include "../Utils/WorkerPool.h"
+#include "../World.h"
+
+namespace
+{
+	constexpr uint32_t NumFrames = 4;
+	constexpr uint32_t SamplesPerFrame = 2;
+
+	bool RenderWithWorkers(uint32_t maxWorkers, const RayTracer& rayTracer, const World& world, std::vector<uint32_t>& pixels,
+		uint32_t& numWorkers)
+	{
+		const glm::vec2 dimensions(256.0f, 192.0f);
+
+		WorkerPool workerPool;
+		if (!workerPool.Initialise(0, maxWorkers))
+			return false;
+
+		numWorkers = workerPool.GetNumWorkers();
+
+		RayEmitter rayEmitter;
+		if (!rayEmitter.Initialise(dimensions))
+			return false;
+
+		RayTracedImage image;
+		if (!image.Initialise(dimensions, workerPool))
+			return false;
+
+		image.SetSamplesPerFrame(SamplesPerFrame);
+
+		uint32_t* imagePixels = nullptr;
+		for (uint32_t frame = 0; frame < NumFrames; frame++)
+		{
+			imagePixels = image.FillPixels(rayTracer, rayEmitter, world);
+			if (!imagePixels)
+				return false;
+		}
+
+		pixels.assign(imagePixels, imagePixels + (size_t)dimensions.x * (size_t)dimensions.y);
+		return true;
+	}
+}
+
+int RunDeterminismCheck()
+{
+	RayTracer rayTracer;
+	rayTracer.Initialise();
+	World world;
+
+	std::vector<uint32_t> serialPixels;
+	std::vector<uint32_t> parallelPixels;
+	uint32_t serialWorkers = 0;
+	uint32_t parallelWorkers = 0;
+	if (!RenderWithWorkers(1, rayTracer, world, serialPixels, serialWorkers) ||
+		!RenderWithWorkers(0, rayTracer, world, parallelPixels, parallelWorkers))
+	{
+		std::cout << "FAILED: could not render" << std::endl;
+		return 1;
+	}
+
+	size_t differingPixels = 0;
+	for (size_t i = 0; i < serialPixels.size(); i++)
+	{
+		if (serialPixels[i] != parallelPixels[i])
+			differingPixels++;
+	}
+
+	bool passed = differingPixels == 0;
+	std::cout << (passed ? "passed: " : "FAILED: ") << serialWorkers << " and " << parallelWorkers
+		<< " workers render identical images (" << differingPixels << " pixels differ)" << std::endl;
+
+	return passed ? 0 : 1;
+}
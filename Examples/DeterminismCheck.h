@@ -0,0 +1,5 @@
+#pragma once
+
+// Renders the default scene headless with a single worker and with every worker, and checks the two images are
+// bit-identical. Returns 0 when they match.
+int RunDeterminismCheck();
@@ -0,0 +1,258 @@
+#include "EnvironmentMapBenchmark.h"
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <glm/gtc/constants.hpp>
+
+#include "../RayTracing/EnvironmentMap.h"
+#include "../RayTracing/Ray.h"
+#include "../RayTracing/RayEmitter.h"
+#include "../RayTracing/RayTracer.h"
+#include "../ScopedTimer.h"
+#include "../Utils/WorkerPool.h"
+#include "../World.h"
+
+namespace
+{
+	constexpr uint32_t LoadWidth = 8192;
+	constexpr uint32_t LoadHeight = 4096;
+	constexpr uint32_t RenderMapWidth = 1024;
+	constexpr uint32_t RenderMapHeight = 512;
+	constexpr uint32_t Width = 96;
+	constexpr uint32_t Height = 72;
+	constexpr uint32_t ReferenceSamples = 4096;
+	// Far along the sequence so the reference's noise is unrelated to the test renders'.
+	constexpr uint32_t ReferenceFirstSample = 1u << 20;
+	constexpr uint32_t Checkpoints[] = { 16, 64, 256 };
+
+	// A sky fading from white at the horizon to blue overhead, dark ground below it, and a sun 1 degree across
+	// 40 degrees from straight up, giving about two thirds of the light falling on the floor.
+	std::vector<glm::vec3> MakeSky(uint32_t width, uint32_t height)
+	{
+		const glm::vec3 sunDirection = glm::normalize(glm::vec3(0.5f, -1.0f, -0.4f));
+		const float sunCosine = std::cos(glm::radians(0.5f));
+
+		std::vector<glm::vec3> pixels((size_t)width * height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			float theta = glm::pi<float>() * ((float)y + 0.5f) / (float)height;
+			for (uint32_t x = 0; x < width; x++)
+			{
+				float phi = glm::two_pi<float>() * (((float)x + 0.5f) / (float)width - 0.5f);
+				glm::vec3 direction(std::sin(theta) * std::sin(phi), -std::cos(theta), -std::sin(theta) * std::cos(phi));
+
+				float up = glm::max(-direction.y, 0.0f);
+				glm::vec3 radiance = direction.y < 0.0f ? glm::mix(glm::vec3(1.0f), glm::vec3(0.3f, 0.5f, 1.0f), up) :
+					glm::vec3(0.1f);
+				if (glm::dot(direction, sunDirection) > sunCosine)
+					radiance += glm::vec3(20000.0f, 18000.0f, 15000.0f);
+				pixels[(size_t)y * width + x] = radiance;
+			}
+		}
+		return pixels;
+	}
+
+	bool WritePfm(const std::filesystem::path& path, uint32_t width, uint32_t height, const std::vector<glm::vec3>& pixels)
+	{
+		std::ofstream file(path, std::ios::binary);
+		uint32_t one = 1;
+		bool littleEndian = *(const uint8_t*)&one == 1;
+		file << "PF\n" << width << " " << height << "\n" << (littleEndian ? "-1.0" : "1.0") << "\n";
+		// Bottom row first.
+		for (uint32_t y = height; y-- > 0;)
+			file.write((const char*)&pixels[(size_t)y * width], (std::streamsize)(width * sizeof(glm::vec3)));
+		return (bool)file;
+	}
+
+	// As Radiance writes them, each scanline's four channels one after another as runs of a repeated byte and
+	// stretches of literal bytes.
+	bool WriteHdr(const std::filesystem::path& path, uint32_t width, uint32_t height, const std::vector<glm::vec3>& pixels)
+	{
+		std::ofstream file(path, std::ios::binary);
+		file << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << height << " +X " << width << "\n";
+
+		std::vector<uint8_t> channels[4];
+		std::vector<uint8_t> encoded;
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (std::vector<uint8_t>& channel : channels)
+				channel.resize(width);
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const glm::vec3& colour = pixels[(size_t)y * width + x];
+				float largest = glm::max(colour.x, glm::max(colour.y, colour.z));
+				int exponent = 0;
+				float scale = largest > 1e-32f ? std::frexp(largest, &exponent) * 256.0f / largest : 0.0f;
+				channels[0][x] = (uint8_t)(colour.x * scale);
+				channels[1][x] = (uint8_t)(colour.y * scale);
+				channels[2][x] = (uint8_t)(colour.z * scale);
+				channels[3][x] = largest > 1e-32f ? (uint8_t)(exponent + 128) : 0;
+			}
+
+			encoded.assign({ 2, 2, (uint8_t)(width >> 8), (uint8_t)(width & 0xff) });
+			for (const std::vector<uint8_t>& channel : channels)
+			{
+				uint32_t x = 0;
+				while (x < width)
+				{
+					uint32_t run = 1;
+					while (x + run < width && run < 127 && channel[x + run] == channel[x])
+						run++;
+					if (run >= 4)
+					{
+						encoded.push_back((uint8_t)(128 + run));
+						encoded.push_back(channel[x]);
+						x += run;
+						continue;
+					}
+
+					// Literals up to the next run of four or more.
+					uint32_t end = x;
+					while (end < width && end - x < 128 &&
+						!(end + 3 < width && channel[end] == channel[end + 1] && channel[end] == channel[end + 2] &&
+							channel[end] == channel[end + 3]))
+						end++;
+					end = glm::max(end, x + 1);
+					encoded.push_back((uint8_t)(end - x));
+					encoded.insert(encoded.end(), channel.begin() + x, channel.begin() + end);
+					x = end;
+				}
+			}
+			file.write((const char*)encoded.data(), (std::streamsize)encoded.size());
+		}
+		return (bool)file;
+	}
+
+	bool MeasureLoad(const char* name, const std::filesystem::path& path, WorkerPool& workerPool)
+	{
+		EnvironmentMap environmentMap;
+		ScopedTimer timer;
+		if (!environmentMap.Load(path.string().c_str(), workerPool))
+			return false;
+		double time = timer.ElapsedTimeInMilliseconds();
+
+		std::cout << std::setw(6) << name << " " << environmentMap.GetWidth() << "x" << environmentMap.GetHeight() << ", "
+			<< std::filesystem::file_size(path) / (1024 * 1024) << "MB: loaded with tables in " << std::setprecision(1) << time
+			<< "ms" << std::endl;
+		return true;
+	}
+
+	double GetRmse(const std::vector<glm::vec3>& sums, uint32_t numSamples, const std::vector<glm::vec3>& reference)
+	{
+		double squaredError = 0.0;
+		for (size_t i = 0; i < sums.size(); i++)
+		{
+			glm::vec3 difference = sums[i] / (float)numSamples - reference[i];
+			squaredError += glm::dot(difference, difference);
+		}
+		return std::sqrt(squaredError / (3.0 * sums.size()));
+	}
+
+	void Render(WorkerPool& workerPool, const RayTracer& rayTracer, const RayEmitter& rayEmitter, const WorldSnapshot& world,
+		uint32_t firstSample, uint32_t numSamples, std::vector<glm::vec3>& sums)
+	{
+		workerPool.ParallelFor(Height, [&](uint32_t y, uint32_t workerIndex)
+		{
+			for (uint32_t x = 0; x < Width; x++)
+			{
+				Ray ray(rayEmitter.GetPosition(), rayEmitter.GetRayDirection(x, y));
+				for (uint32_t sample = firstSample; sample < firstSample + numSamples; sample++)
+					sums[y * Width + x] += rayTracer.CalculatePixelColour(x, y, sample, world, ray);
+			}
+		});
+	}
+}
+
+int RunEnvironmentMapBenchmark(const char* fileName)
+{
+	WorkerPool workerPool;
+	RayEmitter rayEmitter;
+	if (!workerPool.Initialise() || !rayEmitter.Initialise(glm::vec2((float)Width, (float)Height)))
+	{
+		std::cout << "FAILED: could not initialise" << std::endl;
+		return 1;
+	}
+
+	std::cout << std::fixed;
+	if (fileName)
+	{
+		if (!MeasureLoad("File", fileName, workerPool))
+			return 1;
+	}
+	else
+	{
+		std::vector<glm::vec3> sky = MakeSky(LoadWidth, LoadHeight);
+		std::filesystem::path pfmPath = std::filesystem::temp_directory_path() / "EnvironmentMapBenchmark.pfm";
+		std::filesystem::path hdrPath = std::filesystem::temp_directory_path() / "EnvironmentMapBenchmark.hdr";
+		bool written = WritePfm(pfmPath, LoadWidth, LoadHeight, sky) && WriteHdr(hdrPath, LoadWidth, LoadHeight, sky);
+		bool loaded = written && MeasureLoad("PFM", pfmPath, workerPool) && MeasureLoad("HDR", hdrPath, workerPool);
+		std::filesystem::remove(pfmPath);
+		std::filesystem::remove(hdrPath);
+		if (!loaded)
+		{
+			std::cout << "FAILED: could not write and load the 8K maps" << std::endl;
+			return 1;
+		}
+
+		EnvironmentMap fromMemory;
+		ScopedTimer timer;
+		fromMemory.Initialise(LoadWidth, LoadHeight, sky.data(), workerPool);
+		std::cout << "Memory " << LoadWidth << "x" << LoadHeight << ": encoded with tables in " << std::setprecision(1)
+			<< timer.ElapsedTimeInMilliseconds() << "ms" << std::endl;
+	}
+
+	std::shared_ptr<EnvironmentMap> environmentMap = std::make_shared<EnvironmentMap>();
+	std::vector<glm::vec3> sky = MakeSky(RenderMapWidth, RenderMapHeight);
+	environmentMap->Initialise(RenderMapWidth, RenderMapHeight, sky.data(), workerPool);
+
+	// A floor and two diffuse spheres with no emissive spheres, lit only by the map.
+	World world;
+	world.LoadManyLightsScene(0);
+	world.SetEnvironmentMap(environmentMap);
+	World::SnapshotHandle snapshot = world.AcquireSnapshot();
+
+	RayTracer rayTracer;
+	rayTracer.Initialise();
+	RayTracer::PathSettings pathSettings;
+	pathSettings.m_shadingModel = RayTracer::ShadingModel::Throughput;
+	rayTracer.SetPathSettings(pathSettings);
+
+	std::vector<glm::vec3> reference(Width * Height, glm::vec3(0.0f));
+	Render(workerPool, rayTracer, rayEmitter, *snapshot, ReferenceFirstSample, ReferenceSamples, reference);
+	for (glm::vec3& pixel : reference)
+		pixel /= (float)ReferenceSamples;
+
+	std::cout << "Sky and sun, throughput shading, " << Width << "x" << Height << ", against a " << ReferenceSamples
+		<< " sample reference" << std::endl;
+
+	const char* names[2] = { "Uniform", "Importance" };
+	for (int mode = 0; mode < 2; mode++)
+	{
+		pathSettings.m_environmentSampling = (RayTracer::EnvironmentSampling)mode;
+		rayTracer.SetPathSettings(pathSettings);
+
+		std::vector<glm::vec3> sums(reference.size(), glm::vec3(0.0f));
+		double time = 0.0;
+		uint32_t pass = 0;
+		std::cout << std::setw(10) << names[mode];
+		for (uint32_t checkpoint : Checkpoints)
+		{
+			ScopedTimer timer;
+			Render(workerPool, rayTracer, rayEmitter, *snapshot, pass, checkpoint - pass, sums);
+			time += timer.ElapsedTimeInMilliseconds();
+			pass = checkpoint;
+
+			std::cout << "  RMSE at " << std::setw(3) << pass << " " << std::setprecision(5) << GetRmse(sums, pass, reference);
+		}
+		std::cout << "  " << std::setprecision(2) << time / (double)pass << "ms/pass" << std::endl;
+	}
+	std::cout << std::defaultfloat;
+
+	return 0;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Writes an 8192x4096 sky with a small bright sun as PFM and run length compressed Radiance HDR files to the temporary
+// directory and prints how long EnvironmentMap takes to load each and build its sampling tables, or loads fileName
+// instead when given. Then renders a floor and two diffuse spheres lit only by a 1024x512 version of the sky, headless,
+// with the environment's shadow rays sampled uniformly and by importance, and prints the time per pass and the RMSE
+// against a high sample count reference after 16, 64 and 256 passes. Returns 0 when every load and render completed.
+int RunEnvironmentMapBenchmark(const char* fileName = nullptr);
@@ -0,0 +1,326 @@
+#include "LightSamplingBenchmark.h"
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "../RayTracing/LightResampler.h"
+#include "../RayTracing/Ray.h"
+#include "../RayTracing/RayEmitter.h"
+#include "../RayTracing/RayTracer.h"
+#include "../ScopedTimer.h"
+#include "../Utils/WorkerPool.h"
+#include "../World.h"
+
+namespace
+{
+	// Far along the sequence so the reference's noise is unrelated to the test renders'.
+	constexpr uint32_t ReferenceFirstSample = 1u << 20;
+
+	struct Comparison
+	{
+		uint32_t m_width;
+		uint32_t m_height;
+		uint32_t m_referenceSamples;
+		// Test renders are measured at 1, 2, 4 ... samples, up to 2^(m_numCheckpoints - 1).
+		uint32_t m_numCheckpoints;
+		// The noise target is what the second mode reaches at this checkpoint.
+		uint32_t m_targetCheckpoint;
+		// The reference is rendered with the second mode.
+		RayTracer::PathSettings m_modes[2];
+		const char* m_names[2];
+	};
+
+	struct Checkpoint
+	{
+		double m_time = 0.0;
+		double m_rmse = 0.0;
+	};
+
+	// Adds samples [firstSample, endSample) of every pixel to sums.
+	void AddSamples(WorkerPool& workerPool, const RayTracer& rayTracer, const RayEmitter& rayEmitter, const WorldSnapshot& world,
+		const Comparison& comparison, uint32_t firstSample, uint32_t endSample, std::vector<glm::vec3>& sums)
+	{
+		workerPool.ParallelFor(comparison.m_height, [&](uint32_t y, uint32_t workerIndex)
+		{
+			for (uint32_t x = 0; x < comparison.m_width; x++)
+			{
+				Ray ray(rayEmitter.GetPosition(), rayEmitter.GetRayDirection(x, y));
+				for (uint32_t sample = firstSample; sample < endSample; sample++)
+					sums[y * comparison.m_width + x] += rayTracer.CalculatePixelColour(x, y, sample, world, ray);
+			}
+		});
+	}
+
+	double GetRmse(const std::vector<glm::vec3>& sums, uint32_t numSamples, const std::vector<glm::vec3>& reference)
+	{
+		double squaredError = 0.0;
+		for (size_t i = 0; i < sums.size(); i++)
+		{
+			glm::vec3 difference = sums[i] / (float)numSamples - reference[i];
+			squaredError += glm::dot(difference, difference);
+		}
+		return std::sqrt(squaredError / (3.0 * sums.size()));
+	}
+
+	// Time spent tracing and RMSE at each checkpoint.
+	std::vector<Checkpoint> Measure(WorkerPool& workerPool, const RayTracer& rayTracer, const RayEmitter& rayEmitter,
+		const WorldSnapshot& world, const Comparison& comparison, const std::vector<glm::vec3>& reference)
+	{
+		std::vector<Checkpoint> checkpoints(comparison.m_numCheckpoints);
+		std::vector<glm::vec3> sums(reference.size(), glm::vec3(0.0f));
+		double time = 0.0;
+		uint32_t samplesTaken = 0;
+		for (uint32_t checkpoint = 0; checkpoint < comparison.m_numCheckpoints; checkpoint++)
+		{
+			ScopedTimer timer;
+			AddSamples(workerPool, rayTracer, rayEmitter, world, comparison, samplesTaken, 1u << checkpoint, sums);
+			time += timer.ElapsedTimeInMilliseconds();
+			samplesTaken = 1u << checkpoint;
+
+			checkpoints[checkpoint].m_time = time;
+			checkpoints[checkpoint].m_rmse = GetRmse(sums, samplesTaken, reference);
+		}
+		return checkpoints;
+	}
+
+	int RunComparison(const Comparison& comparison, World& world)
+	{
+		WorkerPool workerPool;
+		RayEmitter rayEmitter;
+		if (!workerPool.Initialise() || !rayEmitter.Initialise(glm::vec2((float)comparison.m_width, (float)comparison.m_height)))
+		{
+			std::cout << "FAILED: could not initialise" << std::endl;
+			return 1;
+		}
+
+		RayTracer rayTracer;
+		rayTracer.Initialise();
+		World::SnapshotHandle snapshot = world.AcquireSnapshot();
+
+		rayTracer.SetPathSettings(comparison.m_modes[1]);
+		std::vector<glm::vec3> reference(comparison.m_width * comparison.m_height, glm::vec3(0.0f));
+		AddSamples(workerPool, rayTracer, rayEmitter, *snapshot, comparison, ReferenceFirstSample,
+			ReferenceFirstSample + comparison.m_referenceSamples, reference);
+		for (glm::vec3& colour : reference)
+			colour /= (float)comparison.m_referenceSamples;
+
+		std::vector<Checkpoint> checkpoints[2];
+		for (int mode = 0; mode < 2; mode++)
+		{
+			rayTracer.SetPathSettings(comparison.m_modes[mode]);
+			checkpoints[mode] = Measure(workerPool, rayTracer, rayEmitter, *snapshot, comparison, reference);
+		}
+
+		std::cout << comparison.m_width << "x" << comparison.m_height << ", against a " << comparison.m_referenceSamples
+			<< " sample reference" << std::endl << std::fixed;
+		for (int mode = 0; mode < 2; mode++)
+		{
+			std::cout << comparison.m_names[mode] << std::endl;
+			for (uint32_t checkpoint = 0; checkpoint < comparison.m_numCheckpoints; checkpoint++)
+			{
+				std::cout << std::setw(8) << (1u << checkpoint) << " samples" << std::setprecision(1) << std::setw(10)
+					<< checkpoints[mode][checkpoint].m_time << "ms" << std::setprecision(5) << "  RMSE "
+					<< checkpoints[mode][checkpoint].m_rmse << std::endl;
+			}
+		}
+
+		// The first checkpoint at or below the target, or the last one if none got there.
+		double targetRmse = checkpoints[1][comparison.m_targetCheckpoint].m_rmse;
+		std::cout << "Time to RMSE " << std::setprecision(5) << targetRmse << ":" << std::setprecision(1);
+		for (int mode = 0; mode < 2; mode++)
+		{
+			const Checkpoint* reached = nullptr;
+			for (const Checkpoint& checkpoint : checkpoints[mode])
+			{
+				if (checkpoint.m_rmse <= targetRmse)
+				{
+					reached = &checkpoint;
+					break;
+				}
+			}
+
+			std::cout << " " << comparison.m_names[mode] << " ";
+			if (reached)
+				std::cout << reached->m_time << "ms";
+			else
+				std::cout << "over " << checkpoints[mode].back().m_time << "ms";
+		}
+		std::cout << std::defaultfloat << std::endl;
+
+		return 0;
+	}
+
+	// Traces single sample frames with the resampler, each reusing the reservoirs of the one before, and prints the
+	// RMSE of frames 1, 2, 4 ... Returns the time and RMSE of the last frame.
+	Checkpoint MeasureResampling(WorkerPool& workerPool, const RayTracer& rayTracer, const RayEmitter& rayEmitter,
+		const WorldSnapshot& world, const Comparison& comparison, const LightResampler& resampler, uint32_t numFrames,
+		const std::vector<glm::vec3>& reference)
+	{
+		std::vector<LightResampler::Reservoir> reservoirs[2];
+		for (std::vector<LightResampler::Reservoir>& frameReservoirs : reservoirs)
+			frameReservoirs.assign(reference.size(), LightResampler::Reservoir());
+
+		Checkpoint checkpoint;
+		for (uint32_t frame = 0; frame < numFrames; frame++)
+		{
+			const LightResampler::Reservoir* previousReservoirs = reservoirs[(frame + 1) % 2].data();
+			LightResampler::Reservoir* frameReservoirs = reservoirs[frame % 2].data();
+			std::vector<glm::vec3> colours(reference.size(), glm::vec3(0.0f));
+
+			ScopedTimer timer;
+			workerPool.ParallelFor(comparison.m_height, [&](uint32_t y, uint32_t workerIndex)
+			{
+				for (uint32_t x = 0; x < comparison.m_width; x++)
+				{
+					uint32_t pixel = y * comparison.m_width + x;
+					Ray ray(rayEmitter.GetPosition(), rayEmitter.GetRayDirection(x, y));
+					glm::vec3 directLight;
+					if (resampler.EstimateDirectLight(x, y, frame, ray, rayTracer, world, previousReservoirs, comparison.m_width,
+						comparison.m_height, frameReservoirs[pixel], directLight))
+						colours[pixel] = rayTracer.CalculatePixelColour(x, y, frame, world, ray, false) + directLight;
+					else
+						colours[pixel] = rayTracer.CalculatePixelColour(x, y, frame, world, ray);
+				}
+			});
+
+			checkpoint.m_time = timer.ElapsedTimeInMilliseconds();
+			checkpoint.m_rmse = GetRmse(colours, 1, reference);
+			if ((frame & (frame + 1)) == 0)
+			{
+				std::cout << std::setw(8) << frame + 1 << " frames" << std::setprecision(1) << std::setw(11) << checkpoint.m_time
+					<< "ms" << std::setprecision(5) << "  RMSE " << checkpoint.m_rmse << std::endl;
+			}
+		}
+		return checkpoint;
+	}
+}
+
+int RunLightSamplingBenchmark()
+{
+	Comparison comparison;
+	comparison.m_width = 128;
+	comparison.m_height = 96;
+	comparison.m_referenceSamples = 4096;
+	comparison.m_numCheckpoints = 11;
+	comparison.m_targetCheckpoint = 4;
+	comparison.m_modes[0].m_shadingModel = RayTracer::ShadingModel::Throughput;
+	comparison.m_modes[0].m_lightSampling = false;
+	comparison.m_modes[1] = comparison.m_modes[0];
+	comparison.m_modes[1].m_lightSampling = true;
+	comparison.m_names[0] = "BSDF sampling";
+	comparison.m_names[1] = "Light sampling";
+
+	std::cout << "Default scene, throughput shading" << std::endl;
+	World world;
+	return RunComparison(comparison, world);
+}
+
+int RunManyLightsBenchmark()
+{
+	constexpr uint32_t numLights = 10000;
+
+	// Every ray is tested against every sphere, so the image is kept small and the paths short.
+	Comparison comparison;
+	comparison.m_width = 64;
+	comparison.m_height = 48;
+	comparison.m_referenceSamples = 512;
+	comparison.m_numCheckpoints = 7;
+	comparison.m_targetCheckpoint = 2;
+	comparison.m_modes[0].m_shadingModel = RayTracer::ShadingModel::Throughput;
+	comparison.m_modes[0].m_maxBounces = 3;
+	comparison.m_modes[0].m_lightSelection = RayTracer::LightSelection::Uniform;
+	comparison.m_modes[1] = comparison.m_modes[0];
+	comparison.m_modes[1].m_lightSelection = RayTracer::LightSelection::Hierarchy;
+	comparison.m_names[0] = "Uniform selection";
+	comparison.m_names[1] = "Light BVH";
+
+	std::cout << numLights << " lights, throughput shading" << std::endl;
+	World world;
+	world.LoadManyLightsScene(numLights);
+	return RunComparison(comparison, world);
+}
+
+
+int RunLightResamplingBenchmark()
+{
+	constexpr uint32_t numLights = 1000;
+	// Resampled frames traced, each reusing the reservoirs of the one before.
+	constexpr uint32_t numFrames = 16;
+	constexpr uint32_t maxIndependentSamples = 64;
+
+	// Two bounces, so the direct light at the first surface is most of the image and the light found by scattering
+	// there is still counted.
+	Comparison comparison;
+	comparison.m_width = 64;
+	comparison.m_height = 48;
+	comparison.m_referenceSamples = 1024;
+	comparison.m_modes[0].m_shadingModel = RayTracer::ShadingModel::Throughput;
+	comparison.m_modes[0].m_maxBounces = 2;
+
+	std::cout << numLights << " lights, throughput shading, single frames against a " << comparison.m_referenceSamples
+		<< " sample reference" << std::endl << std::fixed;
+	World world;
+	world.LoadManyLightsScene(numLights);
+
+	WorkerPool workerPool;
+	RayEmitter rayEmitter;
+	if (!workerPool.Initialise() || !rayEmitter.Initialise(glm::vec2((float)comparison.m_width, (float)comparison.m_height)))
+	{
+		std::cout << "FAILED: could not initialise" << std::endl;
+		return 1;
+	}
+
+	RayTracer rayTracer;
+	rayTracer.Initialise();
+	rayTracer.SetPathSettings(comparison.m_modes[0]);
+	World::SnapshotHandle snapshot = world.AcquireSnapshot();
+
+	std::vector<glm::vec3> reference(comparison.m_width * comparison.m_height, glm::vec3(0.0f));
+	AddSamples(workerPool, rayTracer, rayEmitter, *snapshot, comparison, ReferenceFirstSample,
+		ReferenceFirstSample + comparison.m_referenceSamples, reference);
+	for (glm::vec3& colour : reference)
+		colour /= (float)comparison.m_referenceSamples;
+
+	std::cout << "Independent light sampling" << std::endl;
+	std::vector<Checkpoint> independent;
+	for (uint32_t samples = 1; samples <= maxIndependentSamples; samples *= 2)
+	{
+		std::vector<glm::vec3> sums(reference.size(), glm::vec3(0.0f));
+		ScopedTimer timer;
+		AddSamples(workerPool, rayTracer, rayEmitter, *snapshot, comparison, 0, samples, sums);
+
+		Checkpoint checkpoint;
+		checkpoint.m_time = timer.ElapsedTimeInMilliseconds();
+		checkpoint.m_rmse = GetRmse(sums, samples, reference);
+		independent.push_back(checkpoint);
+		std::cout << std::setw(8) << samples << " samples" << std::setprecision(1) << std::setw(10) << checkpoint.m_time
+			<< "ms" << std::setprecision(5) << "  RMSE " << checkpoint.m_rmse << std::endl;
+	}
+
+	LightResampler::Settings settings[2];
+	settings[1].m_spatialNeighbours = 3;
+	const char* names[2] = { "Temporal reuse", "Temporal and spatial reuse" };
+	for (int mode = 0; mode < 2; mode++)
+	{
+		std::cout << "Light resampling, " << names[mode] << ", one sample per frame" << std::endl;
+		LightResampler resampler;
+		resampler.SetSettings(settings[mode]);
+		Checkpoint resampled = MeasureResampling(workerPool, rayTracer, rayEmitter, *snapshot, comparison, resampler, numFrames,
+			reference);
+
+		// The most samples independent light sampling can take in the time of one resampled frame.
+		size_t equalIndex = 0;
+		while (equalIndex + 1 < independent.size() && independent[equalIndex + 1].m_time <= resampled.m_time)
+			equalIndex++;
+
+		std::cout << "Equal cost: resampled frame " << std::setprecision(1) << resampled.m_time << "ms RMSE "
+			<< std::setprecision(5) << resampled.m_rmse << ", independent " << (1u << equalIndex) << " samples "
+			<< std::setprecision(1) << independent[equalIndex].m_time << "ms RMSE " << std::setprecision(5)
+			<< independent[equalIndex].m_rmse << std::endl;
+	}
+	std::cout << std::defaultfloat;
+
+	return 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// Renders the default scene headless with the throughput shading model, with and without light sampling, and prints
+// how long each takes to get within a target RMSE of a high sample count reference. Returns 0 when every render
+// completed.
+int RunLightSamplingBenchmark();
+
+// As RunLightSamplingBenchmark, comparing uniform light selection with the light hierarchy on a scene with 10,000
+// emissive spheres.
+int RunManyLightsBenchmark();
+
+// Renders single frames of a scene with 1,000 emissive spheres with LightResampler, each frame reusing the last
+// frame's reservoirs, and with independent light sampling at 1, 2, 4 ... samples per pixel. Prints the RMSE of each
+// against a high sample count reference and compares a resampled frame with independent sampling at equal time.
+// Returns 0 when every render completed.
+int RunLightResamplingBenchmark();
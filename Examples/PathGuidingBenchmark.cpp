@@ -0,0 +1,144 @@
+#include "PathGuidingBenchmark.h"
+
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "../RayTracing/PathGuide.h"
+#include "../RayTracing/Ray.h"
+#include "../RayTracing/RayEmitter.h"
+#include "../RayTracing/RayTracer.h"
+#include "../ScopedTimer.h"
+#include "../Utils/WorkerPool.h"
+#include "../World.h"
+
+namespace
+{
+	constexpr uint32_t Width = 96;
+	constexpr uint32_t Height = 72;
+	// Passes of one sample per pixel the guide is trained with, six iterations of 1, 2, 4 ... passes.
+	constexpr uint32_t TrainingPasses = 63;
+	// Enough that the bright paths reaching the lamp by way of a mirror are counted many times over.
+	constexpr uint32_t MeasuredSamples = 256;
+	// Past the training passes' sample numbers, so the measured samples are unrelated to the ones trained on.
+	constexpr uint32_t MeasuredFirstSample = 1u << 16;
+
+	struct Measurement
+	{
+		double m_time = 0.0;
+		// Variance of one sample, averaged over the colour channels and summed over the pixels.
+		double m_variance = 0.0;
+		// Mean of all the pixels, which guiding must leave unchanged.
+		double m_mean = 0.0;
+	};
+
+	Measurement Measure(WorkerPool& workerPool, const RayTracer& rayTracer, const RayEmitter& rayEmitter, const WorldSnapshot& world,
+		PathGuide* guide)
+	{
+		std::vector<glm::vec3> sums(Width * Height, glm::vec3(0.0f));
+		std::vector<glm::vec3> squaredSums(Width * Height, glm::vec3(0.0f));
+
+		ScopedTimer timer;
+		workerPool.ParallelFor(Height, [&](uint32_t y, uint32_t workerIndex)
+		{
+			for (uint32_t x = 0; x < Width; x++)
+			{
+				Ray ray(rayEmitter.GetPosition(), rayEmitter.GetRayDirection(x, y));
+				for (uint32_t sample = 0; sample < MeasuredSamples; sample++)
+				{
+					glm::vec3 colour = rayTracer.CalculatePixelColour(x, y, MeasuredFirstSample + sample, world, ray, true, guide);
+					sums[y * Width + x] += colour;
+					squaredSums[y * Width + x] += colour * colour;
+				}
+			}
+		});
+
+		Measurement measurement;
+		measurement.m_time = timer.ElapsedTimeInMilliseconds();
+		for (size_t pixel = 0; pixel < sums.size(); pixel++)
+		{
+			glm::vec3 mean = sums[pixel] / (float)MeasuredSamples;
+			glm::vec3 variance = glm::max(squaredSums[pixel] / (float)MeasuredSamples - mean * mean, glm::vec3(0.0f));
+			measurement.m_variance += (variance.x + variance.y + variance.z) / 3.0;
+			measurement.m_mean += (mean.x + mean.y + mean.z) / (3.0 * sums.size());
+		}
+		return measurement;
+	}
+
+	int RunComparison(const char* name, World& world)
+	{
+		WorkerPool workerPool;
+		RayEmitter rayEmitter;
+		if (!workerPool.Initialise() || !rayEmitter.Initialise(glm::vec2((float)Width, (float)Height)))
+		{
+			std::cout << "FAILED: could not initialise" << std::endl;
+			return 1;
+		}
+
+		RayTracer rayTracer;
+		rayTracer.Initialise();
+		RayTracer::PathSettings pathSettings;
+		pathSettings.m_shadingModel = RayTracer::ShadingModel::Throughput;
+		rayTracer.SetPathSettings(pathSettings);
+		World::SnapshotHandle snapshot = world.AcquireSnapshot();
+
+		// Trained as RayTracedImage does, refining the guide after each pass over the image.
+		PathGuide guide;
+		guide.Prepare(*snapshot);
+		ScopedTimer trainingTimer;
+		for (uint32_t pass = 0; pass < TrainingPasses; pass++)
+		{
+			workerPool.ParallelFor(Height, [&](uint32_t y, uint32_t workerIndex)
+			{
+				for (uint32_t x = 0; x < Width; x++)
+				{
+					Ray ray(rayEmitter.GetPosition(), rayEmitter.GetRayDirection(x, y));
+					rayTracer.CalculatePixelColour(x, y, pass, *snapshot, ray, true, &guide);
+				}
+			});
+			guide.EndPass();
+		}
+		double trainingTime = trainingTimer.ElapsedTimeInMilliseconds();
+
+		Measurement measurements[2];
+		measurements[0] = Measure(workerPool, rayTracer, rayEmitter, *snapshot, nullptr);
+		measurements[1] = Measure(workerPool, rayTracer, rayEmitter, *snapshot, &guide);
+
+		std::cout << name << ", " << Width << "x" << Height << ", " << MeasuredSamples << " samples per pixel" << std::endl
+			<< std::fixed << std::setprecision(1) << "Guide trained in " << TrainingPasses << " passes, " << trainingTime
+			<< "ms, " << guide.GetNumCells() << " cells" << std::endl;
+
+		const char* names[2] = { "Material sampling", "Path guiding" };
+		for (int mode = 0; mode < 2; mode++)
+		{
+			std::cout << std::setw(18) << names[mode] << std::setprecision(1) << std::setw(10) << measurements[mode].m_time
+				<< "ms  variance " << std::setprecision(3) << measurements[mode].m_variance << "  mean " << std::setprecision(5)
+				<< measurements[mode].m_mean << std::endl;
+		}
+
+		// Variance times time: below 1, guiding reaches a given noise level in less time.
+		double efficiency = (measurements[1].m_variance * measurements[1].m_time) /
+			(measurements[0].m_variance * measurements[0].m_time);
+		std::cout << "Guided variance " << std::setprecision(2) << measurements[1].m_variance / measurements[0].m_variance
+			<< "x, at equal time " << efficiency << "x" << std::defaultfloat << std::endl;
+
+		return 0;
+	}
+}
+
+int RunPathGuidingBenchmark()
+{
+	World mirrorWorld;
+	mirrorWorld.LoadMirrorScene();
+	if (RunComparison("Mirror scene", mirrorWorld) != 0)
+		return 1;
+
+	World roomWorld;
+	roomWorld.LoadRoomScene();
+	if (RunComparison("Room scene", roomWorld) != 0)
+		return 1;
+
+	World manyLightsWorld;
+	manyLightsWorld.LoadManyLightsScene(100);
+	return RunComparison("100 lights", manyLightsWorld);
+}
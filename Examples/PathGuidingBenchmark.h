@@ -0,0 +1,9 @@
+#pragma once
+
+// Trains a PathGuide headless on World::LoadMirrorScene, a closed room lit mostly by way of its walls and two mirror
+// spheres, then renders it with and without guiding and prints the variance of the pixels and the time each took. Does
+// the same for World::LoadRoomScene, lit mostly by light bounced off its diffuse walls, and for a scene with 100 emissive
+// spheres, lit mostly by the sky and light sampling, where sampling the material is already close to ideal and guiding
+// should change little.
+// Returns 0 when every render completed.
+int RunPathGuidingBenchmark();
@@ -0,0 +1,130 @@
+#include "RadianceCacheBenchmark.h"
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "../RayTracing/RadianceCache.h"
+#include "../RayTracing/Ray.h"
+#include "../RayTracing/RayEmitter.h"
+#include "../RayTracing/RayTracer.h"
+#include "../ScopedTimer.h"
+#include "../Utils/WorkerPool.h"
+#include "../World.h"
+
+namespace
+{
+	constexpr uint32_t Width = 96;
+	constexpr uint32_t Height = 72;
+	constexpr uint32_t ReferenceSamples = 2048;
+	// Far along the sequence so the reference's noise is unrelated to the test renders'.
+	constexpr uint32_t ReferenceFirstSample = 1u << 20;
+	// The RMSE is printed after each of these numbers of passes.
+	constexpr uint32_t Checkpoints[] = { 16, 256 };
+
+	double GetRmse(const std::vector<glm::vec3>& sums, uint32_t numSamples, const std::vector<glm::vec3>& reference)
+	{
+		double squaredError = 0.0;
+		for (size_t i = 0; i < sums.size(); i++)
+		{
+			glm::vec3 difference = sums[i] / (float)numSamples - reference[i];
+			squaredError += glm::dot(difference, difference);
+		}
+		return std::sqrt(squaredError / (3.0 * sums.size()));
+	}
+
+	// Traces one sample per pixel per pass, resolving the cache after each, and prints the time per pass and the RMSE
+	// at each checkpoint.
+	void Measure(const char* name, WorkerPool& workerPool, const RayTracer& rayTracer, const RayEmitter& rayEmitter,
+		const WorldSnapshot& world, RadianceCache* radianceCache, const std::vector<glm::vec3>& reference)
+	{
+		if (radianceCache)
+			radianceCache->Prepare(world, rayTracer.GetPathSettings());
+
+		std::vector<glm::vec3> sums(reference.size(), glm::vec3(0.0f));
+		double time = 0.0;
+		uint32_t pass = 0;
+		std::cout << std::setw(24) << name;
+		for (uint32_t checkpoint : Checkpoints)
+		{
+			ScopedTimer timer;
+			for (; pass < checkpoint; pass++)
+			{
+				workerPool.ParallelFor(Height, [&](uint32_t y, uint32_t workerIndex)
+				{
+					for (uint32_t x = 0; x < Width; x++)
+					{
+						Ray ray(rayEmitter.GetPosition(), rayEmitter.GetRayDirection(x, y));
+						sums[y * Width + x] += rayTracer.CalculatePixelColour(x, y, pass, world, ray, true, nullptr, radianceCache);
+					}
+				});
+
+				if (radianceCache)
+					radianceCache->EndPass();
+			}
+			time += timer.ElapsedTimeInMilliseconds();
+
+			std::cout << std::setprecision(2) << std::setw(9) << time / (double)pass << "ms/pass" << std::setprecision(5)
+				<< "  RMSE at " << std::setw(3) << pass << " " << GetRmse(sums, pass, reference);
+		}
+
+		if (radianceCache)
+			std::cout << "  " << radianceCache->GetNumCells() << " cells";
+		std::cout << std::endl;
+	}
+}
+
+int RunRadianceCacheBenchmark()
+{
+	World world;
+	world.LoadRoomScene();
+
+	WorkerPool workerPool;
+	RayEmitter rayEmitter;
+	if (!workerPool.Initialise() || !rayEmitter.Initialise(glm::vec2((float)Width, (float)Height)))
+	{
+		std::cout << "FAILED: could not initialise" << std::endl;
+		return 1;
+	}
+
+	RayTracer rayTracer;
+	rayTracer.Initialise();
+	RayTracer::PathSettings pathSettings;
+	pathSettings.m_shadingModel = RayTracer::ShadingModel::Throughput;
+	rayTracer.SetPathSettings(pathSettings);
+	World::SnapshotHandle snapshot = world.AcquireSnapshot();
+
+	std::vector<glm::vec3> reference(Width * Height, glm::vec3(0.0f));
+	workerPool.ParallelFor(Height, [&](uint32_t y, uint32_t workerIndex)
+	{
+		for (uint32_t x = 0; x < Width; x++)
+		{
+			Ray ray(rayEmitter.GetPosition(), rayEmitter.GetRayDirection(x, y));
+			for (uint32_t sample = ReferenceFirstSample; sample < ReferenceFirstSample + ReferenceSamples; sample++)
+				reference[y * Width + x] += rayTracer.CalculatePixelColour(x, y, sample, *snapshot, ray);
+			reference[y * Width + x] /= (float)ReferenceSamples;
+		}
+	});
+
+	std::cout << "Room, throughput shading, " << Width << "x" << Height << ", against a " << ReferenceSamples
+		<< " sample reference" << std::endl << std::fixed;
+	Measure("No cache", workerPool, rayTracer, rayEmitter, *snapshot, nullptr, reference);
+
+	const float cellSizes[] = { 0.4f, 0.1f, 0.025f };
+	for (float cellSize : cellSizes)
+	{
+		RadianceCache radianceCache;
+		RadianceCache::Settings settings;
+		settings.m_cellSize = cellSize;
+		radianceCache.SetSettings(settings);
+
+		std::ostringstream name;
+		name << std::setprecision(3) << "Cache, " << cellSize << " cells";
+		Measure(name.str().c_str(), workerPool, rayTracer, rayEmitter, *snapshot, &radianceCache, reference);
+	}
+	std::cout << std::defaultfloat;
+
+	return 0;
+}
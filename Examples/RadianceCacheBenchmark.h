@@ -0,0 +1,7 @@
+#pragma once
+
+// Renders World::LoadRoomScene headless, with and without a RadianceCache at a few cell sizes, one sample per pixel per
+// pass as RayTracedImage does. Prints the time per pass and the RMSE against a high sample count reference without the
+// cache after 16 and 256 passes. Without the cache the error keeps falling
+// with more passes; with it, it levels off at the cache's bias. Returns 0 when every render completed.
+int RunRadianceCacheBenchmark();
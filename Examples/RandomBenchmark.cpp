@@ -0,0 +1,164 @@
+#include "RandomBenchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../ScopedTimer.h"
+#include "../Utils/Pcg32.h"
+#include "../Utils/Xoshiro128x8.h"
+
+namespace
+{
+	constexpr uint32_t NumBenchmarkValues = 1u << 26;
+	constexpr uint32_t NumTestValues = 1u << 22;
+	constexpr uint32_t NumBuckets = 256;
+	// Chi-squared with 255 degrees of freedom is above this one time in a thousand for uniform values.
+	constexpr double ChiSquaredLimit = 330.5;
+
+	// The generator Random used before, a std::mt19937 through a uniform_int_distribution.
+	struct MersenneTwister
+	{
+		std::mt19937 m_engine{ 5489u };
+		std::uniform_int_distribution<uint32_t> m_distribution;
+
+		inline float Float()
+		{
+			return (float)(m_distribution(m_engine) >> 8) * (1.0f / 16777216.0f);
+		}
+	};
+
+	// Calls fillFunction(values, count) to fill the whole array a block at a time.
+	template<typename FillFunction>
+	void Fill(std::vector<float>& values, FillFunction fillFunction)
+	{
+		constexpr uint32_t blockSize = 1024;
+		for (size_t i = 0; i < values.size(); i += blockSize)
+			fillFunction(&values[i], blockSize);
+	}
+
+	void FillMersenneTwister(std::vector<float>& values)
+	{
+		MersenneTwister generator;
+		Fill(values, [&](float* block, uint32_t count) { for (uint32_t i = 0; i < count; i++) block[i] = generator.Float(); });
+	}
+
+	void FillPcg32(std::vector<float>& values)
+	{
+		Pcg32 generator;
+		Fill(values, [&](float* block, uint32_t count) { for (uint32_t i = 0; i < count; i++) block[i] = generator.Float(); });
+	}
+
+	void FillXoshiro128x8(std::vector<float>& values)
+	{
+		Xoshiro128x8 generator;
+		Fill(values, [&](float* block, uint32_t count)
+		{
+			for (uint32_t i = 0; i < count; i += Xoshiro128x8::NumLanes)
+				generator.Float8(&block[i]);
+		});
+	}
+
+	struct Generator
+	{
+		const char* m_name;
+		void (*m_fill)(std::vector<float>&);
+	};
+
+	const Generator Generators[] =
+	{
+		{ "mt19937", FillMersenneTwister },
+		{ "Pcg32", FillPcg32 },
+		{ "Xoshiro128x8", FillXoshiro128x8 },
+	};
+
+	bool CheckUniform(const std::vector<float>& values)
+	{
+		double n = (double)values.size();
+		double sum = 0.0;
+		double sumSquares = 0.0;
+		double sumLagProducts = 0.0;
+		std::vector<uint32_t> buckets(NumBuckets, 0);
+		bool inRange = true;
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			double value = values[i];
+			inRange &= value >= 0.0 && value < 1.0;
+			sum += value;
+			sumSquares += value * value;
+			if (i > 0)
+				sumLagProducts += (value - 0.5) * (values[i - 1] - 0.5);
+			buckets[std::min((uint32_t)(value * NumBuckets), NumBuckets - 1)]++;
+		}
+
+		double mean = sum / n;
+		double variance = sumSquares / n - mean * mean;
+		double serialCorrelation = (sumLagProducts / (n - 1.0)) / (1.0 / 12.0);
+
+		double expected = n / NumBuckets;
+		double chiSquared = 0.0;
+		for (uint32_t count : buckets)
+			chiSquared += (count - expected) * (count - expected) / expected;
+
+		// Five standard errors either way.
+		bool meanPassed = std::abs(mean - 0.5) < 5.0 * std::sqrt(1.0 / 12.0 / n);
+		bool variancePassed = std::abs(variance - 1.0 / 12.0) < 5.0 * std::sqrt(1.0 / 180.0 / n);
+		bool correlationPassed = std::abs(serialCorrelation) < 5.0 / std::sqrt(n);
+		bool chiSquaredPassed = chiSquared < ChiSquaredLimit;
+
+		std::cout << std::fixed << std::setprecision(5) << "  mean " << mean << (meanPassed ? "" : " FAILED")
+			<< ", variance " << variance << (variancePassed ? "" : " FAILED")
+			<< ", serial correlation " << serialCorrelation << (correlationPassed ? "" : " FAILED")
+			<< std::setprecision(1) << ", chi-squared " << chiSquared << (chiSquaredPassed ? "" : " FAILED")
+			<< (inRange ? "" : ", out of range FAILED") << std::defaultfloat << std::endl;
+
+		return inRange && meanPassed && variancePassed && correlationPassed && chiSquaredPassed;
+	}
+
+	// The eight wide version must step each lane exactly as NextLane does.
+	bool CheckLanesMatch()
+	{
+		Xoshiro128x8 wide(1234);
+		Xoshiro128x8 scalar(1234);
+		for (uint32_t step = 0; step < 1000; step++)
+		{
+			float values[Xoshiro128x8::NumLanes];
+			wide.Float8(values);
+			for (uint32_t lane = 0; lane < Xoshiro128x8::NumLanes; lane++)
+			{
+				if (values[lane] != (float)(scalar.NextLane(lane) >> 8) * (1.0f / 16777216.0f))
+					return false;
+			}
+		}
+		return true;
+	}
+}
+
+int RunRandomBenchmark()
+{
+	bool passed = true;
+	std::vector<float> values(NumBenchmarkValues);
+	for (const Generator& generator : Generators)
+	{
+		ScopedTimer timer;
+		generator.m_fill(values);
+		double nanoseconds = timer.ElapsedTimeInMilliseconds() * 1.0e6 / NumBenchmarkValues;
+
+		std::cout << generator.m_name << ": " << std::setprecision(3) << nanoseconds << "ns per float" << std::endl;
+
+		values.resize(NumTestValues);
+		generator.m_fill(values);
+		passed &= CheckUniform(values);
+		values.resize(NumBenchmarkValues);
+	}
+
+	bool lanesMatch = CheckLanesMatch();
+	std::cout << "Xoshiro128x8 lanes " << (lanesMatch ? "match" : "FAILED to match") << " the scalar generator" << std::endl;
+	passed &= lanesMatch;
+
+	std::cout << (passed ? "passed" : "FAILED") << std::endl;
+	return passed ? 0 : 1;
+}
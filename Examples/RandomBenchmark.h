@@ -0,0 +1,6 @@
+#pragma once
+
+// Times the random number generators per float and checks the floats they give look uniform: in [0, 1), the right
+// mean and variance, evenly spread over buckets and uncorrelated with the previous value. Returns 0 when every check
+// passes.
+int RunRandomBenchmark();
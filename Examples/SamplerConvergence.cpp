@@ -0,0 +1,121 @@
+#include "SamplerConvergence.h"
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "../RayTracing/Ray.h"
+#include "../RayTracing/RayEmitter.h"
+#include "../RayTracing/RayTracer.h"
+#include "../Utils/WorkerPool.h"
+#include "../World.h"
+
+namespace
+{
+	constexpr uint32_t Width = 128;
+	constexpr uint32_t Height = 96;
+	constexpr uint32_t ReferenceSamples = 2048;
+	// The reference takes its samples from far along the sequence so its noise is unrelated to that of the
+	// independent sampler's test renders.
+	constexpr uint32_t ReferenceFirstSample = 1u << 20;
+	constexpr uint32_t NumCheckpoints = 9;
+	constexpr uint32_t MaxSamples = 1u << (NumCheckpoints - 1);
+
+	const char* SamplerNames[] = { "Independent", "Stratified", "Sobol", "Blue noise" };
+
+	// Mean of each pixel's samples from firstSample on, straight from the path tracer so the error is not hidden by
+	// rounding to 8 bits.
+	void RenderReference(WorkerPool& workerPool, const RayTracer& rayTracer, const RayEmitter& rayEmitter,
+		const WorldSnapshot& world, std::vector<glm::vec3>& reference)
+	{
+		reference.assign(Width * Height, glm::vec3(0.0f));
+		workerPool.ParallelFor(Height, [&](uint32_t y, uint32_t workerIndex)
+		{
+			for (uint32_t x = 0; x < Width; x++)
+			{
+				Ray ray(rayEmitter.GetPosition(), rayEmitter.GetRayDirection(x, y));
+				glm::vec3 sum(0.0f);
+				for (uint32_t sample = 0; sample < ReferenceSamples; sample++)
+					sum += rayTracer.CalculatePixelColour(x, y, ReferenceFirstSample + sample, world, ray);
+
+				reference[y * Width + x] = sum / (float)ReferenceSamples;
+			}
+		});
+	}
+
+	// Squared error summed over the image after 1, 2, 4 ... MaxSamples samples per pixel.
+	void MeasureError(WorkerPool& workerPool, const RayTracer& rayTracer, const RayEmitter& rayEmitter,
+		const WorldSnapshot& world, const std::vector<glm::vec3>& reference, double (&squaredError)[NumCheckpoints])
+	{
+		std::vector<double> rowErrors(Height * NumCheckpoints, 0.0);
+		workerPool.ParallelFor(Height, [&](uint32_t y, uint32_t workerIndex)
+		{
+			double* rowError = &rowErrors[y * NumCheckpoints];
+			for (uint32_t x = 0; x < Width; x++)
+			{
+				Ray ray(rayEmitter.GetPosition(), rayEmitter.GetRayDirection(x, y));
+				glm::vec3 sum(0.0f);
+				uint32_t checkpoint = 0;
+				for (uint32_t sample = 0; sample < MaxSamples; sample++)
+				{
+					sum += rayTracer.CalculatePixelColour(x, y, sample, world, ray);
+					if (sample + 1 == 1u << checkpoint)
+					{
+						glm::vec3 difference = sum / (float)(sample + 1) - reference[y * Width + x];
+						rowError[checkpoint++] += glm::dot(difference, difference);
+					}
+				}
+			}
+		});
+
+		for (uint32_t checkpoint = 0; checkpoint < NumCheckpoints; checkpoint++)
+		{
+			squaredError[checkpoint] = 0.0;
+			for (uint32_t y = 0; y < Height; y++)
+				squaredError[checkpoint] += rowErrors[y * NumCheckpoints + checkpoint];
+		}
+	}
+}
+
+int RunSamplerConvergence()
+{
+	WorkerPool workerPool;
+	RayEmitter rayEmitter;
+	if (!workerPool.Initialise() || !rayEmitter.Initialise(glm::vec2((float)Width, (float)Height)))
+	{
+		std::cout << "FAILED: could not initialise" << std::endl;
+		return 1;
+	}
+
+	RayTracer rayTracer;
+	rayTracer.Initialise();
+	World world;
+	World::SnapshotHandle snapshot = world.AcquireSnapshot();
+
+	std::vector<glm::vec3> reference;
+	rayTracer.SetSamplerType(SamplerType::Independent);
+	RenderReference(workerPool, rayTracer, rayEmitter, *snapshot, reference);
+
+	std::cout << "RMSE against a " << ReferenceSamples << " sample reference, " << Width << "x" << Height << std::endl;
+	std::cout << std::setw(12) << "samples";
+	for (uint32_t checkpoint = 0; checkpoint < NumCheckpoints; checkpoint++)
+		std::cout << std::setw(10) << (1u << checkpoint);
+	std::cout << std::endl;
+
+	for (uint32_t samplerType = 0; samplerType < (uint32_t)std::size(SamplerNames); samplerType++)
+	{
+		rayTracer.SetSamplerType((SamplerType)samplerType);
+
+		double squaredError[NumCheckpoints];
+		MeasureError(workerPool, rayTracer, rayEmitter, *snapshot, reference, squaredError);
+
+		std::cout << std::setw(12) << SamplerNames[samplerType] << std::fixed << std::setprecision(5);
+		for (uint32_t checkpoint = 0; checkpoint < NumCheckpoints; checkpoint++)
+			std::cout << std::setw(10) << std::sqrt(squaredError[checkpoint] / (3.0 * Width * Height));
+		std::cout << std::defaultfloat << std::endl;
+	}
+
+	return 0;
+}
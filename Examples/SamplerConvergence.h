@@ -0,0 +1,5 @@
+#pragma once
+
+// Renders the default scene headless with each sampler and prints the RMSE against a high sample count reference at
+// every power of two sample count up to 256. Returns 0 when every render completed.
+int RunSamplerConvergence();
@@ -0,0 +1,178 @@
+#include "SamplingBenchmark.h"
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "../ScopedTimer.h"
+#include "../Utils/Pcg32.h"
+#include "../Utils/Sampling.h"
+
+namespace
+{
+	constexpr uint32_t NumBenchmarkSamples = 1u << 24;
+	constexpr uint32_t NumTestSamples = 1u << 20;
+	// Chi-squared one time in a thousand limits for uniform counts, by degrees of freedom.
+	constexpr double ChiSquaredLimit15 = 37.70;
+	constexpr double ChiSquaredLimit511 = 614.0;
+
+	// What RandomStream did before, for comparison.
+	glm::vec3 RejectionInUnitSphere(Pcg32& random)
+	{
+		while (true)
+		{
+			glm::vec3 p(random.Float() * 2.0f - 1.0f, random.Float() * 2.0f - 1.0f, random.Float() * 2.0f - 1.0f);
+			if (glm::dot(p, p) < 1.0f)
+				return p;
+		}
+	}
+
+	glm::vec3 RejectionUnitVector(Pcg32& random)
+	{
+		return glm::normalize(RejectionInUnitSphere(random));
+	}
+
+	// The old Lambertian scatter, a hemisphere vector from a normalised cube sample plus a unit vector.
+	glm::vec3 OldLambertian(Pcg32& random, const glm::vec3& normal)
+	{
+		glm::vec3 onSphere = glm::normalize(glm::vec3(random.Float() * 2.0f - 1.0f, random.Float() * 2.0f - 1.0f,
+			random.Float() * 2.0f - 1.0f));
+		glm::vec3 onHemisphere = glm::dot(onSphere, normal) > 0.0f ? onSphere : -onSphere;
+		return onHemisphere + RejectionUnitVector(random);
+	}
+
+	inline glm::vec2 Uniform2(Pcg32& random)
+	{
+		float x = random.Float();
+		float y = random.Float();
+		return glm::vec2(x, y);
+	}
+
+	template<typename SampleFunction>
+	void Time(const char* name, SampleFunction sampleFunction)
+	{
+		Pcg32 random;
+		glm::vec3 sum(0.0f);
+		ScopedTimer timer;
+		for (uint32_t i = 0; i < NumBenchmarkSamples; i++)
+			sum += sampleFunction(random);
+		double nanoseconds = timer.ElapsedTimeInMilliseconds() * 1.0e6 / NumBenchmarkSamples;
+
+		// Printing the sum keeps the work from being optimised away.
+		std::cout << std::setw(24) << name << ": " << std::fixed << std::setprecision(2) << nanoseconds
+			<< "ns per sample" << std::defaultfloat << " (" << sum.x + sum.y + sum.z << ")" << std::endl;
+	}
+
+	double ChiSquared(const std::vector<uint32_t>& bins, double expected)
+	{
+		double chiSquared = 0.0;
+		for (uint32_t count : bins)
+			chiSquared += (count - expected) * (count - expected) / expected;
+		return chiSquared;
+	}
+
+	bool Report(const char* name, bool unitLength, bool inDomain, double chiSquared, double limit)
+	{
+		bool passed = unitLength && inDomain && chiSquared < limit;
+		std::cout << std::setw(24) << name << ": chi-squared " << std::fixed << std::setprecision(1) << chiSquared
+			<< " (limit " << limit << ")" << std::defaultfloat << (unitLength ? "" : ", not unit length")
+			<< (inDomain ? "" : ", outside domain") << (passed ? "" : " FAILED") << std::endl;
+		return passed;
+	}
+
+	inline bool IsUnitLength(const glm::vec3& direction)
+	{
+		return std::abs(glm::length(direction) - 1.0f) < 1.0e-5f;
+	}
+
+	// Equal area bins: 16 bands of z, which is uniform for a uniform sphere, by 32 of azimuth.
+	bool CheckUniformSphere()
+	{
+		Pcg32 random;
+		std::vector<uint32_t> bins(16 * 32, 0);
+		bool unitLength = true;
+		for (uint32_t i = 0; i < NumTestSamples; i++)
+		{
+			glm::vec3 direction = Sampling::UniformSphere(Uniform2(random));
+			unitLength &= IsUnitLength(direction);
+			float phi = std::atan2(direction.y, direction.x) / (2.0f * glm::pi<float>()) + 0.5f;
+			uint32_t zBin = glm::min((uint32_t)((direction.z * 0.5f + 0.5f) * 16.0f), 15u);
+			uint32_t phiBin = glm::min((uint32_t)(phi * 32.0f), 31u);
+			bins[zBin * 32 + phiBin]++;
+		}
+		return Report("UniformSphere", unitLength, true, ChiSquared(bins, NumTestSamples / 512.0), ChiSquaredLimit511);
+	}
+
+	// Each of the hemisphere and cone mappings has some function of the cosine to the axis that is uniform on
+	// [0, 1] when the distribution is right. Checked about an axis pointing each way in z, where the basis switches
+	// sign, and one off axis.
+	template<typename SampleFunction, typename UniformFunction>
+	bool CheckAboutAxis(const char* name, SampleFunction sampleFunction, UniformFunction uniformFunction)
+	{
+		const glm::vec3 axes[] = { glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::normalize(glm::vec3(1.0f, -2.0f, 3.0f)) };
+
+		bool passed = true;
+		for (const glm::vec3& axis : axes)
+		{
+			Pcg32 random;
+			std::vector<uint32_t> bins(16, 0);
+			bool unitLength = true;
+			bool inDomain = true;
+			for (uint32_t i = 0; i < NumTestSamples; i++)
+			{
+				glm::vec3 direction = sampleFunction(Uniform2(random), axis);
+				unitLength &= IsUnitLength(direction);
+				float value = uniformFunction(glm::dot(direction, axis));
+				inDomain &= value >= -1.0e-5f && value <= 1.0f + 1.0e-5f;
+				bins[glm::clamp((int)(value * 16.0f), 0, 15)]++;
+			}
+			passed &= Report(name, unitLength, inDomain, ChiSquared(bins, NumTestSamples / 16.0), ChiSquaredLimit15);
+		}
+		return passed;
+	}
+
+	bool CheckSinCos()
+	{
+		float maxError = 0.0f;
+		for (uint32_t i = 0; i <= 1u << 16; i++)
+		{
+			float u = (float)i / (float)(1u << 16);
+			float sinAngle;
+			float cosAngle;
+			Sampling::SinCos2Pi(u, sinAngle, cosAngle);
+			double angle = 2.0 * 3.14159265358979323846 * u;
+			maxError = glm::max(maxError, (float)std::abs(sinAngle - std::sin(angle)));
+			maxError = glm::max(maxError, (float)std::abs(cosAngle - std::cos(angle)));
+		}
+
+		bool passed = maxError < 1.0e-6f;
+		std::cout << std::setw(24) << "SinCos2Pi" << ": max error " << maxError << (passed ? "" : " FAILED") << std::endl;
+		return passed;
+	}
+}
+
+int RunSamplingBenchmark()
+{
+	const glm::vec3 normal = glm::normalize(glm::vec3(1.0f, -2.0f, 3.0f));
+	constexpr float coneCosThetaMax = 0.8f;
+
+	Time("Rejection unit vector", [](Pcg32& random) { return RejectionUnitVector(random); });
+	Time("UniformSphere", [](Pcg32& random) { return Sampling::UniformSphere(Uniform2(random)); });
+	Time("Old Lambertian", [&](Pcg32& random) { return OldLambertian(random, normal); });
+	Time("CosineHemisphere", [&](Pcg32& random) { return Sampling::CosineHemisphere(Uniform2(random), normal); });
+	Time("UniformHemisphere", [&](Pcg32& random) { return Sampling::UniformHemisphere(Uniform2(random), normal); });
+	Time("UniformCone", [&](Pcg32& random) { return Sampling::UniformCone(Uniform2(random), normal, coneCosThetaMax); });
+
+	bool passed = CheckSinCos();
+	passed &= CheckUniformSphere();
+	passed &= CheckAboutAxis("UniformHemisphere", [](const glm::vec2& u, const glm::vec3& axis) { return Sampling::UniformHemisphere(u, axis); },
+		[](float cosTheta) { return cosTheta; });
+	passed &= CheckAboutAxis("CosineHemisphere", [](const glm::vec2& u, const glm::vec3& axis) { return Sampling::CosineHemisphere(u, axis); },
+		[](float cosTheta) { return cosTheta * cosTheta; });
+	passed &= CheckAboutAxis("UniformCone", [&](const glm::vec2& u, const glm::vec3& axis) { return Sampling::UniformCone(u, axis, coneCosThetaMax); },
+		[&](float cosTheta) { return (1.0f - cosTheta) / (1.0f - coneCosThetaMax); });
+
+	std::cout << (passed ? "passed" : "FAILED") << std::endl;
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Times each direction sampling routine per sample against the rejection sampling it replaced, and checks the
+// directions are unit length and follow the distribution they are meant to. Returns 0 when every check passes.
+int RunSamplingBenchmark();
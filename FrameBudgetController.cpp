@@ -0,0 +1,71 @@
+#include "FrameBudgetController.h"
+
+#include <algorithm>
+#include <glm/glm.hpp>
+
+FrameBudgetController::FrameBudgetController() :
+	m_enabled(false),
+	m_targetFrameTime(16.0f),
+	m_frameTimes(HistorySize, 0.0f),
+	m_tileSampleCosts(HistorySize, 0.0f),
+	m_historyIndex(0),
+	m_historyCount(0),
+	m_samplesPerFrame(1),
+	m_tilesPerFrame(0)
+{
+}
+
+FrameBudgetController::~FrameBudgetController()
+{
+}
+
+void FrameBudgetController::AddFrameTiming(float generationTime, uint32_t tilesTraced, uint32_t samplesPerFrame)
+{
+	// Cancelled frames that did no work tell us nothing about the cost.
+	if (tilesTraced == 0 || samplesPerFrame == 0)
+		return;
+
+	m_frameTimes[m_historyIndex] = generationTime;
+	m_tileSampleCosts[m_historyIndex] = generationTime / (float)(tilesTraced * samplesPerFrame);
+	m_historyIndex = (m_historyIndex + 1) % HistorySize;
+	m_historyCount = glm::min(m_historyCount + 1, HistorySize);
+}
+
+void FrameBudgetController::Update(uint32_t numTiles)
+{
+	if (!m_enabled || m_historyCount == 0 || numTiles == 0)
+	{
+		m_samplesPerFrame = 1;
+		m_tilesPerFrame = 0;
+		return;
+	}
+
+	// Use the median cost so a single hitch (e.g. a resize or the OS stealing a core) doesn't swing the work size.
+	std::vector<float> costs(m_tileSampleCosts.begin(), m_tileSampleCosts.begin() + m_historyCount);
+	std::nth_element(costs.begin(), costs.begin() + costs.size() / 2, costs.end());
+	float tileSampleCost = glm::max(costs[costs.size() / 2], 1.0e-6f);
+
+	float affordableTileSamples = m_targetFrameTime / tileSampleCost;
+	if (affordableTileSamples >= (float)numTiles)
+	{
+		m_tilesPerFrame = 0;
+		m_samplesPerFrame = glm::clamp((uint32_t)(affordableTileSamples / (float)numTiles), 1u, MaxSamplesPerFrame);
+	}
+	else
+	{
+		m_samplesPerFrame = 1;
+		m_tilesPerFrame = glm::max((uint32_t)affordableTileSamples, 1u);
+	}
+}
+
+float FrameBudgetController::GetAchievedFrameTime() const
+{
+	if (m_historyCount == 0)
+		return 0.0f;
+
+	float total = 0.0f;
+	for (size_t i = 0; i < m_historyCount; i++)
+		total += m_frameTimes[i];
+
+	return total / (float)m_historyCount;
+}
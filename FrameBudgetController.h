@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Chooses how much ray tracing work to do per frame so the trace time stays close to a target frame time.
+// The cost of one sample over one tile is estimated from the recent history of measured trace times. Spare budget is
+// spent on extra samples per pixel, and when even one sample over the whole image is too slow the image is spread
+// across several frames by tracing fewer tiles per frame.
+class FrameBudgetController
+{
+public:
+
+	FrameBudgetController();
+	~FrameBudgetController();
+
+	inline void SetEnabled(bool enabled)
+	{
+		m_enabled = enabled;
+	}
+
+	inline bool IsEnabled() const
+	{
+		return m_enabled;
+	}
+
+	inline void SetTargetFrameTime(float targetFrameTime)
+	{
+		m_targetFrameTime = targetFrameTime;
+	}
+
+	inline float GetTargetFrameTime() const
+	{
+		return m_targetFrameTime;
+	}
+
+	// Records a measured trace time (ms) along with the work that was done in that time.
+	void AddFrameTiming(float generationTime, uint32_t tilesTraced, uint32_t samplesPerFrame);
+
+	// Picks the samples and tiles for the next frame given the number of tiles in the image.
+	void Update(uint32_t numTiles);
+
+	inline uint32_t GetSamplesPerFrame() const
+	{
+		return m_samplesPerFrame;
+	}
+
+	// Zero means the whole image.
+	inline uint32_t GetTilesPerFrame() const
+	{
+		return m_tilesPerFrame;
+	}
+
+	// Average measured trace time over the history window.
+	float GetAchievedFrameTime() const;
+
+	// Ring buffer of recent trace times, the oldest entry is at GetFrameTimeHistoryOffset().
+	const std::vector<float>& GetFrameTimeHistory() const
+	{
+		return m_frameTimes;
+	}
+
+	inline int GetFrameTimeHistoryOffset() const
+	{
+		return (int)m_historyIndex;
+	}
+
+private:
+
+	static constexpr size_t HistorySize = 32;
+	static constexpr uint32_t MaxSamplesPerFrame = 64;
+
+	bool m_enabled;
+	float m_targetFrameTime;
+
+	// Ring buffers of the most recent trace times and the estimated cost of one sample over one tile.
+	std::vector<float> m_frameTimes;
+	std::vector<float> m_tileSampleCosts;
+	size_t m_historyIndex;
+	size_t m_historyCount;
+
+	uint32_t m_samplesPerFrame;
+	uint32_t m_tilesPerFrame;
+};
@@ -1,7 +1,54 @@
 #include "Application.h"
 
+#include <cstring>
+
+#include "Examples/AsyncRenderExample.h"
+#include "Examples/DeterminismCheck.h"
+#include "Examples/EnvironmentMapBenchmark.h"
+#include "Examples/LightSamplingBenchmark.h"
+#include "Examples/PathGuidingBenchmark.h"
+#include "Examples/RadianceCacheBenchmark.h"
+#include "Examples/RandomBenchmark.h"
+#include "Examples/SamplerConvergence.h"
+#include "Examples/SamplingBenchmark.h"
+
 int main(int argc, char** args) {
 
+	// Headless examples and checks, run instead of the interactive demo.
+	if (argc > 1 && strcmp(args[1], "--async-render-example") == 0)
+		return RunAsyncRenderExample();
+
+	if (argc > 1 && strcmp(args[1], "--determinism-check") == 0)
+		return RunDeterminismCheck();
+
+	if (argc > 1 && strcmp(args[1], "--sampler-convergence") == 0)
+		return RunSamplerConvergence();
+
+	if (argc > 1 && strcmp(args[1], "--random-benchmark") == 0)
+		return RunRandomBenchmark();
+
+	if (argc > 1 && strcmp(args[1], "--sampling-benchmark") == 0)
+		return RunSamplingBenchmark();
+
+	if (argc > 1 && strcmp(args[1], "--light-sampling-benchmark") == 0)
+		return RunLightSamplingBenchmark();
+
+	if (argc > 1 && strcmp(args[1], "--many-lights-benchmark") == 0)
+		return RunManyLightsBenchmark();
+
+	if (argc > 1 && strcmp(args[1], "--light-resampling-benchmark") == 0)
+		return RunLightResamplingBenchmark();
+
+	if (argc > 1 && strcmp(args[1], "--path-guiding-benchmark") == 0)
+		return RunPathGuidingBenchmark();
+
+	if (argc > 1 && strcmp(args[1], "--radiance-cache-benchmark") == 0)
+		return RunRadianceCacheBenchmark();
+
+	// Optionally followed by the name of a PFM or HDR file to time loading instead of the generated 8K sky.
+	if (argc > 1 && strcmp(args[1], "--environment-map-benchmark") == 0)
+		return RunEnvironmentMapBenchmark(argc > 2 ? args[2] : nullptr);
+
 	Application application;
 	if (!application.Initialise())
 		return 0;
@@ -2,7 +2,7 @@
 
 #include "../Materials/IMaterial.h"
 #include "../RayTracing/Ray.h"
-#include "../Utils/Random.h"
+#include "../Utils/RandomStream.h"
 
 class Diffuse : public IMaterial
 {
@@ -25,6 +25,11 @@ public:
 		return MaterialType::Diffuse;
 	};
 
+	virtual IMaterial* Clone() const override
+	{
+		return new Diffuse(*this);
+	}
+
 	inline glm::vec3 GetAlbedo() {
 		return m_albedo;
 	};
@@ -33,7 +38,7 @@ public:
 		m_albedo = albedo;
 	};
 
-	inline float GetRoughness() {
+	inline float GetRoughness() const {
 		return m_roughness;
 	};
 
@@ -45,7 +50,7 @@ public:
 		m_lightDirection = glm::normalize(lightDirection);
 	};
 
-	virtual glm::vec3 GetColourContribution(const RayCollisionData& rayCollisionData) override
+	virtual glm::vec3 GetColourContribution(const RayCollisionData& rayCollisionData) const override
 	{
 		glm::vec3 sphereColour = m_albedo;
 		float lightIntensity = glm::max(glm::dot(rayCollisionData.worldNormal, -m_lightDirection), 0.0f);
@@ -53,16 +58,21 @@ public:
 		return sphereColour;
 	}
 
-	virtual Ray GetNewRayDirection(const Ray& ray, const RayCollisionData& rayCollisionData) override
+	virtual Ray GetNewRayDirection(const Ray& ray, const RayCollisionData& rayCollisionData, RandomStream& random) const override
 	{
 		// Put the new origin at the hit location, but jiggle a bit so we don't collide with ourself
 		glm::vec3 newRayOrigin = rayCollisionData.worldPosition + rayCollisionData.worldNormal * 0.0001f;
-		glm::vec3 scatteredRayDirection = glm::reflect(ray.GetDirection(), rayCollisionData.worldNormal + m_roughness * Random::VectorInUnitSphere()/*Random::Vec3(-0.5f, 0.5f)*/);
+		glm::vec3 scatteredRayDirection = glm::reflect(ray.GetDirection(), rayCollisionData.worldNormal + m_roughness * random.RandomUnitVector());
 
 		return { newRayOrigin, scatteredRayDirection };
 
 	}
 
+	virtual void Scatter(ScatterBatch& batch) const override
+	{
+		ScatterEach(*this, batch);
+	}
+
 private:
 	glm::vec3 m_lightDirection;
 	float m_roughness;
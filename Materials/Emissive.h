@@ -1,7 +1,7 @@
 #pragma once
 
 #include "../Materials/IMaterial.h"
-#include "../Utils/Random.h"
+#include "../Utils/RandomStream.h"
 #include "../RayTracing/Ray.h"
 
 class Emissive : public IMaterial
@@ -18,26 +18,38 @@ public:
 		return MaterialType::Emissive;
 	};
 
-	glm::vec3 GetEmission() const { return m_albedo * m_emissionPower; }
+	virtual IMaterial* Clone() const override
+	{
+		return new Emissive(*this);
+	}
+
+	glm::vec3 GetEmission() const override { return m_albedo * m_emissionPower; }
+	// Lights absorb everything arriving at them.
+	glm::vec3 GetReflectance() const override { return glm::vec3(0.0f); }
 	glm::vec3 GetEmissionColour() const { return m_albedo; }
 	void SetEmissionColour(glm::vec3& emissionColour) { m_albedo = emissionColour; }
 	float GetEmissionPower() const { return m_emissionPower; }
 	void SetEmissionPower(float emissionPower) { m_emissionPower = emissionPower; }
 
-	virtual glm::vec3 GetColourContribution(const RayCollisionData& rayCollisionData) override
+	virtual glm::vec3 GetColourContribution(const RayCollisionData& rayCollisionData) const override
 	{
 		return GetEmission();
 	}
 
-	virtual Ray GetNewRayDirection(const Ray& ray, const RayCollisionData& rayCollisionData) override
+	virtual Ray GetNewRayDirection(const Ray& ray, const RayCollisionData& rayCollisionData, RandomStream& random) const override
 	{
 		// Put the new origin at the hit location, but jiggle a bit so we don't collide with ourself
 		glm::vec3 newRayOrigin = rayCollisionData.worldPosition + rayCollisionData.worldNormal * 0.0001f;
-		glm::vec3 scatteredRayDirection = glm::normalize(rayCollisionData.worldNormal * Random::VectorInUnitSphere());
+		glm::vec3 scatteredRayDirection = glm::normalize(rayCollisionData.worldNormal * random.RandomUnitVector());
 
 		return { newRayOrigin, scatteredRayDirection };
 	}
 
+	virtual void Scatter(ScatterBatch& batch) const override
+	{
+		ScatterEach(*this, batch);
+	}
+
 private:
 	float m_emissionPower = 0.0f;
 };
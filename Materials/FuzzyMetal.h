@@ -1,7 +1,7 @@
 #pragma once
 
 #include "../Materials/IMaterial.h"
-//#include "../Utils/Random.h"
+#include "../Utils/RandomStream.h"
 #include "../RayTracing/Ray.h"
 
 class FuzzyMetal : public IMaterial
@@ -23,7 +23,12 @@ public:
 		return MaterialType::FuzzyMetal;
 	};
 
-	inline float GetRoughness() {
+	virtual IMaterial* Clone() const override
+	{
+		return new FuzzyMetal(*this);
+	}
+
+	inline float GetRoughness() const {
 		return m_roughness;
 	};
 
@@ -31,15 +36,15 @@ public:
 		m_roughness = roughness;
 	};
 
-	inline virtual glm::vec3 GetColourContribution(const RayCollisionData& rayCollisionData) override
+	inline virtual glm::vec3 GetColourContribution(const RayCollisionData& rayCollisionData) const override
 	{
 		return m_albedo;
 	}
 
-	virtual Ray GetNewRayDirection(const Ray& ray, const RayCollisionData& rayCollisionData) override
+	virtual Ray GetNewRayDirection(const Ray& ray, const RayCollisionData& rayCollisionData, RandomStream& random) const override
 	{
-		glm::vec3 scatteredRayDirection = glm::reflect(ray.GetDirection(), rayCollisionData.worldNormal/* + roughness * Random::VectorInUnitSphere()*/);
-		scatteredRayDirection += m_roughness * Random::RandomUnitVector();
+		glm::vec3 scatteredRayDirection = glm::reflect(ray.GetDirection(), rayCollisionData.worldNormal/* + roughness * random.VectorInUnitSphere()*/);
+		scatteredRayDirection += m_roughness * random.RandomUnitVector();
 
 		if (glm::all(glm::lessThan(glm::abs(scatteredRayDirection), glm::vec3(0.0001f))))
 			scatteredRayDirection = rayCollisionData.worldNormal;
@@ -49,6 +54,11 @@ public:
 
 	}
 
+	virtual void Scatter(ScatterBatch& batch) const override
+	{
+		ScatterEach(*this, batch);
+	}
+
 private:
 	float m_roughness = 1.0f;
 };
\ No newline at end of file
@@ -2,8 +2,21 @@
 
 #include "glm/vec3.hpp"
 
-class Ray;
-struct RayCollisionData;
+#include "../RayTracing/Ray.h"
+#include "../Utils/RandomStream.h"
+
+// A run of hits on one material scattered in a single call. Every array holds m_count entries, the last two are
+// filled in by the material.
+struct ScatterBatch
+{
+	const Ray* m_rays = nullptr;
+	const RayCollisionData* m_hits = nullptr;
+	RandomStream* m_randoms = nullptr;
+
+	glm::vec3* m_contributions = nullptr;
+	Ray* m_scatteredRays = nullptr;
+	uint32_t m_count = 0;
+};
 
 enum class MaterialType
 {
@@ -25,6 +38,13 @@ public:
 	{
 	}
 
+	virtual ~IMaterial()
+	{
+	}
+
+	// Materials are shared between World versions, so edits are made to a copy.
+	virtual IMaterial* Clone() const = 0;
+
 	inline virtual MaterialType GetType() const = 0;
 
 	virtual inline glm::vec3 GetAlbedo() const
@@ -36,8 +56,56 @@ public:
 		m_albedo = albedo;
 	}
 
-	virtual glm::vec3 GetColourContribution(const RayCollisionData &rayCollisionData) = 0;
-	virtual Ray GetNewRayDirection(const Ray& ray, const RayCollisionData &rayCollisionData) = 0;
+	// Used by RayTracer::ShadingModel::Throughput. Light given off by the surface, and the fraction of the light
+	// arriving that it scatters on.
+	virtual inline glm::vec3 GetEmission() const
+	{
+		return glm::vec3(0.0f);
+	}
+
+	virtual inline glm::vec3 GetReflectance() const
+	{
+		return m_albedo;
+	}
+
+	// Used by light sampling. The density per unit solid angle with which GetNewRayDirection picks the outgoing
+	// direction, for materials whose GetReflectance is exactly the weight of the directions they pick, so that the
+	// light reflected towards the incoming ray from a direction is reflectance * pdf * light. Zero for materials where
+	// that can not be evaluated, such as mirrors, and lights are then not sampled from their surface.
+	virtual inline float GetScatterPdf(const RayCollisionData& rayCollisionData, const glm::vec3& incoming, const glm::vec3& outgoing) const
+	{
+		return 0.0f;
+	}
+
+	virtual glm::vec3 GetColourContribution(const RayCollisionData &rayCollisionData) const = 0;
+	// Random numbers are drawn from the stream of the path being traced, so the result is reproducible.
+	virtual Ray GetNewRayDirection(const Ray& ray, const RayCollisionData &rayCollisionData, RandomStream& random) const = 0;
+
+	// GetColourContribution and GetNewRayDirection for every hit in the batch.
+	virtual void Scatter(ScatterBatch& batch) const
+	{
+		for (uint32_t i = 0; i < batch.m_count; i++)
+		{
+			batch.m_contributions[i] = GetColourContribution(batch.m_hits[i]);
+			batch.m_scatteredRays[i] = GetNewRayDirection(batch.m_rays[i], batch.m_hits[i], batch.m_randoms[i]);
+		}
+	}
+
+protected:
+
+	// Runs the batch through MaterialT's own functions called directly rather than through the vtable, so materials
+	// overriding Scatter with this get a loop the compiler can inline and unroll.
+	template<typename MaterialT>
+	static void ScatterEach(const MaterialT& material, ScatterBatch& batch)
+	{
+		for (uint32_t i = 0; i < batch.m_count; i++)
+		{
+			batch.m_contributions[i] = material.MaterialT::GetColourContribution(batch.m_hits[i]);
+			batch.m_scatteredRays[i] = material.MaterialT::GetNewRayDirection(batch.m_rays[i], batch.m_hits[i], batch.m_randoms[i]);
+		}
+	}
+
+public:
 
 	glm::vec3 m_albedo;
 };
\ No newline at end of file
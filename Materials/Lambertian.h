@@ -1,7 +1,8 @@
 #pragma once
 
 #include "../Materials/IMaterial.h"
-#include "../Utils/Random.h"
+#include "../Utils/RandomStream.h"
+#include "../Utils/Sampling.h"
 #include "../RayTracing/Ray.h"
 
 class Lambertian : public IMaterial
@@ -17,22 +18,35 @@ public:
 		return MaterialType::Lambertian;
 	};
 
-	virtual glm::vec3 GetColourContribution(const RayCollisionData& rayCollisionData) override
+	virtual IMaterial* Clone() const override
+	{
+		return new Lambertian(*this);
+	}
+
+	virtual glm::vec3 GetColourContribution(const RayCollisionData& rayCollisionData) const override
 	{
 		return m_albedo;
 	}
 
-	virtual Ray GetNewRayDirection(const Ray& ray, const RayCollisionData& rayCollisionData) override
+	virtual float GetScatterPdf(const RayCollisionData& rayCollisionData, const glm::vec3& incoming, const glm::vec3& outgoing) const override
 	{
-		glm::vec3 scatteredRayDirection = Random::UnitSphereWithOnHemisphereCheck(rayCollisionData.worldNormal) + Random::RandomUnitVector();
+		return Sampling::CosineHemispherePdf(glm::dot(outgoing, rayCollisionData.worldNormal));
+	}
 
-		if (glm::all(glm::lessThan(glm::abs(scatteredRayDirection), glm::vec3(0.0001f))))
-			scatteredRayDirection = rayCollisionData.worldNormal;
+	virtual Ray GetNewRayDirection(const Ray& ray, const RayCollisionData& rayCollisionData, RandomStream& random) const override
+	{
+		// Cosine weighted, the distribution of an ideal diffuse surface. Never parallel to the surface or zero length.
+		glm::vec3 scatteredRayDirection = random.CosineWeightedHemisphere(rayCollisionData.worldNormal);
 
 		glm::vec3 newRayOrigin = rayCollisionData.worldPosition + rayCollisionData.worldNormal * 0.0001f;
 		return { newRayOrigin, scatteredRayDirection };
 	}
 
+	virtual void Scatter(ScatterBatch& batch) const override
+	{
+		ScatterEach(*this, batch);
+	}
+
 private:
 
 };
@@ -16,12 +16,17 @@ public:
 		 return MaterialType::Metal;
 	 };
 
-	 virtual glm::vec3 GetColourContribution(const RayCollisionData& rayCollisionData) override
+	virtual IMaterial* Clone() const override
+	{
+		return new Metal(*this);
+	}
+
+	 virtual glm::vec3 GetColourContribution(const RayCollisionData& rayCollisionData) const override
 	 {
 		 return m_albedo;
 	 }
 
-	virtual Ray GetNewRayDirection(const Ray& ray, const RayCollisionData& rayCollisionData) override
+	virtual Ray GetNewRayDirection(const Ray& ray, const RayCollisionData& rayCollisionData, RandomStream& random) const override
 	{
 		glm::vec3 scatteredRayDirection = glm::reflect(ray.GetDirection(), rayCollisionData.worldNormal);
 
@@ -33,6 +38,11 @@ public:
 
 	}
 
+	virtual void Scatter(ScatterBatch& batch) const override
+	{
+		ScatterEach(*this, batch);
+	}
+
 private:
 
 };
\ No newline at end of file
@@ -1,21 +1,67 @@
 #include "RayTracedImage.h"
 
-#include <execution>
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <numeric>
 #include "RayTracing/Ray.h"
 #include "RayTracing/RayEmitter.h"
 #include "RayTracing/RayTracer.h"
+#include "RayTracing/WavefrontIntegrator.h"
 #include "Utils/Utils.h"
+#include "Utils/WorkerPool.h"
+#include "World.h"
 
 RayTracedImage::RayTracedImage() :
 	m_pixels(nullptr),
-	m_dimensions(0.0f, 0.0f)
+	m_pixelBuffers{ nullptr, nullptr },
+	m_writeBuffer(0),
+	m_presentBuffer(1),
+	m_fillIndex(0),
+	m_traceInFlight(false),
+	m_numTilesInFlight(0),
+	m_lastTraceTime(0.0f),
+	m_workerPool(nullptr),
+	m_replicateScene(false),
+	m_dimensions(0.0f, 0.0f),
+	m_renderDimensions(0.0f, 0.0f),
+	m_resolutionScale(1),
+	m_samplesPerFrame(1),
+	m_tilesPerFrame(0),
+	m_nextTile(0),
+	m_costCellsX(0),
+	m_numSplitTiles(0),
+	m_tailIdleTime(0.0f),
+	m_tailIdleFraction(0.0f),
+	m_sampleIndexOffset(0),
+	m_tilesTraced(0),
+	m_tileOrderMode(TileOrder::Scanline),
+	m_integrator(Integrator::Megakernel),
+	m_sortHits(true),
+	m_luminanceMoments(nullptr),
+	m_adaptiveSampling(false),
+	m_noiseThreshold(0.02f),
+	m_adaptiveMinSamples(16),
+	m_showConvergence(false),
+	m_lightResampling(false),
+	m_reservoirs{ nullptr, nullptr },
+	m_reservoirWriteBuffer(0),
+	m_pathGuiding(false),
+	m_radianceCaching(false),
+	m_focusPoint(0.0f, 0.0f),
+	m_orderedFocusPoint(0.0f, 0.0f),
+	m_resetRequested(true),
+	m_awaitingFirstSample(false),
+	m_restartRequestTime(Clock::now().time_since_epoch().count()),
+	m_lastRestartLatency(0.0f),
+	m_worstRestartLatency(0.0f)
 {
-
 }
 
 RayTracedImage::~RayTracedImage()
 {
+	ResetFrameIndex();
+	EndFillPixels();
 	Destroy();
 }
 
@@ -23,109 +69,850 @@ void RayTracedImage::Destroy()
 {
 	if (m_accumulationSettings.m_data)
 	{
-		delete[] m_accumulationSettings.m_data;
+		WorkerPool::FreeFirstTouch(m_accumulationSettings.m_data);
 		m_accumulationSettings.m_data = 0;
 	}
 
-	if (m_pixels)
+	WorkerPool::FreeFirstTouch(m_luminanceMoments);
+	m_luminanceMoments = nullptr;
+
+	for (LightResampler::Reservoir*& reservoirs : m_reservoirs)
 	{
-		delete[] m_pixels;
+		WorkerPool::FreeFirstTouch(reservoirs);
+		reservoirs = nullptr;
 	}
+
+	for (uint32_t*& pixelBuffer : m_pixelBuffers)
+	{
+		WorkerPool::FreeFirstTouch(pixelBuffer);
+		pixelBuffer = nullptr;
+	}
+	m_pixels = nullptr;
+
+	m_nodeScenes.clear();
 }
 
-bool RayTracedImage::Initialise(glm::vec2 renderRect)
+bool RayTracedImage::Initialise(glm::vec2 renderRect, WorkerPool& workerPool)
 {
+	m_workerPool = &workerPool;
 	m_dimensions = renderRect;
+	m_renderDimensions = glm::ceil(m_dimensions / (float)m_resolutionScale);
+
+	size_t imageSize = (size_t)m_dimensions.x * (size_t)m_dimensions.y;
+
+	// The buffers are left untouched here so that FirstTouchBuffers decides which node each page lives on.
+	m_accumulationSettings.m_data = (glm::vec4*)WorkerPool::AllocateFirstTouch(imageSize * sizeof(glm::vec4));
+	m_luminanceMoments = (glm::vec2*)WorkerPool::AllocateFirstTouch(imageSize * sizeof(glm::vec2));
+	for (LightResampler::Reservoir*& reservoirs : m_reservoirs)
+		reservoirs = (LightResampler::Reservoir*)WorkerPool::AllocateFirstTouch(imageSize * sizeof(LightResampler::Reservoir));
 
-	m_accumulationSettings.m_data = new glm::vec4[(int)renderRect.x * (int)renderRect.y];
+	// Allocate memory for the pixel data that we will pass to a direct x texture. One buffer is traced into while the
+	// other is uploaded.
+	for (uint32_t*& pixelBuffer : m_pixelBuffers)
+		pixelBuffer = (uint32_t*)WorkerPool::AllocateFirstTouch(imageSize * sizeof(uint32_t));
 
-	m_xIndexIterator.resize((uint32_t)m_dimensions.x);
-	m_yIndexIterator.resize((uint32_t)m_dimensions.y);
-	for (uint32_t i = 0; i < m_dimensions.x; i++)
-		m_xIndexIterator[i] = i;
-	for (uint32_t i = 0; i < m_dimensions.y; i++)
-		m_yIndexIterator[i] = i;
+	m_writeBuffer = 0;
+	m_presentBuffer = 1;
+	m_pixels = m_pixelBuffers[m_writeBuffer];
 
-	int imageSize = (int)m_dimensions.x * (int)m_dimensions.y;
+	if (!m_accumulationSettings.m_data || !m_luminanceMoments || !m_reservoirs[0] || !m_reservoirs[1] || !m_pixelBuffers[0] ||
+		!m_pixelBuffers[1])
+	{
+		std::cout << "failed to allocate image buffers" << std::endl;
+		return false;
+	}
+
+	FirstTouchBuffers();
+	ResetTileCosts();
+	BuildTiles();
 
-	// Allocate memory for the pixel data that we will pass to a direct x texture.
-	m_pixels = new uint32_t[imageSize];
+	m_workerTimings.assign(m_workerPool->GetNumWorkers(), WorkerTiming());
 
 	return true;
 }
 
+// Splits both buffers into one contiguous band per node and has a worker on that node write its band first, which
+// places the pages in that node's memory. Tiles are then dispatched to the node owning their band.
+void RayTracedImage::FirstTouchBuffers()
+{
+	uint32_t numNodes = m_workerPool->GetNumNodes();
+	size_t imageSize = (size_t)m_dimensions.x * (size_t)m_dimensions.y;
+
+	m_workerPool->RunOnEachNode([this, numNodes, imageSize](uint32_t node)
+		{
+			size_t first = imageSize * node / numNodes;
+			size_t last = imageSize * (node + 1) / numNodes;
+			memset(m_accumulationSettings.m_data + first, 0, (last - first) * sizeof(glm::vec4));
+			memset(m_luminanceMoments + first, 0, (last - first) * sizeof(glm::vec2));
+			for (LightResampler::Reservoir* reservoirs : m_reservoirs)
+				memset(reservoirs + first, 0, (last - first) * sizeof(LightResampler::Reservoir));
+			for (uint32_t* pixelBuffer : m_pixelBuffers)
+				memset(pixelBuffer + first, 0, (last - first) * sizeof(uint32_t));
+		});
+}
+
+uint32_t RayTracedImage::GetTileNode(const RenderTile& tile) const
+{
+	// The accumulation buffer is indexed at the internal resolution, so at reduced resolution the tile's rows sit
+	// nearer the start of the buffer than its output pixels do. Follow the accumulation buffer, it is read and
+	// written for every sample.
+	uint64_t numNodes = m_workerPool->GetNumNodes();
+	uint64_t firstElement = (uint64_t)tile.m_minY * (uint64_t)m_renderDimensions.x;
+	uint64_t imageSize = (uint64_t)m_dimensions.x * (uint64_t)m_dimensions.y;
+	return (uint32_t)glm::min(firstElement * numNodes / imageSize, numNodes - 1);
+}
+
+void RayTracedImage::BuildDispatchList(size_t firstTile, size_t lastTile)
+{
+	uint32_t numNodes = m_workerPool->GetNumNodes();
+
+	// Counting sort by node, stable so each node still traces its tiles in priority order.
+	m_dispatchNodeOffsets.assign(numNodes + 1, 0);
+	for (size_t i = firstTile; i < lastTile; i++)
+		m_dispatchNodeOffsets[GetTileNode(m_tiles[m_tileOrder[i]]) + 1]++;
+
+	for (uint32_t node = 0; node < numNodes; node++)
+		m_dispatchNodeOffsets[node + 1] += m_dispatchNodeOffsets[node];
+
+	std::vector<uint32_t> insertPositions(m_dispatchNodeOffsets.begin(), m_dispatchNodeOffsets.end() - 1);
+	m_dispatchTiles.resize(lastTile - firstTile);
+	for (size_t i = firstTile; i < lastTile; i++)
+	{
+		uint32_t tileIndex = m_tileOrder[i];
+		m_dispatchTiles[insertPositions[GetTileNode(m_tiles[tileIndex])]++] = tileIndex;
+	}
+}
+
+void RayTracedImage::UpdateNodeScenes(const WorldSnapshot& world)
+{
+	uint32_t numNodes = m_workerPool->GetNumNodes();
+	if (m_nodeScenes.size() == numNodes && m_nodeScenes[0]->GetVersion() == world.GetVersion())
+		return;
+
+	// Each copy is made by a worker on its node so the allocations come from that node's memory.
+	m_nodeScenes.resize(numNodes);
+	m_workerPool->RunOnEachNode([this, &world](uint32_t node)
+		{
+			m_nodeScenes[node] = world.Replicate();
+		});
+}
+
+void RayTracedImage::BuildTiles()
+{
+	m_tiles.clear();
+	m_numSplitTiles = 0;
+
+	// Split any tile expected to take more than a quarter of one worker's share of the pass, so no single tile can
+	// hold up the end of the frame for long.
+	float splitCost = std::numeric_limits<float>::max();
+	if (m_tileOrderMode == TileOrder::CostGuided)
+	{
+		float totalCost = std::accumulate(m_cellCosts.begin(), m_cellCosts.end(), 0.0f);
+		if (totalCost > 0.0f)
+			splitCost = totalCost / (float)(glm::max(m_workerPool->GetNumWorkers(), 1u) * 4);
+	}
+
+	uint32_t width = (uint32_t)m_renderDimensions.x;
+	uint32_t height = (uint32_t)m_renderDimensions.y;
+	for (uint32_t y = 0; y < height; y += TileSize)
+	{
+		for (uint32_t x = 0; x < width; x += TileSize)
+		{
+			RenderTile tile;
+			tile.m_minX = x;
+			tile.m_minY = y;
+			tile.m_maxX = glm::min(x + TileSize, width);
+			tile.m_maxY = glm::min(y + TileSize, height);
+
+			if (GetTileCost(tile) <= splitCost)
+			{
+				m_tiles.push_back(tile);
+				continue;
+			}
+
+			m_numSplitTiles++;
+			for (uint32_t subY = tile.m_minY; subY < tile.m_maxY; subY += CostCellSize)
+			{
+				for (uint32_t subX = tile.m_minX; subX < tile.m_maxX; subX += CostCellSize)
+				{
+					RenderTile subTile;
+					subTile.m_minX = subX;
+					subTile.m_minY = subY;
+					subTile.m_maxX = glm::min(subX + CostCellSize, tile.m_maxX);
+					subTile.m_maxY = glm::min(subY + CostCellSize, tile.m_maxY);
+					m_tiles.push_back(subTile);
+				}
+			}
+		}
+	}
+
+	m_tileOrder.resize(m_tiles.size());
+	m_tileFillIndex.assign(m_tiles.size(), 0);
+	std::iota(m_tileOrder.begin(), m_tileOrder.end(), 0);
+}
+
+void RayTracedImage::OrderTiles(size_t firstTile)
+{
+	if (m_tileOrderMode == TileOrder::Scanline)
+	{
+		std::sort(m_tileOrder.begin() + firstTile, m_tileOrder.end());
+		return;
+	}
+
+	if (m_tileOrderMode == TileOrder::CostGuided)
+	{
+		// Longest first, ties in scanline order. Tiles not traced yet cost zero and go last.
+		std::stable_sort(m_tileOrder.begin() + firstTile, m_tileOrder.end(),
+			[this](uint32_t a, uint32_t b)
+			{
+				return GetTileCost(m_tiles[a]) > GetTileCost(m_tiles[b]);
+			});
+		return;
+	}
+
+	glm::vec2 focusPoint = m_tileOrderMode == TileOrder::CursorDistance ? m_focusPoint : m_dimensions * 0.5f;
+	m_orderedFocusPoint = focusPoint;
+
+	// Tiles are in internal resolution pixels, the focus point is in output pixels.
+	float resolutionScale = (float)m_resolutionScale;
+	auto distanceToFocus = [this, focusPoint, resolutionScale](uint32_t tileIndex)
+	{
+		const RenderTile& tile = m_tiles[tileIndex];
+		glm::vec2 tileCentre = glm::vec2((float)(tile.m_minX + tile.m_maxX), (float)(tile.m_minY + tile.m_maxY)) * 0.5f * resolutionScale;
+		glm::vec2 offset = tileCentre - focusPoint;
+		return glm::dot(offset, offset);
+	};
+
+	std::sort(m_tileOrder.begin() + firstTile, m_tileOrder.end(),
+		[&distanceToFocus](uint32_t a, uint32_t b)
+		{
+			return distanceToFocus(a) < distanceToFocus(b);
+		});
+}
+
+void RayTracedImage::ResetTileCosts()
+{
+	m_costCellsX = ((uint32_t)m_renderDimensions.x + CostCellSize - 1) / CostCellSize;
+	uint32_t costCellsY = ((uint32_t)m_renderDimensions.y + CostCellSize - 1) / CostCellSize;
+	m_cellCosts.assign((size_t)m_costCellsX * costCellsY, 0.0f);
+}
+
+float RayTracedImage::GetTileCost(const RenderTile& tile) const
+{
+	float cost = 0.0f;
+	for (uint32_t cellY = tile.m_minY / CostCellSize; cellY * CostCellSize < tile.m_maxY; cellY++)
+	{
+		for (uint32_t cellX = tile.m_minX / CostCellSize; cellX * CostCellSize < tile.m_maxX; cellX++)
+			cost += m_cellCosts[cellX + cellY * m_costCellsX];
+	}
+
+	return cost;
+}
+
+// Spreads the tile's cost evenly over the cells it covers. Tiles never share cells, so workers can record costs
+// without synchronising.
+void RayTracedImage::RecordTileCost(const RenderTile& tile, float cost)
+{
+	uint32_t firstCellX = tile.m_minX / CostCellSize;
+	uint32_t firstCellY = tile.m_minY / CostCellSize;
+	uint32_t endCellX = (tile.m_maxX + CostCellSize - 1) / CostCellSize;
+	uint32_t endCellY = (tile.m_maxY + CostCellSize - 1) / CostCellSize;
+	float cellCost = cost / (float)((endCellX - firstCellX) * (endCellY - firstCellY));
+
+	for (uint32_t cellY = firstCellY; cellY < endCellY; cellY++)
+	{
+		for (uint32_t cellX = firstCellX; cellX < endCellX; cellX++)
+			m_cellCosts[cellX + cellY * m_costCellsX] = cellCost;
+	}
+}
+
+// Runs on the worker completing the trace, once every worker has finished its last tile.
+void RayTracedImage::MeasureTailIdle()
+{
+	long long traceStart = m_traceStartTime.time_since_epoch().count();
+	long long traceEnd = Clock::now().time_since_epoch().count();
+
+	long long totalIdle = 0;
+	for (const WorkerTiming& workerTiming : m_workerTimings)
+		totalIdle += traceEnd - glm::max(workerTiming.m_lastTileEnd, traceStart);
+
+	double averageIdle = std::chrono::duration<double, std::milli>(Clock::duration(totalIdle)).count() / (double)glm::max<size_t>(m_workerTimings.size(), 1);
+	m_tailIdleTime = (float)averageIdle;
+	m_tailIdleFraction = m_lastTraceTime > 0.0f ? (float)averageIdle / m_lastTraceTime : 0.0f;
+}
+
+void RayTracedImage::SetResolutionScale(uint32_t resolutionScale)
+{
+	resolutionScale = glm::max(resolutionScale, 1u);
+	if (resolutionScale == m_resolutionScale)
+		return;
+
+	// Finish with the current tile list before replacing it.
+	ResetFrameIndex();
+	EndFillPixels();
+
+	// The buffers are allocated for full resolution, so a lower internal resolution just uses the front of the
+	// accumulation buffer. Only the tile list is rebuilt, reusing its storage.
+	m_resolutionScale = resolutionScale;
+	m_renderDimensions = glm::ceil(m_dimensions / (float)m_resolutionScale);
+	ResetTileCosts();
+	BuildTiles();
+
+	m_nextTile = 0;
+}
+
+void RayTracedImage::ResetFrameIndex(Clock::time_point requestTime)
+{
+	// Only the first request since the last restart starts the latency clock.
+	if (!m_resetRequested.exchange(true))
+		m_restartRequestTime.store(requestTime.time_since_epoch().count(), std::memory_order_relaxed);
+
+	m_cancellationToken.Cancel();
+}
+
 uint32_t* RayTracedImage::FillPixels(const RayTracer& rayTracer, const RayEmitter& rayEmitter, const World& world)
+{
+	if (!BeginFillPixels(rayTracer, rayEmitter, world))
+		return nullptr;
+
+	return EndFillPixels();
+}
+
+bool RayTracedImage::PrepareTrace(const RayEmitter& rayEmitter)
 {
 	assert(m_pixels != nullptr);
+	assert(!m_traceInFlight);
 
 	if (!rayEmitter.Ready())
 	{
 		std::cout << "ray emitter not initialised" << std::endl;
-		return nullptr;
+		return false;
 	}
 
-	if (m_accumulationSettings.m_frameIndex == 1)
-		memset(m_accumulationSettings.m_data, 0, (size_t)m_dimensions.x * (size_t)m_dimensions.y * (size_t)sizeof(glm::vec4));
+	// Clear the token before consuming the reset request so that a reset arriving in between cancels this frame
+	// rather than being lost.
+	m_cancellationToken.Reset();
+	if (m_resetRequested.exchange(false))
+	{
+		m_accumulationSettings.m_frameIndex = 1;
+		m_nextTile = 0;
+		m_sampleIndexOffset = 0;
+		m_awaitingFirstSample = true;
+
+		// Nothing from before the restart is reused. Zeroed reservoirs are empty.
+		memset(m_reservoirs[1 - m_reservoirWriteBuffer], 0, (size_t)m_renderDimensions.x * (size_t)m_renderDimensions.y *
+			sizeof(LightResampler::Reservoir));
+	}
+
+	// Cost guided passes re-split the tiles from the latest costs. Switching away from it goes back to whole tiles.
+	if (m_nextTile == 0 && (m_tileOrderMode == TileOrder::CostGuided || m_numSplitTiles > 0))
+		BuildTiles();
+
+	// A pass over the whole image can be spread across several calls when only a budgeted number of tiles are traced
+	// per call. The frame index counts complete passes.
+	// A pass part way through when the budget is lifted finishes its remaining tiles.
+	size_t numTiles = m_tiles.size() - m_nextTile;
+	if (m_tilesPerFrame != 0)
+		numTiles = glm::min<size_t>(m_tilesPerFrame, numTiles);
+
+	// Order the pass so the tiles nearest the point of interest are traced first. When a pass spans several calls the
+	// untraced remainder is re-ordered if the point of interest has moved, so priority follows the cursor.
+	glm::vec2 focusPoint = m_tileOrderMode == TileOrder::CursorDistance ? m_focusPoint : m_dimensions * 0.5f;
+	bool focusOrdered = m_tileOrderMode == TileOrder::CursorDistance || m_tileOrderMode == TileOrder::ScreenCentre;
+	if (m_nextTile == 0 || (focusOrdered && glm::distance(focusPoint, m_orderedFocusPoint) > (float)TileSize))
+	{
+		OrderTiles(m_nextTile);
+	}
+
+	m_numTilesInFlight = numTiles;
+	m_tilesTraced = 0;
+	m_fillIndex++;
+	m_traceInFlight = true;
+	m_traceStartTime = Clock::now();
+
+	if (m_accumulationSettings.m_frameIndex == 1 && m_nextTile == 0)
+	{
+		memset(m_accumulationSettings.m_data, 0, (size_t)m_renderDimensions.x * (size_t)m_renderDimensions.y * (size_t)sizeof(glm::vec4));
+		memset(m_luminanceMoments, 0, (size_t)m_renderDimensions.x * (size_t)m_renderDimensions.y * (size_t)sizeof(glm::vec2));
+	}
+
+	// Workers claim tiles in order from their own node's range first, so execution follows the priority order within
+	// each node and only moves to another node's tiles once their own are all taken.
+	BuildDispatchList(m_nextTile, m_nextTile + m_numTilesInFlight);
+
+	return true;
+}
+
+bool RayTracedImage::BeginFillPixels(const RayTracer& rayTracer, const RayEmitter& rayEmitter, const World& world)
+{
+	if (!PrepareTrace(rayEmitter))
+		return false;
+
+	// Pin one version of the scene for the whole frame. Edits made while tracing are published as new versions and
+	// picked up by the next frame.
+	m_tracedSnapshot = std::make_unique<World::SnapshotHandle>(world.AcquireSnapshot());
+	const WorldSnapshot* snapshot = m_tracedSnapshot->Get();
+	if (m_pathGuiding)
+		m_pathGuide.Prepare(*snapshot);
+	if (m_radianceCaching)
+		m_radianceCache.Prepare(*snapshot, rayTracer.GetPathSettings());
+
+	if (m_replicateScene)
+		UpdateNodeScenes(*snapshot);
+	else
+		m_nodeScenes.clear();
 
 #define MULTITHREADED 1
 #if MULTITHREADED
-	std::for_each(std::execution::par, m_yIndexIterator.begin(), m_yIndexIterator.end(),
-		[this, &rayTracer, &rayEmitter, &world](uint32_t y)
+	m_traceJob = m_workerPool->Dispatch((uint32_t)m_dispatchTiles.size(), m_dispatchNodeOffsets,
+		[this, &rayTracer, &rayEmitter, snapshot](uint32_t item, uint32_t workerIndex)
 		{
-			std::for_each(std::execution::par, m_xIndexIterator.begin(), m_xIndexIterator.end(),
-			[this, &rayTracer, &rayEmitter, &world, y](uint32_t x)
-				{
-					Ray ray(rayEmitter.GetPosition(), rayEmitter.GetRayDirection(x, y));
-					ProcessPixel(m_pixels, x, y, ray, rayTracer, world);
-				});
+			if (m_cancellationToken.IsCancelled())
+				return;
+
+			const WorldSnapshot& nodeWorld = m_nodeScenes.empty() ? *snapshot : *m_nodeScenes[m_workerPool->GetWorkerNode(workerIndex)];
+			ProcessTile(m_dispatchTiles[item], rayTracer, rayEmitter, nodeWorld);
+			m_workerTimings[workerIndex].m_lastTileEnd = Clock::now().time_since_epoch().count();
+		},
+		[this]()
+		{
+			m_lastTraceTime = (float)std::chrono::duration<double, std::milli>(Clock::now() - m_traceStartTime).count();
+			MeasureTailIdle();
 		});
 
 #else
 
-	for (int y = 0; y < m_dimensions.y; y++)
+	for (size_t tile = m_nextTile; tile != m_nextTile + m_numTilesInFlight; tile++)
 	{
-		for (int x = 0; x < m_dimensions.x; x++)
-		{
-			Ray ray(rayEmitter.GetPosition(), rayEmitter.GetRayDirection(x, y));
-			ProcessPixel(m_pixels, x, y, ray, rayTracer, world);
-		}
+		ProcessTile(m_tileOrder[tile], rayTracer, rayEmitter, *snapshot);
 	}
+	m_lastTraceTime = (float)std::chrono::duration<double, std::milli>(Clock::now() - m_traceStartTime).count();
 #endif
 
+	return true;
+}
+
+uint32_t* RayTracedImage::EndFillPixels()
+{
+	if (!m_traceInFlight)
+		return GetPresentPixels();
+
+	if (m_traceJob)
+	{
+		m_workerPool->Wait(m_traceJob);
+		m_traceJob.reset();
+	}
+
+	m_tracedSnapshot.reset();
+	FinishTrace();
+
+	return GetPresentPixels();
+}
+
+void RayTracedImage::FinishTrace()
+{
+	m_traceInFlight = false;
+
+	// Only the traced tiles were written to this buffer, bring the rest over from the previous one so it holds the
+	// whole image. Nothing is copied when a full pass was traced.
+	uint32_t* previousPixels = m_pixelBuffers[1 - m_writeBuffer];
+	for (uint32_t tileIndex = 0; tileIndex < m_tiles.size(); tileIndex++)
+	{
+		if (m_tileFillIndex[tileIndex] != m_fillIndex)
+			CopyTileOutput(m_tiles[tileIndex], previousPixels, m_pixels);
+	}
+
+	// The finished buffer is handed out for upload and the next trace writes into the other one.
+	m_presentBuffer = m_writeBuffer;
+	m_writeBuffer = 1 - m_writeBuffer;
+	m_pixels = m_pixelBuffers[m_writeBuffer];
+
+	// The frame was abandoned part way through. Leave the frame index alone, the pending reset will clear the
+	// partially accumulated tiles at the start of the next call.
+	if (m_cancellationToken.IsCancelled())
+		return;
+
+	m_nextTile += m_numTilesInFlight;
+	if (m_nextTile < m_tiles.size())
+		return;
+
+	m_nextTile = 0;
+	m_reservoirWriteBuffer = 1 - m_reservoirWriteBuffer;
+	if (m_pathGuiding)
+		m_pathGuide.EndPass();
+	if (m_radianceCaching)
+		m_radianceCache.EndPass();
 	if (m_accumulationSettings.m_accumulate)
 	{
 		m_accumulationSettings.m_frameIndex++;
 	}
 	else
 	{
+		// The sample counts are cleared every pass, move on to fresh sample numbers so the noise still changes.
 		m_accumulationSettings.m_frameIndex = 1;
+		m_sampleIndexOffset += m_samplesPerFrame;
 	}
+}
+
+bool RayTracedImage::FillPixelsMultiView(const std::vector<View>& views, const RayTracer& rayTracer, const World& world)
+{
+	assert(!views.empty());
+
+	RayTracedImage& primary = *views[0].m_image;
+	WorkerPool& workerPool = *primary.m_workerPool;
+	for (const View& view : views)
+	{
+		assert(view.m_image->m_workerPool == &workerPool);
+		view.m_image->EndFillPixels();
+	}
+
+	// Check every view up front so none is left prepared without being traced.
+	for (const View& view : views)
+	{
+		if (!view.m_rayEmitter->Ready())
+		{
+			std::cout << "ray emitter not initialised" << std::endl;
+			return false;
+		}
+	}
+
+	for (const View& view : views)
+		view.m_image->PrepareTrace(*view.m_rayEmitter);
+
+	// One pinned version and one set of node copies serves every view. The node copies are kept by the first view.
+	World::SnapshotHandle snapshotHandle = world.AcquireSnapshot();
+	const WorldSnapshot& snapshot = *snapshotHandle;
+	for (const View& view : views)
+	{
+		if (view.m_image->m_pathGuiding)
+			view.m_image->m_pathGuide.Prepare(snapshot);
+		if (view.m_image->m_radianceCaching)
+			view.m_image->m_radianceCache.Prepare(snapshot, rayTracer.GetPathSettings());
+	}
+
+	if (primary.m_replicateScene)
+		primary.UpdateNodeScenes(snapshot);
+	else
+		primary.m_nodeScenes.clear();
+
+	const std::vector<std::unique_ptr<WorldSnapshot>>& nodeScenes = primary.m_nodeScenes;
+
+	// Merge the views' dispatch lists node by node, so every view's tiles are spread over the whole pool and a worker
+	// finishing one view moves straight on to the next instead of waiting for the slowest worker.
+	struct BatchTile
+	{
+		const View* m_view;
+		uint32_t m_tileIndex;
+	};
+	uint32_t numNodes = workerPool.GetNumNodes();
+	std::vector<BatchTile> batchTiles;
+	std::vector<uint32_t> nodeOffsets(numNodes + 1, 0);
+	for (uint32_t node = 0; node < numNodes; node++)
+	{
+		nodeOffsets[node] = (uint32_t)batchTiles.size();
+		for (const View& view : views)
+		{
+			const RayTracedImage& image = *view.m_image;
+			for (uint32_t item = image.m_dispatchNodeOffsets[node]; item < image.m_dispatchNodeOffsets[node + 1]; item++)
+				batchTiles.push_back({ &view, image.m_dispatchTiles[item] });
+		}
+	}
+	nodeOffsets[numNodes] = (uint32_t)batchTiles.size();
+
+	Clock::time_point traceStart = Clock::now();
+	primary.m_traceStartTime = traceStart;
+	workerPool.ParallelFor((uint32_t)batchTiles.size(), nodeOffsets,
+		[&](uint32_t item, uint32_t workerIndex)
+		{
+			const BatchTile& batchTile = batchTiles[item];
+			RayTracedImage& image = *batchTile.m_view->m_image;
+			if (image.m_cancellationToken.IsCancelled())
+				return;
 
-	return m_pixels;
+			const WorldSnapshot& nodeWorld = nodeScenes.empty() ? snapshot : *nodeScenes[workerPool.GetWorkerNode(workerIndex)];
+			image.ProcessTile(batchTile.m_tileIndex, rayTracer, *batchTile.m_view->m_rayEmitter, nodeWorld);
+			// Tail idle is measured over the whole batch, so it is all recorded against the first view.
+			primary.m_workerTimings[workerIndex].m_lastTileEnd = Clock::now().time_since_epoch().count();
+		});
+
+	float traceTime = (float)std::chrono::duration<double, std::milli>(Clock::now() - traceStart).count();
+	primary.m_lastTraceTime = traceTime;
+	primary.MeasureTailIdle();
+
+	for (const View& view : views)
+	{
+		view.m_image->m_lastTraceTime = traceTime;
+		view.m_image->FinishTrace();
+	}
+
+	return true;
+}
+
+void RayTracedImage::CopyTileOutput(const RenderTile& tile, const uint32_t* source, uint32_t* destination) const
+{
+	uint32_t width = (uint32_t)m_dimensions.x;
+	uint32_t minX = tile.m_minX * m_resolutionScale;
+	uint32_t maxX = glm::min(tile.m_maxX * m_resolutionScale, width);
+	uint32_t maxY = glm::min(tile.m_maxY * m_resolutionScale, (uint32_t)m_dimensions.y);
+	for (uint32_t y = tile.m_minY * m_resolutionScale; y < maxY; y++)
+		memcpy(destination + minX + y * width, source + minX + y * width, (maxX - minX) * sizeof(uint32_t));
+}
+
+void RayTracedImage::ProcessTile(uint32_t tileIndex, const RayTracer& rayTracer, const RayEmitter& rayEmitter, const WorldSnapshot& world)
+{
+	// Checked once per tile, so a cancel takes at most one tile's trace time per worker to take effect.
+	if (m_cancellationToken.IsCancelled())
+		return;
+
+	Clock::time_point tileStart = Clock::now();
+
+	const RenderTile& tile = m_tiles[tileIndex];
+	uint32_t samplesPerPixel = m_adaptiveSampling ? GetAdaptiveSamplesPerPixel(tile) : m_samplesPerFrame;
+	if (m_integrator == Integrator::Wavefront && !m_lightResampling && !m_pathGuiding && !m_radianceCaching)
+	{
+		ProcessTileWavefront(tile, samplesPerPixel, rayTracer, rayEmitter, world);
+	}
+	else
+	{
+		for (uint32_t y = tile.m_minY; y < tile.m_maxY; y++)
+		{
+			for (uint32_t x = tile.m_minX; x < tile.m_maxX; x++)
+				ProcessPixel(m_pixels, x, y, GetPixelSamples(x, y, samplesPerPixel), GetCameraRay(x, y, rayEmitter), rayTracer, world);
+		}
+	}
+
+	// Per sample, so the costs stay comparable when the samples per frame change.
+	float tileCost = (float)std::chrono::duration<double, std::milli>(Clock::now() - tileStart).count();
+	RecordTileCost(tile, tileCost / (float)m_samplesPerFrame);
+
+	m_tileFillIndex[tileIndex] = m_fillIndex;
+	m_tilesTraced.fetch_add(1, std::memory_order_relaxed);
+
+	if (m_awaitingFirstSample.exchange(false))
+	{
+		long long elapsedTicks = Clock::now().time_since_epoch().count() - m_restartRequestTime.load(std::memory_order_relaxed);
+		float latency = (float)(std::chrono::duration<double, std::milli>(Clock::duration(elapsedTicks)).count());
+		m_lastRestartLatency.store(latency, std::memory_order_relaxed);
+		if (latency > m_worstRestartLatency.load(std::memory_order_relaxed))
+			m_worstRestartLatency.store(latency, std::memory_order_relaxed);
+	}
+}
+
+Ray RayTracedImage::GetCameraRay(uint32_t x, uint32_t y, const RayEmitter& rayEmitter) const
+{
+	// At reduced resolution each traced pixel covers a block of output pixels, use the ray through its centre.
+	uint32_t outputX = glm::min(x * m_resolutionScale + m_resolutionScale / 2, (uint32_t)m_dimensions.x - 1);
+	uint32_t outputY = glm::min(y * m_resolutionScale + m_resolutionScale / 2, (uint32_t)m_dimensions.y - 1);
+
+	return Ray(rayEmitter.GetPosition(), rayEmitter.GetRayDirection(outputX, outputY));
 }
 
-bool RayTracedImage::ProcessPixel(uint32_t* pixels, int x, int y, const Ray& ray, const RayTracer& rayTracer, const World &world)
+uint32_t RayTracedImage::GetFirstSampleIndex(int x, int y) const
 {
-	glm::vec3 colour = rayTracer.CalculatePixelColour(x, y, 10, world, ray);
+	// Samples are numbered by how many the pixel already holds, so every sample of a pixel gets different random
+	// numbers and the result does not depend on which thread traces the tile or when.
+	return (uint32_t)m_accumulationSettings.m_data[x + y * (int)m_renderDimensions.x].w + m_sampleIndexOffset;
+}
 
-	m_accumulationSettings.m_data[x + y * (int)m_dimensions.x] += glm::vec4(colour, 1.0f);
+void RayTracedImage::ProcessTileWavefront(const RenderTile& tile, uint32_t samplesPerPixel, const RayTracer& rayTracer, const RayEmitter& rayEmitter, const WorldSnapshot& world)
+{
+	// One per thread, so the queues are allocated once by each worker in its own node's memory and then reused.
+	thread_local WavefrontIntegrator integrator;
+	integrator.Clear();
+	integrator.SetSortHits(m_sortHits);
+
+	// A pixel's samples are queued together, so its paths are consecutive.
+	for (uint32_t y = tile.m_minY; y < tile.m_maxY; y++)
+	{
+		for (uint32_t x = tile.m_minX; x < tile.m_maxX; x++)
+		{
+			Ray ray = GetCameraRay(x, y, rayEmitter);
+			uint32_t firstSample = GetFirstSampleIndex(x, y);
+			uint32_t numSamples = GetPixelSamples(x, y, samplesPerPixel);
+			for (uint32_t sample = 0; sample < numSamples; sample++)
+				integrator.AddPath(x, y, firstSample + sample, ray);
+		}
+	}
+
+	integrator.Trace(rayTracer, world);
+
+	uint32_t pathIndex = 0;
+	for (uint32_t y = tile.m_minY; y < tile.m_maxY; y++)
+	{
+		for (uint32_t x = tile.m_minX; x < tile.m_maxX; x++)
+		{
+			uint32_t numSamples = GetPixelSamples(x, y, samplesPerPixel);
+			uint32_t samplesTaken = GetSamplesTaken(x, y);
+			glm::vec3 colour(0.0f);
+			for (uint32_t sample = 0; sample < numSamples; sample++)
+			{
+				const glm::vec3& sampleColour = integrator.GetPathColour(pathIndex++);
+				colour += sampleColour;
+				AddSampleToMoments(x, y, samplesTaken + sample + 1, sampleColour);
+			}
+
+			WritePixel(m_pixels, x, y, colour, numSamples);
+		}
+	}
+}
+
+bool RayTracedImage::ProcessPixel(uint32_t* pixels, int x, int y, uint32_t numSamples, const Ray& ray, const RayTracer& rayTracer, const WorldSnapshot &world)
+{
+	uint32_t firstSample = GetFirstSampleIndex(x, y);
+	uint32_t samplesTaken = GetSamplesTaken(x, y);
+
+	// One reservoir per pixel per pass, so all of this pass's samples share its estimate of the direct light.
+	glm::vec3 directLight(0.0f);
+	bool resampled = m_lightResampling && ResampleDirectLight(x, y, numSamples, ray, rayTracer, world, directLight);
+	PathGuide* guide = m_pathGuiding ? &m_pathGuide : nullptr;
+	RadianceCache* radianceCache = m_radianceCaching ? &m_radianceCache : nullptr;
+
+	glm::vec3 colour(0.0f);
+	for (uint32_t sample = 0; sample < numSamples; sample++)
+	{
+		glm::vec3 sampleColour = rayTracer.CalculatePixelColour(x, y, firstSample + sample, world, ray, !resampled, guide,
+			radianceCache);
+		if (resampled)
+			sampleColour += directLight;
+		colour += sampleColour;
+		AddSampleToMoments(x, y, samplesTaken + sample + 1, sampleColour);
+	}
+
+	WritePixel(pixels, x, y, colour, numSamples);
+	return true;
+}
+
+bool RayTracedImage::ResampleDirectLight(int x, int y, uint32_t numSamples, const Ray& ray, const RayTracer& rayTracer,
+	const WorldSnapshot& world, glm::vec3& directLight)
+{
+	uint32_t width = (uint32_t)m_renderDimensions.x;
+	const LightResampler::Reservoir* previousReservoirs = m_reservoirs[1 - m_reservoirWriteBuffer];
+	LightResampler::Reservoir& reservoir = m_reservoirs[m_reservoirWriteBuffer][x + y * (int)width];
+
+	// A converged pixel takes no samples, but its reservoir is carried over for its neighbours.
+	if (numSamples == 0)
+	{
+		reservoir = previousReservoirs[x + y * (int)width];
+		return false;
+	}
+
+	// The samples already taken number the passes, so each pass draws new candidates.
+	return m_lightResampler.EstimateDirectLight(x, y, GetFirstSampleIndex(x, y), ray, rayTracer, world, previousReservoirs,
+		width, (uint32_t)m_renderDimensions.y, reservoir, directLight);
+}
+
+uint32_t RayTracedImage::GetAdaptiveSamplesPerPixel(const RenderTile& tile) const
+{
+	// The tile keeps its uniform budget. What the converged pixels would have taken is shared between the rest, up to
+	// a limit so one noisy pixel cannot make a tile many times slower than its neighbours.
+	uint32_t numPixels = (tile.m_maxX - tile.m_minX) * (tile.m_maxY - tile.m_minY);
+	uint32_t numUnconverged = 0;
+	for (uint32_t y = tile.m_minY; y < tile.m_maxY; y++)
+	{
+		for (uint32_t x = tile.m_minX; x < tile.m_maxX; x++)
+			numUnconverged += IsPixelConverged(x, y) ? 0 : 1;
+	}
+
+	if (numUnconverged == 0)
+		return m_samplesPerFrame;
+
+	return glm::min(m_samplesPerFrame * numPixels / numUnconverged, m_samplesPerFrame * MaxAdaptiveBoost);
+}
+
+uint32_t RayTracedImage::GetPixelSamples(int x, int y, uint32_t samplesPerPixel) const
+{
+	return m_adaptiveSampling && IsPixelConverged(x, y) ? 0 : samplesPerPixel;
+}
+
+uint32_t RayTracedImage::GetSamplesTaken(int x, int y) const
+{
+	return (uint32_t)m_accumulationSettings.m_data[x + y * (int)m_renderDimensions.x].w;
+}
+
+void RayTracedImage::AddSampleToMoments(int x, int y, uint32_t sampleCount, const glm::vec3& sample)
+{
+	// Welford's running mean and sum of squared differences, of luminance so one number tracks a pixel's noise.
+	glm::vec2& moments = m_luminanceMoments[x + y * (int)m_renderDimensions.x];
+	float luminance = glm::dot(sample, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	float delta = luminance - moments.x;
+	moments.x += delta / (float)sampleCount;
+	moments.y += delta * (luminance - moments.x);
+}
+
+float RayTracedImage::GetRelativeError(int x, int y) const
+{
+	int index = x + y * (int)m_renderDimensions.x;
+	float samplesTaken = m_accumulationSettings.m_data[index].w;
+	if (samplesTaken < 2.0f)
+		return std::numeric_limits<float>::max();
+
+	// Standard error of the mean relative to the mean, with a floor on the mean so black pixels can converge.
+	const glm::vec2& moments = m_luminanceMoments[index];
+	float variance = moments.y / (samplesTaken - 1.0f);
+	return glm::sqrt(variance / samplesTaken) / glm::max(moments.x, 0.01f);
+}
+
+bool RayTracedImage::IsPixelConverged(int x, int y) const
+{
+	return GetSamplesTaken(x, y) >= m_adaptiveMinSamples && GetRelativeError(x, y) <= m_noiseThreshold;
+}
+
+float RayTracedImage::ComputeConvergedFraction() const
+{
+	assert(!m_traceInFlight);
+
+	uint32_t numConverged = 0;
+	for (int y = 0; y < (int)m_renderDimensions.y; y++)
+	{
+		for (int x = 0; x < (int)m_renderDimensions.x; x++)
+			numConverged += IsPixelConverged(x, y) ? 1 : 0;
+	}
+
+	return (float)numConverged / glm::max(m_renderDimensions.x * m_renderDimensions.y, 1.0f);
+}
+
+void RayTracedImage::WritePixel(uint32_t* pixels, int x, int y, const glm::vec3& colour, uint32_t numSamples)
+{
+	// The w component counts the samples taken for this pixel.
+	m_accumulationSettings.m_data[x + y * (int)m_renderDimensions.x] += glm::vec4(colour, (float)numSamples);
 
 	// Average the accumulated colour
-	glm::vec4 accumulatedColour = m_accumulationSettings.m_data[x + y * (int)m_dimensions.x];
-	accumulatedColour /= (float)m_accumulationSettings.m_frameIndex;
+	glm::vec4 accumulatedColour = m_accumulationSettings.m_data[x + y * (int)m_renderDimensions.x];
+	accumulatedColour /= accumulatedColour.w;
 	accumulatedColour = glm::clamp(accumulatedColour, glm::vec4(0.0f), glm::vec4(1.0f));
 
-	pixels[x + y * (int)m_dimensions.x] = Utils::ColourToUIntRGBA(accumulatedColour);
+	// Converged pixels are green. The rest run from yellow to red as their error rises above the threshold.
+	if (m_showConvergence)
+	{
+		float excess = glm::clamp(glm::log2(GetRelativeError(x, y) / m_noiseThreshold) / 4.0f, 0.0f, 1.0f);
+		accumulatedColour = IsPixelConverged(x, y) ? glm::vec4(0.0f, 0.6f, 0.0f, 1.0f) : glm::vec4(1.0f, 1.0f - excess, 0.0f, 1.0f);
+	}
 
-	return true;
+	uint32_t pixelColour = Utils::ColourToUIntRGBA(accumulatedColour);
+	if (m_resolutionScale == 1)
+	{
+		pixels[x + y * (int)m_dimensions.x] = pixelColour;
+		return;
+	}
+
+	// Nearest neighbour upsample to the output resolution.
+	int maxX = glm::min((x + 1) * (int)m_resolutionScale, (int)m_dimensions.x);
+	int maxY = glm::min((y + 1) * (int)m_resolutionScale, (int)m_dimensions.y);
+	for (int outputY = y * (int)m_resolutionScale; outputY < maxY; outputY++)
+	{
+		for (int outputX = x * (int)m_resolutionScale; outputX < maxX; outputX++)
+			pixels[outputX + outputY * (int)m_dimensions.x] = pixelColour;
+	}
 }
 
 void RayTracedImage::Resize(glm::vec2 renderRect)
 {
 	ResetFrameIndex();
+	EndFillPixels();
+	m_nextTile = 0;
 	Destroy();
 
-	Initialise(renderRect);
+	Initialise(renderRect, *m_workerPool);
 }
 
 
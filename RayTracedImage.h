@@ -1,12 +1,21 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <glm/glm.hpp>
 
+#include "RayTracing/LightResampler.h"
+#include "RayTracing/PathGuide.h"
+#include "RayTracing/RadianceCache.h"
+#include "ScopedTimer.h"
+#include "Utils/CancellationToken.h"
+#include "Utils/WorkerPool.h"
+#include "World.h"
+
 class Ray;
 class RayEmitter;
 class RayTracer;
-class World;
 
 class RayTracedImage
 {
@@ -20,13 +29,97 @@ public:
         bool m_accumulate = true;
     };
 
+    // A rectangular block of pixels traced as one unit of work. Max values are exclusive.
+    struct RenderTile
+    {
+        uint32_t m_minX = 0;
+        uint32_t m_minY = 0;
+        uint32_t m_maxX = 0;
+        uint32_t m_maxY = 0;
+    };
+
+    static constexpr uint32_t TileSize = 32;
+    // Most samples per frame an adaptively sampled pixel can take, as a multiple of the samples per frame.
+    static constexpr uint32_t MaxAdaptiveBoost = 8;
+    // Tile costs are kept on a grid of this size, so they survive tiles being split.
+    static constexpr uint32_t CostCellSize = TileSize / 2;
+
+    // The order tiles are traced in. The priority modes trace the tiles nearest the point of interest first.
+    // CostGuided traces the most expensive tiles of the previous pass first and splits the most expensive of them, so
+    // the last tiles handed out are cheap and the workers finish together.
+    enum class TileOrder
+    {
+        Scanline,
+        CursorDistance,
+        ScreenCentre,
+        CostGuided
+    };
+
+    // How the paths of a tile are traced. Megakernel runs each path's bounces to the end before starting the next,
+    // Wavefront traces all the tile's paths together a bounce at a time with WavefrontIntegrator. Both give the same
+    // image.
+    enum class Integrator
+    {
+        Megakernel,
+        Wavefront
+    };
+
     RayTracedImage();
     ~RayTracedImage();
 
-    bool Initialise(glm::vec2 renderRect);
+    bool Initialise(glm::vec2 renderRect, WorkerPool& workerPool);
+    // Traces a frame and waits for it, returning the finished pixels.
     uint32_t* FillPixels(const RayTracer& rayTracer, const RayEmitter& rayEmitter, const World& world);
+
+    // Split version of FillPixels for overlapping tracing with other work. BeginFillPixels starts tracing on the worker
+    // pool and returns straight away, EndFillPixels waits for it and returns the finished pixels. The pixels stay
+    // valid, and untouched by tracing, until the following EndFillPixels call. Only one frame can be in flight, and
+    // the ray tracer, ray emitter and image settings must not change until it has ended.
+    bool BeginFillPixels(const RayTracer& rayTracer, const RayEmitter& rayEmitter, const World& world);
+    uint32_t* EndFillPixels();
+
+    // One camera rendered by FillPixelsMultiView, traced at the image's own resolution and settings.
+    struct View
+    {
+        RayTracedImage* m_image = nullptr;
+        const RayEmitter* m_rayEmitter = nullptr;
+    };
+
+    // Traces a frame of every view as a single job on the worker pool and waits for it. The scene is pinned and
+    // replicated across nodes once for the whole batch, and the views' tiles are mixed in one queue so the pool stays
+    // busy until the last tile of the last view. Views are traced in priority order within each node, so list the
+    // most important first. Every image must use the same worker pool, and replication follows the first view's
+    // setting. Each image's present pixels hold its finished frame afterwards.
+    static bool FillPixelsMultiView(const std::vector<View>& views, const RayTracer& rayTracer, const World& world);
+
+    // The most recently finished frame.
+    inline uint32_t* GetPresentPixels() const
+    {
+        return m_pixelBuffers[m_presentBuffer];
+    }
+
+    inline bool IsTraceInFlight() const
+    {
+        return m_traceInFlight;
+    }
+
+    // The pool job tracing the frame in flight. Null when nothing is in flight or tracing ran on the calling thread.
+    inline const WorkerPool::JobHandle& GetTraceJob() const
+    {
+        return m_traceJob;
+    }
+
+    // Milliseconds from the start to the end of the last trace.
+    inline float GetLastTraceTime() const
+    {
+        return m_lastTraceTime;
+    }
     void Resize(glm::vec2 renderRect);
-    void ResetFrameIndex() { m_accumulationSettings.m_frameIndex = 1; };
+
+    // Restarts accumulation. Any frame currently being traced is cancelled at the next tile boundary.
+    // Safe to call from a different thread to the one running FillPixels. requestTime is when the input asking for the
+    // restart arrived, where the restart latency is measured from.
+    void ResetFrameIndex(Clock::time_point requestTime = Clock::now());
 
     inline void SetAccumulate(bool accumulate)
     {
@@ -38,15 +131,377 @@ public:
         return m_accumulationSettings.m_accumulate;
     }
 
+    // Traces at 1/resolutionScale of the output resolution in each axis and upsamples the result. Changing it keeps
+    // the existing allocations and restarts accumulation.
+    void SetResolutionScale(uint32_t resolutionScale);
+
+    inline uint32_t GetResolutionScale() const
+    {
+        return m_resolutionScale;
+    }
+
+    inline glm::vec2 GetRenderDimensions() const
+    {
+        return m_renderDimensions;
+    }
+
+    // Number of samples traced for every pixel in each tile processed.
+    inline void SetSamplesPerFrame(uint32_t samplesPerFrame)
+    {
+        m_samplesPerFrame = glm::max(samplesPerFrame, 1u);
+    }
+
+    inline uint32_t GetSamplesPerFrame() const
+    {
+        return m_samplesPerFrame;
+    }
+
+    // Maximum number of tiles traced per call to FillPixels, zero traces the whole image.
+    inline void SetTilesPerFrame(uint32_t tilesPerFrame)
+    {
+        m_tilesPerFrame = tilesPerFrame;
+    }
+
+    inline uint32_t GetTilesPerFrame() const
+    {
+        return m_tilesPerFrame;
+    }
+
+    inline void SetTileOrder(TileOrder tileOrder)
+    {
+        m_tileOrderMode = tileOrder;
+    }
+
+    inline TileOrder GetTileOrder() const
+    {
+        return m_tileOrderMode;
+    }
+
+    inline void SetIntegrator(Integrator integrator)
+    {
+        m_integrator = integrator;
+    }
+
+    inline Integrator GetIntegrator() const
+    {
+        return m_integrator;
+    }
+
+    // Wavefront only. Sorts each bounce's hits by material and direction before shading them, see BatchShader.
+    inline void SetSortHits(bool sortHits)
+    {
+        m_sortHits = sortHits;
+    }
+
+    inline bool GetSortHits() const
+    {
+        return m_sortHits;
+    }
+
+    // Stops sampling pixels once their relative error, the standard error of the mean luminance over the mean, is
+    // below the noise threshold. A tile's unconverged pixels share the samples its converged pixels no longer take.
+    // Pixels always take the minimum number of samples first, so the error estimate can be trusted.
+    inline void SetAdaptiveSampling(bool adaptiveSampling)
+    {
+        m_adaptiveSampling = adaptiveSampling;
+    }
+
+    inline bool GetAdaptiveSampling() const
+    {
+        return m_adaptiveSampling;
+    }
+
+    inline void SetNoiseThreshold(float noiseThreshold)
+    {
+        m_noiseThreshold = noiseThreshold;
+    }
+
+    inline float GetNoiseThreshold() const
+    {
+        return m_noiseThreshold;
+    }
+
+    inline void SetAdaptiveMinSamples(uint32_t adaptiveMinSamples)
+    {
+        m_adaptiveMinSamples = glm::max(adaptiveMinSamples, 2u);
+    }
+
+    inline uint32_t GetAdaptiveMinSamples() const
+    {
+        return m_adaptiveMinSamples;
+    }
+
+    // Outputs which pixels have converged in place of the image.
+    inline void SetShowConvergence(bool showConvergence)
+    {
+        m_showConvergence = showConvergence;
+    }
+
+    inline bool GetShowConvergence() const
+    {
+        return m_showConvergence;
+    }
+
+    // Estimates the direct light at the surface each camera ray hits with LightResampler, from reservoirs kept per
+    // pixel and reused between frames and neighbouring pixels. Needs the ray tracer's light sampling, pixels it does
+    // not apply to are traced as usual. Always traced with the megakernel integrator. Restart accumulation after
+    // changing either.
+    inline void SetLightResampling(bool lightResampling)
+    {
+        m_lightResampling = lightResampling;
+    }
+
+    inline bool GetLightResampling() const
+    {
+        return m_lightResampling;
+    }
+
+    inline void SetLightResamplerSettings(const LightResampler::Settings& settings)
+    {
+        m_lightResampler.SetSettings(settings);
+    }
+
+    inline const LightResampler::Settings& GetLightResamplerSettings() const
+    {
+        return m_lightResampler.GetSettings();
+    }
+
+    // Guides the scattered rays of paths with a PathGuide trained on this image's own passes, starting again whenever
+    // the world changes. Needs the ray tracer's throughput shading model, surfaces it does not apply to scatter as
+    // usual. Always traced with the megakernel integrator. Restart accumulation after changing either.
+    inline void SetPathGuiding(bool pathGuiding)
+    {
+        m_pathGuiding = pathGuiding;
+    }
+
+    inline bool GetPathGuiding() const
+    {
+        return m_pathGuiding;
+    }
+
+    inline void SetPathGuideSettings(const PathGuide::Settings& settings)
+    {
+        m_pathGuide.SetSettings(settings);
+    }
+
+    inline const PathGuide::Settings& GetPathGuideSettings() const
+    {
+        return m_pathGuide.GetSettings();
+    }
+
+    inline const PathGuide& GetPathGuide() const
+    {
+        return m_pathGuide;
+    }
+
+    // Ends most paths at their second diffuse surface with the light a RadianceCache holds for it, the cache filled by
+    // the rest of this image's paths and emptied whenever the world changes. Needs the ray tracer's throughput shading
+    // model. Always traced with the megakernel integrator. Restart accumulation after changing either.
+    inline void SetRadianceCaching(bool radianceCaching)
+    {
+        m_radianceCaching = radianceCaching;
+    }
+
+    inline bool GetRadianceCaching() const
+    {
+        return m_radianceCaching;
+    }
+
+    inline void SetRadianceCacheSettings(const RadianceCache::Settings& settings)
+    {
+        m_radianceCache.SetSettings(settings);
+    }
+
+    inline const RadianceCache::Settings& GetRadianceCacheSettings() const
+    {
+        return m_radianceCache.GetSettings();
+    }
+
+    inline const RadianceCache& GetRadianceCache() const
+    {
+        return m_radianceCache;
+    }
+
+    // Fraction of the traced pixels below the noise threshold. Reads every pixel, so call between frames.
+    float ComputeConvergedFraction() const;
+
+    // Point of interest in output image pixels, used by TileOrder::CursorDistance.
+    inline void SetFocusPoint(glm::vec2 focusPoint)
+    {
+        m_focusPoint = focusPoint;
+    }
+
+    // Gives every NUMA node its own copy of the scene, rebuilt on the node whenever a new version is published.
+    inline void SetReplicateScene(bool replicateScene)
+    {
+        m_replicateScene = replicateScene;
+    }
+
+    inline bool GetReplicateScene() const
+    {
+        return m_replicateScene;
+    }
+
+    inline uint32_t GetNumTiles() const
+    {
+        return (uint32_t)m_tiles.size();
+    }
+
+    // Tiles completed by the last trace.
+    inline uint32_t GetTilesTraced() const
+    {
+        return m_tilesTraced.load(std::memory_order_relaxed);
+    }
+
+    // Tiles of the current pass that were split into quarters by TileOrder::CostGuided.
+    inline uint32_t GetNumSplitTiles() const
+    {
+        return m_numSplitTiles;
+    }
+
+    // Average time each worker spent idle at the end of the last trace, between finishing its last tile and the
+    // trace completing, and that time as a fraction of the trace time.
+    inline float GetTailIdleTime() const
+    {
+        return m_tailIdleTime;
+    }
+
+    inline float GetTailIdleFraction() const
+    {
+        return m_tailIdleFraction;
+    }
+
+    // Time from the request time of the first ResetFrameIndex call to the first tile of the restarted frame
+    // completing.
+    inline float GetLastRestartLatency() const
+    {
+        return m_lastRestartLatency.load(std::memory_order_relaxed);
+    }
+
+    inline float GetWorstRestartLatency() const
+    {
+        return m_worstRestartLatency.load(std::memory_order_relaxed);
+    }
+
 private:
 
     void Destroy();
-    bool ProcessPixel(uint32_t* pixels, int x, int y, const Ray& ray, const RayTracer& rayTracer, const World &world);
+    // Everything BeginFillPixels does before pinning the scene and dispatching, up to building the dispatch list.
+    bool PrepareTrace(const RayEmitter& rayEmitter);
+    // The part of EndFillPixels after the trace has completed.
+    void FinishTrace();
+    void BuildTiles();
+    void OrderTiles(size_t firstTile);
+    void ResetTileCosts();
+    float GetTileCost(const RenderTile& tile) const;
+    void RecordTileCost(const RenderTile& tile, float cost);
+    void MeasureTailIdle();
+    void FirstTouchBuffers();
+    uint32_t GetTileNode(const RenderTile& tile) const;
+    void BuildDispatchList(size_t firstTile, size_t lastTile);
+    void UpdateNodeScenes(const WorldSnapshot& world);
+    void CopyTileOutput(const RenderTile& tile, const uint32_t* source, uint32_t* destination) const;
+    void ProcessTile(uint32_t tileIndex, const RayTracer& rayTracer, const RayEmitter& rayEmitter, const WorldSnapshot& world);
+    void ProcessTileWavefront(const RenderTile& tile, uint32_t samplesPerPixel, const RayTracer& rayTracer, const RayEmitter& rayEmitter, const WorldSnapshot& world);
+    Ray GetCameraRay(uint32_t x, uint32_t y, const RayEmitter& rayEmitter) const;
+    uint32_t GetFirstSampleIndex(int x, int y) const;
+    bool ProcessPixel(uint32_t* pixels, int x, int y, uint32_t numSamples, const Ray& ray, const RayTracer& rayTracer, const WorldSnapshot &world);
+    // Builds the pixel's reservoir for this pass, returning false if the pixel is to be traced without it.
+    bool ResampleDirectLight(int x, int y, uint32_t numSamples, const Ray& ray, const RayTracer& rayTracer, const WorldSnapshot& world,
+        glm::vec3& directLight);
+    // Adds a pixel's new samples to the accumulated colour and writes the average to the output.
+    void WritePixel(uint32_t* pixels, int x, int y, const glm::vec3& colour, uint32_t numSamples);
+    uint32_t GetAdaptiveSamplesPerPixel(const RenderTile& tile) const;
+    uint32_t GetPixelSamples(int x, int y, uint32_t samplesPerPixel) const;
+    uint32_t GetSamplesTaken(int x, int y) const;
+    void AddSampleToMoments(int x, int y, uint32_t sampleCount, const glm::vec3& sample);
+    float GetRelativeError(int x, int y) const;
+    bool IsPixelConverged(int x, int y) const;
 
     AccumulationSettings m_accumulationSettings;
-    std::vector<uint32_t> m_xIndexIterator, m_yIndexIterator;
+    // Running mean and sum of squared differences of each pixel's sample luminance, next to the accumulated colour.
+    glm::vec2* m_luminanceMoments;
+    bool m_adaptiveSampling;
+    float m_noiseThreshold;
+    uint32_t m_adaptiveMinSamples;
+    bool m_showConvergence;
+    bool m_lightResampling;
+    LightResampler m_lightResampler;
+    // Each pixel's light reservoir as of the last complete pass, read for reuse, and the one being built by this pass.
+    // They swap at the end of each pass.
+    LightResampler::Reservoir* m_reservoirs[2];
+    uint32_t m_reservoirWriteBuffer;
+    bool m_pathGuiding;
+    // Trained at the end of each complete pass, and only read and added to while tracing.
+    PathGuide m_pathGuide;
+    bool m_radianceCaching;
+    // Resolved at the end of each complete pass, and only read and added to while tracing.
+    RadianceCache m_radianceCache;
+    std::vector<RenderTile> m_tiles;
+    // Indices into m_tiles in the order they are traced.
+    std::vector<uint32_t> m_tileOrder;
+    // The fill index each tile was last traced in.
+    std::vector<uint32_t> m_tileFillIndex;
+
+    // Milliseconds per sample each cost cell took the last time it was traced.
+    std::vector<float> m_cellCosts;
+    uint32_t m_costCellsX;
+    uint32_t m_numSplitTiles;
+
+    struct alignas(64) WorkerTiming
+    {
+        // Clock ticks when the worker finished its last tile.
+        long long m_lastTileEnd = 0;
+    };
+    std::vector<WorkerTiming> m_workerTimings;
+    float m_tailIdleTime;
+    float m_tailIdleFraction;
+    // The tiles traced by the current call grouped by NUMA node, keeping priority order within each node.
+    std::vector<uint32_t> m_dispatchTiles;
+    std::vector<uint32_t> m_dispatchNodeOffsets;
+    TileOrder m_tileOrderMode;
+    Integrator m_integrator;
+    bool m_sortHits;
+    glm::vec2 m_focusPoint;
+    // Focus point the current tile order was sorted around.
+    glm::vec2 m_orderedFocusPoint;
     glm::vec2 m_dimensions;
+    // Internal resolution actually traced, m_dimensions divided by the resolution scale.
+    glm::vec2 m_renderDimensions;
+    uint32_t m_resolutionScale;
 
+    // Points at the pixel buffer being traced into.
     uint32_t* m_pixels;
-};
+    uint32_t* m_pixelBuffers[2];
+    uint32_t m_writeBuffer;
+    uint32_t m_presentBuffer;
 
+    // Counts calls to BeginFillPixels.
+    uint32_t m_fillIndex;
+    bool m_traceInFlight;
+    size_t m_numTilesInFlight;
+    WorkerPool::JobHandle m_traceJob;
+    std::unique_ptr<World::SnapshotHandle> m_tracedSnapshot;
+    Clock::time_point m_traceStartTime;
+    float m_lastTraceTime;
+
+    WorkerPool* m_workerPool;
+    bool m_replicateScene;
+    std::vector<std::unique_ptr<WorldSnapshot>> m_nodeScenes;
+
+    uint32_t m_samplesPerFrame;
+    uint32_t m_tilesPerFrame;
+    size_t m_nextTile;
+    // Added to the sample numbers, advanced every pass when not accumulating.
+    uint32_t m_sampleIndexOffset;
+    std::atomic<uint32_t> m_tilesTraced;
+
+    CancellationToken m_cancellationToken;
+    std::atomic<bool> m_resetRequested;
+    std::atomic<bool> m_awaitingFirstSample;
+
+    // Clock ticks at the time the pending restart was first requested.
+    std::atomic<long long> m_restartRequestTime;
+    std::atomic<float> m_lastRestartLatency;
+    std::atomic<float> m_worstRestartLatency;
+};
@@ -0,0 +1,109 @@
+#include "BatchShader.h"
+
+#include <utility>
+
+#include "../Materials/IMaterial.h"
+#include "../WorldSnapshot.h"
+
+BatchShader::BatchShader() :
+	m_sortHits(true)
+{
+}
+
+BatchShader::~BatchShader()
+{
+}
+
+void BatchShader::Clear()
+{
+	m_tags.clear();
+	m_materialIndices.clear();
+	m_rays.clear();
+	m_hits.clear();
+	m_randoms.clear();
+}
+
+void BatchShader::AddHit(uint32_t tag, int materialIndex, const Ray& ray, const RayCollisionData& hit, const RandomStream& random)
+{
+	m_tags.push_back(tag);
+	m_materialIndices.push_back(materialIndex);
+	m_rays.push_back(ray);
+	m_hits.push_back(hit);
+	m_randoms.push_back(random);
+}
+
+void BatchShader::Shade(const WorldSnapshot& world)
+{
+	uint32_t numHits = GetNumHits();
+	m_contributions.resize(numHits);
+	m_scatteredRays.resize(numHits, Ray(glm::vec3(0.0f), glm::vec3(0.0f)));
+
+	if (!m_sortHits)
+	{
+		for (uint32_t i = 0; i < numHits; i++)
+		{
+			const IMaterial* material = world.GetMaterialPtr(m_materialIndices[i]);
+			m_contributions[i] = material->GetColourContribution(m_hits[i]);
+			m_scatteredRays[i] = material->GetNewRayDirection(m_rays[i], m_hits[i], m_randoms[i]);
+		}
+		return;
+	}
+
+	int numMaterials = world.GetNumMaterials();
+	SortHits(numMaterials);
+
+	for (int materialIndex = 0; materialIndex < numMaterials; materialIndex++)
+	{
+		uint32_t first = m_binOffsets[materialIndex * 8];
+		uint32_t last = m_binOffsets[(materialIndex + 1) * 8];
+		if (first == last)
+			continue;
+
+		ScatterBatch batch;
+		batch.m_rays = m_rays.data() + first;
+		batch.m_hits = m_hits.data() + first;
+		batch.m_randoms = m_randoms.data() + first;
+		batch.m_contributions = m_contributions.data() + first;
+		batch.m_scatteredRays = m_scatteredRays.data() + first;
+		batch.m_count = last - first;
+		world.GetMaterialPtr(materialIndex)->Scatter(batch);
+	}
+}
+
+void BatchShader::SortHits(int numMaterials)
+{
+	// Counting sort, which keeps the hits in the order they were added within each bin.
+	uint32_t numHits = GetNumHits();
+	uint32_t numBins = (uint32_t)numMaterials * 8;
+	m_binOffsets.assign(numBins + 1, 0);
+	for (uint32_t i = 0; i < numHits; i++)
+		m_binOffsets[m_materialIndices[i] * 8 + GetOctant(m_rays[i].GetDirection()) + 1]++;
+
+	for (uint32_t bin = 0; bin < numBins; bin++)
+		m_binOffsets[bin + 1] += m_binOffsets[bin];
+
+	m_order.resize(numHits);
+	m_binInsertPositions.assign(m_binOffsets.begin(), m_binOffsets.end() - 1);
+	for (uint32_t i = 0; i < numHits; i++)
+		m_order[m_binInsertPositions[m_materialIndices[i] * 8 + GetOctant(m_rays[i].GetDirection())]++] = i;
+
+	m_sortedTags.clear();
+	m_sortedMaterialIndices.clear();
+	m_sortedRays.clear();
+	m_sortedHits.clear();
+	m_sortedRandoms.clear();
+	for (uint32_t hit : m_order)
+	{
+		m_sortedTags.push_back(m_tags[hit]);
+		m_sortedMaterialIndices.push_back(m_materialIndices[hit]);
+		m_sortedRays.push_back(m_rays[hit]);
+		m_sortedHits.push_back(m_hits[hit]);
+		m_sortedRandoms.push_back(m_randoms[hit]);
+	}
+
+	std::swap(m_tags, m_sortedTags);
+	std::swap(m_materialIndices, m_sortedMaterialIndices);
+	std::swap(m_rays, m_sortedRays);
+	std::swap(m_hits, m_sortedHits);
+	std::swap(m_randoms, m_sortedRandoms);
+}
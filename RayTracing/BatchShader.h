@@ -0,0 +1,105 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Ray.h"
+#include "../Utils/RandomStream.h"
+
+class WorldSnapshot;
+
+// Shades a set of hits together. With sorting on the hits are binned by material and by the octant of the incoming
+// ray's direction, then each material scatters its whole run with one IMaterial::Scatter call, so one material's code
+// and data stay hot and neighbouring hits reflect in similar directions. With sorting off every hit is shaded on its
+// own, through virtual calls, in the order it was added.
+// Results are read back in the order they were shaded, with the tag given to AddHit saying which hit each one is.
+class BatchShader
+{
+public:
+
+	BatchShader();
+	~BatchShader();
+
+	inline void SetSortHits(bool sortHits)
+	{
+		m_sortHits = sortHits;
+	}
+
+	inline bool GetSortHits() const
+	{
+		return m_sortHits;
+	}
+
+	// Empties the batch, keeping the allocations for the next one.
+	void Clear();
+
+	void AddHit(uint32_t tag, int materialIndex, const Ray& ray, const RayCollisionData& hit, const RandomStream& random);
+	void Shade(const WorldSnapshot& world);
+
+	inline uint32_t GetNumHits() const
+	{
+		return (uint32_t)m_tags.size();
+	}
+
+	inline uint32_t GetTag(uint32_t index) const
+	{
+		return m_tags[index];
+	}
+
+	inline int GetMaterialIndex(uint32_t index) const
+	{
+		return m_materialIndices[index];
+	}
+
+	inline const Ray& GetRay(uint32_t index) const
+	{
+		return m_rays[index];
+	}
+
+	inline const RayCollisionData& GetHit(uint32_t index) const
+	{
+		return m_hits[index];
+	}
+
+	inline const glm::vec3& GetContribution(uint32_t index) const
+	{
+		return m_contributions[index];
+	}
+
+	inline const Ray& GetScatteredRay(uint32_t index) const
+	{
+		return m_scatteredRays[index];
+	}
+
+private:
+
+	void SortHits(int numMaterials);
+
+	static inline uint32_t GetOctant(const glm::vec3& direction)
+	{
+		return (direction.x < 0.0f ? 1u : 0u) | (direction.y < 0.0f ? 2u : 0u) | (direction.z < 0.0f ? 4u : 0u);
+	}
+
+	bool m_sortHits;
+
+	std::vector<uint32_t> m_tags;
+	std::vector<int> m_materialIndices;
+	std::vector<Ray> m_rays;
+	std::vector<RayCollisionData> m_hits;
+	std::vector<RandomStream> m_randoms;
+
+	std::vector<glm::vec3> m_contributions;
+	std::vector<Ray> m_scatteredRays;
+
+	// Sorting gathers into these and then swaps them with the arrays above.
+	std::vector<uint32_t> m_sortedTags;
+	std::vector<int> m_sortedMaterialIndices;
+	std::vector<Ray> m_sortedRays;
+	std::vector<RayCollisionData> m_sortedHits;
+	std::vector<RandomStream> m_sortedRandoms;
+	// Start of each material and octant bin, material major so a material's bins form one run.
+	std::vector<uint32_t> m_binOffsets;
+	std::vector<uint32_t> m_binInsertPositions;
+	// The hit shaded at each position.
+	std::vector<uint32_t> m_order;
+};
@@ -0,0 +1,522 @@
+#include "EnvironmentMap.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <glm/gtc/constants.hpp>
+
+#include "../Utils/WorkerPool.h"
+
+namespace
+{
+	// Reads a whole file into memory with one call, as fast as the disk allows. Null if it can not be read.
+	std::unique_ptr<char[]> ReadFile(const char* fileName, size_t& size)
+	{
+		std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+		if (!file)
+			return nullptr;
+
+		size = (size_t)file.tellg();
+		file.seekg(0);
+		// Not zeroed, for an 8K map it would be another pass over several hundred megabytes.
+		std::unique_ptr<char[]> data(new char[size + 1]);
+		if (!file.read(data.get(), size))
+			return nullptr;
+		// So the header can be parsed as a string however the file ends.
+		data[size] = '\0';
+		return data;
+	}
+
+	// Reads the next line of a text header, without its end of line. False at the end of the data.
+	bool ReadLine(const char* data, size_t size, size_t& offset, std::string& line)
+	{
+		if (offset >= size)
+			return false;
+
+		const char* end = (const char*)memchr(data + offset, '\n', size - offset);
+		size_t length = end ? (size_t)(end - (data + offset)) : size - offset;
+		line.assign(data + offset, length);
+		offset += length + (end ? 1 : 0);
+		return true;
+	}
+
+	// Reads the next whitespace separated token of a PFM header.
+	bool ReadToken(const char* data, size_t size, size_t& offset, std::string& token)
+	{
+		while (offset < size && isspace((unsigned char)data[offset]))
+			offset++;
+
+		size_t start = offset;
+		while (offset < size && !isspace((unsigned char)data[offset]))
+			offset++;
+
+		token.assign(data + start, offset - start);
+		return !token.empty();
+	}
+}
+
+EnvironmentMap::EnvironmentMap() :
+	m_width(0),
+	m_height(0),
+	m_totalWeight(0.0)
+{
+}
+
+EnvironmentMap::~EnvironmentMap()
+{
+}
+
+bool EnvironmentMap::Load(const char* fileName, WorkerPool& workerPool)
+{
+	size_t size = 0;
+	std::unique_ptr<char[]> data = ReadFile(fileName, size);
+	if (!data)
+	{
+		std::cout << "Could not read environment map " << fileName << std::endl;
+		return false;
+	}
+
+	bool loaded = false;
+	if (size >= 2 && data[0] == 'P' && (data[1] == 'F' || data[1] == 'f'))
+		loaded = LoadPfm(data.get(), size, workerPool);
+	else if (size >= 2 && data[0] == '#' && data[1] == '?')
+		loaded = LoadHdr(data.get(), size, workerPool);
+	else
+		std::cout << "Environment map " << fileName << " is neither a PFM nor a Radiance HDR file" << std::endl;
+
+	if (!loaded)
+	{
+		std::cout << "Could not load environment map " << fileName << std::endl;
+		return false;
+	}
+
+	BuildSampling(workerPool);
+	return true;
+}
+
+void EnvironmentMap::Initialise(uint32_t width, uint32_t height, const glm::vec3* pixels, WorkerPool& workerPool)
+{
+	Allocate(width, height);
+	workerPool.ParallelFor(height, [&](uint32_t y, uint32_t workerIndex)
+	{
+		for (uint32_t x = 0; x < width; x++)
+			m_pixels[(size_t)y * width + x] = ToRgbe(pixels[(size_t)y * width + x]);
+	});
+
+	BuildSampling(workerPool);
+}
+
+glm::vec3 EnvironmentMap::GetRadiance(const glm::vec3& direction) const
+{
+	uint32_t x;
+	uint32_t y;
+	GetPixel(direction, x, y);
+	return FromRgbe(m_pixels[(size_t)y * m_width + x]);
+}
+
+glm::vec3 EnvironmentMap::Sample(const glm::vec2& u, float& pdf) const
+{
+	pdf = 0.0f;
+	if (m_totalWeight <= 0.0)
+		return glm::vec3(0.0f, -1.0f, 0.0f);
+
+	float rowRemainder;
+	float columnRemainder;
+	uint32_t y = SampleAliasTable(m_rowTable.get(), m_height, u.x, rowRemainder);
+	uint32_t x = SampleAliasTable(&m_pixelTables[(size_t)y * m_width], m_width, u.y, columnRemainder);
+
+	// Uniform over the pixel's rectangle of the image.
+	float theta = glm::pi<float>() * ((float)y + rowRemainder) / (float)m_height;
+	float phi = glm::two_pi<float>() * (((float)x + columnRemainder) / (float)m_width - 0.5f);
+	float sinTheta = std::sin(theta);
+	glm::vec3 direction(sinTheta * std::sin(phi), -std::cos(theta), -sinTheta * std::cos(phi));
+
+	// From a density over the image, which covers 2 pi by pi radians, to one over solid angle.
+	if (sinTheta > 0.0f)
+	{
+		pdf = GetPixelProbability(x, y) * (float)m_width * (float)m_height /
+			(2.0f * glm::pi<float>() * glm::pi<float>() * sinTheta);
+	}
+	return direction;
+}
+
+float EnvironmentMap::GetPdf(const glm::vec3& direction) const
+{
+	if (m_totalWeight <= 0.0)
+		return 0.0f;
+
+	float sinTheta = glm::sqrt(glm::max(0.0f, 1.0f - direction.y * direction.y));
+	if (sinTheta <= 0.0f)
+		return 0.0f;
+
+	uint32_t x;
+	uint32_t y;
+	GetPixel(direction, x, y);
+	return GetPixelProbability(x, y) * (float)m_width * (float)m_height /
+		(2.0f * glm::pi<float>() * glm::pi<float>() * sinTheta);
+}
+
+bool EnvironmentMap::LoadPfm(const char* data, size_t size, WorkerPool& workerPool)
+{
+	// "PF" for colour or "Pf" for grey, the width and height, then a scale whose sign gives the byte order, and after
+	// one more whitespace character the floats, bottom row first.
+	size_t offset = 0;
+	std::string format;
+	std::string width;
+	std::string height;
+	std::string scale;
+	if (!ReadToken(data, size, offset, format) || !ReadToken(data, size, offset, width) ||
+		!ReadToken(data, size, offset, height) || !ReadToken(data, size, offset, scale))
+	{
+		std::cout << "PFM header is incomplete" << std::endl;
+		return false;
+	}
+	offset++;
+
+	uint32_t channels = format == "PF" ? 3 : 1;
+	long long numColumns = atoll(width.c_str());
+	long long numRows = atoll(height.c_str());
+	if (numColumns <= 0 || numRows <= 0 || numColumns > 65536 || numRows > 65536)
+	{
+		std::cout << "PFM size " << width << "x" << height << " is not supported" << std::endl;
+		return false;
+	}
+	if (offset + (size_t)numColumns * (size_t)numRows * channels * sizeof(float) > size)
+	{
+		std::cout << "PFM data is shorter than its size says" << std::endl;
+		return false;
+	}
+
+	// Little endian files have a negative scale. The byte order of this machine is found the same way.
+	uint32_t one = 1;
+	bool littleEndianMachine = *(const uint8_t*)&one == 1;
+	bool swapBytes = (atof(scale.c_str()) < 0.0) != littleEndianMachine;
+
+	Allocate((uint32_t)numColumns, (uint32_t)numRows);
+	const char* floats = data + offset;
+	workerPool.ParallelFor(m_height, [&](uint32_t y, uint32_t workerIndex)
+	{
+		const char* row = floats + (size_t)(m_height - 1 - y) * m_width * channels * sizeof(float);
+		for (uint32_t x = 0; x < m_width; x++)
+		{
+			float values[3];
+			for (uint32_t channel = 0; channel < channels; channel++)
+			{
+				uint32_t bits;
+				memcpy(&bits, row + ((size_t)x * channels + channel) * sizeof(float), sizeof(bits));
+				if (swapBytes)
+					bits = (bits >> 24) | ((bits >> 8) & 0xff00u) | ((bits << 8) & 0xff0000u) | (bits << 24);
+				memcpy(&values[channel], &bits, sizeof(float));
+			}
+
+			glm::vec3 colour = channels == 3 ? glm::vec3(values[0], values[1], values[2]) : glm::vec3(values[0]);
+			m_pixels[(size_t)y * m_width + x] = ToRgbe(colour);
+		}
+	});
+
+	return true;
+}
+
+bool EnvironmentMap::LoadHdr(const char* data, size_t size, WorkerPool& workerPool)
+{
+	// Text lines up to an empty one, then the resolution line, then the scanlines.
+	size_t offset = 0;
+	std::string line;
+	while (ReadLine(data, size, offset, line) && !line.empty())
+	{
+		if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe")
+		{
+			std::cout << "HDR " << line << " is not supported" << std::endl;
+			return false;
+		}
+	}
+
+	int numRows = 0;
+	int numColumns = 0;
+	std::string yAxis;
+	std::string xAxis;
+	bool readResolution = ReadLine(data, size, offset, line);
+	std::istringstream resolution(line);
+	if (!readResolution || !(resolution >> yAxis >> numRows >> xAxis >> numColumns) || yAxis != "-Y" || xAxis != "+X" ||
+		numRows <= 0 || numColumns <= 0 || numRows > 65536 || numColumns > 65536)
+	{
+		std::cout << "HDR resolution \"" << line << "\" is not supported, only -Y height +X width" << std::endl;
+		return false;
+	}
+
+	// Scanlines compressed with run lengths vary in size, so where each starts is found first by reading just the
+	// counts, a small part of the data, then they are decoded in parallel.
+	const uint8_t* bytes = (const uint8_t*)data;
+	std::vector<size_t> rowOffsets((size_t)numRows);
+	std::vector<uint8_t> rowCompressed((size_t)numRows);
+	for (int y = 0; y < numRows; y++)
+	{
+		rowOffsets[y] = offset;
+		if (offset + 4 > size)
+		{
+			std::cout << "HDR data ends at scanline " << y << " of " << numRows << std::endl;
+			return false;
+		}
+
+		// Run length scanlines start 2 2 and the width in two bytes, and only exist for widths 8 to 32767.
+		bool compressed = numColumns >= 8 && numColumns < 32768 && bytes[offset] == 2 && bytes[offset + 1] == 2 &&
+			((bytes[offset + 2] << 8) | bytes[offset + 3]) == numColumns;
+		rowCompressed[y] = compressed ? 1 : 0;
+		if (!compressed)
+		{
+			// Flat RGBE pixels. Files using the old run length scheme, long out of use, are not supported.
+			offset += (size_t)numColumns * 4;
+			continue;
+		}
+
+		offset += 4;
+		for (int channel = 0; channel < 4; channel++)
+		{
+			int x = 0;
+			while (x < numColumns && offset < size)
+			{
+				int count = bytes[offset++];
+				bool run = count > 128;
+				count = run ? count - 128 : count;
+				if (count == 0 || x + count > numColumns)
+				{
+					std::cout << "HDR scanline " << y << " is corrupt" << std::endl;
+					return false;
+				}
+				x += count;
+				offset += run ? 1 : (size_t)count;
+			}
+
+			// The data ran out part way through the channel.
+			if (x != numColumns)
+			{
+				std::cout << "HDR data ends in scanline " << y << " of " << numRows << std::endl;
+				return false;
+			}
+		}
+	}
+	if (offset > size)
+	{
+		std::cout << "HDR data is shorter than its size says" << std::endl;
+		return false;
+	}
+
+	// RGBE is kept as it is, the bytes only have to be put in place.
+	Allocate((uint32_t)numColumns, (uint32_t)numRows);
+	workerPool.ParallelFor(m_height, [&](uint32_t y, uint32_t workerIndex)
+	{
+		uint32_t* pixels = &m_pixels[(size_t)y * m_width];
+		const uint8_t* source = bytes + rowOffsets[y];
+		if (!rowCompressed[y])
+		{
+			for (uint32_t x = 0; x < m_width; x++, source += 4)
+				pixels[x] = source[0] | (source[1] << 8) | (source[2] << 16) | ((uint32_t)source[3] << 24);
+			return;
+		}
+
+		// Each channel in turn, as runs of one repeated byte or literal bytes.
+		memset(pixels, 0, m_width * sizeof(uint32_t));
+		source += 4;
+		for (uint32_t channel = 0; channel < 4; channel++)
+		{
+			uint32_t shift = channel * 8;
+			uint32_t x = 0;
+			while (x < m_width)
+			{
+				uint32_t count = *source++;
+				bool run = count > 128;
+				count = run ? count - 128 : count;
+				// Validated above, but a bad count must never leave the loop spinning or writing past the row.
+				if (count == 0 || x + count > m_width)
+					break;
+
+				if (run)
+				{
+					uint32_t value = (uint32_t)*source++ << shift;
+					for (uint32_t end = x + count; x < end; x++)
+						pixels[x] |= value;
+				}
+				else
+				{
+					for (uint32_t end = x + count; x < end; x++)
+						pixels[x] |= (uint32_t)*source++ << shift;
+				}
+			}
+		}
+	});
+
+	return true;
+}
+
+void EnvironmentMap::Allocate(uint32_t width, uint32_t height)
+{
+	m_width = width;
+	m_height = height;
+	m_pixels.reset(new uint32_t[(size_t)width * height]);
+	m_rowTable.reset(new AliasEntry[height]);
+	m_pixelTables.reset(new AliasEntry[(size_t)width * height]);
+	m_totalWeight = 0.0;
+}
+
+void EnvironmentMap::BuildSampling(WorkerPool& workerPool)
+{
+	// Each row's table is built on its own, so the rows are shared out between the workers.
+	std::vector<double> rowTotals(m_height, 0.0);
+	workerPool.ParallelFor(m_height, [&](uint32_t y, uint32_t workerIndex)
+	{
+		thread_local std::vector<float> weights;
+		thread_local std::vector<uint32_t> small;
+		thread_local std::vector<uint32_t> large;
+		weights.resize(m_width);
+		small.resize(m_width);
+		large.resize(m_width);
+
+		float sinTheta = GetRowSine(y);
+		double total = 0.0;
+		for (uint32_t x = 0; x < m_width; x++)
+		{
+			weights[x] = Luminance(FromRgbe(m_pixels[(size_t)y * m_width + x])) * sinTheta;
+			total += weights[x];
+		}
+		rowTotals[y] = total;
+
+		AliasEntry* table = &m_pixelTables[(size_t)y * m_width];
+		if (total > 0.0)
+		{
+			BuildAliasTable(weights.data(), m_width, total, table, small.data(), large.data());
+		}
+		else
+		{
+			// Never picked, as the row has no weight.
+			for (uint32_t x = 0; x < m_width; x++)
+				table[x] = { 1.0f, x };
+		}
+	});
+
+	m_totalWeight = 0.0;
+	std::vector<float> rowWeights(m_height);
+	for (uint32_t y = 0; y < m_height; y++)
+	{
+		m_totalWeight += rowTotals[y];
+		rowWeights[y] = (float)rowTotals[y];
+	}
+
+	if (m_totalWeight > 0.0)
+	{
+		std::vector<uint32_t> small(m_height);
+		std::vector<uint32_t> large(m_height);
+		BuildAliasTable(rowWeights.data(), m_height, m_totalWeight, m_rowTable.get(), small.data(), large.data());
+	}
+}
+
+void EnvironmentMap::BuildAliasTable(const float* weights, uint32_t numWeights, double total, AliasEntry* table,
+	uint32_t* small, uint32_t* large)
+{
+	// Vose's method. Entries are scaled so the average is one, then each entry below one is topped up from one above,
+	// which becomes its alias, until every entry holds exactly one.
+	uint32_t numSmall = 0;
+	uint32_t numLarge = 0;
+	double scale = (double)numWeights / total;
+	for (uint32_t i = 0; i < numWeights; i++)
+	{
+		table[i] = { (float)(weights[i] * scale), i };
+		if (table[i].m_probability < 1.0f)
+			small[numSmall++] = i;
+		else
+			large[numLarge++] = i;
+	}
+
+	while (numSmall > 0 && numLarge > 0)
+	{
+		uint32_t lower = small[--numSmall];
+		uint32_t upper = large[numLarge - 1];
+		table[lower].m_alias = upper;
+		table[upper].m_probability -= 1.0f - table[lower].m_probability;
+		if (table[upper].m_probability < 1.0f)
+		{
+			numLarge--;
+			small[numSmall++] = upper;
+		}
+	}
+
+	// What is left is one to within rounding.
+	for (uint32_t i = 0; i < numLarge; i++)
+		table[large[i]] = { 1.0f, large[i] };
+	for (uint32_t i = 0; i < numSmall; i++)
+		table[small[i]] = { 1.0f, small[i] };
+}
+
+inline uint32_t EnvironmentMap::SampleAliasTable(const AliasEntry* table, uint32_t numEntries, float u, float& remainder)
+{
+	float scaled = u * (float)numEntries;
+	uint32_t index = glm::min((uint32_t)scaled, numEntries - 1);
+	float fraction = scaled - (float)index;
+
+	const AliasEntry& entry = table[index];
+	if (fraction < entry.m_probability)
+	{
+		remainder = glm::min(fraction / entry.m_probability, 0x1.fffffep-1f);
+		return index;
+	}
+
+	remainder = glm::min((fraction - entry.m_probability) / (1.0f - entry.m_probability), 0x1.fffffep-1f);
+	return entry.m_alias;
+}
+
+uint32_t EnvironmentMap::ToRgbe(const glm::vec3& colour)
+{
+	// Negative, infinite and not a number are all taken as black.
+	glm::vec3 clean = colour;
+	for (int channel = 0; channel < 3; channel++)
+	{
+		if (!(clean[channel] > 0.0f) || !std::isfinite(clean[channel]))
+			clean[channel] = 0.0f;
+	}
+
+	// The largest channel sets a power of two exponent shared by all three, each then stored in 8 bits.
+	float largest = glm::max(clean.x, glm::max(clean.y, clean.z));
+	if (largest < 1e-32f)
+		return 0;
+
+	int exponent;
+	float scale = std::frexp(largest, &exponent) * 256.0f / largest;
+	glm::uvec3 mantissas = glm::uvec3(glm::min(clean * scale, glm::vec3(255.0f)));
+	return mantissas.x | (mantissas.y << 8) | (mantissas.z << 16) | ((uint32_t)(exponent + 128) << 24);
+}
+
+glm::vec3 EnvironmentMap::FromRgbe(uint32_t rgbe)
+{
+	uint32_t exponent = rgbe >> 24;
+	if (exponent == 0)
+		return glm::vec3(0.0f);
+
+	float scale = std::ldexp(1.0f, (int)exponent - (128 + 8));
+	return glm::vec3((float)(rgbe & 0xff), (float)((rgbe >> 8) & 0xff), (float)((rgbe >> 16) & 0xff)) * scale;
+}
+
+float EnvironmentMap::Luminance(const glm::vec3& colour)
+{
+	return glm::dot(colour, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+float EnvironmentMap::GetRowSine(uint32_t y) const
+{
+	return std::sin(glm::pi<float>() * ((float)y + 0.5f) / (float)m_height);
+}
+
+float EnvironmentMap::GetPixelProbability(uint32_t x, uint32_t y) const
+{
+	return (float)(Luminance(FromRgbe(m_pixels[(size_t)y * m_width + x])) * GetRowSine(y) / m_totalWeight);
+}
+
+void EnvironmentMap::GetPixel(const glm::vec3& direction, uint32_t& x, uint32_t& y) const
+{
+	float u = 0.5f + std::atan2(direction.x, -direction.z) / glm::two_pi<float>();
+	float v = std::acos(glm::clamp(-direction.y, -1.0f, 1.0f)) / glm::pi<float>();
+	x = glm::min((uint32_t)glm::max(u * (float)m_width, 0.0f), m_width - 1);
+	y = glm::min((uint32_t)glm::max(v * (float)m_height, 0.0f), m_height - 1);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+
+class WorkerPool;
+
+// Light arriving from infinitely far away in every direction, an equirectangular (latitude-longitude) HDR image loaded
+// from a PFM or Radiance .hdr file. The top row of the image is straight up, -y, and its centre column looks along -z.
+// Pixels are kept as Radiance's four byte shared exponent RGBE, a third the size of three floats, so an 8K map takes
+// 128MB rather than 384MB.
+// Directions are importance sampled in proportion to the luminance of each pixel times the solid angle it covers
+// through a 2D alias table: one table picking the row from the rows' totals, then the row's own table picking the pixel,
+// each in constant time however bright or dark the rest of the map is. Loading and building the tables are spread
+// over a WorkerPool one row at a time.
+// Immutable once loaded, shared between WorldSnapshots and read by any number of threads.
+class EnvironmentMap
+{
+public:
+
+	EnvironmentMap();
+	~EnvironmentMap();
+
+	// Loads the file, telling the format from its first bytes, and builds the sampling tables. Prints why and returns
+	// false if the file can not be read or is not a format it knows.
+	bool Load(const char* fileName, WorkerPool& workerPool);
+	// Takes the pixels from memory instead, width * height of them from the top row down.
+	void Initialise(uint32_t width, uint32_t height, const glm::vec3* pixels, WorkerPool& workerPool);
+
+	inline uint32_t GetWidth() const
+	{
+		return m_width;
+	}
+
+	inline uint32_t GetHeight() const
+	{
+		return m_height;
+	}
+
+	// Light arriving from the unit direction, the nearest pixel's.
+	glm::vec3 GetRadiance(const glm::vec3& direction) const;
+
+	// Picks a direction with the uniform numbers u, returning its density per unit solid angle in pdf. Zero if the map
+	// is black everywhere.
+	glm::vec3 Sample(const glm::vec2& u, float& pdf) const;
+	// Density with which Sample picks the unit direction.
+	float GetPdf(const glm::vec3& direction) const;
+
+private:
+
+	struct AliasEntry
+	{
+		// Chance of keeping this entry rather than taking its alias.
+		float m_probability;
+		uint32_t m_alias;
+	};
+
+	bool LoadPfm(const char* data, size_t size, WorkerPool& workerPool);
+	bool LoadHdr(const char* data, size_t size, WorkerPool& workerPool);
+	void Allocate(uint32_t width, uint32_t height);
+	// Builds the tables from the pixels.
+	void BuildSampling(WorkerPool& workerPool);
+
+	// Builds an alias table over the weights, which must not all be zero. small and large are scratch space of the
+	// same size.
+	static void BuildAliasTable(const float* weights, uint32_t numWeights, double total, AliasEntry* table, uint32_t* small,
+		uint32_t* large);
+	// Picks an entry from the table, reusing what is left of u for the position within it.
+	static inline uint32_t SampleAliasTable(const AliasEntry* table, uint32_t numEntries, float u, float& remainder);
+
+	static uint32_t ToRgbe(const glm::vec3& colour);
+	static glm::vec3 FromRgbe(uint32_t rgbe);
+	static float Luminance(const glm::vec3& colour);
+	// Sine of the polar angle of the row's centre, in proportion to the solid angle its pixels cover.
+	float GetRowSine(uint32_t y) const;
+	// Chance of Sample picking the pixel: its luminance times the solid angle it covers, over the same for the map.
+	float GetPixelProbability(uint32_t x, uint32_t y) const;
+	void GetPixel(const glm::vec3& direction, uint32_t& x, uint32_t& y) const;
+
+	uint32_t m_width;
+	uint32_t m_height;
+	std::unique_ptr<uint32_t[]> m_pixels;
+	// One entry a row, then one table a row of one entry a pixel.
+	std::unique_ptr<AliasEntry[]> m_rowTable;
+	std::unique_ptr<AliasEntry[]> m_pixelTables;
+	// Sum over the pixels of their luminance times GetRowSine, zero if the map is black.
+	double m_totalWeight;
+};
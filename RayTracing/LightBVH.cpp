@@ -0,0 +1,149 @@
+#include "LightBVH.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "../CollidableObjects/CollidableObject.h"
+#include "../Materials/IMaterial.h"
+#include "../WorldSnapshot.h"
+
+LightBVH::LightBVH()
+{
+}
+
+LightBVH::~LightBVH()
+{
+}
+
+void LightBVH::Build(const WorldSnapshot& world)
+{
+	m_nodes.clear();
+	m_objectLeaves.assign(world.GetCollidableObjects().size(), -1);
+
+	const std::vector<int>& emissiveObjects = world.GetEmissiveObjects();
+	if (emissiveObjects.empty())
+		return;
+
+	std::vector<Light> lights;
+	lights.reserve(emissiveObjects.size());
+	for (int objectIndex : emissiveObjects)
+	{
+		const CollidableObject& object = world.GetCollidableObject(objectIndex);
+		glm::vec3 emission = world.GetMaterialPtr(object.GetMaterialIndex())->GetEmission();
+		// Luminance times surface area, leaving out the constant factors.
+		float power = glm::dot(emission, glm::vec3(0.2126f, 0.7152f, 0.0722f)) * object.GetRadius() * object.GetRadius();
+		lights.push_back({ object.GetPosition(), object.GetRadius(), power, objectIndex });
+	}
+
+	m_nodes.reserve(lights.size() * 2 - 1);
+	BuildNode(lights, 0, lights.size(), -1);
+}
+
+int LightBVH::BuildNode(std::vector<Light>& lights, size_t begin, size_t end, int parent)
+{
+	int nodeIndex = (int)m_nodes.size();
+	m_nodes.emplace_back();
+
+	Node node;
+	node.m_boundsMin = glm::vec3(std::numeric_limits<float>::max());
+	node.m_boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+	node.m_power = 0.0f;
+	node.m_parent = parent;
+	node.m_secondChild = -1;
+	node.m_objectIndex = -1;
+	for (size_t i = begin; i < end; i++)
+	{
+		node.m_boundsMin = glm::min(node.m_boundsMin, lights[i].m_centre - glm::vec3(lights[i].m_radius));
+		node.m_boundsMax = glm::max(node.m_boundsMax, lights[i].m_centre + glm::vec3(lights[i].m_radius));
+		node.m_power += lights[i].m_power;
+	}
+
+	if (end - begin == 1)
+	{
+		node.m_objectIndex = lights[begin].m_objectIndex;
+		m_objectLeaves[node.m_objectIndex] = nodeIndex;
+		m_nodes[nodeIndex] = node;
+		return nodeIndex;
+	}
+
+	// Median split of the centres along the widest axis.
+	glm::vec3 extent = node.m_boundsMax - node.m_boundsMin;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	size_t middle = begin + (end - begin) / 2;
+	std::nth_element(lights.begin() + begin, lights.begin() + middle, lights.begin() + end,
+		[axis](const Light& a, const Light& b) { return a.m_centre[axis] < b.m_centre[axis]; });
+
+	m_nodes[nodeIndex] = node;
+	BuildNode(lights, begin, middle, nodeIndex);
+	int secondChild = BuildNode(lights, middle, end, nodeIndex);
+	m_nodes[nodeIndex].m_secondChild = secondChild;
+	return nodeIndex;
+}
+
+float LightBVH::GetImportance(const glm::vec3& origin, const Node& node) const
+{
+	// Squared distance to the nearest point of the bounds, but no nearer than their thinnest half extent, which for
+	// a single light is its radius, or a small minimum for a light of zero radius, which would otherwise divide by zero
+	// from anywhere within its bounds.
+	constexpr float minDistanceSquared = 1e-8f;
+	glm::vec3 halfExtent = (node.m_boundsMax - node.m_boundsMin) * 0.5f;
+	float minHalfExtent = glm::min(halfExtent.x, glm::min(halfExtent.y, halfExtent.z));
+	glm::vec3 toBounds = glm::max(glm::max(node.m_boundsMin - origin, origin - node.m_boundsMax), glm::vec3(0.0f));
+	float nearestSquared = glm::max(minHalfExtent * minHalfExtent, minDistanceSquared);
+	return node.m_power / glm::max(glm::dot(toBounds, toBounds), nearestSquared);
+}
+
+float LightBVH::GetFirstChildProbability(const glm::vec3& origin, int nodeIndex) const
+{
+	float first = GetImportance(origin, m_nodes[nodeIndex + 1]);
+	float second = GetImportance(origin, m_nodes[m_nodes[nodeIndex].m_secondChild]);
+	return first + second > 0.0f ? first / (first + second) : 0.5f;
+}
+
+int LightBVH::Sample(const glm::vec3& origin, float u, float& pmf) const
+{
+	// Largest float below one, u is rescaled at every step and must stay in [0, 1).
+	constexpr float oneMinusEpsilon = 0x1.fffffep-1f;
+
+	pmf = 0.0f;
+	if (m_nodes.empty())
+		return -1;
+
+	pmf = 1.0f;
+	int nodeIndex = 0;
+	while (m_nodes[nodeIndex].m_objectIndex < 0)
+	{
+		float firstProbability = GetFirstChildProbability(origin, nodeIndex);
+		if (u < firstProbability)
+		{
+			u = glm::min(u / firstProbability, oneMinusEpsilon);
+			pmf *= firstProbability;
+			nodeIndex = nodeIndex + 1;
+		}
+		else
+		{
+			u = glm::min((u - firstProbability) / (1.0f - firstProbability), oneMinusEpsilon);
+			pmf *= 1.0f - firstProbability;
+			nodeIndex = m_nodes[nodeIndex].m_secondChild;
+		}
+	}
+
+	return m_nodes[nodeIndex].m_objectIndex;
+}
+
+float LightBVH::GetPmf(const glm::vec3& origin, int objectIndex) const
+{
+	if (objectIndex < 0 || objectIndex >= (int)m_objectLeaves.size() || m_objectLeaves[objectIndex] < 0)
+		return 0.0f;
+
+	// The choices made on the way down, from the bottom up.
+	float pmf = 1.0f;
+	int nodeIndex = m_objectLeaves[objectIndex];
+	for (int parent = m_nodes[nodeIndex].m_parent; parent >= 0; nodeIndex = parent, parent = m_nodes[parent].m_parent)
+	{
+		float firstProbability = GetFirstChildProbability(origin, parent);
+		pmf *= nodeIndex == parent + 1 ? firstProbability : 1.0f - firstProbability;
+	}
+
+	return pmf;
+}
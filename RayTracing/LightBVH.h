@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+class WorldSnapshot;
+
+// Binary hierarchy over the emissive spheres of a snapshot, each node holding the bounds and total power of the lights
+// below it. A light is picked for a shading point by walking down from the root and choosing between the two children
+// in proportion to an estimate of how much light each sends to the point: its power over the squared distance to its
+// bounds. Bright and nearby lights are picked far more often than with uniform selection, at a cost of one walk down
+// the tree however many lights there are.
+class LightBVH
+{
+public:
+
+	LightBVH();
+	~LightBVH();
+
+	void Build(const WorldSnapshot& world);
+
+	inline bool IsEmpty() const
+	{
+		return m_nodes.empty();
+	}
+
+	// Picks an emissive object for the point with the uniform number u. The probability it was picked with is
+	// returned in pmf.
+	int Sample(const glm::vec3& origin, float u, float& pmf) const;
+
+	// Probability Sample picks the given emissive object for the point.
+	float GetPmf(const glm::vec3& origin, int objectIndex) const;
+
+private:
+
+	struct Light
+	{
+		glm::vec3 m_centre;
+		float m_radius;
+		float m_power;
+		int m_objectIndex;
+	};
+
+	struct Node
+	{
+		glm::vec3 m_boundsMin;
+		glm::vec3 m_boundsMax;
+		float m_power;
+		int m_parent;
+		// Nodes are stored depth first, so the first child of an interior node follows it. -1 for leaves.
+		int m_secondChild;
+		// The light of a leaf, -1 for interior nodes.
+		int m_objectIndex;
+	};
+
+	int BuildNode(std::vector<Light>& lights, size_t begin, size_t end, int parent);
+
+	float GetImportance(const glm::vec3& origin, const Node& node) const;
+	// Probability of going to the first child of an interior node.
+	float GetFirstChildProbability(const glm::vec3& origin, int nodeIndex) const;
+
+	std::vector<Node> m_nodes;
+	// Leaf of each object, -1 for objects that are not lights.
+	std::vector<int> m_objectLeaves;
+};
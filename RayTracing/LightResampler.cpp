@@ -0,0 +1,272 @@
+#include "LightResampler.h"
+
+#include "Ray.h"
+#include "RayTracer.h"
+#include "../CollidableObjects/CollidableObject.h"
+#include "../Materials/IMaterial.h"
+#include "../Utils/RandomStream.h"
+#include "../Utils/Sampling.h"
+#include "../WorldSnapshot.h"
+
+bool LightResampler::EstimateDirectLight(uint32_t x, uint32_t y, uint32_t frameIndex, const Ray& ray, const RayTracer& rayTracer,
+	const WorldSnapshot& world, const Reservoir* previousReservoirs, uint32_t width, uint32_t height,
+	Reservoir& reservoir, glm::vec3& directLight) const
+{
+	reservoir = Reservoir();
+	directLight = glm::vec3(0.0f);
+	if (!rayTracer.UsesLightSampling() || world.GetEmissiveObjects().empty())
+		return false;
+
+	RayCollisionData hit = rayTracer.TraceRay(ray, world);
+	if (hit.collisionDistance < 0.0001f)
+		return false;
+
+	const IMaterial& material = *world.GetMaterialPtr(world.GetCollidableObject(hit.objectIndex).GetMaterialIndex());
+	if (material.GetScatterPdf(hit, ray.GetDirection(), hit.worldNormal) <= 0.0f)
+		return false;
+
+	reservoir.m_surfacePosition = hit.worldPosition;
+	reservoir.m_surfaceNormal = hit.worldNormal;
+	reservoir.m_objectIndex = hit.objectIndex;
+
+	RandomStream random(x, y, frameIndex, RayTracer::ResamplingStream);
+	glm::vec3 origin = hit.worldPosition + hit.worldNormal * 0.0001f;
+
+	// New candidates are drawn as light sampling draws them, a light and then a direction within the cone it fills,
+	// but weighted by their density per unit area of the light so they can be compared with points reused from
+	// other surfaces.
+	Reservoir initial = reservoir;
+	for (uint32_t candidate = 0; candidate < m_settings.m_initialCandidates; candidate++)
+	{
+		float lightChoice = random.Float();
+		glm::vec2 u = random.Vec2();
+		float reservoirChoice = random.Float();
+
+		float selectionPmf;
+		int lightIndex = rayTracer.SelectLight(world, origin, lightChoice, selectionPmf);
+		if (selectionPmf <= 0.0f)
+			continue;
+
+		const CollidableObject& light = world.GetCollidableObject(lightIndex);
+		glm::vec3 toLight = light.GetPosition() - origin;
+		float distanceSquared = glm::dot(toLight, toLight);
+		float radiusSquared = light.GetRadius() * light.GetRadius();
+		if (distanceSquared <= radiusSquared)
+			continue;
+
+		float cosThetaMax = glm::sqrt(1.0f - radiusSquared / distanceSquared);
+		glm::vec3 direction = Sampling::UniformCone(u, toLight / glm::sqrt(distanceSquared), cosThetaMax);
+
+		// The near side of the sphere along the direction.
+		float along = glm::dot(direction, toLight);
+		float distance = along - glm::sqrt(glm::max(along * along - (distanceSquared - radiusSquared), 0.0f));
+		glm::vec3 lightNormal = glm::normalize(origin + direction * distance - light.GetPosition());
+		float cosLight = glm::dot(lightNormal, -direction);
+		if (cosLight <= 0.0f)
+			continue;
+
+		float areaPdf = selectionPmf * Sampling::UniformConePdf(cosThetaMax) * cosLight / (distance * distance);
+		float target = Luminance(GetUnshadowedLight(world, material, ray.GetDirection(), hit, lightIndex, lightNormal));
+		Update(initial, lightIndex, lightNormal, target / areaPdf, reservoirChoice);
+	}
+
+	initial.m_candidates = (float)m_settings.m_initialCandidates;
+	if (initial.m_lightIndex != -1)
+	{
+		float target = Luminance(GetUnshadowedLight(world, material, ray.GetDirection(), hit, initial.m_lightIndex, initial.m_lightNormal));
+		initial.m_weight = target > 0.0f ? initial.m_weightSum / (initial.m_candidates * target) : 0.0f;
+	}
+
+	// The pixel's own history, the new candidates merged with its reservoir from the last frame, is what is stored.
+	Source sources[1 + MaxSpatialNeighbours];
+	uint32_t numSources = 0;
+	sources[numSources++] = { &initial, hit, &material, ray.GetDirection(), initial.m_candidates };
+	if (m_settings.m_temporalReuse && AddSource(previousReservoirs[x + y * width], ray, hit, world, sources[numSources]))
+		numSources++;
+
+	Merge(sources, numSources, world, random, reservoir);
+	bool visible = IsVisible(reservoir, origin, rayTracer, world);
+	if (!visible)
+	{
+		// Dropped along with the history behind it, so blocked points are not reused.
+		reservoir.m_lightIndex = -1;
+		reservoir.m_weightSum = 0.0f;
+		reservoir.m_candidates = 0.0f;
+		reservoir.m_weight = 0.0f;
+	}
+
+	// The neighbours' histories are then merged in for shading this frame only. Storing the result would pass the same
+	// candidates on again through every neighbour that reused them, so they would be counted many times over.
+	Reservoir shading = reservoir;
+	uint32_t numNeighbours = glm::min(m_settings.m_spatialNeighbours, MaxSpatialNeighbours);
+	if (numNeighbours > 0)
+	{
+		numSources = 0;
+		sources[numSources++] = { &reservoir, hit, &material, ray.GetDirection(), reservoir.m_candidates };
+		for (uint32_t neighbour = 0; neighbour < numNeighbours; neighbour++)
+		{
+			glm::vec2 u = random.Vec2();
+
+			float sinAngle, cosAngle;
+			Sampling::SinCos2Pi(u.x, sinAngle, cosAngle);
+			float radius = m_settings.m_spatialRadius * glm::sqrt(u.y);
+			int neighbourX = (int)x + (int)glm::round(radius * cosAngle);
+			int neighbourY = (int)y + (int)glm::round(radius * sinAngle);
+			if (neighbourX < 0 || neighbourY < 0 || neighbourX >= (int)width || neighbourY >= (int)height ||
+				(neighbourX == (int)x && neighbourY == (int)y))
+				continue;
+
+			if (AddSource(previousReservoirs[neighbourX + neighbourY * (int)width], ray, hit, world, sources[numSources]))
+				numSources++;
+		}
+
+		if (numSources > 1)
+		{
+			Merge(sources, numSources, world, random, shading);
+			// The stored point's visibility is already known.
+			bool storedPoint = shading.m_lightIndex == reservoir.m_lightIndex && shading.m_lightNormal == reservoir.m_lightNormal;
+			visible = storedPoint ? visible : IsVisible(shading, origin, rayTracer, world);
+		}
+	}
+
+	if (!visible || shading.m_lightIndex == -1)
+		return true;
+
+	directLight = material.GetReflectance() * shading.m_weight *
+		GetUnshadowedLight(world, material, ray.GetDirection(), hit, shading.m_lightIndex, shading.m_lightNormal);
+	return true;
+}
+
+void LightResampler::Merge(const Source* sources, uint32_t numSources, const WorldSnapshot& world, RandomStream& random,
+	Reservoir& reservoir) const
+{
+	// The first source is the surface the merged reservoir is for.
+	reservoir.m_lightIndex = -1;
+	reservoir.m_weightSum = 0.0f;
+	reservoir.m_candidates = 0.0f;
+	reservoir.m_weight = 0.0f;
+
+	// Each point is weighted by the share of all the candidates behind it that would have been drawn from the
+	// surface that drew it, the generalised balance heuristic, rather than by the source's share of the candidates.
+	for (uint32_t source = 0; source < numSources; source++)
+	{
+		const Reservoir& other = *sources[source].m_reservoir;
+		float reservoirChoice = random.Float();
+		reservoir.m_candidates += sources[source].m_candidates;
+		if (other.m_lightIndex == -1 || other.m_weight <= 0.0f)
+			continue;
+
+		float target = GetTarget(world, sources[0], other.m_lightIndex, other.m_lightNormal);
+		if (target <= 0.0f)
+			continue;
+
+		float sourceDensity = 0.0f;
+		float totalDensity = 0.0f;
+		for (uint32_t i = 0; i < numSources; i++)
+		{
+			float density = sources[i].m_candidates * (i == 0 ? target : GetTarget(world, sources[i], other.m_lightIndex, other.m_lightNormal));
+			totalDensity += density;
+			sourceDensity = i == source ? density : sourceDensity;
+		}
+
+		Update(reservoir, other.m_lightIndex, other.m_lightNormal, sourceDensity / totalDensity * target * other.m_weight, reservoirChoice);
+	}
+
+	reservoir.m_candidates = glm::min(reservoir.m_candidates, m_settings.m_maxHistory * (float)m_settings.m_initialCandidates);
+	if (reservoir.m_lightIndex == -1)
+		return;
+
+	float target = GetTarget(world, sources[0], reservoir.m_lightIndex, reservoir.m_lightNormal);
+	reservoir.m_weight = target > 0.0f ? reservoir.m_weightSum / target : 0.0f;
+}
+
+bool LightResampler::IsVisible(const Reservoir& reservoir, const glm::vec3& origin, const RayTracer& rayTracer,
+	const WorldSnapshot& world) const
+{
+	if (reservoir.m_lightIndex == -1 || reservoir.m_weight <= 0.0f)
+		return true;
+
+	const CollidableObject& light = world.GetCollidableObject(reservoir.m_lightIndex);
+	glm::vec3 direction = glm::normalize(light.GetPosition() + reservoir.m_lightNormal * light.GetRadius() - origin);
+	RENDER_STATS_ADD(*rayTracer.m_renderStats, ShadowRays, 1);
+	RayCollisionData shadowHit = rayTracer.TraceRay(Ray(origin, direction), world);
+	return shadowHit.collisionDistance >= 0.0001f && shadowHit.objectIndex == reservoir.m_lightIndex;
+}
+
+bool LightResampler::AddSource(const Reservoir& other, const Ray& ray, const RayCollisionData& hit, const WorldSnapshot& world,
+	Source& source) const
+{
+	if (other.m_candidates <= 0.0f || other.m_objectIndex < 0 || other.m_objectIndex >= (int)world.GetCollidableObjects().size())
+		return false;
+
+	// Points found for a surface facing another way or at a different depth are rarely useful here.
+	glm::vec3 toSurface = other.m_surfacePosition - ray.GetOrigin();
+	float depth = glm::length(toSurface);
+	if (glm::dot(other.m_surfaceNormal, hit.worldNormal) < 0.9f || glm::abs(depth - hit.collisionDistance) > 0.1f * hit.collisionDistance)
+		return false;
+
+	source.m_reservoir = &other;
+	source.m_hit.objectIndex = other.m_objectIndex;
+	source.m_hit.collisionDistance = depth;
+	source.m_hit.worldNormal = other.m_surfaceNormal;
+	source.m_hit.worldPosition = other.m_surfacePosition;
+	source.m_material = world.GetMaterialPtr(world.GetCollidableObject(other.m_objectIndex).GetMaterialIndex());
+	source.m_incoming = toSurface / depth;
+	// Counted as no more than m_maxHistory frames, so old points give way to new ones.
+	source.m_candidates = glm::min(other.m_candidates, m_settings.m_maxHistory * (float)m_settings.m_initialCandidates);
+	return true;
+}
+
+glm::vec3 LightResampler::GetUnshadowedLight(const WorldSnapshot& world, const IMaterial& material, const glm::vec3& incoming,
+	const RayCollisionData& hit, int lightIndex, const glm::vec3& lightNormal) const
+{
+	// The scene may have changed since a reused reservoir was made.
+	if (lightIndex < 0 || lightIndex >= (int)world.GetCollidableObjects().size())
+		return glm::vec3(0.0f);
+
+	const CollidableObject& light = world.GetCollidableObject(lightIndex);
+	glm::vec3 emission = world.GetMaterialPtr(light.GetMaterialIndex())->GetEmission();
+	if (!glm::any(glm::greaterThan(emission, glm::vec3(0.0f))))
+		return glm::vec3(0.0f);
+
+	glm::vec3 origin = hit.worldPosition + hit.worldNormal * 0.0001f;
+	glm::vec3 toPoint = light.GetPosition() + lightNormal * light.GetRadius() - origin;
+	float distanceSquared = glm::dot(toPoint, toPoint);
+	glm::vec3 direction = toPoint / glm::sqrt(distanceSquared);
+
+	float cosLight = glm::dot(lightNormal, -direction);
+	if (cosLight <= 0.0f)
+		return glm::vec3(0.0f);
+
+	float scatterPdf = material.GetScatterPdf(hit, incoming, direction);
+	if (scatterPdf <= 0.0f)
+		return glm::vec3(0.0f);
+
+	// Light per unit area of the emitter. With the surface's reflectance, the light reflected along the ray.
+	return emission * (scatterPdf * cosLight / distanceSquared);
+}
+
+float LightResampler::GetTarget(const WorldSnapshot& world, const Source& source, int lightIndex, const glm::vec3& lightNormal) const
+{
+	return Luminance(GetUnshadowedLight(world, *source.m_material, source.m_incoming, source.m_hit, lightIndex, lightNormal));
+}
+
+bool LightResampler::Update(Reservoir& reservoir, int lightIndex, const glm::vec3& lightNormal, float weight, float u)
+{
+	if (!(weight > 0.0f))
+		return false;
+
+	// Weighted reservoir sampling, each point so far is kept with probability in proportion to its weight.
+	reservoir.m_weightSum += weight;
+	if (u * reservoir.m_weightSum >= weight)
+		return false;
+
+	reservoir.m_lightIndex = lightIndex;
+	reservoir.m_lightNormal = lightNormal;
+	return true;
+}
+
+float LightResampler::Luminance(const glm::vec3& colour)
+{
+	return glm::dot(colour, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Ray.h"
+
+class IMaterial;
+class RandomStream;
+class RayTracer;
+class WorldSnapshot;
+
+// Spatiotemporal reservoir resampling of direct light (ReSTIR, Bitterli et al. 2020) for the first surface each camera
+// ray hits. Every frame a pixel draws a few candidate points on emissive spheres with the ray tracer's light selection
+// and keeps one of them in a reservoir, chosen in proportion to the unshadowed light it sends to the surface. The
+// pixel's reservoir from the previous frame is merged in, so the point kept has in effect been picked from the
+// candidates of many frames. One shadow ray validates it before it is stored; a blocked point is dropped along with
+// its history. The reservoirs of a few nearby pixels with similar surfaces can also be merged in, for shading the
+// current frame only.
+// Reservoirs are merged with the generalised balance heuristic, weighting each point by how likely every merged
+// reservoir's surface was to pick it, so a point a neighbour could barely see can not turn into a bright speck here.
+// Neighbours are read only from the previous frame's reservoirs, so pixels can be resampled in any order and on any
+// thread.
+class LightResampler
+{
+public:
+
+	struct Reservoir
+	{
+		// The point kept, as the emissive object and the unit direction from its centre. Kept relative to the object
+		// so it follows the object if it moves.
+		glm::vec3 m_lightNormal{ 0.0f };
+		int m_lightIndex = -1;
+		float m_weightSum = 0.0f;
+		// Number of candidates the reservoir has seen. Zero for an empty reservoir.
+		float m_candidates = 0.0f;
+		// Weight of the point kept, making the light it sends an unbiased estimate of the direct light.
+		float m_weight = 0.0f;
+		// The surface the reservoir was built for, to weight its point when it is reused.
+		glm::vec3 m_surfacePosition{ 0.0f };
+		glm::vec3 m_surfaceNormal{ 0.0f };
+		int m_objectIndex = -1;
+	};
+
+	static constexpr uint32_t MaxSpatialNeighbours = 8;
+
+	struct Settings
+	{
+		// New candidate points drawn each frame.
+		uint32_t m_initialCandidates = 8;
+		bool m_temporalReuse = true;
+		// Reservoirs of the previous frame merged from random pixels within m_spatialRadius pixels, at most
+		// MaxSpatialNeighbours. Off by default: where most of a pixel's light comes from a few lights close by, as in
+		// World::LoadManyLightsScene, neighbours rarely share them and their points add more noise than they remove.
+		uint32_t m_spatialNeighbours = 0;
+		float m_spatialRadius = 16.0f;
+		// A reused reservoir counts as at most this many frames of candidates, so old samples give way to new ones.
+		float m_maxHistory = 20.0f;
+	};
+
+	inline void SetSettings(const Settings& settings)
+	{
+		m_settings = settings;
+	}
+
+	inline const Settings& GetSettings() const
+	{
+		return m_settings;
+	}
+
+	// Estimates the light reaching the surface the camera ray hits straight from emissive spheres, including the
+	// surface's reflectance, and builds the pixel's reservoir for the next frame. previousReservoirs holds the last
+	// frame's reservoirs of the whole width x height image, made with camera rays from the same origin. frameIndex must
+	// change every frame.
+	// Returns false, with an empty reservoir, when the ray tracer does not sample lights from the surface hit, in
+	// which case the whole pixel is left to RayTracer::CalculatePixelColour. Otherwise the rest of the pixel is given by
+	// CalculatePixelColour with firstHitLights false.
+	bool EstimateDirectLight(uint32_t x, uint32_t y, uint32_t frameIndex, const Ray& ray, const RayTracer& rayTracer,
+		const WorldSnapshot& world, const Reservoir* previousReservoirs, uint32_t width, uint32_t height,
+		Reservoir& reservoir, glm::vec3& directLight) const;
+
+private:
+
+	// A reservoir being merged and the surface it was made for.
+	struct Source
+	{
+		const Reservoir* m_reservoir;
+		RayCollisionData m_hit;
+		const IMaterial* m_material;
+		glm::vec3 m_incoming;
+		float m_candidates;
+	};
+
+	// Merges the sources' points into the reservoir, which is for the surface of the first source.
+	void Merge(const Source* sources, uint32_t numSources, const WorldSnapshot& world, RandomStream& random,
+		Reservoir& reservoir) const;
+	// Whether the reservoir's point can be seen from the origin. True for a reservoir without a point.
+	bool IsVisible(const Reservoir& reservoir, const glm::vec3& origin, const RayTracer& rayTracer, const WorldSnapshot& world) const;
+	// Fills in source for merging another reservoir, if it is not empty and its surface is like the one hit.
+	bool AddSource(const Reservoir& other, const Ray& ray, const RayCollisionData& hit, const WorldSnapshot& world,
+		Source& source) const;
+	// Light, ignoring visibility, sent to the surface from the given point on an emissive object, weighted by the
+	// density with which the material scatters towards it. Its luminance is the resampling target.
+	glm::vec3 GetUnshadowedLight(const WorldSnapshot& world, const IMaterial& material, const glm::vec3& incoming,
+		const RayCollisionData& hit, int lightIndex, const glm::vec3& lightNormal) const;
+	float GetTarget(const WorldSnapshot& world, const Source& source, int lightIndex, const glm::vec3& lightNormal) const;
+	static bool Update(Reservoir& reservoir, int lightIndex, const glm::vec3& lightNormal, float weight, float u);
+	static float Luminance(const glm::vec3& colour);
+
+	Settings m_settings;
+};
@@ -0,0 +1,476 @@
+#include "PathGuide.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <glm/gtc/constants.hpp>
+
+#include "../CollidableObjects/CollidableObject.h"
+#include "../Utils/Sampling.h"
+#include "../WorldSnapshot.h"
+
+namespace
+{
+	// Deep enough for cells a few hundredths of the scene across on every axis, well past what the split threshold
+	// allows in practice.
+	constexpr uint32_t MaxSpatialDepth = 48;
+	constexpr uint32_t MaxDirectionalDepth = 20;
+	// Largest float below one, keeping points remapped within a node inside it.
+	constexpr float OneMinusEpsilon = 0x1.fffffep-1f;
+	// Share of the first iteration's training positions left outside the fitted bounds at each end of each axis, so a
+	// few rays grazing a ground sphere far away do not stretch them.
+	constexpr float BoundsOutlierFraction = 0.005f;
+}
+
+PathGuide::PathGuide() :
+	m_worldVersion(0),
+	m_boundsMin(0.0f),
+	m_boundsSize(1.0f),
+	m_nodes(1, { { 0, 0 }, 0, 0 }),
+	m_boundsSamples(new glm::vec3[MaxBoundsSamples]),
+	m_numBoundsSamples(0),
+	m_cells(NumOrientations),
+	m_iteration(0),
+	m_iterationPasses(1),
+	m_passes(0)
+{
+}
+
+PathGuide::~PathGuide()
+{
+}
+
+void PathGuide::Prepare(const WorldSnapshot& world)
+{
+	if (world.GetVersion() != m_worldVersion)
+		Reset(world);
+}
+
+void PathGuide::Reset(const WorldSnapshot& world)
+{
+	m_worldVersion = world.GetVersion();
+
+	glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+	m_boundsMin = glm::vec3(std::numeric_limits<float>::max());
+	for (const auto& object : world.GetCollidableObjects())
+	{
+		m_boundsMin = glm::min(m_boundsMin, object->GetPosition() - object->GetRadius());
+		boundsMax = glm::max(boundsMax, object->GetPosition() + object->GetRadius());
+	}
+
+	if (world.GetCollidableObjects().empty())
+	{
+		m_boundsMin = glm::vec3(0.0f);
+		boundsMax = glm::vec3(1.0f);
+	}
+	m_boundsSize = glm::max(boundsMax - m_boundsMin, glm::vec3(0.0001f));
+
+	m_nodes.assign(1, { { 0, 0 }, 0, 0 });
+	m_cells.assign(NumOrientations, Cell());
+	m_numBoundsSamples.store(0, std::memory_order_relaxed);
+	m_iteration = 0;
+	m_iterationPasses = 1;
+	m_passes = 0;
+}
+
+void PathGuide::EndPass()
+{
+	if (++m_passes < m_iterationPasses)
+		return;
+
+	// The tree is still a single leaf, so cells do not depend on the bounds yet.
+	if (m_iteration == 0)
+		FitBounds();
+
+	// Splitting only adds nodes at the end, so the leaves to look at are all below the current size.
+	uint32_t threshold = (uint32_t)((float)m_settings.m_splitSamples * std::sqrt((float)m_iterationPasses));
+	uint32_t numNodes = (uint32_t)m_nodes.size();
+	for (uint32_t node = 0; node < numNodes; node++)
+	{
+		if (m_nodes[node].m_children[0] != 0)
+			continue;
+
+		uint32_t samples = 0;
+		for (uint32_t orientation = 0; orientation < NumOrientations; orientation++)
+			samples += m_cells[m_nodes[node].m_cell + orientation].m_samples.load(std::memory_order_relaxed);
+		Split(node, samples, threshold);
+	}
+
+	for (Cell& cell : m_cells)
+	{
+		// A cell no path reached keeps what it had.
+		if (cell.m_training.GetTotal() > 0.0f)
+		{
+			cell.m_sampling = cell.m_training;
+			cell.m_trainedSamples = cell.m_samples.load(std::memory_order_relaxed);
+		}
+		cell.m_training.Build(cell.m_sampling, m_settings.m_splitFraction);
+		cell.m_samples.store(0, std::memory_order_relaxed);
+
+		// Nothing is recorded for a cell that was not guided, or whose paths found no light.
+		uint32_t best = 0;
+		float bestMoment = cell.m_moments[0].load(std::memory_order_relaxed);
+		for (uint32_t fraction = 1; fraction < NumGuideFractions; fraction++)
+		{
+			float moment = cell.m_moments[fraction].load(std::memory_order_relaxed);
+			if (moment < bestMoment)
+			{
+				best = fraction;
+				bestMoment = moment;
+			}
+		}
+		if (bestMoment > 0.0f)
+			cell.m_guideFraction = GuideFractions[best];
+		for (std::atomic<float>& moment : cell.m_moments)
+			moment.store(0.0f, std::memory_order_relaxed);
+	}
+
+	m_iteration++;
+	m_iterationPasses *= 2;
+	m_passes = 0;
+}
+
+void PathGuide::Split(uint32_t node, uint32_t samples, uint32_t threshold)
+{
+	if (samples <= threshold || m_nodes[node].m_depth >= MaxSpatialDepth)
+		return;
+
+	// Both halves start from what the whole cell learnt.
+	uint32_t cell = m_nodes[node].m_cell;
+	uint32_t newCell = (uint32_t)m_cells.size();
+	for (uint32_t orientation = 0; orientation < NumOrientations; orientation++)
+	{
+		Cell copy = m_cells[cell + orientation];
+		m_cells.push_back(copy);
+	}
+
+	uint32_t firstChild = (uint32_t)m_nodes.size();
+	uint32_t depth = m_nodes[node].m_depth + 1;
+	m_nodes[node].m_children[0] = firstChild;
+	m_nodes[node].m_children[1] = firstChild + 1;
+	m_nodes.push_back({ { 0, 0 }, depth, cell });
+	m_nodes.push_back({ { 0, 0 }, depth, newCell });
+
+	Split(firstChild, samples / 2, threshold);
+	Split(firstChild + 1, samples / 2, threshold);
+}
+
+void PathGuide::FitBounds()
+{
+	uint32_t numSamples = glm::min(m_numBoundsSamples.load(std::memory_order_relaxed), MaxBoundsSamples);
+	if (numSamples == 0)
+		return;
+
+	// Only ever shrunk, the objects' bounds hold every surface.
+	uint32_t outliers = (uint32_t)((float)numSamples * BoundsOutlierFraction);
+	std::vector<float> values(numSamples);
+	glm::vec3 boundsMin = m_boundsMin;
+	glm::vec3 boundsMax = m_boundsMin + m_boundsSize;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (uint32_t i = 0; i < numSamples; i++)
+			values[i] = m_boundsSamples[i][axis];
+
+		std::nth_element(values.begin(), values.begin() + outliers, values.end());
+		float low = values[outliers];
+		std::nth_element(values.begin(), values.end() - 1 - outliers, values.end());
+		float high = values[numSamples - 1 - outliers];
+
+		// A little room either side so the surfaces at the edges are not all clamped into the outermost cells.
+		float margin = (high - low) * 0.01f + 0.001f;
+		boundsMin[axis] = glm::max(boundsMin[axis], low - margin);
+		boundsMax[axis] = glm::min(boundsMax[axis], high + margin);
+	}
+
+	m_boundsMin = boundsMin;
+	m_boundsSize = glm::max(boundsMax - boundsMin, glm::vec3(0.0001f));
+}
+
+int PathGuide::FindCell(const glm::vec3& position, const glm::vec3& normal) const
+{
+	glm::vec3 point = glm::clamp((position - m_boundsMin) / m_boundsSize, glm::vec3(0.0f), glm::vec3(OneMinusEpsilon));
+	uint32_t node = 0;
+	while (m_nodes[node].m_children[0] != 0)
+	{
+		int axis = (int)(m_nodes[node].m_depth % 3);
+		int half = point[axis] >= 0.5f ? 1 : 0;
+		point[axis] = point[axis] * 2.0f - (float)half;
+		node = m_nodes[node].m_children[half];
+	}
+
+	// The axis the normal is closest to and which way along it.
+	glm::vec3 size = glm::abs(normal);
+	int axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+	uint32_t orientation = (uint32_t)axis * 2 + (normal[axis] < 0.0f ? 1 : 0);
+	return (int)(m_nodes[node].m_cell + orientation);
+}
+
+float PathGuide::GetGuideFraction(int cell) const
+{
+	const Cell& current = m_cells[cell];
+	if (current.m_trainedSamples < m_settings.m_minSamples || current.m_sampling.GetTotal() <= 0.0f)
+		return 0.0f;
+	return m_settings.m_learnGuideFraction && current.m_guideFraction >= 0.0f ? current.m_guideFraction :
+		m_settings.m_guideFraction;
+}
+
+glm::vec3 PathGuide::Sample(int cell, const glm::vec2& u, float& pdf) const
+{
+	glm::vec3 direction = DirectionalTree::ToDirection(m_cells[cell].m_sampling.Sample(u, pdf));
+	pdf /= 4.0f * glm::pi<float>();
+	return direction;
+}
+
+float PathGuide::GetPdf(int cell, const glm::vec3& direction) const
+{
+	// The square maps to the sphere with equal area, 4 pi steradians.
+	return m_cells[cell].m_sampling.GetPdf(DirectionalTree::ToSquare(direction)) / (4.0f * glm::pi<float>());
+}
+
+void PathGuide::Train(const Vertex* vertices, uint32_t numVertices, const glm::vec3& colour)
+{
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		const Vertex& vertex = vertices[i];
+		Cell& cell = m_cells[vertex.m_cell];
+		cell.m_samples.fetch_add(1, std::memory_order_relaxed);
+		if (m_iteration == 0)
+		{
+			uint32_t sample = m_numBoundsSamples.fetch_add(1, std::memory_order_relaxed);
+			if (sample < MaxBoundsSamples)
+				m_boundsSamples[sample] = vertex.m_position;
+		}
+
+		// Everything the path collected after the surface came in along the scattered ray, scaled by the weight it
+		// had there.
+		glm::vec3 collected = glm::max(colour - vertex.m_radiance, glm::vec3(0.0f));
+		glm::vec3 incoming(0.0f);
+		for (int channel = 0; channel < 3; channel++)
+		{
+			if (vertex.m_throughput[channel] > 0.0f)
+				incoming[channel] = collected[channel] / vertex.m_throughput[channel];
+		}
+
+		// Weighted by the material's density, so the guide learns the light reflected from each direction rather than
+		// the light arriving, which for a diffuse surface would send rays towards the horizon where it barely sees any.
+		// Divided by the density the direction was picked with, so each node's sum estimates the total over its
+		// directions.
+		float value = Luminance(incoming) * vertex.m_materialPdf / vertex.m_pdf;
+		if (!(value > 0.0f) || !std::isfinite(value))
+			continue;
+		cell.m_training.Record(DirectionalTree::ToSquare(vertex.m_direction), value);
+
+		// The second moment with another mixture of the two densities, estimated from a direction picked with this one.
+		// Only known where the guide's density was.
+		if (GetGuideFraction(vertex.m_cell) <= 0.0f)
+			continue;
+		for (uint32_t fraction = 0; fraction < NumGuideFractions; fraction++)
+		{
+			float guideFraction = GuideFractions[fraction];
+			float pdf = guideFraction * vertex.m_guidePdf + (1.0f - guideFraction) * vertex.m_materialPdf;
+			cell.m_moments[fraction].fetch_add(value * value * vertex.m_pdf / pdf, std::memory_order_relaxed);
+		}
+	}
+}
+
+float PathGuide::Luminance(const glm::vec3& colour)
+{
+	return glm::dot(colour, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+PathGuide::Cell::Cell() :
+	m_samples(0),
+	m_trainedSamples(0),
+	m_moments{ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+	m_guideFraction(-1.0f)
+{
+}
+
+PathGuide::Cell::Cell(const Cell& other)
+{
+	*this = other;
+}
+
+PathGuide::Cell& PathGuide::Cell::operator=(const Cell& other)
+{
+	m_sampling = other.m_sampling;
+	m_training = other.m_training;
+	m_samples.store(other.m_samples.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	m_trainedSamples = other.m_trainedSamples;
+	for (uint32_t fraction = 0; fraction < NumGuideFractions; fraction++)
+		m_moments[fraction].store(other.m_moments[fraction].load(std::memory_order_relaxed), std::memory_order_relaxed);
+	m_guideFraction = other.m_guideFraction;
+	return *this;
+}
+
+PathGuide::DirectionalTree::Node::Node() :
+	m_sums{ 0.0f, 0.0f, 0.0f, 0.0f },
+	m_children{ 0, 0, 0, 0 }
+{
+}
+
+PathGuide::DirectionalTree::Node::Node(const Node& other)
+{
+	*this = other;
+}
+
+PathGuide::DirectionalTree::Node& PathGuide::DirectionalTree::Node::operator=(const Node& other)
+{
+	for (int quarter = 0; quarter < 4; quarter++)
+	{
+		m_sums[quarter].store(other.m_sums[quarter].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		m_children[quarter] = other.m_children[quarter];
+	}
+	return *this;
+}
+
+PathGuide::DirectionalTree::DirectionalTree() :
+	m_nodes(1)
+{
+}
+
+int PathGuide::DirectionalTree::GetQuarter(glm::vec2& point)
+{
+	int x = point.x >= 0.5f ? 1 : 0;
+	int y = point.y >= 0.5f ? 1 : 0;
+	point = point * 2.0f - glm::vec2((float)x, (float)y);
+	return x + 2 * y;
+}
+
+void PathGuide::DirectionalTree::Record(glm::vec2 point, float value)
+{
+	uint32_t node = 0;
+	for (;;)
+	{
+		int quarter = GetQuarter(point);
+		m_nodes[node].m_sums[quarter].fetch_add(value, std::memory_order_relaxed);
+		node = m_nodes[node].m_children[quarter];
+		if (node == 0)
+			return;
+	}
+}
+
+float PathGuide::DirectionalTree::GetTotal() const
+{
+	const Node& root = m_nodes[0];
+	return root.m_sums[0].load(std::memory_order_relaxed) + root.m_sums[1].load(std::memory_order_relaxed) +
+		root.m_sums[2].load(std::memory_order_relaxed) + root.m_sums[3].load(std::memory_order_relaxed);
+}
+
+glm::vec2 PathGuide::DirectionalTree::Sample(glm::vec2 u, float& pdf) const
+{
+	glm::vec2 origin(0.0f);
+	float size = 1.0f;
+	pdf = 1.0f;
+	uint32_t node = 0;
+	for (;;)
+	{
+		const Node& current = m_nodes[node];
+		float sums[4];
+		for (int quarter = 0; quarter < 4; quarter++)
+			sums[quarter] = current.m_sums[quarter].load(std::memory_order_relaxed);
+
+		// The column and then the row within it, each number rescaled to be uniform again for the next level.
+		float left = sums[0] + sums[2];
+		float right = sums[1] + sums[3];
+		float column = u.x * (left + right);
+		int x = column < left || right <= 0.0f ? 0 : 1;
+		u.x = x == 0 ? column / left : (column - left) / right;
+
+		float lower = sums[x];
+		float upper = sums[x + 2];
+		float row = u.y * (lower + upper);
+		int y = row < lower || upper <= 0.0f ? 0 : 1;
+		u.y = y == 0 ? row / lower : (row - lower) / upper;
+		u = glm::min(u, glm::vec2(OneMinusEpsilon));
+
+		// As GetPdf works it out, saving a second walk down the tree.
+		pdf *= 4.0f * sums[x + 2 * y] / (left + right);
+		size *= 0.5f;
+		origin += glm::vec2((float)x, (float)y) * size;
+		node = current.m_children[x + 2 * y];
+		if (node == 0)
+			return glm::min(origin + u * size, glm::vec2(OneMinusEpsilon));
+	}
+}
+
+float PathGuide::DirectionalTree::GetPdf(glm::vec2 point) const
+{
+	float pdf = 1.0f;
+	uint32_t node = 0;
+	for (;;)
+	{
+		const Node& current = m_nodes[node];
+		float total = current.m_sums[0].load(std::memory_order_relaxed) + current.m_sums[1].load(std::memory_order_relaxed) +
+			current.m_sums[2].load(std::memory_order_relaxed) + current.m_sums[3].load(std::memory_order_relaxed);
+		if (total <= 0.0f)
+			return 0.0f;
+
+		int quarter = GetQuarter(point);
+		pdf *= 4.0f * current.m_sums[quarter].load(std::memory_order_relaxed) / total;
+		node = current.m_children[quarter];
+		if (node == 0)
+			return pdf;
+	}
+}
+
+void PathGuide::DirectionalTree::Build(const DirectionalTree& trained, float splitFraction)
+{
+	m_nodes.assign(1, Node());
+	float total = trained.GetTotal();
+	if (total <= 0.0f)
+		return;
+
+	// Nodes still to look at, with the trained node covering the same area if it was split that far. Below that the
+	// light is taken to be spread evenly.
+	struct Entry
+	{
+		uint32_t m_node;
+		uint32_t m_trainedNode;
+		bool m_trained;
+		float m_light;
+		uint32_t m_depth;
+	};
+	std::vector<Entry> stack;
+	stack.push_back({ 0, 0, true, total, 1 });
+	while (!stack.empty())
+	{
+		Entry entry = stack.back();
+		stack.pop_back();
+		if (entry.m_depth >= MaxDirectionalDepth)
+			continue;
+
+		for (int quarter = 0; quarter < 4; quarter++)
+		{
+			float light = entry.m_trained ? trained.m_nodes[entry.m_trainedNode].m_sums[quarter].load(std::memory_order_relaxed) :
+				entry.m_light * 0.25f;
+			if (light <= total * splitFraction)
+				continue;
+
+			uint32_t child = (uint32_t)m_nodes.size();
+			m_nodes.emplace_back();
+			m_nodes[entry.m_node].m_children[quarter] = child;
+
+			uint32_t trainedChild = entry.m_trained ? trained.m_nodes[entry.m_trainedNode].m_children[quarter] : 0;
+			stack.push_back({ child, trainedChild, trainedChild != 0, light, entry.m_depth + 1 });
+		}
+	}
+}
+
+glm::vec2 PathGuide::DirectionalTree::ToSquare(const glm::vec3& direction)
+{
+	// Cylindrical coordinates, the height on the sphere and the angle around it.
+	float angle = std::atan2(direction.y, direction.x) * (0.5f / glm::pi<float>());
+	glm::vec2 point((direction.z + 1.0f) * 0.5f, angle < 0.0f ? angle + 1.0f : angle);
+	return glm::clamp(point, glm::vec2(0.0f), glm::vec2(OneMinusEpsilon));
+}
+
+glm::vec3 PathGuide::DirectionalTree::ToDirection(const glm::vec2& point)
+{
+	float z = point.x * 2.0f - 1.0f;
+	float r = glm::sqrt(glm::max(0.0f, 1.0f - z * z));
+	float sinAngle;
+	float cosAngle;
+	Sampling::SinCos2Pi(point.y, sinAngle, cosAngle);
+	return glm::vec3(r * cosAngle, r * sinAngle, z);
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+class WorldSnapshot;
+
+// Online path guiding with a spatial-directional tree (Muller et al., "Practical Path Guiding for Efficient Light-
+// Transport Simulation", 2017). A binary tree splits the scene's bounds into cells and each cell has a quadtree over
+// the sphere of directions for each way its surfaces can face, holding how much light they reflect from each. Guided paths pick some of
+// their scattered rays from the quadtree at the surface hit, the rest with the material, and deposit the light they go
+// on to find into a second copy of the tree being trained.
+// Training runs in iterations of 1, 2, 4 ... passes over the image. At the end of each, cells that took many samples
+// are split, the trained quadtrees become the ones sampled, and fresh quadtrees for training are built with nodes
+// split wherever the trained ones found most light.
+// Sampling only reads, and training only adds to counters with atomics in a tree whose structure is fixed during a
+// pass, so both are safe on any number of threads. Prepare and EndPass must be called while nothing is being traced.
+class PathGuide
+{
+public:
+
+	struct Settings
+	{
+		// Probability of a guided surface picking its scattered ray from the guide rather than the material, until its
+		// cell has learnt one of its own.
+		float m_guideFraction = 0.5f;
+		// Each cell picks the fraction that would have given the paths it trained on the least variance. Where the
+		// material alone already samples the light well, guiding adds noise and the cell learns to guide less.
+		bool m_learnGuideFraction = true;
+		// Cells whose distribution was learnt from fewer samples than this are not guided, a few bright paths would
+		// otherwise send most rays after them.
+		uint32_t m_minSamples = 128;
+		// A cell is split once it has taken more than this many samples in an iteration, times the square root of the
+		// iteration's passes so cells keep collecting more samples as they are refined.
+		uint32_t m_splitSamples = 4000;
+		// Quadtree nodes holding more than this fraction of a cell's light are split for the next iteration.
+		float m_splitFraction = 0.01f;
+	};
+
+	// Most surfaces along a path that it can train the guide with, the rest are left out.
+	static constexpr uint32_t MaxPathVertices = 16;
+
+	// A guided surface on a path, with what the path had when it left it, from which the light arriving along the
+	// scattered ray is worked out once the path is finished.
+	struct Vertex
+	{
+		int m_cell;
+		glm::vec3 m_position;
+		glm::vec3 m_direction;
+		// Density the direction was picked with, and the material's and guide's alone.
+		float m_pdf;
+		float m_materialPdf;
+		float m_guidePdf;
+		// Weight of the light arriving along the direction and the light collected before it.
+		glm::vec3 m_throughput;
+		glm::vec3 m_radiance;
+	};
+
+	PathGuide();
+	~PathGuide();
+
+	inline void SetSettings(const Settings& settings)
+	{
+		m_settings = settings;
+	}
+
+	inline const Settings& GetSettings() const
+	{
+		return m_settings;
+	}
+
+	// Starts again from nothing if the world has changed since the guide was trained.
+	void Prepare(const WorldSnapshot& world);
+	void Reset(const WorldSnapshot& world);
+	// Counts a finished pass over the image, refining the tree at the end of each iteration.
+	void EndPass();
+
+	inline uint32_t GetNumCells() const
+	{
+		return (uint32_t)m_cells.size();
+	}
+
+	// Number of times the tree has been refined.
+	inline uint32_t GetIteration() const
+	{
+		return m_iteration;
+	}
+
+	// The cell for a surface at the position facing along the unit normal.
+	int FindCell(const glm::vec3& position, const glm::vec3& normal) const;
+	// Probability of picking a direction at the cell from the guide, zero until it has learnt enough to sample.
+	float GetGuideFraction(int cell) const;
+	// A unit direction picked in proportion to the light the cell has learnt arrives from it, and the density it was
+	// picked with.
+	glm::vec3 Sample(int cell, const glm::vec2& u, float& pdf) const;
+	// Density per unit solid angle with which Sample picks the unit direction.
+	float GetPdf(int cell, const glm::vec3& direction) const;
+
+	// Trains the guide on a finished path that ended with the given colour.
+	void Train(const Vertex* vertices, uint32_t numVertices, const glm::vec3& colour);
+
+private:
+
+	// Quadtree over the square [0, 1]^2, which maps to the sphere of directions with equal area.
+	class DirectionalTree
+	{
+	public:
+
+		DirectionalTree();
+
+		// Atomically adds value to every node containing the point.
+		void Record(glm::vec2 point, float value);
+		float GetTotal() const;
+		glm::vec2 Sample(glm::vec2 u, float& pdf) const;
+		// Density of Sample per unit area of the square.
+		float GetPdf(glm::vec2 point) const;
+		// Rebuilds this tree, empty, split wherever the trained tree holds more than splitFraction of its light.
+		void Build(const DirectionalTree& trained, float splitFraction);
+
+		static glm::vec2 ToSquare(const glm::vec3& direction);
+		static glm::vec3 ToDirection(const glm::vec2& point);
+
+	private:
+
+		struct Node
+		{
+			Node();
+			Node(const Node& other);
+			Node& operator=(const Node& other);
+
+			// Light in each quarter of the node, ordered x then y, and the node each quarter is split into, zero for
+			// none.
+			std::atomic<float> m_sums[4];
+			uint32_t m_children[4];
+		};
+
+		static int GetQuarter(glm::vec2& point);
+
+		std::vector<Node> m_nodes;
+	};
+
+	// Guide fractions a cell can learn.
+	static constexpr uint32_t NumGuideFractions = 5;
+	static constexpr float GuideFractions[NumGuideFractions] = { 0.1f, 0.3f, 0.5f, 0.7f, 0.9f };
+
+	struct Cell
+	{
+		Cell();
+		Cell(const Cell& other);
+		Cell& operator=(const Cell& other);
+
+		DirectionalTree m_sampling;
+		DirectionalTree m_training;
+		std::atomic<uint32_t> m_samples;
+		// Samples the sampled distribution was learnt from.
+		uint32_t m_trainedSamples;
+		// Second moment of the light the training paths found, had they been guided with each of GuideFractions.
+		std::atomic<float> m_moments[NumGuideFractions];
+		// Negative until learnt.
+		float m_guideFraction;
+	};
+
+	// Surfaces are told apart by the axis their normal is closest to and its sign, six cells to a leaf. The light
+	// learnt is weighted by the material's density, so surfaces facing different ways in one cell would otherwise
+	// blur each other's distributions, and guided rays from a floor would go where the sides of a sphere see light.
+	static constexpr uint32_t NumOrientations = 6;
+
+	struct SpatialNode
+	{
+		// Zero for a leaf, which instead refers to the first of its cells. Nodes are split in half along x, y and z in
+		// turn.
+		uint32_t m_children[2];
+		uint32_t m_depth;
+		uint32_t m_cell;
+	};
+
+	// Splits the leaf in half until its share of the samples is below threshold, assuming they were spread evenly.
+	void Split(uint32_t node, uint32_t samples, uint32_t threshold);
+	// Fits the bounds to the surfaces the first iteration's paths trained at.
+	void FitBounds();
+	static float Luminance(const glm::vec3& colour);
+
+	Settings m_settings;
+	uint64_t m_worldVersion;
+	glm::vec3 m_boundsMin;
+	glm::vec3 m_boundsSize;
+	std::vector<SpatialNode> m_nodes;
+	// Positions of the first iteration's training vertices, up to MaxBoundsSamples.
+	static constexpr uint32_t MaxBoundsSamples = 1 << 16;
+	std::unique_ptr<glm::vec3[]> m_boundsSamples;
+	std::atomic<uint32_t> m_numBoundsSamples;
+	std::vector<Cell> m_cells;
+	uint32_t m_iteration;
+	uint32_t m_iterationPasses;
+	uint32_t m_passes;
+};
@@ -0,0 +1,198 @@
+#include "RadianceCache.h"
+
+#include <cmath>
+
+#include "../WorldSnapshot.h"
+
+namespace
+{
+	// Cell coordinates are kept to 20 bits each, a million cells across the scene on every axis.
+	constexpr int32_t MaxCellCoordinate = (1 << 19) - 1;
+
+	// Finaliser of SplitMix64, spreading every bit of the input across the output.
+	inline uint64_t Hash64(uint64_t value)
+	{
+		value ^= value >> 30;
+		value *= 0xbf58476d1ce4e5b9ull;
+		value ^= value >> 27;
+		value *= 0x94d049bb133111ebull;
+		value ^= value >> 31;
+		return value;
+	}
+}
+
+RadianceCache::RadianceCache() :
+	m_worldVersion(0),
+	m_keyCellSize(0.0f),
+	m_numUsedSlots(0),
+	m_numDirtySlots(0),
+	m_numCells(0)
+{
+}
+
+RadianceCache::~RadianceCache()
+{
+}
+
+void RadianceCache::Prepare(const WorldSnapshot& world, const RayTracer::PathSettings& pathSettings)
+{
+	if (!m_entries || world.GetVersion() != m_worldVersion || m_settings.m_cellSize != m_keyCellSize ||
+		!(pathSettings == m_pathSettings))
+	{
+		Reset(world, pathSettings);
+	}
+}
+
+void RadianceCache::Reset(const WorldSnapshot& world, const RayTracer::PathSettings& pathSettings)
+{
+	m_worldVersion = world.GetVersion();
+	m_keyCellSize = m_settings.m_cellSize;
+	m_pathSettings = pathSettings;
+	m_numCells = 0;
+
+	if (!m_entries)
+	{
+		m_entries.reset(new Entry[Capacity]);
+		m_resolved.reset(new ResolvedEntry[Capacity]);
+		m_usedSlots.reset(new uint32_t[Capacity]);
+		m_dirtySlots.reset(new uint32_t[Capacity]);
+		for (uint32_t slot = 0; slot < Capacity; slot++)
+			Clear(slot);
+	}
+	else
+	{
+		uint32_t numUsedSlots = m_numUsedSlots.load(std::memory_order_relaxed);
+		for (uint32_t i = 0; i < numUsedSlots; i++)
+			Clear(m_usedSlots[i]);
+	}
+	m_numUsedSlots.store(0, std::memory_order_relaxed);
+	m_numDirtySlots.store(0, std::memory_order_relaxed);
+}
+
+void RadianceCache::EndPass()
+{
+	if (!m_entries)
+		return;
+
+	// Cells keep their samples from pass to pass, only the ones updated in this one have changed.
+	uint32_t numDirtySlots = m_numDirtySlots.load(std::memory_order_relaxed);
+	for (uint32_t i = 0; i < numDirtySlots; i++)
+	{
+		uint32_t slot = m_dirtySlots[i];
+		Entry& entry = m_entries[slot];
+		entry.m_dirty.store(false, std::memory_order_relaxed);
+
+		uint32_t samples = entry.m_samples.load(std::memory_order_relaxed);
+		glm::vec3 sums(entry.m_sums[0].load(std::memory_order_relaxed), entry.m_sums[1].load(std::memory_order_relaxed),
+			entry.m_sums[2].load(std::memory_order_relaxed));
+		if (m_resolved[slot].m_samples < m_settings.m_minSamples && samples >= m_settings.m_minSamples)
+			m_numCells++;
+		m_resolved[slot] = { sums / (float)samples, samples };
+	}
+	m_numDirtySlots.store(0, std::memory_order_relaxed);
+}
+
+bool RadianceCache::Find(const glm::vec3& position, const glm::vec3& normal, glm::vec3& radiance) const
+{
+	assert(m_entries);
+
+	int slot = FindSlot(GetKey(position, normal));
+	if (slot == -1 || m_resolved[slot].m_samples < m_settings.m_minSamples)
+		return false;
+
+	radiance = m_resolved[slot].m_radiance;
+	return true;
+}
+
+void RadianceCache::Update(const Vertex* vertices, uint32_t numVertices, const glm::vec3& colour)
+{
+	assert(m_entries);
+
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		const Vertex& vertex = vertices[i];
+
+		// Everything the path collected from the surface on, scaled by the weight it arrived with.
+		glm::vec3 collected = glm::max(colour - vertex.m_radiance, glm::vec3(0.0f));
+		glm::vec3 outgoing(0.0f);
+		for (int channel = 0; channel < 3; channel++)
+		{
+			if (vertex.m_throughput[channel] > 0.0f)
+				outgoing[channel] = collected[channel] / vertex.m_throughput[channel];
+		}
+
+		if (!std::isfinite(outgoing.x) || !std::isfinite(outgoing.y) || !std::isfinite(outgoing.z))
+			continue;
+
+		int slot = InsertSlot(GetKey(vertex.m_position, vertex.m_normal));
+		if (slot == -1)
+			continue;
+
+		Entry& entry = m_entries[slot];
+		for (int channel = 0; channel < 3; channel++)
+			entry.m_sums[channel].fetch_add(outgoing[channel], std::memory_order_relaxed);
+		entry.m_samples.fetch_add(1, std::memory_order_relaxed);
+		if (!entry.m_dirty.exchange(true, std::memory_order_relaxed))
+			m_dirtySlots[m_numDirtySlots.fetch_add(1, std::memory_order_relaxed)] = slot;
+	}
+}
+
+void RadianceCache::Clear(uint32_t slot)
+{
+	Entry& entry = m_entries[slot];
+	entry.m_key.store(0, std::memory_order_relaxed);
+	for (std::atomic<float>& sum : entry.m_sums)
+		sum.store(0.0f, std::memory_order_relaxed);
+	entry.m_samples.store(0, std::memory_order_relaxed);
+	entry.m_dirty.store(false, std::memory_order_relaxed);
+	m_resolved[slot] = { glm::vec3(0.0f), 0 };
+}
+
+uint64_t RadianceCache::GetKey(const glm::vec3& position, const glm::vec3& normal) const
+{
+	glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor(position / m_keyCellSize)), glm::ivec3(-MaxCellCoordinate),
+		glm::ivec3(MaxCellCoordinate));
+
+	// The axis the normal is closest to and which way along it.
+	glm::vec3 size = glm::abs(normal);
+	int axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+	uint64_t orientation = (uint64_t)axis * 2 + (normal[axis] < 0.0f ? 1 : 0);
+
+	uint64_t packed = (uint64_t)(cell.x + MaxCellCoordinate + 1) | ((uint64_t)(cell.y + MaxCellCoordinate + 1) << 20) |
+		((uint64_t)(cell.z + MaxCellCoordinate + 1) << 40) | (orientation << 60);
+	// Zero marks an empty slot.
+	uint64_t key = Hash64(packed);
+	return key != 0 ? key : 1;
+}
+
+int RadianceCache::FindSlot(uint64_t key) const
+{
+	for (uint32_t probe = 0; probe <= MaxProbes; probe++)
+	{
+		uint32_t slot = (uint32_t)(key + probe) & (Capacity - 1);
+		uint64_t current = m_entries[slot].m_key.load(std::memory_order_relaxed);
+		if (current == key)
+			return (int)slot;
+		if (current == 0)
+			return -1;
+	}
+	return -1;
+}
+
+int RadianceCache::InsertSlot(uint64_t key)
+{
+	for (uint32_t probe = 0; probe <= MaxProbes; probe++)
+	{
+		uint32_t slot = (uint32_t)(key + probe) & (Capacity - 1);
+		uint64_t current = m_entries[slot].m_key.load(std::memory_order_relaxed);
+		if (current == 0 && m_entries[slot].m_key.compare_exchange_strong(current, key, std::memory_order_relaxed))
+		{
+			m_usedSlots[m_numUsedSlots.fetch_add(1, std::memory_order_relaxed)] = slot;
+			return (int)slot;
+		}
+		// Another thread may have just taken the slot for the same key.
+		if (current == key)
+			return (int)slot;
+	}
+	return -1;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <glm/glm.hpp>
+
+#include "RayTracer.h"
+
+class WorldSnapshot;
+
+// Hashed world-space cache of the light leaving diffuse surfaces. Positions are grouped into cubic cells of a set size
+// and surfaces in a cell are told apart by the axis their normal is closest to, each pair found through a fixed size
+// hash table. A small fraction of paths are traced in full and add what they find at every diffuse surface to the
+// cell's running mean. The rest end at the second diffuse surface they hit and take the rest of their light from the
+// cache, so they never trace the long tail of bounces behind it, or go on in full if its cell is not ready yet.
+// The light in a cell is averaged over its surfaces and the samples it has seen, so the image is biased towards the
+// blurred, converged light of the cells, by less the smaller they are.
+// Lookups only read values resolved at the end of the previous pass and updates only insert keys and add to counters
+// with atomics, so both are safe on any number of threads. Prepare and EndPass must be called while nothing is being
+// traced.
+class RadianceCache
+{
+public:
+
+	struct Settings
+	{
+		// Edge length of a cell in world units, the cache's quality. Smaller cells follow the light more closely but
+		// take longer to fill, so more paths are traced in full until they have.
+		float m_cellSize = 0.1f;
+		// Fraction of paths traced in full to update the cache rather than ending in it.
+		float m_updateFraction = 1.0f / 16.0f;
+		// A cell is only looked up once it holds this many samples.
+		uint32_t m_minSamples = 8;
+	};
+
+	// Most diffuse surfaces along a path that it can update the cache with, the rest are left out.
+	static constexpr uint32_t MaxPathVertices = 16;
+
+	// A diffuse surface on an updating path, with what the path had when it reached it, from which the light leaving
+	// the surface is worked out once the path is finished.
+	struct Vertex
+	{
+		glm::vec3 m_position;
+		glm::vec3 m_normal;
+		// Weight of the light leaving the surface towards the path and the light collected before it.
+		glm::vec3 m_throughput;
+		glm::vec3 m_radiance;
+	};
+
+	RadianceCache();
+	~RadianceCache();
+
+	inline void SetSettings(const Settings& settings)
+	{
+		m_settings = settings;
+	}
+
+	inline const Settings& GetSettings() const
+	{
+		return m_settings;
+	}
+
+	// Starts again from nothing if the world, the cell size or the path settings the cells' light was found with have
+	// changed since the cache was filled. Allocates the table the first time.
+	void Prepare(const WorldSnapshot& world, const RayTracer::PathSettings& pathSettings);
+	void Reset(const WorldSnapshot& world, const RayTracer::PathSettings& pathSettings);
+	// Makes what the finished pass recorded visible to lookups.
+	void EndPass();
+
+	// Cells holding enough samples to be looked up, as of the last EndPass.
+	inline uint32_t GetNumCells() const
+	{
+		return m_numCells;
+	}
+
+	// Light leaving a diffuse surface at the position facing along the unit normal. False if its cell has too few
+	// samples yet.
+	bool Find(const glm::vec3& position, const glm::vec3& normal, glm::vec3& radiance) const;
+	// Updates the cache from a path traced in full that ended with the given colour.
+	void Update(const Vertex* vertices, uint32_t numVertices, const glm::vec3& colour);
+
+private:
+
+	static constexpr uint32_t Capacity = 1u << 20;
+	// Slots looked at past the one a key hashes to before it is given up on.
+	static constexpr uint32_t MaxProbes = 8;
+
+	struct Entry
+	{
+		// Zero for an empty slot.
+		std::atomic<uint64_t> m_key;
+		std::atomic<float> m_sums[3];
+		std::atomic<uint32_t> m_samples;
+		// Set by the first update since the last EndPass, which resolves only these.
+		std::atomic<bool> m_dirty;
+	};
+
+	struct ResolvedEntry
+	{
+		glm::vec3 m_radiance;
+		uint32_t m_samples;
+	};
+
+	void Clear(uint32_t slot);
+	uint64_t GetKey(const glm::vec3& position, const glm::vec3& normal) const;
+	// Slot holding the key, or -1 if it is not in the table.
+	int FindSlot(uint64_t key) const;
+	// As FindSlot, inserting the key if it is not there. -1 if every slot it could go in is taken.
+	int InsertSlot(uint64_t key);
+
+	Settings m_settings;
+	uint64_t m_worldVersion;
+	// The cell size the keys in the table were made with.
+	float m_keyCellSize;
+	// The settings the paths adding to the cells were traced with. The bounce limit, roulette and light sampling all
+	// change the light a cell should hold, and its running mean would otherwise keep the old light for ever.
+	RayTracer::PathSettings m_pathSettings;
+	std::unique_ptr<Entry[]> m_entries;
+	std::unique_ptr<ResolvedEntry[]> m_resolved;
+	// Slots taken so far, in the order they were, so resolving and clearing skip the empty ones.
+	std::unique_ptr<uint32_t[]> m_usedSlots;
+	std::atomic<uint32_t> m_numUsedSlots;
+	// Slots updated since the last EndPass, a few thousand a pass however many the table holds.
+	std::unique_ptr<uint32_t[]> m_dirtySlots;
+	std::atomic<uint32_t> m_numDirtySlots;
+	uint32_t m_numCells;
+};
@@ -2,14 +2,27 @@
 
 #include "glm/gtx/scalar_relational.hpp"
 
+#include "EnvironmentMap.h"
+#include "PathGuide.h"
+#include "RadianceCache.h"
 #include "Ray.h"
 #include "../CollidableObjects/CollidableObject.h"
 #include "../Materials/IMaterial.h"
+#include "../Samplers/BlueNoiseSampler.h"
+#include "../Samplers/IndependentSampler.h"
+#include "../Samplers/SobolSampler.h"
+#include "../Samplers/StratifiedSampler.h"
+#include "../Utils/RandomStream.h"
+#include "../Utils/Sampling.h"
 #include "../Utils/Utils.h"
-#include "../World.h"
+#include "../WorldSnapshot.h"
 
-RayTracer::RayTracer()
+RayTracer::RayTracer() :
+	m_sampler(new IndependentSampler())
 {
+#if RENDER_STATS
+	m_renderStats = std::make_unique<RenderStats>();
+#endif
 
 }
 
@@ -22,13 +35,43 @@ void RayTracer::Initialise()
 {
 }
 
+void RayTracer::SetSamplerType(SamplerType samplerType)
+{
+	if (samplerType == m_sampler->GetType())
+		return;
+
+	switch (samplerType)
+	{
+	case SamplerType::Independent:
+		m_sampler.reset(new IndependentSampler());
+		break;
+	case SamplerType::Stratified:
+		m_sampler.reset(new StratifiedSampler());
+		break;
+	case SamplerType::Sobol:
+		m_sampler.reset(new SobolSampler());
+		break;
+	case SamplerType::BlueNoise:
+		m_sampler.reset(new BlueNoiseSampler());
+		break;
+	default:
+		assert(false);
+	}
+}
+
 
-RayCollisionData RayTracer::TraceRay(const Ray& ray, const World& world) const
+RayCollisionData RayTracer::TraceRay(const Ray& ray, const WorldSnapshot& world) const
 {
+	RENDER_STATS_ADD(*m_renderStats, RaysTraced, 1);
+
 	if (world.GetCollidableObjects().size() == 0)
+	{
+		RENDER_STATS_ADD(*m_renderStats, Misses, 1);
 		return FillCollisionDataOnMiss(ray);
+	}
 
-	const std::vector<CollidableObject*>& objects = world.GetCollidableObjects();
+	const WorldSnapshot::ObjectList& objects = world.GetCollidableObjects();
+	RENDER_STATS_ADD(*m_renderStats, IntersectionTests, objects.size());
 	float collisionDistance;
 	float closestCollisionDistance = std::numeric_limits<float>::max();
 	int closestSphereIndex = -1;
@@ -48,23 +91,49 @@ RayCollisionData RayTracer::TraceRay(const Ray& ray, const World& world) const
 	}
 
 	if (closestSphereIndex == -1)
+	{
+		RENDER_STATS_ADD(*m_renderStats, Misses, 1);
 		return FillCollisionDataOnMiss(ray);
+	}
 
 	return FillCollisionDataOnHit(ray, world, closestCollisionDistance, closestSphereIndex);
 
 }
 
-glm::vec3 RayTracer::CalculatePixelColour(uint32_t x, uint32_t y, int numBounces, const World& world, const Ray& ray) const
+glm::vec3 RayTracer::CalculatePixelColour(uint32_t x, uint32_t y, uint32_t sampleIndex, const WorldSnapshot& world, const Ray& ray,
+	bool firstHitLights, PathGuide* guide, RadianceCache* radianceCache) const
 {
-	constexpr float attenuation = 0.9f;
-	constexpr glm::vec3 colourA(1.0f);
-	glm::vec3 colourB(0.0f, 0.0f, 0.0f);
-	//TODO pass into RayTracer from Application
-	constexpr glm::vec3 backgroundColour(0.5f, 0.7f, 1.0f);
-	//constexpr glm::vec3 backgroundColour(0.0f, 0.0f, 0.0f);
+	assert(firstHitLights || UsesLightSampling());
+
+	PathState path;
+	// The guided surfaces the path has left, to train the guide with once the path is finished.
+	PathGuide::Vertex guideVertices[PathGuide::MaxPathVertices];
+	uint32_t numGuideVertices = 0;
+	bool guidedLastBounce = false;
+
+	// A few paths are traced in full to update the radiance cache with the diffuse surfaces they hit, the others end
+	// in it once they have scattered off one.
+	bool cached = radianceCache && m_pathSettings.m_shadingModel == ShadingModel::Throughput;
+	bool updatesCache = cached &&
+		RandomStream(x, y, sampleIndex, CacheStream).Float() < radianceCache->GetSettings().m_updateFraction;
+	RadianceCache::Vertex cacheVertices[RadianceCache::MaxPathVertices];
+	uint32_t numCacheVertices = 0;
+	uint32_t numDiffuseHits = 0;
+
+	// Hands the finished path's colour to the guide and the radiance cache to learn from.
+	auto finishPath = [&](const glm::vec3& colour)
+	{
+		if (numGuideVertices > 0)
+			guide->Train(guideVertices, numGuideVertices, colour);
+		if (numCacheVertices > 0)
+			radianceCache->Update(cacheVertices, numCacheVertices, colour);
+		return colour;
+	};
 
 	Ray currentRay(ray);
+	RENDER_STATS_ADD(*m_renderStats, Paths, 1);
 
+	int numBounces = m_pathSettings.m_maxBounces;
 	int bounce = 0;
 	for (bounce; bounce < numBounces; bounce++)
 	{
@@ -72,22 +141,357 @@ glm::vec3 RayTracer::CalculatePixelColour(uint32_t x, uint32_t y, int numBounces
 		// Move slightly above zero see: Listing 49 https://raytracing.github.io/books/RayTracingInOneWeekend.html
 		if (rayCollisionData.collisionDistance < 0.0001f)
 		{
-			if (bounce == 0) // If we didn't hit anything at all
-				return Utils::Lerp(colourA, backgroundColour, currentRay.GetDirection());
-			else
-				return Utils::Lerp(colourA, colourB, currentRay.GetDirection()) * (float)glm::pow(attenuation, bounce);
+			RENDER_STATS_ADD(*m_renderStats, Bounces, bounce);
+			return finishPath(ShadeMiss(path, bounce, currentRay.GetDirection(), world));
 		}
 		int materialIndex = world.GetCollidableObject(rayCollisionData.objectIndex).GetMaterialIndex();
-		IMaterial* material = world.GetMaterialPtr(materialIndex);
-		colourB += material->GetColourContribution(rayCollisionData);
-		currentRay = material->GetNewRayDirection(currentRay, rayCollisionData);
+		const IMaterial* material = world.GetMaterialPtr(materialIndex);
+		bool diffuse = cached && IsDiffuse(*material, currentRay, rayCollisionData);
+		if (diffuse && updatesCache && numCacheVertices < RadianceCache::MaxPathVertices)
+		{
+			cacheVertices[numCacheVertices++] = { rayCollisionData.worldPosition, rayCollisionData.worldNormal, path.m_throughput,
+				path.m_radiance };
+		}
+		else if (diffuse && !updatesCache && numDiffuseHits == 1)
+		{
+			// The cache holds the light the rest of the path would have found, emitted and reflected by the surface. A
+			// path whose cell is not ready is traced in full without looking again, most lookups further on would miss
+			// as well and each costs about as much as a bounce.
+			glm::vec3 cachedRadiance;
+			if (radianceCache->Find(rayCollisionData.worldPosition, rayCollisionData.worldNormal, cachedRadiance))
+			{
+				path.m_radiance += path.m_throughput * cachedRadiance;
+				RENDER_STATS_ADD(*m_renderStats, Bounces, bounce);
+				RENDER_STATS_ADD(*m_renderStats, CacheTerminations, 1);
+				return finishPath(ShadeTerminated(path));
+			}
+		}
+		numDiffuseHits += diffuse ? 1 : 0;
+
+		bool lit = ShadeHit(path, *material, material->GetColourContribution(rayCollisionData), rayCollisionData, world);
+		// Light the last guided surface sees straight from an emissive sphere is found by sampling the lights. Guiding
+		// towards it as well would take its share of the light from the better estimate, so the guide only learns the
+		// light that scattering alone can find.
+		if (guidedLastBounce && UsesLightSampling())
+			guideVertices[numGuideVertices - 1].m_radiance = path.m_radiance;
+		int guideCell = guide && lit && IsDiffuse(*material, currentRay, rayCollisionData) ?
+			guide->FindCell(rayCollisionData.worldPosition, rayCollisionData.worldNormal) : -1;
+		if (lit)
+		{
+			SampleLights(path, *material, currentRay, rayCollisionData, bounce, x, y, sampleIndex, world, guide, guideCell,
+				bounce > 0 || firstHitLights);
+		}
+
+		RandomStream random(x, y, sampleIndex, (uint32_t)bounce, m_sampler.get());
+		float guidedPdf = 0.0f;
+		float materialPdf = 0.0f;
+		float guidePdf = 0.0f;
+		Ray scatteredRay(currentRay);
+		if (guideCell != -1)
+		{
+			// Hashed rather than from the sampler, whose dimensions for the stream would be the material's, making the
+			// choice between the two depend on the direction the material picks.
+			RandomStream guideRandom(x, y, sampleIndex, (uint32_t)bounce | GuideStream);
+			scatteredRay = ScatterGuided(path, *material, currentRay, rayCollisionData, *guide, guideCell, random, guideRandom, guidedPdf,
+				materialPdf, guidePdf);
+			lit = guidedPdf > 0.0f;
+		}
+		else
+		{
+			scatteredRay = material->GetNewRayDirection(currentRay, rayCollisionData, random);
+		}
+
+		RecordScatter(path, *material, currentRay, rayCollisionData, scatteredRay, guidedPdf);
+		path.m_emissionExcluded = bounce == 0 && !firstHitLights;
+		guidedLastBounce = guidedPdf > 0.0f && numGuideVertices < PathGuide::MaxPathVertices;
+		if (guidedLastBounce)
+		{
+			guideVertices[numGuideVertices++] = { guideCell, rayCollisionData.worldPosition, scatteredRay.GetDirection(),
+				guidedPdf, materialPdf, guidePdf, path.m_throughput, path.m_radiance };
+		}
+		currentRay = scatteredRay;
+
+		if (!lit || !SurvivesRoulette(path, bounce, x, y, sampleIndex))
+		{
+			RENDER_STATS_ADD(*m_renderStats, Bounces, bounce + 1);
+			RENDER_STATS_ADD(*m_renderStats, RouletteTerminations, lit ? 1 : 0);
+			return finishPath(ShadeTerminated(path));
+		}
 	}
 
 	// We stopped before we finished hitting so we don't know the colour.
+	RENDER_STATS_ADD(*m_renderStats, Bounces, numBounces);
+	RENDER_STATS_ADD(*m_renderStats, EarlyTerminations, 1);
+	return finishPath(ShadeTerminated(path));
+}
+
+glm::vec3 RayTracer::ShadeMiss(const PathState& path, int bounce, const glm::vec3& direction, const WorldSnapshot& world) const
+{
+	constexpr float attenuation = 0.9f;
+	constexpr glm::vec3 colourA(1.0f);
+	// Without an environment map.
+	constexpr glm::vec3 backgroundColour(0.5f, 0.7f, 1.0f);
+
+	const EnvironmentMap* environmentMap = world.GetEnvironmentMap();
+	glm::vec3 background = environmentMap ? environmentMap->GetRadiance(direction) :
+		Utils::Lerp(colourA, backgroundColour, direction);
+	if (m_pathSettings.m_shadingModel == ShadingModel::Throughput)
+	{
+		// The last surface may also have found this light by sampling the map, as for the emissive spheres.
+		if (environmentMap && path.m_scatterPdf > 0.0f)
+			background *= PowerHeuristic(path.m_scatterPdf, GetEnvironmentPdf(*environmentMap, direction));
+		return path.m_radiance + path.m_throughput * background;
+	}
+
+	if (bounce == 0) // If we didn't hit anything at all
+		return background;
+	else
+		return Utils::Lerp(colourA, path.m_gathered, direction) * (float)glm::pow(attenuation, bounce) * path.m_rouletteWeight;
+}
+
+bool RayTracer::ShadeHit(PathState& path, const IMaterial& material, const glm::vec3& contribution, const RayCollisionData& hit,
+	const WorldSnapshot& world) const
+{
+	if (m_pathSettings.m_shadingModel == ShadingModel::Gathered)
+	{
+		path.m_gathered += contribution;
+		return true;
+	}
+
+	glm::vec3 emission = material.GetEmission();
+	// The last surface may also have found this light by sampling it, the two estimates share it out between them.
+	if (path.m_emissionExcluded)
+		emission = glm::vec3(0.0f);
+	else if (path.m_scatterPdf > 0.0f && glm::any(glm::greaterThan(emission, glm::vec3(0.0f))))
+		emission *= PowerHeuristic(path.m_scatterPdf, GetLightPdf(world, hit.objectIndex, path.m_scatterOrigin));
+
+	path.m_radiance += path.m_throughput * emission;
+	path.m_throughput *= material.GetReflectance();
+	return glm::any(glm::greaterThan(path.m_throughput, glm::vec3(0.0f)));
+}
+
+void RayTracer::SampleLights(PathState& path, const IMaterial& material, const Ray& ray, const RayCollisionData& hit, int bounce,
+	uint32_t x, uint32_t y, uint32_t sampleIndex, const WorldSnapshot& world, const PathGuide* guide, int guideCell,
+	bool emissiveObjects) const
+{
+	if (!UsesLightSampling())
+		return;
+
+	glm::vec3 origin = hit.worldPosition + hit.worldNormal * 0.0001f;
+	if (const EnvironmentMap* environmentMap = world.GetEnvironmentMap())
+	{
+		SampleEnvironment(path, material, ray, hit, origin, bounce, x, y, sampleIndex, world, *environmentMap, guide,
+			guideCell);
+	}
+
+	const std::vector<int>& lights = world.GetEmissiveObjects();
+	if (!emissiveObjects || lights.empty())
+		return;
+
+	// One light picked, then a direction uniformly within the cone it fills as seen from the surface. The sampler's
+	// dimensions for it follow those of every material bounce, so the shadow ray and the scattered ray are independent.
+	RandomStream random(x, y, sampleIndex, (uint32_t)bounce | LightStream, m_sampler.get(),
+		(uint32_t)(m_pathSettings.m_maxBounces + bounce) * RandomStream::DimensionsPerBounce);
+	float lightChoice = random.Float();
+	glm::vec2 u = random.Vec2();
+
+	float selectionPmf;
+	int lightIndex = SelectLight(world, origin, lightChoice, selectionPmf);
+	if (selectionPmf <= 0.0f)
+		return;
+
+	const CollidableObject& light = world.GetCollidableObject(lightIndex);
+	glm::vec3 toLight = light.GetPosition() - origin;
+	float distanceSquared = glm::dot(toLight, toLight);
+	float radiusSquared = light.GetRadius() * light.GetRadius();
+	if (distanceSquared <= radiusSquared)
+		return;
+
+	float cosThetaMax = glm::sqrt(1.0f - radiusSquared / distanceSquared);
+	glm::vec3 direction = Sampling::UniformCone(u, toLight / glm::sqrt(distanceSquared), cosThetaMax);
+	float scatterPdf = material.GetScatterPdf(hit, ray.GetDirection(), direction);
+	if (scatterPdf <= 0.0f)
+		return;
+
+	RENDER_STATS_ADD(*m_renderStats, ShadowRays, 1);
+	RayCollisionData shadowHit = TraceRay(Ray(origin, direction), world);
+	if (shadowHit.collisionDistance < 0.0001f || shadowHit.objectIndex != lightIndex)
+		return;
+
+	float lightPdf = Sampling::UniformConePdf(cosThetaMax) * selectionPmf;
+	// Weighted against the density the scattered ray would have picked the direction with.
+	float pathPdf = guideCell != -1 ? GetGuidedPdf(*guide, guideCell, scatterPdf, direction) : scatterPdf;
+	const IMaterial& lightMaterial = *world.GetMaterialPtr(light.GetMaterialIndex());
+	// The throughput already includes this surface's reflectance, which with its pdf gives the reflected light.
+	path.m_radiance += path.m_throughput * lightMaterial.GetEmission() *
+		(scatterPdf * PowerHeuristic(lightPdf, pathPdf) / lightPdf);
+}
+
+void RayTracer::SampleEnvironment(PathState& path, const IMaterial& material, const Ray& ray, const RayCollisionData& hit,
+	const glm::vec3& origin, int bounce, uint32_t x, uint32_t y, uint32_t sampleIndex, const WorldSnapshot& world,
+	const EnvironmentMap& environmentMap, const PathGuide* guide, int guideCell) const
+{
+	// Hashed, the sampler's dimensions for the light stream are already the emissive spheres'.
+	RandomStream random(x, y, sampleIndex, (uint32_t)bounce | EnvironmentStream);
+	glm::vec2 u = random.Vec2();
+
+	float lightPdf;
+	glm::vec3 direction;
+	if (m_pathSettings.m_environmentSampling == EnvironmentSampling::Importance)
+	{
+		direction = environmentMap.Sample(u, lightPdf);
+	}
+	else
+	{
+		direction = Sampling::UniformSphere(u);
+		lightPdf = Sampling::UniformSpherePdf();
+	}
+	if (lightPdf <= 0.0f)
+		return;
+
+	float scatterPdf = material.GetScatterPdf(hit, ray.GetDirection(), direction);
+	if (scatterPdf <= 0.0f)
+		return;
+
+	// Anything in the way blocks the map.
+	RENDER_STATS_ADD(*m_renderStats, ShadowRays, 1);
+	if (TraceRay(Ray(origin, direction), world).collisionDistance >= 0.0001f)
+		return;
+
+	float pathPdf = guideCell != -1 ? GetGuidedPdf(*guide, guideCell, scatterPdf, direction) : scatterPdf;
+	path.m_radiance += path.m_throughput * environmentMap.GetRadiance(direction) *
+		(scatterPdf * PowerHeuristic(lightPdf, pathPdf) / lightPdf);
+}
+
+float RayTracer::GetEnvironmentPdf(const EnvironmentMap& environmentMap, const glm::vec3& direction) const
+{
+	return m_pathSettings.m_environmentSampling == EnvironmentSampling::Importance ? environmentMap.GetPdf(direction) :
+		Sampling::UniformSpherePdf();
+}
+
+void RayTracer::RecordScatter(PathState& path, const IMaterial& material, const Ray& ray, const RayCollisionData& hit,
+	const Ray& scatteredRay, float guidedPdf) const
+{
+	if (!UsesLightSampling())
+		return;
+
+	path.m_scatterOrigin = scatteredRay.GetOrigin();
+	path.m_scatterPdf = guidedPdf > 0.0f ? guidedPdf : material.GetScatterPdf(hit, ray.GetDirection(), scatteredRay.GetDirection());
+}
+
+bool RayTracer::IsDiffuse(const IMaterial& material, const Ray& ray, const RayCollisionData& hit) const
+{
+	// Only the throughput model carries a weight that can be divided by the density.
+	return m_pathSettings.m_shadingModel == ShadingModel::Throughput &&
+		material.GetScatterPdf(hit, ray.GetDirection(), hit.worldNormal) > 0.0f;
+}
+
+Ray RayTracer::ScatterGuided(PathState& path, const IMaterial& material, const Ray& ray, const RayCollisionData& hit,
+	const PathGuide& guide, int cell, RandomStream& random, RandomStream& guideRandom, float& pdf, float& materialPdf,
+	float& guidePdf) const
+{
+	// Until the cell has learnt enough every ray comes from the material.
+	float guideFraction = guide.GetGuideFraction(cell);
+	float choice = guideRandom.Float();
+	glm::vec2 u = guideRandom.Vec2();
+	bool guided = choice < guideFraction;
+	guidePdf = 0.0f;
+	Ray scatteredRay = guided ? Ray(hit.worldPosition + hit.worldNormal * 0.0001f, guide.Sample(cell, u, guidePdf)) :
+		material.GetNewRayDirection(ray, hit, random);
+
+	materialPdf = material.GetScatterPdf(hit, ray.GetDirection(), scatteredRay.GetDirection());
+	if (!guided && guideFraction > 0.0f)
+		guidePdf = guide.GetPdf(cell, scatteredRay.GetDirection());
+	pdf = materialPdf > 0.0f ? guideFraction * guidePdf + (1.0f - guideFraction) * materialPdf : 0.0f;
+
+	// The throughput holds the reflectance, the weight of a direction picked by the material alone.
+	path.m_throughput *= pdf > 0.0f ? materialPdf / pdf : 0.0f;
+	return scatteredRay;
+}
+
+float RayTracer::GetGuidedPdf(const PathGuide& guide, int cell, float materialPdf, const glm::vec3& direction) const
+{
+	float guideFraction = guide.GetGuideFraction(cell);
+	if (guideFraction <= 0.0f)
+		return materialPdf;
+
+	return guideFraction * guide.GetPdf(cell, direction) + (1.0f - guideFraction) * materialPdf;
+}
+
+float RayTracer::GetLightPdf(const WorldSnapshot& world, int objectIndex, const glm::vec3& origin) const
+{
+	float selectionPmf = GetLightSelectionPmf(world, origin, objectIndex);
+	if (selectionPmf <= 0.0f)
+		return 0.0f;
+
+	const CollidableObject& light = world.GetCollidableObject(objectIndex);
+	glm::vec3 toLight = light.GetPosition() - origin;
+	float distanceSquared = glm::dot(toLight, toLight);
+	float radiusSquared = light.GetRadius() * light.GetRadius();
+	if (distanceSquared <= radiusSquared)
+		return 0.0f;
+
+	float cosThetaMax = glm::sqrt(1.0f - radiusSquared / distanceSquared);
+	return Sampling::UniformConePdf(cosThetaMax) * selectionPmf;
+}
+
+int RayTracer::SelectLight(const WorldSnapshot& world, const glm::vec3& origin, float u, float& pmf) const
+{
+	if (m_pathSettings.m_lightSelection == LightSelection::Hierarchy)
+		return world.GetLightBVH().Sample(origin, u, pmf);
+
+	const std::vector<int>& lights = world.GetEmissiveObjects();
+	pmf = 1.0f / (float)lights.size();
+	return lights[glm::min((size_t)(u * lights.size()), lights.size() - 1)];
+}
+
+float RayTracer::GetLightSelectionPmf(const WorldSnapshot& world, const glm::vec3& origin, int objectIndex) const
+{
+	if (m_pathSettings.m_lightSelection == LightSelection::Hierarchy)
+		return world.GetLightBVH().GetPmf(origin, objectIndex);
+
+	const std::vector<int>& lights = world.GetEmissiveObjects();
+	return lights.empty() ? 0.0f : 1.0f / (float)lights.size();
+}
+
+bool RayTracer::SurvivesRoulette(PathState& path, int bounce, uint32_t x, uint32_t y, uint32_t sampleIndex) const
+{
+	if (!m_pathSettings.m_russianRoulette || bounce + 1 < m_pathSettings.m_rouletteMinBounces)
+		return true;
+
+	// The weight every later contribution will be scaled by. In the gathered model that is the per bounce fade.
+	constexpr float attenuation = 0.9f;
+	float throughput = m_pathSettings.m_shadingModel == ShadingModel::Throughput ?
+		glm::max(path.m_throughput.r, glm::max(path.m_throughput.g, path.m_throughput.b)) :
+		(float)glm::pow(attenuation, bounce + 1) * path.m_rouletteWeight;
+
+	// Capped below one so even bright paths can end, keeping the path length bounded in closed scenes.
+	float survivalProbability = glm::min(throughput, 0.95f);
+
+	// Drawn from a stream of its own, so the material's random numbers are the same with roulette on or off.
+	RandomStream random(x, y, sampleIndex, (uint32_t)bounce | RouletteStream);
+	if (random.Float() >= survivalProbability)
+		return false;
+
+	if (m_pathSettings.m_shadingModel == ShadingModel::Throughput)
+		path.m_throughput /= survivalProbability;
+	else
+		path.m_rouletteWeight /= survivalProbability;
+
+	return true;
+}
+
+glm::vec3 RayTracer::ShadeTerminated(const PathState& path) const
+{
+	// The light found so far is known in the throughput model. The gathered colour depends on where the path leaves
+	// the scene, so it is unknown.
+	if (m_pathSettings.m_shadingModel == ShadingModel::Throughput)
+		return path.m_radiance;
+
 	return glm::vec3(0.0f);
 }
 
-RayCollisionData RayTracer::ClosestHit(const Ray& ray, const World& world, float closestCollisionDistance, 
+RayCollisionData RayTracer::ClosestHit(const Ray& ray, const WorldSnapshot& world, float closestCollisionDistance, 
 	int objectIndex) const
 {
 	RayCollisionData rayCollisionData;
@@ -105,7 +509,7 @@ RayCollisionData RayTracer::ClosestHit(const Ray& ray, const World& world, float
 	return rayCollisionData;
 }
 
-RayCollisionData RayTracer::FillCollisionDataOnHit(const Ray& ray, const World& world, float closestCollisionDistance, 
+RayCollisionData RayTracer::FillCollisionDataOnHit(const Ray& ray, const WorldSnapshot& world, float closestCollisionDistance, 
 	int objectIndex) const
 {
 	RayCollisionData collisionData;
@@ -1,10 +1,19 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <memory>
 
+#include "../Samplers/ISampler.h"
+#include "../Utils/RenderStats.h"
+
+class EnvironmentMap;
+class IMaterial;
+class PathGuide;
+class RadianceCache;
 class Ray;
+class RandomStream;
 class RayEmitter;
-class World;
+class WorldSnapshot;
 
 struct RayCollisionData;
 
@@ -12,19 +21,201 @@ class RayTracer
 {
 public:
 
+	enum class ShadingModel
+	{
+		// Colour gathered from every surface hit, blended by the direction the path leaves the scene in and faded
+		// with each bounce.
+		Gathered,
+		// Emission and sky light carried back along the path, scaled by the reflectance of each surface hit.
+		Throughput
+	};
+
+	// How light sampling picks the light to send a shadow ray to.
+	enum class LightSelection
+	{
+		Uniform,
+		// In proportion to estimated contribution, by walking the snapshot's LightBVH.
+		Hierarchy
+	};
+
+	// How light sampling picks the direction of the shadow ray sent towards the snapshot's EnvironmentMap.
+	enum class EnvironmentSampling
+	{
+		Uniform,
+		// In proportion to the light of each pixel, through the map's alias tables.
+		Importance
+	};
+
+	struct PathSettings
+	{
+		ShadingModel m_shadingModel = ShadingModel::Gathered;
+		int m_maxBounces = 10;
+		// Once a path has hit m_rouletteMinBounces surfaces it only continues with a probability based on its
+		// throughput, and the paths that continue are weighted up by the inverse of that probability so the image
+		// stays unbiased. Paths carrying little light end early, so the bounce limit can be raised.
+		bool m_russianRoulette = false;
+		int m_rouletteMinBounces = 3;
+		// ShadingModel::Throughput only. At each surface that supports it (IMaterial::GetScatterPdf) a shadow ray
+		// is sent towards a point on an emissive sphere, and the light found that way and the light found by the
+		// scattered ray hitting an emissive sphere are weighted by multiple importance sampling. Small bright lights
+		// are then found on most bounces rather than the few that happen to hit them.
+		bool m_lightSampling = true;
+		LightSelection m_lightSelection = LightSelection::Hierarchy;
+		// With an environment map, each such surface also sends a shadow ray towards it, weighted the same way against
+		// the scattered ray escaping the scene.
+		EnvironmentSampling m_environmentSampling = EnvironmentSampling::Importance;
+
+		bool operator==(const PathSettings& other) const = default;
+	};
+
 	RayTracer();
 	~RayTracer();
 
 	void Initialise();
 
-	glm::vec3 CalculatePixelColour(uint32_t x, uint32_t y, int numBounces, const World& world, const Ray& ray) const;
+	// Must not change while a frame is being traced.
+	inline void SetPathSettings(const PathSettings& pathSettings)
+	{
+		m_pathSettings = pathSettings;
+	}
+
+	inline const PathSettings& GetPathSettings() const
+	{
+		return m_pathSettings;
+	}
+
+	// Where the numbers the materials draw come from. Must not change while a frame is being traced.
+	void SetSamplerType(SamplerType samplerType);
+
+	inline SamplerType GetSamplerType() const
+	{
+		return m_sampler->GetType();
+	}
+
+	inline const ISampler& GetSampler() const
+	{
+		return *m_sampler;
+	}
+
+	// sampleIndex numbers the samples taken for the pixel. Together with the pixel it picks the random numbers used,
+	// so the same arguments always give the same colour.
+	// With firstHitLights false the light reaching the first surface straight from emissive spheres is left out, for
+	// the caller to add its own estimate of it (see LightResampler). Only for surfaces where light sampling applies.
+	// Light from the environment map is still sampled there.
+	// With a path guide, ShadingModel::Throughput only, surfaces that support it (IMaterial::GetScatterPdf) pick some
+	// of their scattered rays from the guide, and the finished path trains it. The guide must not be refined while
+	// paths are being traced with it.
+	// With a radiance cache, ShadingModel::Throughput only, most paths end at the second such surface they hit if the
+	// cache holds its light, and the rest are traced in full and update the cache.
+	glm::vec3 CalculatePixelColour(uint32_t x, uint32_t y, uint32_t sampleIndex, const WorldSnapshot& world, const Ray& ray,
+		bool firstHitLights = true, PathGuide* guide = nullptr, RadianceCache* radianceCache = nullptr) const;
+
+#if RENDER_STATS
+	inline RenderStats& GetRenderStats() const
+	{
+		return *m_renderStats;
+	}
+#endif
 
 private:
 
-	RayCollisionData FillCollisionDataOnHit(const Ray& ray, const World& world, float closestCollisionDistance, int objectIndex) const;
-	RayCollisionData TraceRay(const Ray& ray, const World& world) const;
-	RayCollisionData ClosestHit(const Ray& ray, const World& world, float closestCollisionDistance, int objectIndex) const;
+	// Shares the hit and miss shading with the batched integrator so both give the same colours.
+	friend class WavefrontIntegrator;
+	// Uses the light selection and shadow rays of light sampling.
+	friend class LightResampler;
+
+	// Or'd into the bounce number of the random streams used for roulette, light sampling, light resampling, path
+	// guiding, picking the paths that update the radiance cache and sampling the environment map, keeping them apart
+	// from the material's.
+	static constexpr uint32_t RouletteStream = 0x80000000u;
+	static constexpr uint32_t LightStream = 0x40000000u;
+	static constexpr uint32_t ResamplingStream = 0x20000000u;
+	static constexpr uint32_t GuideStream = 0x10000000u;
+	static constexpr uint32_t CacheStream = 0x08000000u;
+	static constexpr uint32_t EnvironmentStream = 0x04000000u;
+
+	// What a path has picked up so far.
+	struct PathState
+	{
+		// ShadingModel::Gathered, the colour gathered from the surfaces hit and the roulette weight applied at the end.
+		glm::vec3 m_gathered{ 0.0f };
+		float m_rouletteWeight = 1.0f;
+		// ShadingModel::Throughput, the light collected and the weight of the light still to be found.
+		glm::vec3 m_radiance{ 0.0f };
+		glm::vec3 m_throughput{ 1.0f };
+		// Light sampling, where the last scattered ray started and the density it was picked with. Zero when the
+		// surface it left does not sample lights, so light it hits is counted in full.
+		glm::vec3 m_scatterOrigin{ 0.0f };
+		float m_scatterPdf = 0.0f;
+		// Set when emissive spheres hit by the last scattered ray are estimated by the caller instead and not counted.
+		bool m_emissionExcluded = false;
+	};
+
+	// Colour of a path leaving the scene after hitting the given number of surfaces, lit by the snapshot's environment
+	// map or, without one, a sky gradient.
+	glm::vec3 ShadeMiss(const PathState& path, int bounce, const glm::vec3& direction, const WorldSnapshot& world) const;
+	// Adds a hit surface to the path. Returns false if no light can come along the path from here on.
+	bool ShadeHit(PathState& path, const IMaterial& material, const glm::vec3& contribution, const RayCollisionData& hit,
+		const WorldSnapshot& world) const;
+	// Next event estimation from a surface the path has just hit, after ShadeHit, with a shadow ray towards an emissive
+	// sphere, unless emissiveObjects is false, and another towards the environment map if there is one. guideCell is
+	// the path guide's cell for the surface when its scattered ray is guided, otherwise -1.
+	void SampleLights(PathState& path, const IMaterial& material, const Ray& ray, const RayCollisionData& hit, int bounce,
+		uint32_t x, uint32_t y, uint32_t sampleIndex, const WorldSnapshot& world, const PathGuide* guide = nullptr,
+		int guideCell = -1, bool emissiveObjects = true) const;
+	// Light sampling's shadow ray towards the environment map, from SampleLights.
+	void SampleEnvironment(PathState& path, const IMaterial& material, const Ray& ray, const RayCollisionData& hit,
+		const glm::vec3& origin, int bounce, uint32_t x, uint32_t y, uint32_t sampleIndex, const WorldSnapshot& world,
+		const EnvironmentMap& environmentMap, const PathGuide* guide, int guideCell) const;
+	// Density with which SampleEnvironment picks the unit direction.
+	float GetEnvironmentPdf(const EnvironmentMap& environmentMap, const glm::vec3& direction) const;
+	// Remembers the ray scattered, for weighting any light it hits. guidedPdf is the density it was picked with when
+	// it was guided, zero when the material picked it alone.
+	void RecordScatter(PathState& path, const IMaterial& material, const Ray& ray, const RayCollisionData& hit,
+		const Ray& scatteredRay, float guidedPdf = 0.0f) const;
+	// Whether the surface scatters with a density the throughput model can weight by, so the path guide can pick its
+	// scattered ray and the radiance cache can stand in for the light it sends out.
+	bool IsDiffuse(const IMaterial& material, const Ray& ray, const RayCollisionData& hit) const;
+	// Picks the scattered ray from the guide's distribution for the cell or the material's, and weights the path for
+	// the mixture. pdf is the density of the mixture for the direction, zero if the material does not scatter along it,
+	// and materialPdf and guidePdf the material's and the guide's alone.
+	Ray ScatterGuided(PathState& path, const IMaterial& material, const Ray& ray, const RayCollisionData& hit,
+		const PathGuide& guide, int cell, RandomStream& random, RandomStream& guideRandom, float& pdf, float& materialPdf,
+		float& guidePdf) const;
+	// Density with which a guided surface picks the direction, given the material's.
+	float GetGuidedPdf(const PathGuide& guide, int cell, float materialPdf, const glm::vec3& direction) const;
+	// Density with which SampleLights picks the direction from the given point that hits the given emissive object.
+	float GetLightPdf(const WorldSnapshot& world, int objectIndex, const glm::vec3& origin) const;
+	// Picks the light to sample from the given point, returning its object index and the probability it was picked with.
+	int SelectLight(const WorldSnapshot& world, const glm::vec3& origin, float u, float& pmf) const;
+	float GetLightSelectionPmf(const WorldSnapshot& world, const glm::vec3& origin, int objectIndex) const;
+
+	// Weight for an estimate from a technique with density pdf, against another with otherPdf. Veach's power heuristic
+	// with an exponent of two.
+	static inline float PowerHeuristic(float pdf, float otherPdf)
+	{
+		return (pdf * pdf) / (pdf * pdf + otherPdf * otherPdf);
+	}
+
+	inline bool UsesLightSampling() const
+	{
+		return m_pathSettings.m_lightSampling && m_pathSettings.m_shadingModel == ShadingModel::Throughput;
+	}
+
+	// Russian roulette after the surface at the given bounce. Returns false if the path should end.
+	bool SurvivesRoulette(PathState& path, int bounce, uint32_t x, uint32_t y, uint32_t sampleIndex) const;
+	// Colour of a path ended without leaving the scene.
+	glm::vec3 ShadeTerminated(const PathState& path) const;
+	RayCollisionData FillCollisionDataOnHit(const Ray& ray, const WorldSnapshot& world, float closestCollisionDistance, int objectIndex) const;
+	RayCollisionData TraceRay(const Ray& ray, const WorldSnapshot& world) const;
+	RayCollisionData ClosestHit(const Ray& ray, const WorldSnapshot& world, float closestCollisionDistance, int objectIndex) const;
 	RayCollisionData FillCollisionDataOnMiss(const Ray& ray) const;
 
+	PathSettings m_pathSettings;
+	std::unique_ptr<ISampler> m_sampler;
+
+#if RENDER_STATS
+	std::unique_ptr<RenderStats> m_renderStats;
+#endif
 };
 
@@ -0,0 +1,230 @@
+#include "WavefrontIntegrator.h"
+
+#include <limits>
+
+#include "Ray.h"
+#include "RayTracer.h"
+#include "../CollidableObjects/CollidableObject.h"
+#include "../Materials/IMaterial.h"
+#include "../ScopedTimer.h"
+#include "../Utils/RandomStream.h"
+#include "../WorldSnapshot.h"
+
+WavefrontIntegrator::WavefrontIntegrator() :
+	m_shadeTime(0.0),
+	m_raysTraced(0)
+{
+}
+
+WavefrontIntegrator::~WavefrontIntegrator()
+{
+}
+
+void WavefrontIntegrator::Clear()
+{
+	m_pathX.clear();
+	m_pathY.clear();
+	m_pathSampleIndex.clear();
+	m_pathStates.clear();
+	m_pathColours.clear();
+
+	m_rayPath.clear();
+	m_rayOriginX.clear();
+	m_rayOriginY.clear();
+	m_rayOriginZ.clear();
+	m_rayDirectionX.clear();
+	m_rayDirectionY.clear();
+	m_rayDirectionZ.clear();
+}
+
+uint32_t WavefrontIntegrator::AddPath(uint32_t x, uint32_t y, uint32_t sampleIndex, const Ray& ray)
+{
+	uint32_t pathIndex = (uint32_t)m_pathColours.size();
+	m_pathX.push_back(x);
+	m_pathY.push_back(y);
+	m_pathSampleIndex.push_back(sampleIndex);
+	m_pathStates.push_back(RayTracer::PathState());
+	m_pathColours.push_back(glm::vec3(0.0f));
+
+	glm::vec3 origin = ray.GetOrigin();
+	glm::vec3 direction = ray.GetDirection();
+	m_rayPath.push_back(pathIndex);
+	m_rayOriginX.push_back(origin.x);
+	m_rayOriginY.push_back(origin.y);
+	m_rayOriginZ.push_back(origin.z);
+	m_rayDirectionX.push_back(direction.x);
+	m_rayDirectionY.push_back(direction.y);
+	m_rayDirectionZ.push_back(direction.z);
+
+	return pathIndex;
+}
+
+void WavefrontIntegrator::Trace(const RayTracer& rayTracer, const WorldSnapshot& world)
+{
+	RENDER_STATS_ADD(*rayTracer.m_renderStats, Paths, m_pathColours.size());
+
+	int numBounces = rayTracer.GetPathSettings().m_maxBounces;
+
+	// Every live path has hit the same number of surfaces, so the bounce is shared by the whole queue.
+	for (int bounce = 0; bounce < numBounces && !m_rayPath.empty(); bounce++)
+	{
+		Extend(rayTracer, world);
+		ShadeMisses(rayTracer, world, bounce);
+		ShadeHits(rayTracer, world, bounce);
+		Compact();
+	}
+
+	// Paths still going when the bounces ran out.
+	for (uint32_t path : m_rayPath)
+		m_pathColours[path] = rayTracer.ShadeTerminated(m_pathStates[path]);
+
+	RENDER_STATS_ADD(*rayTracer.m_renderStats, Bounces, m_rayPath.size() * numBounces);
+	RENDER_STATS_ADD(*rayTracer.m_renderStats, EarlyTerminations, m_rayPath.size());
+}
+
+void WavefrontIntegrator::Extend(const RayTracer& rayTracer, const WorldSnapshot& world)
+{
+	size_t numRays = m_rayPath.size();
+	m_hitDistance.assign(numRays, std::numeric_limits<float>::max());
+	m_hitObject.assign(numRays, -1);
+	m_rayAlive.assign(numRays, 1);
+
+	const WorldSnapshot::ObjectList& objects = world.GetCollidableObjects();
+	m_raysTraced += numRays;
+	RENDER_STATS_ADD(*rayTracer.m_renderStats, RaysTraced, numRays);
+	RENDER_STATS_ADD(*rayTracer.m_renderStats, IntersectionTests, numRays * objects.size());
+
+	// One object against every ray, so the inner loop always calls the same intersection code. Objects are visited
+	// in the same order with the same strict comparison as RayTracer::TraceRay, so ties resolve the same way.
+	for (size_t objectIndex = 0; objectIndex < objects.size(); objectIndex++)
+	{
+		const CollidableObject& object = *objects[objectIndex];
+		for (size_t slot = 0; slot < numRays; slot++)
+		{
+			Ray ray(glm::vec3(m_rayOriginX[slot], m_rayOriginY[slot], m_rayOriginZ[slot]),
+				glm::vec3(m_rayDirectionX[slot], m_rayDirectionY[slot], m_rayDirectionZ[slot]));
+
+			float collisionDistance = object.Intersect(ray, world);
+			if (collisionDistance > 0.0f && collisionDistance < m_hitDistance[slot])
+			{
+				m_hitDistance[slot] = collisionDistance;
+				m_hitObject[slot] = (int)objectIndex;
+			}
+		}
+	}
+}
+
+void WavefrontIntegrator::ShadeMisses(const RayTracer& rayTracer, const WorldSnapshot& world, int bounce)
+{
+	size_t numFinished = 0;
+	size_t numMisses = 0;
+	for (size_t slot = 0; slot < m_rayPath.size(); slot++)
+	{
+		// Hits closer than this are treated as misses, matching the self intersection cut off of the path tracer.
+		if (m_hitObject[slot] != -1 && m_hitDistance[slot] >= 0.0001f)
+			continue;
+
+		numFinished++;
+		numMisses += m_hitObject[slot] == -1 ? 1 : 0;
+
+		uint32_t path = m_rayPath[slot];
+		glm::vec3 direction(m_rayDirectionX[slot], m_rayDirectionY[slot], m_rayDirectionZ[slot]);
+		m_pathColours[path] = rayTracer.ShadeMiss(m_pathStates[path], bounce, direction, world);
+		m_rayAlive[slot] = 0;
+	}
+
+	RENDER_STATS_ADD(*rayTracer.m_renderStats, Misses, numMisses);
+	RENDER_STATS_ADD(*rayTracer.m_renderStats, Bounces, numFinished * bounce);
+}
+
+void WavefrontIntegrator::ShadeHits(const RayTracer& rayTracer, const WorldSnapshot& world, int bounce)
+{
+	Clock::time_point shadeStart = Clock::now();
+
+	m_batchShader.Clear();
+	for (uint32_t slot = 0; slot < (uint32_t)m_rayPath.size(); slot++)
+	{
+		if (!m_rayAlive[slot])
+			continue;
+
+		uint32_t path = m_rayPath[slot];
+		Ray ray(glm::vec3(m_rayOriginX[slot], m_rayOriginY[slot], m_rayOriginZ[slot]),
+			glm::vec3(m_rayDirectionX[slot], m_rayDirectionY[slot], m_rayDirectionZ[slot]));
+		RayCollisionData collisionData = rayTracer.FillCollisionDataOnHit(ray, world, m_hitDistance[slot], m_hitObject[slot]);
+		int materialIndex = world.GetCollidableObject(m_hitObject[slot]).GetMaterialIndex();
+		m_batchShader.AddHit(slot, materialIndex, ray, collisionData, RandomStream(m_pathX[path], m_pathY[path], m_pathSampleIndex[path], (uint32_t)bounce, &rayTracer.GetSampler()));
+	}
+
+	m_batchShader.Shade(world);
+
+	size_t numFinished = 0;
+	size_t numRouletteTerminations = 0;
+	for (uint32_t i = 0; i < m_batchShader.GetNumHits(); i++)
+	{
+		uint32_t slot = m_batchShader.GetTag(i);
+		uint32_t path = m_rayPath[slot];
+
+		const IMaterial& material = *world.GetMaterialPtr(m_batchShader.GetMaterialIndex(i));
+		RayTracer::PathState& pathState = m_pathStates[path];
+		const Ray& ray = m_batchShader.GetRay(i);
+		const RayCollisionData& hit = m_batchShader.GetHit(i);
+		const Ray& newRay = m_batchShader.GetScatteredRay(i);
+
+		// Shadow rays are traced here one at a time rather than as a stage of their own.
+		bool lit = rayTracer.ShadeHit(pathState, material, m_batchShader.GetContribution(i), hit, world);
+		if (lit)
+			rayTracer.SampleLights(pathState, material, ray, hit, bounce, m_pathX[path], m_pathY[path], m_pathSampleIndex[path], world);
+
+		rayTracer.RecordScatter(pathState, material, ray, hit, newRay);
+		if (!lit || !rayTracer.SurvivesRoulette(pathState, bounce, m_pathX[path], m_pathY[path], m_pathSampleIndex[path]))
+		{
+			m_pathColours[path] = rayTracer.ShadeTerminated(pathState);
+			m_rayAlive[slot] = 0;
+			numFinished++;
+			numRouletteTerminations += lit ? 1 : 0;
+			continue;
+		}
+
+		glm::vec3 origin = newRay.GetOrigin();
+		glm::vec3 direction = newRay.GetDirection();
+		m_rayOriginX[slot] = origin.x;
+		m_rayOriginY[slot] = origin.y;
+		m_rayOriginZ[slot] = origin.z;
+		m_rayDirectionX[slot] = direction.x;
+		m_rayDirectionY[slot] = direction.y;
+		m_rayDirectionZ[slot] = direction.z;
+	}
+
+	RENDER_STATS_ADD(*rayTracer.m_renderStats, Bounces, numFinished * (bounce + 1));
+	RENDER_STATS_ADD(*rayTracer.m_renderStats, RouletteTerminations, numRouletteTerminations);
+
+	m_shadeTime += std::chrono::duration<double, std::milli>(Clock::now() - shadeStart).count();
+}
+
+void WavefrontIntegrator::Compact()
+{
+	// Stable, so the queue keeps the order paths were added in and neighbouring pixels stay together.
+	size_t numAlive = 0;
+	for (size_t slot = 0; slot < m_rayPath.size(); slot++)
+	{
+		if (!m_rayAlive[slot])
+			continue;
+
+		m_rayPath[numAlive] = m_rayPath[slot];
+		m_rayOriginX[numAlive] = m_rayOriginX[slot];
+		m_rayOriginY[numAlive] = m_rayOriginY[slot];
+		m_rayOriginZ[numAlive] = m_rayOriginZ[slot];
+		m_rayDirectionX[numAlive] = m_rayDirectionX[slot];
+		m_rayDirectionY[numAlive] = m_rayDirectionY[slot];
+		m_rayDirectionZ[numAlive] = m_rayDirectionZ[slot];
+		numAlive++;
+	}
+
+	m_rayPath.resize(numAlive);
+	m_rayOriginX.resize(numAlive);
+	m_rayOriginY.resize(numAlive);
+	m_rayOriginZ.resize(numAlive);
+	m_rayDirectionX.resize(numAlive);
+	m_rayDirectionY.resize(numAlive);
+	m_rayDirectionZ.resize(numAlive);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "BatchShader.h"
+#include "RayTracer.h"
+
+class Ray;
+class WorldSnapshot;
+
+// Traces a batch of paths a bounce at a time rather than a path at a time. Each bounce runs as separate stages over
+// every live path: intersect against each object in turn, shade the misses, shade the hits as one batch with
+// BatchShader and then compact the survivors to the front of the queue. Ray and path data are kept as separate arrays
+// per component so each stage streams through only the data it needs.
+// Gives exactly the colours RayTracer::CalculatePixelColour does for the same pixels and sample numbers.
+class WavefrontIntegrator
+{
+public:
+
+	WavefrontIntegrator();
+	~WavefrontIntegrator();
+
+	// Empties the queue, keeping the allocations for the next batch.
+	void Clear();
+
+	// Queues a path starting with the given camera ray. Returns the path's index in the batch.
+	uint32_t AddPath(uint32_t x, uint32_t y, uint32_t sampleIndex, const Ray& ray);
+
+	// Traces every queued path with the ray tracer's path settings.
+	void Trace(const RayTracer& rayTracer, const WorldSnapshot& world);
+
+	// Whether hits are sorted by material and direction before shading, see BatchShader.
+	inline void SetSortHits(bool sortHits)
+	{
+		m_batchShader.SetSortHits(sortHits);
+	}
+
+	inline bool GetSortHits() const
+	{
+		return m_batchShader.GetSortHits();
+	}
+
+	// Time spent in the shading stage, including sorting, and rays traced since the last reset. Every ray traced is
+	// one segment of a path, so rays over paths is the average path length.
+	inline double GetShadeTime() const
+	{
+		return m_shadeTime;
+	}
+
+	inline uint64_t GetRaysTraced() const
+	{
+		return m_raysTraced;
+	}
+
+	inline void ResetCounters()
+	{
+		m_shadeTime = 0.0;
+		m_raysTraced = 0;
+	}
+
+	inline uint32_t GetNumPaths() const
+	{
+		return (uint32_t)m_pathColours.size();
+	}
+
+	// The colour of a path once the batch has been traced.
+	inline const glm::vec3& GetPathColour(uint32_t pathIndex) const
+	{
+		return m_pathColours[pathIndex];
+	}
+
+private:
+
+	void Extend(const RayTracer& rayTracer, const WorldSnapshot& world);
+	void ShadeMisses(const RayTracer& rayTracer, const WorldSnapshot& world, int bounce);
+	void ShadeHits(const RayTracer& rayTracer, const WorldSnapshot& world, int bounce);
+	void Compact();
+
+	// Per path, indexed by path.
+	std::vector<uint32_t> m_pathX;
+	std::vector<uint32_t> m_pathY;
+	std::vector<uint32_t> m_pathSampleIndex;
+	std::vector<RayTracer::PathState> m_pathStates;
+	std::vector<glm::vec3> m_pathColours;
+
+	// Per live ray, indexed by queue slot.
+	std::vector<uint32_t> m_rayPath;
+	std::vector<float> m_rayOriginX;
+	std::vector<float> m_rayOriginY;
+	std::vector<float> m_rayOriginZ;
+	std::vector<float> m_rayDirectionX;
+	std::vector<float> m_rayDirectionY;
+	std::vector<float> m_rayDirectionZ;
+	std::vector<float> m_hitDistance;
+	std::vector<int> m_hitObject;
+	// Cleared for rays whose path finished this bounce, removed by Compact.
+	std::vector<uint8_t> m_rayAlive;
+
+	BatchShader m_batchShader;
+	// Milliseconds spent in ShadeHits since the last ResetCounters.
+	double m_shadeTime;
+	uint64_t m_raysTraced;
+};
@@ -0,0 +1,131 @@
+#include "BlueNoiseSampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "../Utils/RandomStream.h"
+
+BlueNoiseSampler::BlueNoiseSampler() :
+	m_mask(MaskSize * MaskSize)
+{
+	BuildMask();
+}
+
+BlueNoiseSampler::~BlueNoiseSampler()
+{
+}
+
+void BlueNoiseSampler::BuildMask()
+{
+	constexpr uint32_t numPixels = MaskSize * MaskSize;
+	constexpr float sigma = 1.5f;
+	static_assert(numPixels == 1 << 12, "Ranks are scaled to 32 bits by a shift");
+
+	// Gaussian of the distance between pixels, wrapping around the edges so the mask tiles.
+	std::vector<float> kernel(numPixels);
+	for (uint32_t y = 0; y < MaskSize; y++)
+	{
+		for (uint32_t x = 0; x < MaskSize; x++)
+		{
+			float dx = (float)std::min(x, MaskSize - x);
+			float dy = (float)std::min(y, MaskSize - y);
+			kernel[y * MaskSize + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+		}
+	}
+
+	// How crowded each pixel's neighbourhood is by the pixels set in the pattern.
+	std::vector<uint8_t> pattern(numPixels, 0);
+	std::vector<float> density(numPixels, 0.0f);
+	auto setPixel = [&](uint32_t pixel, bool set)
+	{
+		pattern[pixel] = set ? 1 : 0;
+		float sign = set ? 1.0f : -1.0f;
+		uint32_t pixelX = pixel % MaskSize;
+		uint32_t pixelY = pixel / MaskSize;
+		for (uint32_t y = 0; y < MaskSize; y++)
+		{
+			const float* kernelRow = &kernel[((y - pixelY) % MaskSize) * MaskSize];
+			float* densityRow = &density[y * MaskSize];
+			for (uint32_t x = 0; x < MaskSize; x++)
+				densityRow[x] += sign * kernelRow[(x - pixelX) % MaskSize];
+		}
+	};
+
+	auto tightestCluster = [&]()
+	{
+		uint32_t best = 0;
+		float bestDensity = -1.0f;
+		for (uint32_t pixel = 0; pixel < numPixels; pixel++)
+		{
+			if (pattern[pixel] && density[pixel] > bestDensity)
+			{
+				best = pixel;
+				bestDensity = density[pixel];
+			}
+		}
+		return best;
+	};
+
+	auto largestVoid = [&]()
+	{
+		uint32_t best = 0;
+		float bestDensity = std::numeric_limits<float>::max();
+		for (uint32_t pixel = 0; pixel < numPixels; pixel++)
+		{
+			if (!pattern[pixel] && density[pixel] < bestDensity)
+			{
+				best = pixel;
+				bestDensity = density[pixel];
+			}
+		}
+		return best;
+	};
+
+	// A tenth of the pixels set at random...
+	uint32_t numInitial = numPixels / 10;
+	for (uint32_t i = 0, numSet = 0; numSet < numInitial; i++)
+	{
+		uint32_t pixel = RandomStream::Hash(i) % numPixels;
+		if (!pattern[pixel])
+		{
+			setPixel(pixel, true);
+			numSet++;
+		}
+	}
+
+	// ...then spread out evenly by moving the tightest cluster into the largest void until it would move straight
+	// back. Capped in case the moves cycle.
+	for (uint32_t move = 0; move < numPixels; move++)
+	{
+		uint32_t cluster = tightestCluster();
+		setPixel(cluster, false);
+		uint32_t largest = largestVoid();
+		setPixel(largest, true);
+		if (largest == cluster)
+			break;
+	}
+
+	// The pixels of the initial pattern are ranked from the top down by taking out the tightest cluster, those
+	// outside it from the bottom up by filling in the largest void.
+	std::vector<uint8_t> initialPattern = pattern;
+	std::vector<float> initialDensity = density;
+	for (uint32_t rank = numInitial; rank-- > 0;)
+	{
+		uint32_t cluster = tightestCluster();
+		setPixel(cluster, false);
+		m_mask[cluster] = rank;
+	}
+
+	pattern = initialPattern;
+	density = initialDensity;
+	for (uint32_t rank = numInitial; rank < numPixels; rank++)
+	{
+		uint32_t largest = largestVoid();
+		setPixel(largest, true);
+		m_mask[largest] = rank;
+	}
+
+	for (uint32_t& rank : m_mask)
+		rank <<= 20;
+}
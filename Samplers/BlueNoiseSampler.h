@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include "ISampler.h"
+#include "SobolSampler.h"
+
+// Blue noise dithered Sobol points. Every pixel takes the same Owen scrambled Sobol sequence, shifted (Cranley-Patterson
+// rotation) by a value from a tiled blue noise mask, with the mask offset differently for each dimension. Neighbouring
+// pixels are given values as far apart as possible, so at low sample counts the error that remains is high frequency
+// and looks far less noisy than white noise of the same strength, while each pixel keeps the convergence of Sobol.
+class BlueNoiseSampler : public ISampler
+{
+public:
+
+	static constexpr uint32_t MaskSize = 64;
+
+	BlueNoiseSampler();
+	~BlueNoiseSampler();
+
+	virtual SamplerType GetType() const override
+	{
+		return SamplerType::BlueNoise;
+	}
+
+	virtual float Get(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const override
+	{
+		uint32_t maskOffset = RandomStream::Hash(dimension ^ SequenceSeed);
+		uint32_t maskX = (x + maskOffset) % MaskSize;
+		uint32_t maskY = (y + (maskOffset >> 16)) % MaskSize;
+
+		// Wrapping 32 bit addition is the shift modulo one.
+		return ToFloat(SobolSampler::ShuffledScrambledSobol(sampleIndex, dimension, SequenceSeed) + m_mask[maskY * MaskSize + maskX]);
+	}
+
+private:
+
+	static constexpr uint32_t SequenceSeed = 0x5eed5eedu;
+
+	// Ranks the pixels of the mask with Ulichney's void and cluster method.
+	void BuildMask();
+
+	// The rank of each pixel scaled to the full 32 bit range.
+	std::vector<uint32_t> m_mask;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+enum class SamplerType
+{
+	Independent,
+	Stratified,
+	Sobol,
+	BlueNoise
+};
+
+// Supplies the numbers a path's RandomStream hands out. A value is picked by the pixel, the sample number within the
+// pixel and the dimension, which counts the values drawn along the path. Every implementation is a pure function of
+// those arguments, so renders stay reproducible whichever sampler is used.
+class ISampler abstract
+{
+public:
+
+	virtual ~ISampler()
+	{
+	}
+
+	virtual SamplerType GetType() const = 0;
+
+	// In [0, 1).
+	virtual float Get(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const = 0;
+
+protected:
+
+	// From the top 24 bits so every value is exactly representable, as RandomStream::Float.
+	static inline float ToFloat(uint32_t value)
+	{
+		return (float)(value >> 8) * (1.0f / 16777216.0f);
+	}
+
+	static inline uint32_t ReverseBits(uint32_t value)
+	{
+		value = ((value >> 1) & 0x55555555u) | ((value & 0x55555555u) << 1);
+		value = ((value >> 2) & 0x33333333u) | ((value & 0x33333333u) << 2);
+		value = ((value >> 4) & 0x0f0f0f0fu) | ((value & 0x0f0f0f0fu) << 4);
+		value = ((value >> 8) & 0x00ff00ffu) | ((value & 0x00ff00ffu) << 8);
+		return (value >> 16) | (value << 16);
+	}
+
+	// Owen scrambling: every bit is flipped or not depending on the seed and all the bits above it, which keeps
+	// the stratification of the input. Burley's hash based version of the Laine-Karras permutation from
+	// "Practical Hash-based Owen Scrambling", JCGT 2020.
+	static inline uint32_t NestedUniformScramble(uint32_t value, uint32_t seed)
+	{
+		value = ReverseBits(value);
+		value += seed;
+		value ^= value * 0x6c50b47cu;
+		value ^= value * 0xb82f1e52u;
+		value ^= value * 0xc7afe638u;
+		value ^= value * 0x8d22f6e6u;
+		return ReverseBits(value);
+	}
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "ISampler.h"
+#include "../Utils/RandomStream.h"
+
+// White noise, every value hashed on its own. Converges at the Monte Carlo rate of one over the square root of the
+// sample count.
+class IndependentSampler : public ISampler
+{
+public:
+
+	virtual SamplerType GetType() const override
+	{
+		return SamplerType::Independent;
+	}
+
+	virtual float Get(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const override
+	{
+		return ToFloat(RandomStream::Hash(RandomStream::Hash(RandomStream::Hash(RandomStream::Hash(x) ^ y) ^ sampleIndex) ^ dimension));
+	}
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ISampler.h"
+#include "../Utils/RandomStream.h"
+
+// Owen scrambled Sobol points. Any power of two run of samples is stratified in every pair of the first four
+// dimensions, and scrambling gives each pixel its own randomised copy of the sequence so the error converges close to
+// one over the sample count on smooth integrands instead of one over its square root.
+// Only four dimensions of the sequence are used. Higher dimensions reuse them in groups of four, each group with the
+// order of its samples shuffled independently, which is what Burley's "Practical Hash-based Owen Scrambling" (JCGT
+// 2020) recommends over the poorly distributed high dimensions of a long Sobol table.
+class SobolSampler : public ISampler
+{
+public:
+
+	static constexpr uint32_t NumSobolDimensions = 4;
+
+	virtual SamplerType GetType() const override
+	{
+		return SamplerType::Sobol;
+	}
+
+	virtual float Get(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const override
+	{
+		return ToFloat(ShuffledScrambledSobol(sampleIndex, dimension, RandomStream::Hash(RandomStream::Hash(x) ^ y)));
+	}
+
+	// The dimension of the sample at the given position in the sequence, scrambled with the given seed. Samples are
+	// shuffled per group of four dimensions.
+	static inline uint32_t ShuffledScrambledSobol(uint32_t sampleIndex, uint32_t dimension, uint32_t seed)
+	{
+		uint32_t groupSeed = RandomStream::Hash(seed ^ RandomStream::Hash(dimension / NumSobolDimensions));
+		uint32_t sobolDimension = dimension % NumSobolDimensions;
+		uint32_t index = NestedUniformScramble(sampleIndex, groupSeed);
+		return NestedUniformScramble(Sobol(index, sobolDimension), RandomStream::Hash(groupSeed ^ (sobolDimension + 1)));
+	}
+
+	static inline uint32_t Sobol(uint32_t index, uint32_t dimension)
+	{
+		uint32_t value = 0;
+		for (uint32_t bit = 0; index != 0; bit++, index >>= 1)
+		{
+			if (index & 1)
+				value ^= Directions[dimension][bit];
+		}
+		return value;
+	}
+
+private:
+
+	// Direction numbers from Joe and Kuo's new-joe-kuo-6.21201, dimension 0 is the van der Corput sequence.
+	static constexpr uint32_t Directions[NumSobolDimensions][32] =
+	{
+		{
+			0x80000000u, 0x40000000u, 0x20000000u, 0x10000000u, 0x08000000u, 0x04000000u, 0x02000000u, 0x01000000u,
+			0x00800000u, 0x00400000u, 0x00200000u, 0x00100000u, 0x00080000u, 0x00040000u, 0x00020000u, 0x00010000u,
+			0x00008000u, 0x00004000u, 0x00002000u, 0x00001000u, 0x00000800u, 0x00000400u, 0x00000200u, 0x00000100u,
+			0x00000080u, 0x00000040u, 0x00000020u, 0x00000010u, 0x00000008u, 0x00000004u, 0x00000002u, 0x00000001u
+		},
+		{
+			0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u, 0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+			0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u, 0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+			0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u, 0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+			0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u, 0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu
+		},
+		{
+			0x80000000u, 0xc0000000u, 0x60000000u, 0x90000000u, 0xe8000000u, 0x5c000000u, 0x8e000000u, 0xc5000000u,
+			0x68800000u, 0x9cc00000u, 0xee600000u, 0x55900000u, 0x80680000u, 0xc09c0000u, 0x60ee0000u, 0x90550000u,
+			0xe8808000u, 0x5cc0c000u, 0x8e606000u, 0xc5909000u, 0x6868e800u, 0x9c9c5c00u, 0xeeee8e00u, 0x5555c500u,
+			0x8000e880u, 0xc0005cc0u, 0x60008e60u, 0x9000c590u, 0xe8006868u, 0x5c009c9cu, 0x8e00eeeeu, 0xc5005555u
+		},
+		{
+			0x80000000u, 0xc0000000u, 0x20000000u, 0x50000000u, 0xf8000000u, 0x74000000u, 0xa2000000u, 0x93000000u,
+			0xd8800000u, 0x25400000u, 0x59e00000u, 0xe6d00000u, 0x78080000u, 0xb40c0000u, 0x82020000u, 0xc3050000u,
+			0x208f8000u, 0x51474000u, 0xfbea2000u, 0x75d93000u, 0xa0858800u, 0x914e5400u, 0xdbe79e00u, 0x25db6d00u,
+			0x58800080u, 0xe54000c0u, 0x79e00020u, 0xb6d00050u, 0x800800f8u, 0xc00c0074u, 0x200200a2u, 0x50050093u
+		}
+	};
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "ISampler.h"
+#include "../Utils/RandomStream.h"
+
+// Jittered strata, one dimension at a time. The samples of a pixel are taken in blocks of StrataPerBlock and each
+// block puts exactly one value in each of that many equal strata of every dimension, in an order shuffled per
+// dimension so the strata of different dimensions pair up randomly (Latin hypercube sampling). Unlike a fixed grid
+// any sample count can be used, and the error drops fastest at multiples of the block size.
+class StratifiedSampler : public ISampler
+{
+public:
+
+	static constexpr uint32_t StrataPerBlock = 16;
+
+	virtual SamplerType GetType() const override
+	{
+		return SamplerType::Stratified;
+	}
+
+	virtual float Get(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const override
+	{
+		uint32_t block = sampleIndex / StrataPerBlock;
+		uint32_t seed = RandomStream::Hash(RandomStream::Hash(RandomStream::Hash(RandomStream::Hash(x) ^ y) ^ dimension) ^ block);
+
+		// Scrambling only the top four bits of the position in the block permutes the 16 strata.
+		uint32_t stratum = NestedUniformScramble((sampleIndex % StrataPerBlock) << 28, seed) >> 28;
+		uint32_t jitter = RandomStream::Hash(seed ^ sampleIndex) >> 4;
+		return ToFloat((stratum << 28) | jitter);
+	}
+};
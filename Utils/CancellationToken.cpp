@@ -0,0 +1 @@
+#include "CancellationToken.h"
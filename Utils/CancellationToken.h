@@ -0,0 +1,30 @@
+#pragma once
+
+#include <atomic>
+
+// Cooperative cancellation flag shared between the thread requesting a cancel and the threads doing the work.
+// Workers poll IsCancelled() at safe points (e.g. between tiles) and bail out early when it is set.
+class CancellationToken
+{
+public:
+
+	CancellationToken() : m_cancelled(false) {}
+
+	inline void Cancel()
+	{
+		m_cancelled.store(true, std::memory_order_relaxed);
+	}
+
+	inline void Reset()
+	{
+		m_cancelled.store(false, std::memory_order_relaxed);
+	}
+
+	inline bool IsCancelled() const
+	{
+		return m_cancelled.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<bool> m_cancelled;
+};
@@ -0,0 +1 @@
+#include "DetachedTask.h"
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+
+// Return type for coroutines that run to completion on their own, with nothing awaiting their result. The coroutine
+// starts straight away and its frame is freed when it finishes.
+struct DetachedTask
+{
+	struct promise_type
+	{
+		DetachedTask get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
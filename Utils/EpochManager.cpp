@@ -0,0 +1,102 @@
+#include "EpochManager.h"
+
+#include <cassert>
+#include <thread>
+
+EpochManager::Guard::Guard(Guard&& other) noexcept :
+	m_manager(other.m_manager),
+	m_slot(other.m_slot)
+{
+	other.m_manager = nullptr;
+	other.m_slot = -1;
+}
+
+EpochManager::Guard& EpochManager::Guard::operator=(Guard&& other) noexcept
+{
+	if (this != &other)
+	{
+		Release();
+		m_manager = other.m_manager;
+		m_slot = other.m_slot;
+		other.m_manager = nullptr;
+		other.m_slot = -1;
+	}
+	return *this;
+}
+
+EpochManager::Guard::~Guard()
+{
+	Release();
+}
+
+void EpochManager::Guard::Release()
+{
+	if (m_manager)
+	{
+		m_manager->m_slots[m_slot].m_epoch.store(0, std::memory_order_release);
+		m_manager = nullptr;
+		m_slot = -1;
+	}
+}
+
+EpochManager::EpochManager() :
+	m_globalEpoch(1)
+{
+}
+
+EpochManager::~EpochManager()
+{
+	for (RetiredItem& item : m_retired)
+	{
+		item.m_reclaim();
+	}
+}
+
+EpochManager::Guard EpochManager::Pin()
+{
+	while (true)
+	{
+		// Announcing the epoch before the caller loads the shared pointer means the writer either sees this slot when
+		// it collects, or the caller is guaranteed to load the replacement.
+		uint64_t epoch = m_globalEpoch.load(std::memory_order_seq_cst);
+		for (int slot = 0; slot < MaxReaders; slot++)
+		{
+			uint64_t expected = 0;
+			if (m_slots[slot].m_epoch.compare_exchange_strong(expected, epoch, std::memory_order_seq_cst))
+				return Guard(this, slot);
+		}
+
+		// Every slot is taken, wait for a reader to finish.
+		std::this_thread::yield();
+	}
+}
+
+void EpochManager::Retire(std::function<void()> reclaim)
+{
+	m_retired.push_back({ m_globalEpoch.fetch_add(1, std::memory_order_seq_cst), std::move(reclaim) });
+}
+
+void EpochManager::Collect()
+{
+	if (m_retired.empty())
+		return;
+
+	uint64_t oldestPinned = m_globalEpoch.load(std::memory_order_seq_cst);
+	for (const ReaderSlot& slot : m_slots)
+	{
+		uint64_t epoch = slot.m_epoch.load(std::memory_order_seq_cst);
+		if (epoch != 0 && epoch < oldestPinned)
+			oldestPinned = epoch;
+	}
+
+	// Anything retired before the oldest pinned epoch can no longer be reached by a reader.
+	size_t kept = 0;
+	for (size_t i = 0; i < m_retired.size(); i++)
+	{
+		if (m_retired[i].m_epoch < oldestPinned)
+			m_retired[i].m_reclaim();
+		else
+			m_retired[kept++] = std::move(m_retired[i]);
+	}
+	m_retired.resize(kept);
+}
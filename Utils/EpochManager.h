@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Epoch based reclamation for data that is read lock-free by many threads and replaced by a single writer.
+// Readers Pin() before loading a shared pointer and keep the returned guard alive for as long as they use it.
+// The writer hands replaced objects to Retire() and periodically calls Collect(), which only frees objects retired
+// before the oldest epoch still pinned by a reader.
+class EpochManager
+{
+public:
+
+	static constexpr int MaxReaders = 128;
+
+	class Guard
+	{
+	public:
+		Guard() : m_manager(nullptr), m_slot(-1) {}
+		Guard(EpochManager* manager, int slot) : m_manager(manager), m_slot(slot) {}
+		Guard(Guard&& other) noexcept;
+		Guard& operator=(Guard&& other) noexcept;
+		~Guard();
+
+		Guard(const Guard&) = delete;
+		Guard& operator=(const Guard&) = delete;
+
+	private:
+		void Release();
+
+		EpochManager* m_manager;
+		int m_slot;
+	};
+
+	EpochManager();
+	~EpochManager();
+
+	// Lock-free, callable from any thread.
+	Guard Pin();
+
+	// Writer thread only.
+	void Retire(std::function<void()> reclaim);
+	void Collect();
+
+	inline size_t GetNumRetired() const
+	{
+		return m_retired.size();
+	}
+
+private:
+
+	struct alignas(64) ReaderSlot
+	{
+		// Zero when the slot is free, otherwise the global epoch at the time the reader pinned.
+		std::atomic<uint64_t> m_epoch{ 0 };
+	};
+
+	struct RetiredItem
+	{
+		uint64_t m_epoch;
+		std::function<void()> m_reclaim;
+	};
+
+	ReaderSlot m_slots[MaxReaders];
+	std::atomic<uint64_t> m_globalEpoch;
+	std::vector<RetiredItem> m_retired;
+};
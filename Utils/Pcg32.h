@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+// PCG32 (XSH RR) from https://www.pcg-random.org/, 16 bytes of state against the 2.5KB of std::mt19937 and
+// statistically stronger. Different streams with the same seed give unrelated sequences.
+class Pcg32
+{
+public:
+
+	Pcg32(uint64_t seed = 0x853c49e6748fea9bULL, uint64_t stream = 0xda3e39cb94b95bdbULL) :
+		m_state(0),
+		m_increment((stream << 1) | 1)
+	{
+		UInt();
+		m_state += seed;
+		UInt();
+	}
+
+	inline uint32_t UInt()
+	{
+		uint64_t state = m_state;
+		m_state = state * 6364136223846793005ULL + m_increment;
+		uint32_t xorShifted = (uint32_t)(((state >> 18) ^ state) >> 27);
+		uint32_t rotation = (uint32_t)(state >> 59);
+		return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+	}
+
+	// In [0, 1), from the top 24 bits so every value is exactly representable.
+	inline float Float()
+	{
+		return (float)(UInt() >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+	uint64_t m_state;
+	uint64_t m_increment;
+};
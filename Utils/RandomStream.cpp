@@ -0,0 +1,8 @@
+#include "RandomStream.h"
+
+#include "../Samplers/ISampler.h"
+
+float RandomStream::SamplerFloat()
+{
+	return m_sampler->Get(m_x, m_y, m_sampleIndex, m_firstSamplerDimension + m_dimension++);
+}
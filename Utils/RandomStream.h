@@ -0,0 +1,122 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtx/norm.hpp>
+#include <cstdint>
+
+#include "Sampling.h"
+
+class ISampler;
+
+// Stateless counter based random numbers. Every value is a hash of where it is used: the pixel, the index of the
+// sample within that pixel, the bounce along the path and how many values the bounce has already drawn. The same
+// path always sees the same numbers whichever thread traces it and in whatever order, so renders are reproducible
+// bit for bit.
+// Given a sampler, the first DimensionsPerBounce floats of each bounce come from it instead, at dimension
+// bounce * DimensionsPerBounce + the number drawn so far, so each bounce of a path uses its own dimensions. Streams
+// drawing from the sampler for something other than the material's scatter say which dimensions are theirs instead.
+class RandomStream
+{
+public:
+
+	static constexpr uint32_t DimensionsPerBounce = 32;
+
+	RandomStream(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t bounce, const ISampler* sampler = nullptr) :
+		RandomStream(x, y, sampleIndex, bounce, sampler, bounce * DimensionsPerBounce)
+	{
+	}
+
+	RandomStream(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t bounce, const ISampler* sampler,
+		uint32_t firstSamplerDimension) :
+		m_key(Hash(Hash(Hash(Hash(x) ^ y) ^ sampleIndex) ^ bounce)),
+		m_dimension(0),
+		m_sampler(sampler),
+		m_x(x),
+		m_y(y),
+		m_sampleIndex(sampleIndex),
+		m_firstSamplerDimension(firstSamplerDimension)
+	{
+	}
+
+	// lowbias32 from https://nullprogram.com/blog/2018/07/31/
+	static inline uint32_t Hash(uint32_t value)
+	{
+		value ^= value >> 16;
+		value *= 0x7feb352dU;
+		value ^= value >> 15;
+		value *= 0x846ca68bU;
+		value ^= value >> 16;
+		return value;
+	}
+
+	inline uint32_t UInt()
+	{
+		return Hash(m_key ^ Hash(m_dimension++));
+	}
+
+	// In [0, 1), from the top 24 bits so every value is exactly representable.
+	inline float Float()
+	{
+		if (m_sampler != nullptr && m_dimension < DimensionsPerBounce)
+			return SamplerFloat();
+
+		return (float)(UInt() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	inline float Float(float min, float max)
+	{
+		return Float() * (max - min) + min;
+	}
+
+	inline glm::vec2 Vec2()
+	{
+		float x = Float();
+		float y = Float();
+		return glm::vec2(x, y);
+	}
+
+	inline glm::vec3 Vec3(float min, float max)
+	{
+		float x = Float(min, max);
+		float y = Float(min, max);
+		float z = Float(min, max);
+		return glm::vec3(x, y, z);
+	}
+
+	// Closed form, see Sampling, so each draws a fixed number of values.
+	inline glm::vec3 RandomInUnitSphere()
+	{
+		float x = Float();
+		float y = Float();
+		float z = Float();
+		return Sampling::UniformBall(glm::vec3(x, y, z));
+	}
+
+	inline glm::vec3 RandomUnitVector()
+	{
+		return Sampling::UniformSphere(Vec2());
+	}
+
+	inline glm::vec3 RandomOnHemisphere(const glm::vec3& normal)
+	{
+		return Sampling::UniformHemisphere(Vec2(), normal);
+	}
+
+	inline glm::vec3 CosineWeightedHemisphere(const glm::vec3& normal)
+	{
+		return Sampling::CosineHemisphere(Vec2(), normal);
+	}
+
+private:
+
+	float SamplerFloat();
+
+	uint32_t m_key;
+	uint32_t m_dimension;
+
+	const ISampler* m_sampler;
+	uint32_t m_x;
+	uint32_t m_y;
+	uint32_t m_sampleIndex;
+	uint32_t m_firstSamplerDimension;
+};
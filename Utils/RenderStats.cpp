@@ -0,0 +1,52 @@
+#include "RenderStats.h"
+
+#if RENDER_STATS
+
+#include "WorkerPool.h"
+
+RenderStats::RenderStats()
+{
+}
+
+RenderStats::Totals RenderStats::EndFrame()
+{
+	Totals totals;
+	for (uint32_t thread = 0; thread < MaxThreads; thread++)
+	{
+		for (int counter = 0; counter < NumCounters; counter++)
+			totals.m_values[counter] += m_threads[thread].m_values[counter].load(std::memory_order_relaxed);
+	}
+
+	for (int counter = 0; counter < NumCounters; counter++)
+		m_lastFrame.m_values[counter] = totals.m_values[counter] - m_runningTotals.m_values[counter];
+
+	m_runningTotals = totals;
+	return m_lastFrame;
+}
+
+const char* RenderStats::GetCounterName(Counter counter)
+{
+	switch (counter)
+	{
+	case RaysTraced: return "Rays traced";
+	case IntersectionTests: return "Intersection tests";
+	case Paths: return "Paths";
+	case Bounces: return "Bounces";
+	case EarlyTerminations: return "Early terminations";
+	case RouletteTerminations: return "Roulette terminations";
+	case CacheTerminations: return "Cache terminations";
+	case ShadowRays: return "Shadow rays";
+	case Misses: return "Misses";
+	default: return "";
+	}
+}
+
+uint32_t RenderStats::GetThreadSlot()
+{
+	// Slot 0 is shared by every thread that is not a pool worker, in practice just the main thread.
+	thread_local uint32_t slot = WorkerPool::GetCurrentWorkerIndex() == WorkerPool::NotAWorker ? 0 :
+		1 + WorkerPool::GetCurrentWorkerIndex() % (MaxThreads - 1);
+	return slot;
+}
+
+#endif
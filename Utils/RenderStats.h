@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Render statistics are only gathered in debug builds unless RENDER_STATS is defined by the build. With it set to 0
+// the counters and every call recording them compile away.
+#ifndef RENDER_STATS
+#ifdef _DEBUG
+#define RENDER_STATS 1
+#else
+#define RENDER_STATS 0
+#endif
+#endif
+
+#if RENDER_STATS
+#define RENDER_STATS_ADD(renderStats, counter, amount) (renderStats).Add(RenderStats::counter, (amount))
+#else
+#define RENDER_STATS_ADD(renderStats, counter, amount) ((void)0)
+#endif
+
+#if RENDER_STATS
+
+// Counts the work done while tracing. Each thread adds to its own cache line sized block of counters, so recording
+// rarely contends with the other threads. The blocks are summed without locking once per frame by EndFrame().
+// Threads outside the WorkerPool, workers of different pools with the same index and workers beyond MaxThreads share
+// blocks, so every add is atomic and none are lost.
+class RenderStats
+{
+public:
+
+	enum Counter
+	{
+		RaysTraced,
+		IntersectionTests,
+		Paths,
+		Bounces,
+		// Paths cut off by the bounce limit before they escaped the scene.
+		EarlyTerminations,
+		// Paths ended by Russian roulette.
+		RouletteTerminations,
+		// Paths ended by taking the rest of their light from the radiance cache.
+		CacheTerminations,
+		// Rays traced towards a light by next event estimation, included in RaysTraced.
+		ShadowRays,
+		Misses,
+		NumCounters
+	};
+
+	struct Totals
+	{
+		uint64_t m_values[NumCounters] = {};
+
+		inline uint64_t Get(Counter counter) const
+		{
+			return m_values[counter];
+		}
+
+		inline float GetBouncesPerPath() const
+		{
+			return m_values[Paths] > 0 ? (float)m_values[Bounces] / (float)m_values[Paths] : 0.0f;
+		}
+	};
+
+	static constexpr uint32_t MaxThreads = 128;
+
+	RenderStats();
+
+	// Relaxed, the counters are only read once the frame's work is complete.
+	inline void Add(Counter counter, uint64_t amount)
+	{
+		m_threads[GetThreadSlot()].m_values[counter].fetch_add(amount, std::memory_order_relaxed);
+	}
+
+	// Sums every thread's counters and returns the totals added since the previous call. Call from a single thread
+	// once the frame's work is complete.
+	Totals EndFrame();
+
+	inline const Totals& GetLastFrame() const
+	{
+		return m_lastFrame;
+	}
+
+	static const char* GetCounterName(Counter counter);
+
+private:
+
+	struct alignas(64) ThreadCounters
+	{
+		std::atomic<uint64_t> m_values[NumCounters] = {};
+	};
+
+	static uint32_t GetThreadSlot();
+
+	ThreadCounters m_threads[MaxThreads];
+	Totals m_runningTotals;
+	Totals m_lastFrame;
+};
+
+#endif
@@ -0,0 +1 @@
+#include "Sampling.h"
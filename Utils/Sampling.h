@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+// Closed form mappings from uniform numbers in [0, 1)^2 to directions, each using exactly two numbers with no
+// rejection loop and no branches, so the cost per sample is fixed and low discrepancy samplers keep their
+// stratification. Directions come out unit length, and the pdfs are per unit solid angle.
+class Sampling
+{
+public:
+
+	// sin and cos of 2 pi u for u in [0, 1]. Polynomials for half the angle, centred on zero where they are most
+	// accurate, then the double angle formulas. Within about 2e-7 of the library functions.
+	static inline void SinCos2Pi(float u, float& sinAngle, float& cosAngle)
+	{
+		// Half of 2 pi u - pi, in [-pi / 2, pi / 2]. Shifting by pi flips the signs of both results.
+		float h = glm::pi<float>() * (u - 0.5f);
+		float h2 = h * h;
+		float s = h * (1.0f + h2 * (-1.0f / 6.0f + h2 * (1.0f / 120.0f + h2 * (-1.0f / 5040.0f + h2 * (1.0f / 362880.0f +
+			h2 * (-1.0f / 39916800.0f))))));
+		float c = 1.0f + h2 * (-1.0f / 2.0f + h2 * (1.0f / 24.0f + h2 * (-1.0f / 720.0f + h2 * (1.0f / 40320.0f +
+			h2 * (-1.0f / 3628800.0f + h2 * (1.0f / 479001600.0f))))));
+		sinAngle = -2.0f * s * c;
+		cosAngle = s * s - c * c;
+	}
+
+	// Two unit vectors perpendicular to n and each other. Branchless, from Duff et al. "Building an Orthonormal
+	// Basis, Revisited", JCGT 2017.
+	static inline void OrthonormalBasis(const glm::vec3& n, glm::vec3& tangent, glm::vec3& bitangent)
+	{
+		float sign = std::copysign(1.0f, n.z);
+		float a = -1.0f / (sign + n.z);
+		float b = n.x * n.y * a;
+		tangent = glm::vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+		bitangent = glm::vec3(b, sign + n.y * n.y * a, -n.y);
+	}
+
+	// Local direction about the z axis moved to be about axis.
+	static inline glm::vec3 ToWorld(const glm::vec3& local, const glm::vec3& axis)
+	{
+		glm::vec3 tangent;
+		glm::vec3 bitangent;
+		OrthonormalBasis(axis, tangent, bitangent);
+		return local.x * tangent + local.y * bitangent + local.z * axis;
+	}
+
+	// Archimedes: z uniform in [-1, 1] gives equal area.
+	static inline glm::vec3 UniformSphere(const glm::vec2& u)
+	{
+		float z = 1.0f - 2.0f * u.x;
+		float r = glm::sqrt(glm::max(0.0f, 1.0f - z * z));
+		float sinPhi;
+		float cosPhi;
+		SinCos2Pi(u.y, sinPhi, cosPhi);
+		return glm::vec3(r * cosPhi, r * sinPhi, z);
+	}
+
+	static inline float UniformSpherePdf()
+	{
+		return 1.0f / (4.0f * glm::pi<float>());
+	}
+
+	static inline glm::vec3 UniformHemisphere(const glm::vec2& u, const glm::vec3& normal)
+	{
+		float z = u.x;
+		float r = glm::sqrt(glm::max(0.0f, 1.0f - z * z));
+		float sinPhi;
+		float cosPhi;
+		SinCos2Pi(u.y, sinPhi, cosPhi);
+		return ToWorld(glm::vec3(r * cosPhi, r * sinPhi, z), normal);
+	}
+
+	static inline float UniformHemispherePdf()
+	{
+		return 1.0f / (2.0f * glm::pi<float>());
+	}
+
+	// Malley's method, a uniform point on the disc lifted onto the hemisphere. The ideal diffuse distribution.
+	static inline glm::vec3 CosineHemisphere(const glm::vec2& u, const glm::vec3& normal)
+	{
+		float r = glm::sqrt(u.x);
+		float sinPhi;
+		float cosPhi;
+		SinCos2Pi(u.y, sinPhi, cosPhi);
+		return ToWorld(glm::vec3(r * cosPhi, r * sinPhi, glm::sqrt(glm::max(0.0f, 1.0f - u.x))), normal);
+	}
+
+	static inline float CosineHemispherePdf(float cosTheta)
+	{
+		return glm::max(cosTheta, 0.0f) * (1.0f / glm::pi<float>());
+	}
+
+	// Uniform over the directions within the cone around axis whose half angle has the given cosine, such as the
+	// directions towards a sphere.
+	static inline glm::vec3 UniformCone(const glm::vec2& u, const glm::vec3& axis, float cosThetaMax)
+	{
+		float cosTheta = 1.0f - u.x * (1.0f - cosThetaMax);
+		float sinTheta = glm::sqrt(glm::max(0.0f, 1.0f - cosTheta * cosTheta));
+		float sinPhi;
+		float cosPhi;
+		SinCos2Pi(u.y, sinPhi, cosPhi);
+		return ToWorld(glm::vec3(sinTheta * cosPhi, sinTheta * sinPhi, cosTheta), axis);
+	}
+
+	static inline float UniformConePdf(float cosThetaMax)
+	{
+		return 1.0f / (2.0f * glm::pi<float>() * (1.0f - cosThetaMax));
+	}
+
+	// Uniform within the unit ball, the cube root spreading the radius so every shell gets its share of volume.
+	static inline glm::vec3 UniformBall(const glm::vec3& u)
+	{
+		return UniformSphere(glm::vec2(u.x, u.y)) * glm::pow(u.z, 1.0f / 3.0f);
+	}
+};
@@ -0,0 +1,412 @@
+#include "WorkerPool.h"
+
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <cassert>
+
+namespace
+{
+	thread_local uint32_t t_workerIndex = WorkerPool::NotAWorker;
+
+	struct ProcessorNode
+	{
+		uint32_t m_numaNode;
+		uint16_t m_processorGroup;
+		uint64_t m_affinityMask;
+	};
+
+	// Processor masks of every NUMA node that has processors. Memory only nodes are skipped.
+	std::vector<ProcessorNode> QueryProcessorNodes()
+	{
+		std::vector<ProcessorNode> nodes;
+
+		ULONG highestNode = 0;
+		if (!GetNumaHighestNodeNumber(&highestNode))
+			return nodes;
+
+		for (ULONG node = 0; node <= highestNode; node++)
+		{
+			GROUP_AFFINITY affinity = {};
+			if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity) || affinity.Mask == 0)
+				continue;
+
+			nodes.push_back({ (uint32_t)node, affinity.Group, (uint64_t)affinity.Mask });
+		}
+
+		return nodes;
+	}
+}
+
+class WorkerPool::Job
+{
+public:
+
+	struct alignas(64) ItemRange
+	{
+		std::atomic<uint32_t> m_next{ 0 };
+		uint32_t m_end = 0;
+	};
+
+	bool ClaimItem(uint32_t node, uint32_t& item)
+	{
+		// Own node first, then the others if stealing is allowed.
+		for (uint32_t i = 0; i < m_numRanges; i++)
+		{
+			ItemRange& range = m_ranges[(node + i) % m_numRanges];
+			if (range.m_next.load(std::memory_order_relaxed) < range.m_end)
+			{
+				uint32_t claimed = range.m_next.fetch_add(1, std::memory_order_relaxed);
+				if (claimed < range.m_end)
+				{
+					item = claimed;
+					return true;
+				}
+			}
+
+			if (!m_allowStealing)
+				break;
+		}
+
+		return false;
+	}
+
+	bool HasClaimableItem(uint32_t node) const
+	{
+		for (uint32_t i = 0; i < m_numRanges; i++)
+		{
+			const ItemRange& range = m_ranges[(node + i) % m_numRanges];
+			if (range.m_next.load(std::memory_order_relaxed) < range.m_end)
+				return true;
+
+			if (!m_allowStealing)
+				break;
+		}
+
+		return false;
+	}
+
+	bool AllItemsClaimed() const
+	{
+		for (uint32_t i = 0; i < m_numRanges; i++)
+		{
+			if (m_ranges[i].m_next.load(std::memory_order_relaxed) < m_ranges[i].m_end)
+				return false;
+		}
+
+		return true;
+	}
+
+	void Complete()
+	{
+		if (m_onComplete)
+			m_onComplete();
+
+		std::vector<CompletionFunction> continuations;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_complete = true;
+			continuations.swap(m_continuations);
+		}
+		m_condition.notify_all();
+
+		for (CompletionFunction& continuation : continuations)
+			continuation();
+	}
+
+	ItemFunction m_itemFunction;
+	CompletionFunction m_onComplete;
+
+	std::unique_ptr<ItemRange[]> m_ranges;
+	uint32_t m_numRanges = 0;
+	bool m_allowStealing = true;
+
+	// Items not yet finished, the worker that takes this to zero completes the job.
+	std::atomic<uint32_t> m_remaining{ 0 };
+
+	std::atomic<bool> m_complete{ false };
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::vector<CompletionFunction> m_continuations;
+};
+
+WorkerPool::WorkerPool() :
+	m_numWorkers(0),
+	m_stopping(false)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+	Shutdown();
+}
+
+bool WorkerPool::Initialise(uint32_t maxNodes, uint32_t maxWorkers)
+{
+	Shutdown();
+
+	std::vector<ProcessorNode> processorNodes = QueryProcessorNodes();
+	if (maxNodes != 0 && processorNodes.size() > maxNodes)
+		processorNodes.resize(maxNodes);
+
+	// One worker per processor in each node's mask.
+	std::vector<ProcessorNode> workerProcessors;
+	for (uint32_t node = 0; node < processorNodes.size(); node++)
+	{
+		if (maxWorkers != 0 && workerProcessors.size() == maxWorkers)
+			break;
+
+		NodeInfo nodeInfo;
+		nodeInfo.m_numaNode = processorNodes[node].m_numaNode;
+		nodeInfo.m_firstWorker = (uint32_t)workerProcessors.size();
+
+		for (uint32_t bit = 0; bit < 64; bit++)
+		{
+			uint64_t processorMask = 1ull << bit;
+			if ((processorNodes[node].m_affinityMask & processorMask) && (maxWorkers == 0 || workerProcessors.size() < maxWorkers))
+				workerProcessors.push_back({ node, processorNodes[node].m_processorGroup, processorMask });
+		}
+
+		nodeInfo.m_numWorkers = (uint32_t)workerProcessors.size() - nodeInfo.m_firstWorker;
+		m_nodes.push_back(nodeInfo);
+	}
+
+	// No NUMA information, fall back to a single node of unpinned workers.
+	if (workerProcessors.empty())
+	{
+		m_nodes.clear();
+
+		uint32_t numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		if (maxWorkers != 0)
+			numThreads = std::min(numThreads, maxWorkers);
+		for (uint32_t i = 0; i < numThreads; i++)
+			workerProcessors.push_back({ 0, 0, 0 });
+
+		NodeInfo nodeInfo;
+		nodeInfo.m_numWorkers = numThreads;
+		m_nodes.push_back(nodeInfo);
+	}
+
+	m_numWorkers = (uint32_t)workerProcessors.size();
+	m_workers = std::make_unique<Worker[]>(m_numWorkers);
+	for (uint32_t i = 0; i < m_numWorkers; i++)
+	{
+		m_workers[i].m_node = workerProcessors[i].m_numaNode;
+		m_workers[i].m_processorGroup = workerProcessors[i].m_processorGroup;
+		m_workers[i].m_affinityMask = workerProcessors[i].m_affinityMask;
+	}
+
+	m_stopping = false;
+	for (uint32_t i = 0; i < m_numWorkers; i++)
+		m_workers[i].m_thread = std::thread(&WorkerPool::WorkerMain, this, i);
+
+	return true;
+}
+
+void WorkerPool::Shutdown()
+{
+	if (!m_workers)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		m_stopping = true;
+	}
+	m_queueCondition.notify_all();
+
+	for (uint32_t i = 0; i < m_numWorkers; i++)
+	{
+		if (m_workers[i].m_thread.joinable())
+			m_workers[i].m_thread.join();
+	}
+
+	m_workers.reset();
+	m_numWorkers = 0;
+	m_nodes.clear();
+	m_jobs.clear();
+}
+
+uint32_t WorkerPool::GetWorkerNode(uint32_t workerIndex) const
+{
+	assert(workerIndex < m_numWorkers);
+	return m_workers[workerIndex].m_node;
+}
+
+uint64_t WorkerPool::GetItemsCompleted(uint32_t workerIndex) const
+{
+	assert(workerIndex < m_numWorkers);
+	return m_workers[workerIndex].m_itemsCompleted.load(std::memory_order_relaxed);
+}
+
+uint32_t WorkerPool::GetAvailableNodes()
+{
+	return std::max((uint32_t)QueryProcessorNodes().size(), 1u);
+}
+
+uint32_t WorkerPool::GetCurrentWorkerIndex()
+{
+	return t_workerIndex;
+}
+
+WorkerPool::JobHandle WorkerPool::Dispatch(uint32_t numItems, const std::vector<uint32_t>& nodeOffsets,
+	ItemFunction itemFunction, CompletionFunction onComplete)
+{
+	return Dispatch(numItems, nodeOffsets, true, std::move(itemFunction), std::move(onComplete));
+}
+
+WorkerPool::JobHandle WorkerPool::Dispatch(uint32_t numItems, const std::vector<uint32_t>& nodeOffsets, bool allowStealing,
+	ItemFunction itemFunction, CompletionFunction onComplete)
+{
+	assert(m_workers);
+
+	JobHandle job = std::make_shared<Job>();
+	job->m_itemFunction = std::move(itemFunction);
+	job->m_onComplete = std::move(onComplete);
+	job->m_allowStealing = allowStealing;
+	job->m_remaining = numItems;
+
+	if (nodeOffsets.size() > 1)
+	{
+		assert(nodeOffsets.back() == numItems);
+		job->m_numRanges = (uint32_t)nodeOffsets.size() - 1;
+		job->m_ranges = std::make_unique<Job::ItemRange[]>(job->m_numRanges);
+		for (uint32_t i = 0; i < job->m_numRanges; i++)
+		{
+			job->m_ranges[i].m_next = nodeOffsets[i];
+			job->m_ranges[i].m_end = nodeOffsets[i + 1];
+		}
+	}
+	else
+	{
+		job->m_numRanges = 1;
+		job->m_ranges = std::make_unique<Job::ItemRange[]>(1);
+		job->m_ranges[0].m_end = numItems;
+	}
+
+	if (numItems == 0)
+	{
+		job->Complete();
+		return job;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		m_jobs.push_back(job);
+	}
+	m_queueCondition.notify_all();
+
+	return job;
+}
+
+bool WorkerPool::IsComplete(const JobHandle& job) const
+{
+	return job->m_complete.load();
+}
+
+void WorkerPool::Wait(const JobHandle& job)
+{
+	assert(GetCurrentWorkerIndex() == NotAWorker || IsComplete(job));
+
+	std::unique_lock<std::mutex> lock(job->m_mutex);
+	job->m_condition.wait(lock, [&job]() { return job->m_complete.load(); });
+}
+
+bool WorkerPool::AddContinuation(const JobHandle& job, CompletionFunction continuation)
+{
+	std::lock_guard<std::mutex> lock(job->m_mutex);
+	if (job->m_complete.load())
+		return false;
+
+	job->m_continuations.push_back(std::move(continuation));
+	return true;
+}
+
+void WorkerPool::ParallelFor(uint32_t numItems, const std::vector<uint32_t>& nodeOffsets, ItemFunction itemFunction)
+{
+	Wait(Dispatch(numItems, nodeOffsets, std::move(itemFunction)));
+}
+
+void WorkerPool::ParallelFor(uint32_t numItems, ItemFunction itemFunction)
+{
+	Wait(Dispatch(numItems, {}, std::move(itemFunction)));
+}
+
+void WorkerPool::RunOnEachNode(std::function<void(uint32_t node)> nodeFunction)
+{
+	assert(GetCurrentWorkerIndex() == NotAWorker);
+
+	// One item per node with stealing disabled, so each item can only be claimed by its own node.
+	std::vector<uint32_t> nodeOffsets(m_nodes.size() + 1);
+	for (uint32_t i = 0; i < nodeOffsets.size(); i++)
+		nodeOffsets[i] = i;
+
+	Wait(Dispatch((uint32_t)m_nodes.size(), nodeOffsets, false,
+		[&nodeFunction](uint32_t node, uint32_t workerIndex) { nodeFunction(node); }, nullptr));
+}
+
+void* WorkerPool::AllocateFirstTouch(size_t bytes)
+{
+	return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void WorkerPool::FreeFirstTouch(void* memory)
+{
+	if (memory)
+		VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+WorkerPool::JobHandle WorkerPool::FindClaimableJob(uint32_t node)
+{
+	// Drop jobs whose items have all been handed out, the workers running them finish them without the queue.
+	while (!m_jobs.empty() && m_jobs.front()->AllItemsClaimed())
+		m_jobs.pop_front();
+
+	for (const JobHandle& job : m_jobs)
+	{
+		if (job->HasClaimableItem(node))
+			return job;
+	}
+
+	return nullptr;
+}
+
+void WorkerPool::WorkerMain(uint32_t workerIndex)
+{
+	t_workerIndex = workerIndex;
+	Worker& worker = m_workers[workerIndex];
+
+	if (worker.m_affinityMask != 0)
+	{
+		GROUP_AFFINITY affinity = {};
+		affinity.Group = worker.m_processorGroup;
+		affinity.Mask = (KAFFINITY)worker.m_affinityMask;
+		SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+	}
+
+	while (true)
+	{
+		JobHandle job;
+		{
+			std::unique_lock<std::mutex> lock(m_queueMutex);
+			m_queueCondition.wait(lock, [this, &job, &worker]()
+				{
+					job = FindClaimableJob(worker.m_node);
+					return m_stopping || job;
+				});
+
+			if (!job)
+				return;
+		}
+
+		uint32_t item;
+		while (job->ClaimItem(worker.m_node, item))
+		{
+			job->m_itemFunction(item, workerIndex);
+			worker.m_itemsCompleted.fetch_add(1, std::memory_order_relaxed);
+
+			if (job->m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				job->Complete();
+		}
+	}
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed pool of worker threads, one per logical processor, pinned to their processor and grouped by NUMA node.
+// Work is submitted as jobs: a parallel loop over a number of items. The items can be split into one range per node
+// so that each node's workers process the items whose memory lives on that node, stealing from the other nodes only
+// when their own range runs out. On machines without NUMA everything runs as a single node.
+class WorkerPool
+{
+public:
+
+	static constexpr uint32_t NotAWorker = 0xFFFFFFFF;
+
+	using ItemFunction = std::function<void(uint32_t item, uint32_t workerIndex)>;
+	using CompletionFunction = std::function<void()>;
+
+	class Job;
+	using JobHandle = std::shared_ptr<Job>;
+
+	struct NodeInfo
+	{
+		// The operating system's NUMA node number.
+		uint32_t m_numaNode = 0;
+		uint32_t m_firstWorker = 0;
+		uint32_t m_numWorkers = 0;
+	};
+
+	WorkerPool();
+	~WorkerPool();
+
+	// Starts the workers. maxNodes limits how many NUMA nodes are used and maxWorkers how many workers are started in
+	// total, zero uses all of them.
+	bool Initialise(uint32_t maxNodes = 0, uint32_t maxWorkers = 0);
+	void Shutdown();
+
+	inline uint32_t GetNumWorkers() const
+	{
+		return m_numWorkers;
+	}
+
+	inline uint32_t GetNumNodes() const
+	{
+		return (uint32_t)m_nodes.size();
+	}
+
+	inline const NodeInfo& GetNode(uint32_t node) const
+	{
+		return m_nodes[node];
+	}
+
+	uint32_t GetWorkerNode(uint32_t workerIndex) const;
+	uint64_t GetItemsCompleted(uint32_t workerIndex) const;
+
+	// Number of NUMA nodes with processors on this machine.
+	static uint32_t GetAvailableNodes();
+
+	// Index of the calling worker thread in its pool, or NotAWorker when called from any other thread.
+	static uint32_t GetCurrentWorkerIndex();
+
+	// Queues a job and returns straight away. nodeOffsets holds GetNumNodes() + 1 ascending offsets, items in
+	// [nodeOffsets[n], nodeOffsets[n + 1]) are preferably run on node n. Empty means no preference.
+	// onComplete runs on whichever worker finishes the last item.
+	JobHandle Dispatch(uint32_t numItems, const std::vector<uint32_t>& nodeOffsets, ItemFunction itemFunction,
+		CompletionFunction onComplete = nullptr);
+
+	bool IsComplete(const JobHandle& job) const;
+
+	// Blocks until the job is complete. Must not be called from a worker thread unless the job is already complete.
+	void Wait(const JobHandle& job);
+
+	// Queues continuation to run once the job is complete, after its onComplete, on the worker that finished it.
+	// Returns false without queuing anything when the job has already completed.
+	bool AddContinuation(const JobHandle& job, CompletionFunction continuation);
+
+	// Dispatch followed by Wait. Must not be called from a worker thread.
+	void ParallelFor(uint32_t numItems, const std::vector<uint32_t>& nodeOffsets, ItemFunction itemFunction);
+	void ParallelFor(uint32_t numItems, ItemFunction itemFunction);
+
+	// Calls nodeFunction once for every node, on a worker belonging to that node, and waits for them all. Must not be
+	// called from a worker thread.
+	void RunOnEachNode(std::function<void(uint32_t node)> nodeFunction);
+
+	// Reserves and commits memory without touching it, so each page is placed on the NUMA node of the thread that
+	// first writes to it. The memory reads as zero until written.
+	static void* AllocateFirstTouch(size_t bytes);
+	static void FreeFirstTouch(void* memory);
+
+private:
+
+	struct alignas(64) Worker
+	{
+		std::thread m_thread;
+		uint32_t m_node = 0;
+		uint16_t m_processorGroup = 0;
+		// Zero when the worker is not pinned.
+		uint64_t m_affinityMask = 0;
+		std::atomic<uint64_t> m_itemsCompleted{ 0 };
+	};
+
+	JobHandle Dispatch(uint32_t numItems, const std::vector<uint32_t>& nodeOffsets, bool allowStealing,
+		ItemFunction itemFunction, CompletionFunction onComplete);
+
+	void WorkerMain(uint32_t workerIndex);
+	JobHandle FindClaimableJob(uint32_t node);
+
+	std::unique_ptr<Worker[]> m_workers;
+	uint32_t m_numWorkers;
+	std::vector<NodeInfo> m_nodes;
+
+	std::mutex m_queueMutex;
+	std::condition_variable m_queueCondition;
+	std::deque<JobHandle> m_jobs;
+	bool m_stopping;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Eight independent xoshiro128+ generators (https://prng.di.unimi.it/) stepped together, giving eight floats per
+// call. The state is kept lane by lane so one AVX2 instruction steps all eight, which is used when the compiler
+// targets AVX2 (/arch:AVX2). Otherwise the same loop runs over the lanes in plain C++, which gives the same numbers.
+// xoshiro128+ has weak low bits, only the top 24 are used.
+class Xoshiro128x8
+{
+public:
+
+	static constexpr uint32_t NumLanes = 8;
+
+	explicit Xoshiro128x8(uint32_t seed = 0)
+	{
+		// SplitMix32 to spread the seed over the state, every lane seeded differently. The state must not be all
+		// zero, which SplitMix makes vanishingly unlikely.
+		uint32_t mix = seed;
+		for (uint32_t word = 0; word < 4; word++)
+		{
+			for (uint32_t lane = 0; lane < NumLanes; lane++)
+			{
+				mix += 0x9e3779b9u;
+				uint32_t value = mix;
+				value = (value ^ (value >> 16)) * 0x85ebca6bu;
+				value = (value ^ (value >> 13)) * 0xc2b2ae35u;
+				m_state[word][lane] = value ^ (value >> 16);
+			}
+		}
+	}
+
+	// Fills values with eight floats in [0, 1).
+	inline void Float8(float* values)
+	{
+#if defined(__AVX2__)
+		__m256i s0 = _mm256_loadu_si256((const __m256i*)m_state[0]);
+		__m256i s1 = _mm256_loadu_si256((const __m256i*)m_state[1]);
+		__m256i s2 = _mm256_loadu_si256((const __m256i*)m_state[2]);
+		__m256i s3 = _mm256_loadu_si256((const __m256i*)m_state[3]);
+
+		__m256i result = _mm256_add_epi32(s0, s3);
+		__m256i t = _mm256_slli_epi32(s1, 9);
+		s2 = _mm256_xor_si256(s2, s0);
+		s3 = _mm256_xor_si256(s3, s1);
+		s1 = _mm256_xor_si256(s1, s2);
+		s0 = _mm256_xor_si256(s0, s3);
+		s2 = _mm256_xor_si256(s2, t);
+		s3 = _mm256_or_si256(_mm256_slli_epi32(s3, 11), _mm256_srli_epi32(s3, 21));
+
+		_mm256_storeu_si256((__m256i*)m_state[0], s0);
+		_mm256_storeu_si256((__m256i*)m_state[1], s1);
+		_mm256_storeu_si256((__m256i*)m_state[2], s2);
+		_mm256_storeu_si256((__m256i*)m_state[3], s3);
+
+		// The shifted values fit in 24 bits, so the signed conversion is exact.
+		__m256 floats = _mm256_cvtepi32_ps(_mm256_srli_epi32(result, 8));
+		_mm256_storeu_ps(values, _mm256_mul_ps(floats, _mm256_set1_ps(1.0f / 16777216.0f)));
+#else
+		for (uint32_t lane = 0; lane < NumLanes; lane++)
+			values[lane] = (float)(NextLane(lane) >> 8) * (1.0f / 16777216.0f);
+#endif
+	}
+
+	// Steps a single lane, for checking against the eight wide version.
+	inline uint32_t NextLane(uint32_t lane)
+	{
+		uint32_t& s0 = m_state[0][lane];
+		uint32_t& s1 = m_state[1][lane];
+		uint32_t& s2 = m_state[2][lane];
+		uint32_t& s3 = m_state[3][lane];
+
+		uint32_t result = s0 + s3;
+		uint32_t t = s1 << 9;
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= t;
+		s3 = (s3 << 11) | (s3 >> 21);
+		return result;
+	}
+
+private:
+
+	// Word major, so each word of the eight lanes is one 256 bit register.
+	alignas(32) uint32_t m_state[4][NumLanes];
+};
@@ -6,7 +6,8 @@ Window::Window() :
 	m_mainWindowRect(1250.0f, 700.0f),
 	m_renderWindowRect(893.0f, 647.0f),
 	m_waitCursor(nullptr),
-	m_window(nullptr)
+	m_window(nullptr),
+	m_inputTime(Clock::now())
 {
 }
 
@@ -106,10 +107,21 @@ void Window::SetWaitCursor()
 
 bool Window::HandleEventLoop(float deltaTime)
 {
+	// Events are stamped in SDL's milliseconds, converted by how long ago they arrived.
+	Clock::time_point pollTime = Clock::now();
+	Uint32 pollTicks = SDL_GetTicks();
+	m_inputTime = pollTime;
+
 	SDL_Event event;
 	while (SDL_PollEvent(&event))
 	{
 		ImGui_ImplSDL2_ProcessEvent(&event);
+		if (event.type == SDL_KEYDOWN || event.type == SDL_MOUSEMOTION || event.type == SDL_MOUSEBUTTONDOWN)
+		{
+			Clock::time_point eventTime = pollTime - std::chrono::milliseconds(pollTicks - event.common.timestamp);
+			if (eventTime < m_inputTime)
+				m_inputTime = eventTime;
+		}
 		if (event.type == SDL_QUIT)
 			return false;
 		if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE)
@@ -5,6 +5,8 @@
 #include <SDL.h>
 #include <SDL_syswm.h>
 
+#include "ScopedTimer.h"
+
 struct SDL_Window;
 
 class Window
@@ -41,6 +43,10 @@ public:
 
     bool HandleEventLoop(float deltaTime);
 
+    // When the input read by the last HandleEventLoop arrived: its earliest mouse or key event, or the time of the
+    // call itself if there were none, as while a key is held down.
+    Clock::time_point GetInputTime() const { return m_inputTime; };
+
     glm::vec2 m_mainWindowRect;
     glm::vec2 m_renderWindowRect;
 
@@ -50,5 +56,6 @@ private:
 
     SDL_Cursor* m_waitCursor;
     SDL_Window* m_window;
+    Clock::time_point m_inputTime;
 
 };
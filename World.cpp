@@ -6,113 +6,256 @@
 #include "Materials/FuzzyMetal.h"
 #include "Materials/Lambertian.h"
 #include "Materials/Metal.h"
-
-World::~World()
-{
-	for (IMaterial* material : m_materials)
-	{
-		delete material;
-	}
-
-	for (CollidableObject* object : m_objects)
-	{
-		delete object;
-	}
-}
+#include "Utils/RandomStream.h"
 
 World::World() :
-	m_lightDirection(1.0f, 0.73f, 0.0f)
+	m_currentSnapshot(nullptr),
+	m_nextVersion(1)
 {
+	glm::vec3 lightDirection(1.0f, 0.73f, 0.0f);
+	std::shared_ptr<WorldSnapshot::ObjectList> objects = std::make_shared<WorldSnapshot::ObjectList>();
+	std::shared_ptr<WorldSnapshot::MaterialList> materials = std::make_shared<WorldSnapshot::MaterialList>();
+
 	// TODO this should be loaded from a config file or map editor.
 
 	glm::vec3 position1 = { 0.1f, -1.0f, -0.6f };
 	float radius1 = { 1.0f };
 
 	CollidableObject* object1 = new Sphere(position1, radius1, 0);
-	m_objects.push_back(object1);
+	objects->emplace_back(object1);
 
 	glm::vec3 position2 = { -1.0f, 0.0f, -3.0f };
 	float radius2 = { 1.0f };
 
 	CollidableObject* object2 = new Sphere(position2, radius2, 1);
-	m_objects.push_back(object2);
+	objects->emplace_back(object2);
 
 	glm::vec3 position3 = { 2.2f, 1.0f, 0.0f };
 	float radius3 = { 0.7f };
 
 	CollidableObject* object3 = new Sphere(position3, radius3, 2);
-	m_objects.push_back(object3);
+	objects->emplace_back(object3);
 
 	glm::vec3 position4 = { 3.2f, -1.0f, 0.0f };
 	float radius4 = { 0.2f };
 
 	CollidableObject* object4 = new Sphere(position4, radius4, 3);
-	m_objects.push_back(object4);
+	objects->emplace_back(object4);
 
 	glm::vec3 position5 = { 4.2f, -1.0f, 0.0f };
 	float radius5 = { 0.5f };
 
 	CollidableObject* object5 = new Sphere(position5, radius5, 4);
-	m_objects.push_back(object5);
+	objects->emplace_back(object5);
 
 	glm::vec3 position6 = { 6.2f, -1.0f, 0.0f };
 	float radius6 = { 1.0f };
 
 	CollidableObject* object6 = new Sphere(position6, radius6, 5);
-	m_objects.push_back(object6);
+	objects->emplace_back(object6);
 
 	glm::vec3 position7 = { 0.0f, 101.0f, 0.0f };
 	float radius7 = { 100.0f };
 
 	CollidableObject* object7 = new Sphere(position7, radius7, 6);
-	m_objects.push_back(object7);
+	objects->emplace_back(object7);
 
 	IMaterial* yellowEmissive = new Emissive(2.0f, { 1.0f, 1.0f, 0.2f });
-	IMaterial* purpleDiffuse = new Diffuse(m_lightDirection, 1.0f, glm::vec3(1.0f, 0.0f, 1.0f));
-	IMaterial* redDiffuse = new Diffuse(m_lightDirection, 1.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+	IMaterial* purpleDiffuse = new Diffuse(lightDirection, 1.0f, glm::vec3(1.0f, 0.0f, 1.0f));
+	IMaterial* redDiffuse = new Diffuse(lightDirection, 1.0f, glm::vec3(1.0f, 0.0f, 0.0f));
 	IMaterial* blueLambert = new Lambertian(glm::vec3(0.0f, 0.0f, 1.0f));
 	IMaterial* limeGreenFuzzyMetal = new FuzzyMetal(0.4f, glm::vec3(0.0f, 1.0f, 0.0f));
 	IMaterial* forestGreenMetal = new Metal(glm::vec3(0.0f, 0.5f, 0.5f));
 	IMaterial* greyMetal = new Metal(glm::vec3(0.5f, 0.5f, 0.5f));
 
-	m_materials.emplace_back(yellowEmissive);
-	m_materials.emplace_back(purpleDiffuse);
-	m_materials.emplace_back(redDiffuse);
-	m_materials.emplace_back(blueLambert);
-	m_materials.emplace_back(limeGreenFuzzyMetal);
-	m_materials.emplace_back(forestGreenMetal);
-	m_materials.emplace_back(greyMetal);
+	materials->emplace_back(yellowEmissive);
+	materials->emplace_back(purpleDiffuse);
+	materials->emplace_back(redDiffuse);
+	materials->emplace_back(blueLambert);
+	materials->emplace_back(limeGreenFuzzyMetal);
+	materials->emplace_back(forestGreenMetal);
+	materials->emplace_back(greyMetal);
+
+	Publish(objects, materials, lightDirection, nullptr);
 }
 
-const CollidableObject& World::GetCollidableObject(int index) const {
-	return *m_objects[index];
-};
+World::~World()
+{
+	delete m_currentSnapshot.load();
+}
+
+World::SnapshotHandle World::AcquireSnapshot() const
+{
+	EpochManager::Guard guard = m_epochManager.Pin();
+	return SnapshotHandle(std::move(guard), m_currentSnapshot.load(std::memory_order_seq_cst));
+}
 
-IMaterial* World::GetMaterialPtr(int materialIndex) const {
-	assert(materialIndex < m_materials.size());
-	return m_materials[materialIndex];
+void World::Publish(std::shared_ptr<const WorldSnapshot::ObjectList> objects,
+	std::shared_ptr<const WorldSnapshot::MaterialList> materials, const glm::vec3& lightDirection,
+	std::shared_ptr<const EnvironmentMap> environmentMap)
+{
+	const WorldSnapshot* newSnapshot = new WorldSnapshot(m_nextVersion++, std::move(objects), std::move(materials), lightDirection,
+		std::move(environmentMap));
+	const WorldSnapshot* oldSnapshot = m_currentSnapshot.exchange(newSnapshot, std::memory_order_seq_cst);
+	if (oldSnapshot)
+		m_epochManager.Retire([oldSnapshot]() { delete oldSnapshot; });
+}
 
-};
+void World::ReclaimSnapshots()
+{
+	m_epochManager.Collect();
+}
 
-void World::UpdateMaterial(IMaterial* newMaterial, int materialIndex) {
-	assert(materialIndex < m_materials.size());
-	m_materials[materialIndex] = newMaterial;
-};
-void World::AddMaterial(IMaterial* newMaterial, int materialIndex) {
-	assert(materialIndex < m_materials.size());
-	m_materials[materialIndex] = newMaterial;
-};
+void World::EditObject(int objectIndex, const std::function<void(CollidableObject&)>& edit)
+{
+	const WorldSnapshot& current = GetCurrentSnapshot();
+	assert(objectIndex < current.GetCollidableObjects().size());
+
+	std::shared_ptr<CollidableObject> editedObject(current.GetCollidableObject(objectIndex).Clone());
+	edit(*editedObject);
+
+	// Only the list and the edited object are copied, every other object is shared with the previous version.
+	std::shared_ptr<WorldSnapshot::ObjectList> objects = std::make_shared<WorldSnapshot::ObjectList>(current.GetCollidableObjects());
+	(*objects)[objectIndex] = editedObject;
+
+	Publish(objects, current.GetSharedMaterials(), current.GetLightDirection(), current.GetSharedEnvironmentMap());
+}
+
+void World::EditMaterial(int materialIndex, const std::function<void(IMaterial&)>& edit)
+{
+	const WorldSnapshot& current = GetCurrentSnapshot();
+	assert(materialIndex < current.GetNumMaterials());
+
+	std::shared_ptr<IMaterial> editedMaterial(current.GetMaterialPtr(materialIndex)->Clone());
+	edit(*editedMaterial);
+
+	std::shared_ptr<WorldSnapshot::MaterialList> materials = std::make_shared<WorldSnapshot::MaterialList>(*current.GetSharedMaterials());
+	(*materials)[materialIndex] = editedMaterial;
+
+	Publish(current.GetSharedObjects(), materials, current.GetLightDirection(), current.GetSharedEnvironmentMap());
+}
 
 void World::SetLightDirection(glm::vec3& lightDirection) {
-	m_lightDirection = glm::normalize(lightDirection);
-	for (IMaterial* material : m_materials)
+	const WorldSnapshot& current = GetCurrentSnapshot();
+	glm::vec3 normalisedLightDirection = glm::normalize(lightDirection);
+
+	std::shared_ptr<WorldSnapshot::MaterialList> materials = std::make_shared<WorldSnapshot::MaterialList>(*current.GetSharedMaterials());
+	for (std::shared_ptr<const IMaterial>& material : *materials)
 	{
 		if (material->GetType() == MaterialType::Diffuse)
 		{
-			Diffuse* diffuseMaterial = dynamic_cast<Diffuse*>(material);
+			Diffuse* diffuseMaterial = dynamic_cast<Diffuse*>(material->Clone());
 			assert(diffuseMaterial);
 
-			diffuseMaterial->UpdateLightDirection(m_lightDirection);
+			diffuseMaterial->UpdateLightDirection(normalisedLightDirection);
+			material.reset(diffuseMaterial);
 		}
 	}
+
+	Publish(current.GetSharedObjects(), materials, normalisedLightDirection, current.GetSharedEnvironmentMap());
 };
+
+void World::SetEnvironmentMap(std::shared_ptr<const EnvironmentMap> environmentMap)
+{
+	const WorldSnapshot& current = GetCurrentSnapshot();
+	Publish(current.GetSharedObjects(), current.GetSharedMaterials(), current.GetLightDirection(), std::move(environmentMap));
+}
+
+void World::LoadManyLightsScene(uint32_t numLights)
+{
+	const WorldSnapshot& current = GetCurrentSnapshot();
+	std::shared_ptr<WorldSnapshot::ObjectList> objects = std::make_shared<WorldSnapshot::ObjectList>();
+	std::shared_ptr<WorldSnapshot::MaterialList> materials = std::make_shared<WorldSnapshot::MaterialList>();
+
+	materials->emplace_back(new Lambertian(glm::vec3(0.5f)));
+	materials->emplace_back(new Lambertian(glm::vec3(0.8f, 0.3f, 0.3f)));
+	materials->emplace_back(new Lambertian(glm::vec3(0.3f, 0.3f, 0.8f)));
+
+	objects->emplace_back(new Sphere(glm::vec3(0.0f, 101.0f, 0.0f), 100.0f, 0));
+	objects->emplace_back(new Sphere(glm::vec3(-1.5f, 0.0f, -1.0f), 1.0f, 1));
+	objects->emplace_back(new Sphere(glm::vec3(1.5f, 0.0f, -2.0f), 1.0f, 2));
+
+	// Fifteen dim colours and one light twenty times brighter.
+	constexpr int numLightMaterials = 16;
+	int firstLightMaterial = (int)materials->size();
+	for (int i = 0; i < numLightMaterials; i++)
+	{
+		glm::vec3 colour(0.5f + 0.5f * (float)((i >> 0) & 1), 0.5f + 0.5f * (float)((i >> 1) & 1), 0.5f + 0.5f * (float)((i >> 2) & 1));
+		float power = i == numLightMaterials - 1 ? 400.0f : 20.0f;
+		materials->emplace_back(new Emissive(power, colour));
+	}
+
+	// A jittered grid over the floor, hashed so the scene is the same every time.
+	constexpr float lightRadius = 0.05f;
+	uint32_t gridSize = (uint32_t)glm::ceil(glm::sqrt((float)numLights));
+	for (uint32_t i = 0; i < numLights; i++)
+	{
+		uint32_t hash = RandomStream::Hash(i);
+		float jitterX = (float)(hash & 0xffff) / 65536.0f;
+		float jitterZ = (float)(hash >> 16) / 65536.0f;
+		float x = -8.0f + 16.0f * ((float)(i % gridSize) + jitterX) / (float)gridSize;
+		float z = -12.0f + 16.0f * ((float)(i / gridSize) + jitterZ) / (float)gridSize;
+		int material = firstLightMaterial + (int)(RandomStream::Hash(hash) % numLightMaterials);
+		objects->emplace_back(new Sphere(glm::vec3(x, 1.0f - 2.0f * lightRadius, z), lightRadius, material));
+	}
+
+	Publish(objects, materials, current.GetLightDirection(), current.GetSharedEnvironmentMap());
+}
+
+void World::LoadMirrorScene()
+{
+	const WorldSnapshot& current = GetCurrentSnapshot();
+	std::shared_ptr<WorldSnapshot::ObjectList> objects = std::make_shared<WorldSnapshot::ObjectList>();
+	std::shared_ptr<WorldSnapshot::MaterialList> materials = std::make_shared<WorldSnapshot::MaterialList>();
+
+	materials->emplace_back(new Lambertian(glm::vec3(0.7f)));
+	materials->emplace_back(new Lambertian(glm::vec3(0.8f, 0.3f, 0.3f)));
+	materials->emplace_back(new Metal(glm::vec3(0.9f)));
+	materials->emplace_back(new Metal(glm::vec3(0.9f, 0.8f, 0.5f)));
+	materials->emplace_back(new Emissive(50.0f, glm::vec3(1.0f, 0.9f, 0.7f)));
+
+	// Walls as in LoadRoomScene. Open to the sky, most of the light would come from it and sampling the material alone
+	// already finds that well.
+	constexpr float wallRadius = 1000.0f;
+	objects->emplace_back(new Sphere(glm::vec3(0.0f, 1.0f + wallRadius, 0.0f), wallRadius, 0));
+	objects->emplace_back(new Sphere(glm::vec3(0.0f, -3.0f - wallRadius, 0.0f), wallRadius, 0));
+	objects->emplace_back(new Sphere(glm::vec3(-4.0f - wallRadius, 0.0f, 0.0f), wallRadius, 0));
+	objects->emplace_back(new Sphere(glm::vec3(4.0f + wallRadius, 0.0f, 0.0f), wallRadius, 0));
+	objects->emplace_back(new Sphere(glm::vec3(0.0f, 0.0f, -5.0f - wallRadius), wallRadius, 0));
+	objects->emplace_back(new Sphere(glm::vec3(0.0f, 0.0f, 9.0f + wallRadius), wallRadius, 0));
+
+	objects->emplace_back(new Sphere(glm::vec3(-2.2f, 0.0f, -1.0f), 1.0f, 1));
+	objects->emplace_back(new Sphere(glm::vec3(0.0f, 0.0f, -2.0f), 1.0f, 2));
+	objects->emplace_back(new Sphere(glm::vec3(2.2f, 0.25f, -2.5f), 0.75f, 3));
+	// Under the ceiling against the back wall, so most surfaces the camera sees are lit by way of the walls and mirrors.
+	objects->emplace_back(new Sphere(glm::vec3(0.0f, -2.4f, -4.3f), 0.5f, 4));
+
+	Publish(objects, materials, current.GetLightDirection(), current.GetSharedEnvironmentMap());
+}
+
+void World::LoadRoomScene()
+{
+	const WorldSnapshot& current = GetCurrentSnapshot();
+	std::shared_ptr<WorldSnapshot::ObjectList> objects = std::make_shared<WorldSnapshot::ObjectList>();
+	std::shared_ptr<WorldSnapshot::MaterialList> materials = std::make_shared<WorldSnapshot::MaterialList>();
+
+	materials->emplace_back(new Lambertian(glm::vec3(0.75f)));
+	materials->emplace_back(new Lambertian(glm::vec3(0.75f, 0.2f, 0.2f)));
+	materials->emplace_back(new Lambertian(glm::vec3(0.2f, 0.75f, 0.2f)));
+	materials->emplace_back(new Emissive(200.0f, glm::vec3(1.0f, 0.9f, 0.7f)));
+
+	// Walls 1000 units in radius, close to flat over the room, from x -4 to 4, y -3 to 1 and z -5 to 9.
+	constexpr float wallRadius = 1000.0f;
+	objects->emplace_back(new Sphere(glm::vec3(0.0f, 1.0f + wallRadius, 0.0f), wallRadius, 0));
+	objects->emplace_back(new Sphere(glm::vec3(0.0f, -3.0f - wallRadius, 0.0f), wallRadius, 0));
+	objects->emplace_back(new Sphere(glm::vec3(-4.0f - wallRadius, 0.0f, 0.0f), wallRadius, 1));
+	objects->emplace_back(new Sphere(glm::vec3(4.0f + wallRadius, 0.0f, 0.0f), wallRadius, 2));
+	objects->emplace_back(new Sphere(glm::vec3(0.0f, 0.0f, -5.0f - wallRadius), wallRadius, 0));
+	objects->emplace_back(new Sphere(glm::vec3(0.0f, 0.0f, 9.0f + wallRadius), wallRadius, 0));
+
+	objects->emplace_back(new Sphere(glm::vec3(-1.5f, 0.0f, -1.0f), 1.0f, 0));
+	objects->emplace_back(new Sphere(glm::vec3(1.5f, 0.25f, -2.5f), 0.75f, 0));
+	objects->emplace_back(new Sphere(glm::vec3(0.0f, -2.6f, -1.5f), 0.2f, 3));
+
+	Publish(objects, materials, current.GetLightDirection(), current.GetSharedEnvironmentMap());
+}
@@ -1,40 +1,95 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <glm/glm.hpp>
-#include <vector>
+
+#include "Utils/EpochManager.h"
+#include "WorldSnapshot.h"
 
 class CollidableObject;
+class EnvironmentMap;
 class IMaterial;
 
+// Owns the scene and publishes it to the renderer as immutable, versioned WorldSnapshots.
+// Edits are made on a single thread (the UI thread) and copy only the object or material being changed. Render threads
+// pin the current version with AcquireSnapshot() and read it without locks. Replaced versions are freed by
+// ReclaimSnapshots() once no reader can still be using them.
 class World
 {
 public:
+
+	// Keeps a snapshot alive for as long as the handle is in scope.
+	class SnapshotHandle
+	{
+	public:
+		SnapshotHandle(EpochManager::Guard&& guard, const WorldSnapshot* snapshot) :
+			m_guard(std::move(guard)), m_snapshot(snapshot) {}
+
+		const WorldSnapshot& operator*() const { return *m_snapshot; }
+		const WorldSnapshot* operator->() const { return m_snapshot; }
+		const WorldSnapshot* Get() const { return m_snapshot; }
+
+	private:
+		EpochManager::Guard m_guard;
+		const WorldSnapshot* m_snapshot;
+	};
+
 	World();
 	~World();
 
-	std::vector<CollidableObject*>& GetObjectsNonConst() { return m_objects; };
-	const std::vector<CollidableObject*>& GetCollidableObjects() const { return m_objects; };
-	const CollidableObject& GetCollidableObject(int index) const;
+	// Lock-free, callable from any thread.
+	SnapshotHandle AcquireSnapshot() const;
 
-	inline int GetNumMaterials() const {
-		return (int)m_materials.size();
+	// Writer thread only. The returned reference stays valid until the next call to ReclaimSnapshots().
+	const WorldSnapshot& GetCurrentSnapshot() const
+	{
+		return *m_currentSnapshot.load(std::memory_order_relaxed);
+	}
 
+	inline uint64_t GetVersion() const {
+		return GetCurrentSnapshot().GetVersion();
 	};
 
-	IMaterial* GetMaterialPtr(int materialIndex) const;
-
-	void UpdateMaterial(IMaterial* newMaterial, int materialIndex);
-	void AddMaterial(IMaterial* newMaterial, int materialIndex);
+	inline int GetNumMaterials() const {
+		return GetCurrentSnapshot().GetNumMaterials();
+	};
 
-	inline glm::vec3 GetLightDirection() {
-		return m_lightDirection;
+	inline glm::vec3 GetLightDirection() const {
+		return GetCurrentSnapshot().GetLightDirection();
 	};
 
+	// Each edit publishes a new version containing a modified copy of the object or material.
+	void EditObject(int objectIndex, const std::function<void(CollidableObject&)>& edit);
+	void EditMaterial(int materialIndex, const std::function<void(IMaterial&)>& edit);
 	void SetLightDirection(glm::vec3& lightDirection);
+	// Lights the scene with the map instead of the default sky gradient, or with the gradient again if null.
+	void SetEnvironmentMap(std::shared_ptr<const EnvironmentMap> environmentMap);
+
+	// Replaces the scene with a few diffuse spheres on a floor lit by numLights small emissive spheres scattered just
+	// above it, most of them dim and a few bright. For measuring light sampling with many lights.
+	void LoadManyLightsScene(uint32_t numLights);
+
+	// Replaces the scene with a diffuse sphere and two mirror spheres in a closed diffuse room, lit by an emissive sphere
+	// against the back wall. Much of the light comes by way of the walls and the mirrors, which light sampling can not
+	// find. For measuring path guiding.
+	void LoadMirrorScene();
+
+	// Replaces the scene with two diffuse spheres in a closed diffuse room, its walls the insides of very large spheres,
+	// lit by one emissive sphere under the ceiling. No sky reaches in, so much of the light has bounced off several
+	// walls. For measuring the radiance cache.
+	void LoadRoomScene();
+
+	// Frees replaced versions that are no longer pinned by any reader. Call once per frame from the writer thread.
+	void ReclaimSnapshots();
 
 private:
-	glm::vec3 m_lightDirection;
-	std::vector<IMaterial*> m_materials;
-	std::vector<CollidableObject*> m_objects;
-};
 
+	void Publish(std::shared_ptr<const WorldSnapshot::ObjectList> objects,
+		std::shared_ptr<const WorldSnapshot::MaterialList> materials, const glm::vec3& lightDirection,
+		std::shared_ptr<const EnvironmentMap> environmentMap);
+
+	mutable EpochManager m_epochManager;
+	std::atomic<const WorldSnapshot*> m_currentSnapshot;
+	uint64_t m_nextVersion;
+};
@@ -0,0 +1,50 @@
+#include "WorldSnapshot.h"
+
+#include <cassert>
+
+#include "CollidableObjects/CollidableObject.h"
+#include "Materials/IMaterial.h"
+
+WorldSnapshot::WorldSnapshot(uint64_t version, std::shared_ptr<const ObjectList> objects,
+	std::shared_ptr<const MaterialList> materials, const glm::vec3& lightDirection,
+	std::shared_ptr<const EnvironmentMap> environmentMap) :
+	m_version(version),
+	m_objects(std::move(objects)),
+	m_materials(std::move(materials)),
+	m_lightDirection(lightDirection),
+	m_environmentMap(std::move(environmentMap))
+{
+	for (size_t i = 0; i < m_objects->size(); i++)
+	{
+		int materialIndex = (*m_objects)[i]->GetMaterialIndex();
+		if (materialIndex < GetNumMaterials() && glm::any(glm::greaterThan(GetMaterialPtr(materialIndex)->GetEmission(), glm::vec3(0.0f))))
+			m_emissiveObjects.push_back((int)i);
+	}
+
+	m_lightBVH.Build(*this);
+}
+
+std::unique_ptr<WorldSnapshot> WorldSnapshot::Replicate() const
+{
+	auto objects = std::make_shared<ObjectList>();
+	objects->reserve(m_objects->size());
+	for (const std::shared_ptr<const CollidableObject>& object : *m_objects)
+		objects->push_back(std::shared_ptr<const CollidableObject>(object->Clone()));
+
+	auto materials = std::make_shared<MaterialList>();
+	materials->reserve(m_materials->size());
+	for (const std::shared_ptr<const IMaterial>& material : *m_materials)
+		materials->push_back(std::shared_ptr<const IMaterial>(material->Clone()));
+
+	return std::make_unique<WorldSnapshot>(m_version, std::move(objects), std::move(materials), m_lightDirection,
+		m_environmentMap);
+}
+
+const CollidableObject& WorldSnapshot::GetCollidableObject(int index) const {
+	return *(*m_objects)[index];
+};
+
+const IMaterial* WorldSnapshot::GetMaterialPtr(int materialIndex) const {
+	assert(materialIndex < m_materials->size());
+	return (*m_materials)[materialIndex].get();
+};
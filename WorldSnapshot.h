@@ -0,0 +1,87 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+#include "RayTracing/LightBVH.h"
+
+class CollidableObject;
+class EnvironmentMap;
+class IMaterial;
+
+// An immutable version of the scene. Render threads read it without locking while the World publishes edits as new
+// versions. Objects, materials and the lists holding them are shared with the previous version when unchanged.
+class WorldSnapshot
+{
+public:
+
+	using ObjectList = std::vector<std::shared_ptr<const CollidableObject>>;
+	using MaterialList = std::vector<std::shared_ptr<const IMaterial>>;
+
+	WorldSnapshot(uint64_t version, std::shared_ptr<const ObjectList> objects, std::shared_ptr<const MaterialList> materials,
+		const glm::vec3& lightDirection, std::shared_ptr<const EnvironmentMap> environmentMap);
+
+	// Deep copy with its own objects and materials, allocated by the calling thread. Used to give each NUMA node a
+	// node local copy of the scene. The environment map, large and read far less often, stays shared.
+	std::unique_ptr<WorldSnapshot> Replicate() const;
+
+	inline uint64_t GetVersion() const
+	{
+		return m_version;
+	}
+
+	const ObjectList& GetCollidableObjects() const { return *m_objects; };
+	const CollidableObject& GetCollidableObject(int index) const;
+
+	inline int GetNumMaterials() const {
+		return (int)m_materials->size();
+	};
+
+	const IMaterial* GetMaterialPtr(int materialIndex) const;
+
+	// Objects whose material gives off light, which RayTracer samples directly.
+	inline const std::vector<int>& GetEmissiveObjects() const
+	{
+		return m_emissiveObjects;
+	}
+
+	inline const LightBVH& GetLightBVH() const
+	{
+		return m_lightBVH;
+	}
+
+	inline glm::vec3 GetLightDirection() const {
+		return m_lightDirection;
+	};
+
+	// Light from rays leaving the scene, null for the default sky gradient.
+	inline const EnvironmentMap* GetEnvironmentMap() const
+	{
+		return m_environmentMap.get();
+	}
+
+	inline const std::shared_ptr<const ObjectList>& GetSharedObjects() const
+	{
+		return m_objects;
+	}
+
+	inline const std::shared_ptr<const MaterialList>& GetSharedMaterials() const
+	{
+		return m_materials;
+	}
+
+	inline const std::shared_ptr<const EnvironmentMap>& GetSharedEnvironmentMap() const
+	{
+		return m_environmentMap;
+	}
+
+private:
+	uint64_t m_version;
+	std::shared_ptr<const ObjectList> m_objects;
+	std::shared_ptr<const MaterialList> m_materials;
+	glm::vec3 m_lightDirection;
+	std::shared_ptr<const EnvironmentMap> m_environmentMap;
+	std::vector<int> m_emissiveObjects;
+	LightBVH m_lightBVH;
+};